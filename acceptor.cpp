@@ -0,0 +1,147 @@
+#include "acceptor.h"
+
+namespace Http
+{
+
+Acceptor::Acceptor(const struct sockaddr_in &address,
+    std::vector<std::unique_ptr<Worker>> &workers, int backlog) :
+  m_address(address),
+  m_listen(Net::Socket::NONBLOCKING),
+  m_poller(),
+  m_event_list(),
+  m_workers(workers),
+  m_next(0)
+{
+  m_listen.backlog(backlog);
+}
+
+int Acceptor::setupRun()
+{
+  char addr[INET_ADDRSTRLEN];
+  inet_ntop(AF_INET, &m_address.sin_addr, addr, sizeof(addr));
+
+  if (m_listen.configure(addr, ntohs(m_address.sin_port)) < 0)
+  {
+    return m_listen.err();
+  }
+
+  if (m_listen.bind() < 0)   return m_listen.err();
+  if (m_listen.listen() < 0) return m_listen.err();
+
+  signal(SIGPIPE, SIG_IGN);
+
+  return m_poller.add(m_listen.fd(), Net::Event::READ);
+}
+
+void Acceptor::run()
+{
+  if (m_workers.empty() || setupRun() < 0)
+  {
+    ERR("aborting accept loop");
+    return;
+  }
+
+  for (;;)
+  {
+    // the timeout doubles as the rebalance tick
+    int event_count = m_poller.wait(m_event_list, EVENTS_MAX, REBALANCE_MS);
+
+    if (event_count < 0 && errno != EINTR)
+    {
+      ERR("poller read: %s", strerror(errno));
+      return;
+    }
+
+    if (event_count > 0) onAccept();
+
+    rebalance();
+  }
+}
+
+/**
+ * Drain the listen queue in one go, a readiness event can stand for any
+ * number of pending connections.
+ */
+void Acceptor::onAccept()
+{
+  int fd;
+
+  while ((fd = m_listen.accept()) >= 0)
+  {
+    DEBUG("[0x%016" PRIXPTR "] client connect", (uintptr_t) fd);
+    dispatch(fd);
+  }
+}
+
+void Acceptor::dispatch(int fd)
+{
+  // the least loaded inbox can be full, fall back to the others in turn
+  for (size_t tries = 0; tries < m_workers.size(); tries++)
+  {
+    if (pick()->adopt(fd)) return;
+    m_next++;
+  }
+
+  ERR("[0x%016" PRIXPTR "] every worker inbox is full", (uintptr_t) fd);
+  ::close(fd);
+}
+
+/**
+ * Least loaded worker, starting the scan at a rotating offset so ties
+ * don't all land on worker 0.
+ */
+Worker *Acceptor::pick()
+{
+  size_t count = m_workers.size();
+  size_t best = m_next % count;
+  unsigned best_load = m_workers[best]->load();
+
+  for (size_t i = 1; i < count && best_load > 0; i++)
+  {
+    size_t candidate = (m_next + i) % count;
+    unsigned load = m_workers[candidate]->load();
+
+    if (load < best_load)
+    {
+      best = candidate;
+      best_load = load;
+    }
+  }
+
+  m_next = best + 1;
+
+  return m_workers[best].get();
+}
+
+/**
+ * Move half the difference from the busiest worker to the quietest once
+ * the gap is both absolute (REBALANCE_MIN) and relative (a quarter more).
+ */
+void Acceptor::rebalance()
+{
+  if (m_workers.size() < 2) return;
+
+  size_t most = 0, least = 0;
+
+  for (size_t i = 1; i < m_workers.size(); i++)
+  {
+    if (m_workers[i]->active() > m_workers[most]->active())  most = i;
+    if (m_workers[i]->active() < m_workers[least]->active()) least = i;
+  }
+
+  unsigned high = m_workers[most]->active();
+  unsigned low = m_workers[least]->active();
+
+  if (high - low < REBALANCE_MIN || high * 4 < low * 5) return;
+
+  DEBUG("rebalance: worker %zu (%u) -> worker %zu (%u)", most, high,
+      least, low);
+
+  m_workers[most]->shed((high - low) / 2, m_workers[least].get());
+}
+
+Acceptor::~Acceptor()
+{
+}
+
+} // namepsace
@@ -0,0 +1,64 @@
+#ifndef __ACCEPTOR_H
+#define __ACCEPTOR_H
+
+#include <memory>
+#include <vector>
+#include <netinet/in.h>
+#include "log.h"
+#include "socket.h"
+#include "poller.h"
+#include "worker.h"
+
+namespace Http
+{
+
+/**
+ * Accept path for the acceptor/worker dispatch mode. Owns the only
+ * listening socket, accepts in batches and hands every new fd to the
+ * least loaded worker (active connections plus whatever is still sitting
+ * in its inbox).
+ *
+ * Between accepts it also watches the spread of connections: long lived
+ * keep-alive clients pile up wherever they first landed, so when one worker
+ * has noticeably more than the quietest one it's asked to shed idle
+ * connections to it.
+ */
+class Acceptor
+{
+  public:
+    Acceptor(
+        const struct sockaddr_in &address,
+        std::vector<std::unique_ptr<Worker>> &workers,
+        const int backlog = 1000);
+    Acceptor(Acceptor &a) = delete;
+    Acceptor(Acceptor &&a) = delete;
+    ~Acceptor();
+
+    void run();
+
+    // how often the connection spread is checked
+    static const int REBALANCE_MS = 250;
+
+    // don't bother moving fewer connections than this
+    static const unsigned REBALANCE_MIN = 16;
+  private:
+    int setupRun();
+    void onAccept();
+    void dispatch(int fd);
+    void rebalance();
+    Worker *pick();
+
+    struct sockaddr_in m_address;
+    Net::Socket m_listen;
+
+    Net::Poller m_poller;
+    static const int EVENTS_MAX = 4;
+    Net::Event m_event_list[EVENTS_MAX];
+
+    std::vector<std::unique_ptr<Worker>> &m_workers;
+    size_t m_next;
+};
+
+} // namspace
+
+#endif /** __ACCEPTOR_H **/
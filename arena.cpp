@@ -0,0 +1,124 @@
+#include "arena.h"
+
+#include <stdlib.h>
+#include <new>
+
+namespace Http
+{
+
+Arena::Arena(size_t chunk_size) :
+  m_chunk_size(chunk_size),
+  m_reserved(0),
+  m_first(NULL),
+  m_current(NULL),
+  m_cursor(0),
+  m_limit(0)
+{
+}
+
+void Arena::enter(Chunk *chunk)
+{
+  m_current = chunk;
+  m_cursor = (uintptr_t) chunk->data();
+  m_limit = m_cursor + chunk->size;
+}
+
+/**
+ * The current chunk is full. Move on to the next one kept from before the
+ * last reset if the allocation fits there, otherwise link a new chunk in
+ * right after the current one so the kept ones stay in line behind it.
+ */
+void *Arena::grow(size_t size, size_t align)
+{
+  size_t needed = size + align;
+
+  if (m_current && m_current->next && m_current->next->size >= needed)
+  {
+    enter(m_current->next);
+    return allocate(size, align);
+  }
+
+  size_t chunk_size = needed > m_chunk_size ? needed : m_chunk_size;
+  Chunk *chunk = (Chunk *) malloc(sizeof(Chunk) + chunk_size);
+
+  if (chunk == NULL) throw std::bad_alloc();
+
+  chunk->size = chunk_size;
+  m_reserved += chunk_size;
+
+  if (m_current)
+  {
+    chunk->next = m_current->next;
+    m_current->next = chunk;
+  }
+  else
+  {
+    chunk->next = m_first;
+    m_first = chunk;
+  }
+
+  enter(chunk);
+
+  return allocate(size, align);
+}
+
+void *Arena::reallocate(void *old, size_t old_size, size_t new_size,
+    size_t align)
+{
+  if (old == NULL) return allocate(new_size, align);
+
+  // the most recent allocation, and there's room to stretch it
+  if ((uintptr_t) old + old_size == m_cursor &&
+      (uintptr_t) old + new_size <= m_limit)
+  {
+    m_cursor = (uintptr_t) old + new_size;
+    return old;
+  }
+
+  void *moved = allocate(new_size, align);
+  memcpy(moved, old, old_size < new_size ? old_size : new_size);
+
+  return moved;
+}
+
+void Arena::reset()
+{
+  if (m_first == NULL) return;
+
+  enter(m_first);
+}
+
+void Arena::release()
+{
+  while (m_first)
+  {
+    Chunk *next = m_first->next;
+    free(m_first);
+    m_first = next;
+  }
+
+  m_current = NULL;
+  m_cursor = m_limit = 0;
+  m_reserved = 0;
+}
+
+size_t Arena::used() const
+{
+  size_t used = 0;
+
+  for (Chunk *c = m_first; c && c != m_current; c = c->next)
+  {
+    used += c->size;
+  }
+
+  if (m_current) used += m_cursor - (uintptr_t) m_current->data();
+
+  return used;
+}
+
+Arena::~Arena()
+{
+  release();
+}
+
+} // namespace
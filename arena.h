@@ -0,0 +1,98 @@
+#ifndef __ARENA_H
+#define __ARENA_H
+
+#include <cstddef>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+namespace Http
+{
+
+/**
+ * Bump allocator for request scoped memory. Allocation is a pointer bump
+ * in the current chunk; nothing is freed individually, reset() rewinds to
+ * the first chunk in O(1) when the request is done and keeps the chunks for
+ * the next one. After the first request or two a connection stops touching
+ * the global allocator altogether, so loop threads don't contend on it.
+ *
+ * No destructors run on reset, only trivially destructible things belong
+ * in here. Chunks are malloc'd lazily, an arena nobody allocates from costs
+ * nothing but the object itself.
+ */
+class Arena
+{
+  public:
+    Arena(size_t chunk_size = CHUNK_SIZE);
+    Arena(Arena &a) = delete;
+    Arena(Arena &&a) = delete;
+    ~Arena();
+
+    void *allocate(size_t size, size_t align = alignof(std::max_align_t))
+    {
+      uintptr_t at = (m_cursor + align - 1) & ~(uintptr_t) (align - 1);
+
+      if (at + size <= m_limit && at >= m_cursor)
+      {
+        m_cursor = at + size;
+        return (void *) at;
+      }
+
+      return grow(size, align);
+    }
+
+    template <typename T>
+    T *allocate(size_t count)
+    {
+      static_assert(std::is_trivially_destructible<T>::value,
+          "the arena never runs destructors");
+
+      return (T *) allocate(count * sizeof(T), alignof(T));
+    }
+
+    /**
+     * Grow the last thing allocated in place when there's room behind it,
+     * otherwise move it to a fresh allocation. The old copy stays in the
+     * arena until the next reset.
+     */
+    void *reallocate(void *old, size_t old_size, size_t new_size,
+        size_t align = alignof(std::max_align_t));
+
+    // everything allocated so far is gone, the memory is kept
+    void reset();
+
+    // everything allocated so far is gone, and so is the memory
+    void release();
+
+    // bytes handed out since the last reset, padding included
+    size_t used() const;
+
+    // bytes held in chunks
+    size_t reserved() const { return m_reserved; }
+
+    static const size_t CHUNK_SIZE = 4096;
+  private:
+    struct Chunk
+    {
+      Chunk *next;
+      size_t size;
+
+      char *data() { return (char *) (this + 1); }
+    };
+
+    void *grow(size_t size, size_t align);
+    void enter(Chunk *chunk);
+
+    size_t m_chunk_size;
+    size_t m_reserved;
+
+    Chunk *m_first;
+    Chunk *m_current;
+
+    uintptr_t m_cursor;
+    uintptr_t m_limit;
+};
+
+} // namespace
+
+#endif /** __ARENA_H **/
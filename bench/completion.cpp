@@ -0,0 +1,223 @@
+/**
+ * Readiness vs completion benchmark, linux only.
+ *
+ * Forks a server twice, once on Net::Transport (poller wait, then a recv and
+ * a send per event) and once on Net::CompletionTransport (io_uring, multishot
+ * accept/recv, provided buffers, one io_uring_enter per loop iteration).
+ * Both answer every chunk they receive with the same small response.
+ *
+ * The client keeps its connections open and has one small request in flight
+ * on each, so the numbers are about per-request kernel crossings rather than
+ * connection setup. Each server reports how many syscalls it made per
+ * request when it's stopped.
+ *
+ *   build/bench/completion [port] [connections] [seconds]
+ */
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <netinet/tcp.h>
+#include <vector>
+
+#include "transport.h"
+#include "completion.h"
+#include "poller.h"
+
+static const char REQUEST[] =
+  "GET / HTTP/1.1\r\n"
+  "Host: 127.0.0.1\r\n"
+  "Accept: */*\r\n\r\n";
+
+static const char RESPONSE[] =
+  "HTTP/1.1 200 OK\r\n"
+  "Content-Length: 13\r\n"
+  "Content-Type: text/html; charset=UTF-8\r\n"
+  "\r\n"
+  "Hello, world!";
+
+static const size_t RESPONSE_SIZE = sizeof(RESPONSE) - 1;
+
+static volatile sig_atomic_t stopping = 0;
+
+static void stop(int)
+{
+  stopping = 1;
+}
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void serve_readiness(int port)
+{
+  Net::Transport t;
+  unsigned long reads = 0, pumps = 0;
+
+  t.on_data([&](Net::Socket::FD fd, const char *, size_t)
+  {
+    reads++;
+    t.send(fd, RESPONSE, RESPONSE_SIZE);
+  });
+
+  if (t.listen("127.0.0.1", port) < 0) return;
+
+  while (!stopping)
+  {
+    t.pump();
+    pumps++;
+  }
+
+  // one wait per pump, a recv and a send per read
+  printf("  server syscalls/request: %.2f\n",
+      reads ? (pumps + 2.0 * reads) / reads : 0.0);
+}
+
+static void serve_completion(int port)
+{
+  Net::CompletionTransport t;
+  unsigned long reads = 0;
+
+  t.on_data([&](Net::Socket::FD fd, const char *, size_t)
+  {
+    reads++;
+    t.send(fd, RESPONSE, RESPONSE_SIZE);
+  });
+
+  if (t.listen("127.0.0.1", port) < 0) return;
+
+  while (!stopping)
+  {
+    t.pump();
+  }
+
+  printf("  server syscalls/request: %.2f\n",
+      reads ? (double) t.enters() / reads : 0.0);
+}
+
+static double load(int port, int connections, int seconds)
+{
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  addr.sin_port = htons(port);
+
+  Net::Poller poller;
+  std::vector<size_t> received(65536);
+  std::vector<int> fds;
+
+  for (int i = 0; i < connections; i++)
+  {
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+    {
+      fprintf(stderr, "connect: %s\n", strerror(errno));
+      close(fd);
+      continue;
+    }
+
+    fcntl(fd, F_SETFL, O_NONBLOCK);
+    poller.add(fd, Net::Event::READ);
+    send(fd, REQUEST, sizeof(REQUEST) - 1, 0);
+    fds.push_back(fd);
+  }
+
+  Net::Event events[64];
+  char buf[4096];
+  unsigned long completed = 0;
+
+  double began = now();
+  double deadline = began + seconds;
+
+  while (now() < deadline)
+  {
+    int count = poller.wait(events, 64, 100);
+
+    for (int i = 0; i < count; i++)
+    {
+      int fd = events[i].fd;
+      ssize_t bytes = recv(fd, buf, sizeof(buf), 0);
+
+      if (bytes <= 0)
+      {
+        if (bytes < 0 && errno == EAGAIN) continue;
+        poller.remove(fd);
+        continue;
+      }
+
+      received[fd] += bytes;
+
+      while (received[fd] >= RESPONSE_SIZE)
+      {
+        received[fd] -= RESPONSE_SIZE;
+        completed++;
+        send(fd, REQUEST, sizeof(REQUEST) - 1, 0);
+      }
+    }
+  }
+
+  double elapsed = now() - began;
+
+  for (int fd : fds) close(fd);
+
+  return completed / elapsed;
+}
+
+static double run(const char *name, void (*serve)(int), int port,
+    int connections, int seconds)
+{
+  printf("%s\n", name);
+  fflush(stdout);
+
+  pid_t server = fork();
+
+  if (server == 0)
+  {
+    // no SA_RESTART, the server has to come out of its wait to notice
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = stop;
+    sigaction(SIGTERM, &sa, NULL);
+
+    serve(port);
+    fflush(stdout);
+    _exit(0);
+  }
+
+  usleep(200000);
+
+  double rate = load(port, connections, seconds);
+
+  kill(server, SIGTERM);
+  waitpid(server, NULL, 0);
+
+  printf("  req/s: %.0f\n", rate);
+
+  return rate;
+}
+
+int main(int argc, char **argv)
+{
+  int port        = argc > 1 ? atoi(argv[1]) : 8091;
+  int connections = argc > 2 ? atoi(argv[2]) : 64;
+  int seconds     = argc > 3 ? atoi(argv[3]) : 5;
+
+  signal(SIGPIPE, SIG_IGN);
+
+  double readiness = run("readiness (Transport)", serve_readiness,
+      port, connections, seconds);
+  double completion = run("completion (CompletionTransport)", serve_completion,
+      port + 1, connections, seconds);
+
+  printf("completion/readiness: %.2fx\n",
+      readiness > 0 ? completion / readiness : 0.0);
+
+  return 0;
+}
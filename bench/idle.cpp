@@ -0,0 +1,279 @@
+/**
+ * Idle connection memory benchmark, linux only.
+ *
+ * Runs an Http::Worker on a thread of this process and opens connections
+ * to it from a forked child, so what this process holds is the server's
+ * side alone. Memory is sampled three times:
+ *
+ *   connected - every connection accepted, nothing read from any yet
+ *   active    - each has had one request answered, buffers attached
+ *   idle      - Worker::RECLAIM_IDLE_MS later, the buffers given back
+ *
+ * For each it prints, per connection: the growth in this process's
+ * resident set, the bytes the worker charges to its Net::Budget (its
+ * buffers, exactly), and the kernel's TCP buffer pages from
+ * /proc/net/sockstat, both ends of the connection together. Freed memory
+ * isn't always handed back to the OS straight away, so the idle resident
+ * figure is printed again after malloc_trim().
+ *
+ * Both processes need a descriptor per connection; the soft limit is raised
+ * to the hard one and the count capped to fit. 100k connections takes a
+ * hard limit above that (ulimit -Hn, or LimitNOFILE for a service).
+ * Sources are spread over 127.0.0.0/8 so the ephemeral port range isn't
+ * the limit.
+ *
+ * Measured on linux x86-64 with glibc 2.36, DEBUG=0, with a hard limit of
+ * 20000 descriptors that capped it at 19936 connections; nothing per
+ * connection depends on how many there are, past the slab's 256 slot
+ * pages. Bytes per connection:
+ *
+ *               resident      buffers       kernel
+ *   connected        775            0            0
+ *   active          5191         4357            0
+ *   idle            5191            0            0
+ *   trimmed         1828            0            0
+ *
+ * So an idle connection holds no buffers, and what it costs for good is
+ * its slot in the slab; 100k of them come to about 78MB, plus the kernel's
+ * per socket structures, which sockstat doesn't count. What the buffers
+ * gave back stays with the allocator for the next busy connection unless
+ * it's trimmed, so resident memory follows the peak number of busy
+ * connections and the budget is what to watch.
+ *
+ *   build/bench/idle [connections] [port]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <malloc.h>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "worker.h"
+
+// with a couple of fields the parser doesn't know, as a proxy would add,
+// so the request takes room in the connection's arena
+static const char REQUEST[] =
+  "GET / HTTP/1.1\r\n"
+  "Host: 127.0.0.1\r\n"
+  "User-Agent: idle\r\n"
+  "Accept: */*\r\n"
+  "X-Request-Id: 5f0c6a8e-2b1d-4c7e-9a3f-0d8e1b2c4a6f\r\n"
+  "X-Forwarded-For: 10.0.0.1\r\n\r\n";
+
+// connections per source address, well inside the ephemeral port range
+static const int PER_SOURCE = 20000;
+
+// bytes resident in this process
+static size_t resident()
+{
+  long pages = 0, size = 0;
+  FILE *f = fopen("/proc/self/statm", "r");
+
+  if (f == NULL) return 0;
+  if (fscanf(f, "%ld %ld", &size, &pages) != 2) pages = 0;
+  fclose(f);
+
+  return pages * sysconf(_SC_PAGESIZE);
+}
+
+// bytes the kernel has in TCP socket buffers, every socket on the host
+static size_t kernel()
+{
+  char line[256];
+  long pages = 0;
+  FILE *f = fopen("/proc/net/sockstat", "r");
+
+  if (f == NULL) return 0;
+
+  while (fgets(line, sizeof(line), f))
+  {
+    const char *mem = strstr(line, " mem ");
+
+    if (strncmp(line, "TCP:", 4) == 0 && mem) pages = atol(mem + 5);
+  }
+
+  fclose(f);
+
+  return pages * sysconf(_SC_PAGESIZE);
+}
+
+static void step(int fd)
+{
+  char c = 0;
+  if (write(fd, &c, 1) != 1) exit(1);
+}
+
+static int wait_step(int fd)
+{
+  int n = 0;
+  return read(fd, &n, sizeof(n)) == sizeof(n) ? n : -1;
+}
+
+/**
+ * The client side: connect count sockets, tell the parent how many made
+ * it, then on its word send a request on each and read every response,
+ * and hold them all open until told to go.
+ */
+static void clients(int port, int count, int up, int down)
+{
+  std::vector<int> fds;
+
+  for (int i = 0; i < count; i++)
+  {
+    int fd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0) break;
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+
+    struct sockaddr_in source = {};
+    source.sin_family = AF_INET;
+    source.sin_addr.s_addr = htonl(0x7f000002 + i / PER_SOURCE);
+
+    struct sockaddr_in to = {};
+    to.sin_family = AF_INET;
+    to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    to.sin_port = htons(port);
+
+    if (::bind(fd, (struct sockaddr *) &source, sizeof(source)) < 0 ||
+        connect(fd, (struct sockaddr *) &to, sizeof(to)) < 0)
+    {
+      perror("connect");
+      ::close(fd);
+      break;
+    }
+
+    fds.push_back(fd);
+  }
+
+  int made = fds.size();
+  if (write(up, &made, sizeof(made)) != sizeof(made)) exit(1);
+
+  wait_step(down);
+
+  for (int fd : fds)
+  {
+    if (send(fd, REQUEST, sizeof(REQUEST) - 1, 0) < 0) perror("send");
+  }
+
+  char buf[4096];
+
+  for (int fd : fds)
+  {
+    std::string response;
+
+    while (response.find("Hello, world!") == std::string::npos)
+    {
+      ssize_t got = recv(fd, buf, sizeof(buf), 0);
+      if (got <= 0) break;
+
+      response.append(buf, got);
+    }
+  }
+
+  if (write(up, &made, sizeof(made)) != sizeof(made)) exit(1);
+
+  wait_step(down);
+}
+
+struct Sample
+{
+  size_t resident;
+  size_t charged;
+  size_t kernel;
+};
+
+static void print(const char *name, const Sample &s, const Sample &base,
+    int count)
+{
+  printf("%-10s %12.0f %12.0f %12.0f\n", name,
+      (double) (s.resident - base.resident) / count,
+      (double) (s.charged - base.charged) / count,
+      (double) (s.kernel - base.kernel) / count);
+}
+
+int main(int argc, char **argv)
+{
+  int count = argc > 1 ? atoi(argv[1]) : 100000;
+  int port = argc > 2 ? atoi(argv[2]) : 8093;
+
+  struct rlimit limit;
+  getrlimit(RLIMIT_NOFILE, &limit);
+  limit.rlim_cur = limit.rlim_max;
+  setrlimit(RLIMIT_NOFILE, &limit);
+
+  if (limit.rlim_cur != RLIM_INFINITY && count > (int) limit.rlim_cur - 64)
+  {
+    printf("descriptor limit %lu, %d connections instead of %d\n",
+        (unsigned long) limit.rlim_cur, (int) limit.rlim_cur - 64, count);
+    count = limit.rlim_cur - 64;
+  }
+
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+
+  Net::Budget budget;
+
+  // never deleted, the loop runs until the process exits
+  Http::Worker *worker = new Http::Worker(address, 4096);
+  worker->setKeepAlive(0, 0);
+  worker->setBudget(&budget);
+
+  std::thread([worker]() { worker->run(); }).detach();
+  usleep(100000);
+
+  Sample base = { resident(), budget.used(), kernel() };
+
+  int up[2], down[2];
+  if (pipe(up) < 0 || pipe(down) < 0) return 1;
+
+  pid_t child = fork();
+
+  if (child == 0)
+  {
+    clients(port, count, up[1], down[0]);
+    _exit(0);
+  }
+
+  count = wait_step(up[0]);
+
+  if (count <= 0)
+  {
+    printf("no connections\n");
+    return 1;
+  }
+
+  // the last few accepts may still be on their way to the slab
+  while (worker->active() < (unsigned) count) usleep(10000);
+
+  Sample connected = { resident(), budget.used(), kernel() };
+
+  step(down[1]);
+  wait_step(up[0]);
+
+  Sample active = { resident(), budget.used(), kernel() };
+
+  usleep((Http::Worker::RECLAIM_IDLE_MS + 500) * 1000);
+
+  Sample idle = { resident(), budget.used(), kernel() };
+
+  malloc_trim(0);
+  Sample trimmed = { resident(), budget.used(), kernel() };
+
+  printf("connections: %d\n", count);
+  printf("bytes per connection:\n");
+  printf("%-10s %12s %12s %12s\n", "", "resident", "buffers", "kernel");
+  print("connected", connected, base, count);
+  print("active", active, base, count);
+  print("idle", idle, base, count);
+  print("trimmed", trimmed, base, count);
+
+  step(down[1]);
+  waitpid(child, NULL, 0);
+
+  return 0;
+}
@@ -0,0 +1,319 @@
+/**
+ * Loopback throughput benchmark.
+ *
+ * Forks an Http::Server on 127.0.0.1 and drives it from this process with
+ * a fixed number of concurrent nonblocking clients, multiplexed through the
+ * same Net::Poller the server uses. By default every client keeps its
+ * connection open and sends the next GET as soon as a response is in. With
+ * "close" each GET asks for Connection: close instead and the client loops
+ * connect, send, read until the server closes, reconnect; the difference
+ * between the two is what a TCP handshake and an accept per request cost.
+ * A pipeline depth above 1 has kept alive clients send that many GETs in
+ * one write and wait for all the responses before sending the next batch.
+ *
+ * With threads > 1 the server runs that many SO_REUSEPORT workers and the
+ * load comes from as many client threads, for checking how throughput
+ * scales with cores. Pass "acceptor" to have a single accepting thread
+ * hand connections to the workers instead.
+ *
+ * Given a document root the server answers GET / from it, index.html,
+ * instead of its default page; reference/web/public's is small enough to
+ * be served from memory.
+ *
+ * Run the same binary on a kqueue host and an epoll host to compare the two
+ * backends.
+ *
+ *   build/bench/loopback [port] [connections] [seconds] [threads]
+ *                        [reuseport|acceptor] [keepalive|close] [depth]
+ *                        [root]
+ */
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <netinet/tcp.h>
+#include <vector>
+#include <string>
+#include <thread>
+#include <functional>
+
+#include "server.h"
+#include "poller.h"
+
+static const char REQUEST[] =
+  "GET / HTTP/1.1\r\n"
+  "Host: 127.0.0.1\r\n"
+  "User-Agent: loopback\r\n"
+  "Accept: */*\r\n\r\n";
+
+static const char REQUEST_CLOSE[] =
+  "GET / HTTP/1.1\r\n"
+  "Host: 127.0.0.1\r\n"
+  "User-Agent: loopback\r\n"
+  "Accept: */*\r\n"
+  "Connection: close\r\n\r\n";
+
+struct Client
+{
+  int fd = -1;
+  bool connected = false;
+
+  // kept alive responses are framed by Content-Length, this holds what's
+  // read of them so far
+  std::string received;
+  int outstanding = 0;
+};
+
+/**
+ * Length of the first whole response in buf, 0 while it's incomplete.
+ */
+static size_t response_length(const char *buf, size_t size)
+{
+  const char *end = (const char *) memmem(buf, size, "\r\n\r\n", 4);
+  if (end == NULL) return 0;
+
+  size_t head = end + 4 - buf;
+  size_t body = 0;
+
+  const char *length = (const char *) memmem(buf, head, "Content-Length:", 15);
+  if (length) body = strtoul(length + 15, NULL, 10);
+
+  return head + body <= size ? head + body : 0;
+}
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int start(Net::Poller &poller, struct sockaddr_in &addr)
+{
+  int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  int err = connect(fd, (struct sockaddr *) &addr, sizeof(addr));
+
+  if (err < 0 && errno != EINPROGRESS)
+  {
+    fprintf(stderr, "connect: %s\n", strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  poller.add(fd, Net::Event::WRITE);
+  return fd;
+}
+
+struct Result
+{
+  unsigned long completed = 0;
+  unsigned long failed = 0;
+};
+
+static void load(int port, int connections, int seconds, bool keep_alive,
+    int depth, Result &result)
+{
+  std::string batch;
+
+  if (!keep_alive) depth = 1;
+
+  for (int i = 0; i < depth; i++)
+  {
+    batch += keep_alive ? REQUEST : REQUEST_CLOSE;
+  }
+
+  const char *request = batch.data();
+  size_t request_size = batch.size();
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+  addr.sin_port = htons(port);
+
+  Net::Poller poller;
+  std::vector<Client> clients(65536);
+
+  for (int i = 0; i < connections; i++)
+  {
+    int fd = start(poller, addr);
+    if (fd >= 0) clients[fd].fd = fd;
+  }
+
+  Net::Event events[64];
+  char buf[4096];
+
+  double deadline = now() + seconds;
+
+  while (now() < deadline)
+  {
+    int count = poller.wait(events, 64, 100);
+
+    for (int i = 0; i < count; i++)
+    {
+      int fd = events[i].fd;
+      Client &c = clients[fd];
+
+      if (!c.connected && (events[i].flags & Net::Event::WRITE))
+      {
+        c.connected = true;
+
+        if (send(fd, request, request_size, 0) < 0)
+        {
+          events[i].flags |= Net::Event::ERROR;
+        }
+        else
+        {
+          c.outstanding = depth;
+          poller.modify(fd, Net::Event::READ);
+          continue;
+        }
+      }
+
+      ssize_t bytes = 0;
+
+      if (keep_alive && (events[i].flags & Net::Event::READ))
+      {
+        bytes = recv(fd, buf, sizeof(buf), 0);
+
+        if (bytes < 0 && errno == EAGAIN) continue;
+
+        bool closing = false;
+
+        if (bytes > 0)
+        {
+          c.received.append(buf, bytes);
+
+          size_t length;
+
+          while ((length = response_length(c.received.data(),
+                  c.received.size())) > 0)
+          {
+            // the server's request limit, reconnect like it asked
+            if (memmem(c.received.data(), length, "Connection: close", 17))
+            {
+              closing = true;
+            }
+
+            c.received.erase(0, length);
+            c.outstanding--;
+            result.completed++;
+          }
+
+          if (closing) goto reconnect;
+          if (c.outstanding > 0) continue;
+
+          // nothing should follow the last response of a batch
+          if (c.received.empty() &&
+              send(fd, request, request_size, 0) == (ssize_t) request_size)
+          {
+            c.outstanding = depth;
+            continue;
+          }
+        }
+
+        result.failed++;
+      }
+      else
+      {
+        if (events[i].flags & Net::Event::READ)
+        {
+          while ((bytes = recv(fd, buf, sizeof(buf), 0)) > 0);
+          if (bytes < 0 && errno == EAGAIN) continue;
+        }
+
+        // asked to close after the response, that's our end marker
+        if (bytes == 0) result.completed++;
+        else            result.failed++;
+      }
+
+reconnect:
+      poller.remove(fd);
+      close(fd);
+      c = Client();
+
+      int next = start(poller, addr);
+      if (next >= 0) clients[next].fd = next;
+    }
+  }
+
+  for (auto &c : clients)
+  {
+    if (c.fd >= 0) close(c.fd);
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int port        = argc > 1 ? atoi(argv[1]) : 8090;
+  int connections = argc > 2 ? atoi(argv[2]) : 64;
+  int seconds     = argc > 3 ? atoi(argv[3]) : 5;
+  int threads     = argc > 4 ? atoi(argv[4]) : 1;
+  bool acceptor   = argc > 5 && !strcmp(argv[5], "acceptor");
+  bool keep_alive = !(argc > 6 && !strcmp(argv[6], "close"));
+  int depth       = argc > 7 ? atoi(argv[7]) : 1;
+  const char *root = argc > 8 ? argv[8] : NULL;
+
+  pid_t server = fork();
+
+  if (server == 0)
+  {
+    Http::Server s("127.0.0.1", port);
+
+    if (root) s.setRoot(root);
+
+    s.run(threads, acceptor
+        ? Http::Server::Dispatch::ACCEPTOR
+        : Http::Server::Dispatch::REUSE_PORT);
+    _exit(0);
+  }
+
+  // give the child a moment to bind and listen
+  usleep(200000);
+
+  signal(SIGPIPE, SIG_IGN);
+
+  // as many client threads as server loops, so the client isn't the limit
+  std::vector<Result> results(threads);
+  std::vector<std::thread> clients;
+
+  double began = now();
+
+  for (int i = 0; i < threads; i++)
+  {
+    clients.emplace_back(load, port, connections / threads, seconds,
+        keep_alive, depth, std::ref(results[i]));
+  }
+
+  Result total;
+
+  for (int i = 0; i < threads; i++)
+  {
+    clients[i].join();
+    total.completed += results[i].completed;
+    total.failed += results[i].failed;
+  }
+
+  double elapsed = now() - began;
+
+  kill(server, SIGTERM);
+  waitpid(server, NULL, 0);
+
+  printf("threads:     %d\n", threads);
+  printf("dispatch:    %s\n", acceptor ? "acceptor" : "reuseport");
+  printf("connection:  %s\n", keep_alive ? "keep-alive" : "close");
+  printf("depth:       %d\n", keep_alive ? depth : 1);
+  printf("root:        %s\n", root ? root : "-");
+  printf("connections: %d\n", connections);
+  printf("seconds:     %.2f\n", elapsed);
+  printf("requests:    %lu\n", total.completed);
+  printf("failed:      %lu\n", total.failed);
+  printf("req/s:       %.0f\n", total.completed / elapsed);
+
+  return 0;
+}
@@ -0,0 +1,155 @@
+/**
+ * Method recognition microbenchmark.
+ *
+ * Classifies a stream of request lines with the word-at-a-time lookup in
+ * Parser::match_method and with the chain of prefix compares it replaced,
+ * which tried GET, HEAD, POST, PUT, PATCH, DELETE, TRACE, OPTIONS and
+ * CONNECT in that order. Two mixes: one weighted like real traffic (mostly
+ * GET), one with every method equally often.
+ *
+ *   build/bench/method [iterations]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+#include "parser.h"
+
+using Http::Headers;
+
+static volatile size_t sink;
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool expect(const char *&at, const char *end, const char *name)
+{
+  const char *p = at;
+
+  while (*name && p < end)
+  {
+    if (*name != *p) return false;
+    name++;
+    p++;
+  }
+
+  at = p;
+  return true;
+}
+
+static Headers::Method chain(const char *begin, const char *end,
+    size_t &length)
+{
+  static const struct
+  {
+    const char *name;
+    Headers::Method method;
+  } order[] = {
+    { "GET",     Headers::Method::GET },
+    { "HEAD",    Headers::Method::HEAD },
+    { "POST",    Headers::Method::POST },
+    { "PUT",     Headers::Method::PUT },
+    { "PATCH",   Headers::Method::PATCH },
+    { "DELETE",  Headers::Method::DELETE },
+    { "TRACE",   Headers::Method::TRACE },
+    { "OPTIONS", Headers::Method::OPTIONS },
+    { "CONNECT", Headers::Method::CONNECT }
+  };
+
+  for (auto &o : order)
+  {
+    const char *at = begin;
+
+    if (expect(at, end, o.name))
+    {
+      length = at - begin;
+      return o.method;
+    }
+  }
+
+  return Headers::Method::NONE;
+}
+
+typedef Headers::Method (*Matcher)(const char *, const char *, size_t &);
+
+static void run(const char *label, Matcher match,
+    const std::vector<const char *> &lines, long iterations)
+{
+  long rounds = iterations / lines.size() + 1;
+  size_t total = 0;
+  double start = now();
+
+  for (long r = 0; r < rounds; r++)
+  {
+    for (const char *line : lines)
+    {
+      size_t length = 0;
+      total += (size_t) match(line, line + 24, length) + length;
+    }
+  }
+
+  double elapsed = now() - start;
+  sink += total;
+
+  printf("  %-6s %6.2f ns/method\n", label,
+      elapsed * 1e9 / (rounds * lines.size()));
+}
+
+int main(int argc, char **argv)
+{
+  long iterations = argc > 1 ? atol(argv[1]) : 50000000;
+
+  // each padded well past 8 bytes, match_method may load a full word
+  const char *get     = "GET /index.html HTTP/1.1";
+  const char *post    = "POST /api/items HTTP/1.1";
+  const char *head    = "HEAD /health HTTP/1.1\r\n\r\n";
+  const char *put     = "PUT /api/items/1 HTTP/1.1";
+  const char *patch   = "PATCH /api/items HTTP/1.1";
+  const char *del     = "DELETE /api/items HTTP/1.";
+  const char *trace   = "TRACE / HTTP/1.1\r\n\r\n\r\n\r\n";
+  const char *options = "OPTIONS * HTTP/1.1\r\n\r\n\r\n";
+  const char *connect = "CONNECT a.b:443 HTTP/1.1\r";
+
+  std::vector<const char *> traffic;
+
+  for (int i = 0; i < 80; i++) traffic.push_back(get);
+  for (int i = 0; i < 10; i++) traffic.push_back(post);
+  for (int i = 0; i < 4; i++)  traffic.push_back(head);
+  for (int i = 0; i < 3; i++)  traffic.push_back(options);
+  traffic.push_back(put);
+  traffic.push_back(del);
+  traffic.push_back(patch);
+
+  // interleave so the branch predictor can't just learn the sequence
+  srand(7);
+  for (size_t i = traffic.size() - 1; i > 0; i--)
+  {
+    std::swap(traffic[i], traffic[rand() % (i + 1)]);
+  }
+
+  std::vector<const char *> uniform = {
+    get, head, post, put, patch, del, trace, options, connect
+  };
+
+  printf("iterations: %ld\n", iterations);
+
+  printf("traffic mix\n");
+  run("chain", chain, traffic, iterations);
+  run("word", Http::Parser::match_method, traffic, iterations);
+
+  printf("uniform mix\n");
+  run("chain", chain, uniform, iterations);
+  run("word", Http::Parser::match_method, uniform, iterations);
+
+  printf("worst case, CONNECT only\n");
+  run("chain", chain, { connect }, iterations);
+  run("word", Http::Parser::match_method, { connect }, iterations);
+
+  return 0;
+}
@@ -0,0 +1,205 @@
+/**
+ * Delimiter scanning benchmark.
+ *
+ * For every kernel the CPU supports, runs the scans on their own over a
+ * request head (every line end, every field name) and then the whole
+ * Parser, once on a small request and once on one carrying browser sized
+ * cookie and authorization headers. The memchr row is the loop the parser
+ * used before: it only looks for the delimiter and validates nothing.
+ *
+ * Parse rows also count heap allocations per request, for a fresh Parser
+ * per request and for one that's reset and reused.
+ *
+ *   build/bench/scan [iterations]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <string>
+#include <new>
+
+#include "parser.h"
+#include "scan.h"
+
+static const char SMALL[] =
+  "GET / HTTP/1.1\r\n"
+  "Host: 127.0.0.1\r\n"
+  "User-Agent: loopback\r\n"
+  "Accept: */*\r\n\r\n";
+
+// keeps the optimiser from dropping the work
+static volatile size_t sink;
+
+static unsigned long allocations = 0;
+
+void *operator new(size_t size)
+{
+  allocations++;
+
+  void *p = malloc(size ? size : 1);
+  if (p == NULL) throw std::bad_alloc();
+
+  return p;
+}
+
+void operator delete(void *p) noexcept
+{
+  free(p);
+}
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static std::string large_request()
+{
+  std::string r =
+    "GET /assets/app.js?v=3f2a9c HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 "
+      "(KHTML, like Gecko) Chrome/120.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,"
+      "image/avif,image/webp,*/*;q=0.8\r\n"
+    "Accept-Language: en-US,en;q=0.9\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Referer: https://www.example.com/account/settings/notifications\r\n"
+    "Authorization: Bearer ";
+
+  for (int i = 0; i < 12; i++) r += "eyJhbGciOiJSUzI1NiIsInR5cCI6IkpXVCJ9.";
+  r += "\r\nCookie: ";
+
+  for (int i = 0; i < 24; i++)
+  {
+    char pair[64];
+    snprintf(pair, sizeof(pair), "_tracking_cookie_%02d=a1b2c3d4e5f6g7h8i9; ",
+        i);
+    r += pair;
+  }
+
+  r += "session=0123456789abcdef\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n";
+
+  return r;
+}
+
+/**
+ * What the parser does per line minus building Headers: find the end of
+ * the line, then the end of the field name.
+ */
+static size_t scan_head(const char *begin, const char *end, bool validate)
+{
+  size_t found = 0;
+
+  while (begin < end)
+  {
+    const char *line = validate
+      ? Http::Scan::line_end(begin, end)
+      : (const char *) memchr(begin, '\n', end - begin);
+
+    if (line == NULL || line == end) break;
+
+    if (*line == '\r') line++;
+
+    const char *name = validate
+      ? Http::Scan::token_end(begin, line)
+      : (const char *) memchr(begin, ':', line - begin);
+
+    if (name) found += name - begin;
+
+    begin = line + 1;
+  }
+
+  return found;
+}
+
+static void bench_scan(const char *label, const std::string &head,
+    bool validate, long iterations)
+{
+  double start = now();
+
+  for (long i = 0; i < iterations; i++)
+  {
+    sink += scan_head(head.data(), head.data() + head.size(), validate);
+  }
+
+  double elapsed = now() - start;
+
+  printf("  %-8s scan:  %7.2f GB/s\n", label,
+      head.size() * (double) iterations / elapsed / 1e9);
+}
+
+static void bench_parse(const char *label, const char *request, size_t size,
+    long iterations)
+{
+  unsigned long allocated = allocations;
+  double start = now();
+
+  for (long i = 0; i < iterations; i++)
+  {
+    Http::Parser p;
+    p.parse(request, size);
+    sink += p.consumed();
+  }
+
+  double elapsed = now() - start;
+  double fresh = (allocations - allocated) / (double) iterations;
+
+  Http::Parser reused;
+  allocated = allocations;
+
+  for (long i = 0; i < iterations; i++)
+  {
+    reused.reset();
+    reused.parse(request, size);
+    sink += reused.consumed();
+  }
+
+  double again = (allocations - allocated) / (double) iterations;
+
+  printf("  %-8s parse: %7.0f k req/s, allocations/request %.1f fresh, "
+      "%.1f reused\n", label, iterations / elapsed / 1e3, fresh, again);
+}
+
+int main(int argc, char **argv)
+{
+  long iterations = argc > 1 ? atol(argv[1]) : 200000;
+
+  const Http::Scan::Kernel kernels[] = {
+    Http::Scan::Kernel::SCALAR,
+    Http::Scan::Kernel::SSE42,
+    Http::Scan::Kernel::AVX2
+  };
+
+  std::string large = large_request();
+  std::string small = SMALL;
+
+  printf("detected:   %s\n", Http::Scan::name(Http::Scan::kernel()));
+  printf("iterations: %ld\n", iterations);
+
+  for (const std::string *request : { &small, &large })
+  {
+    printf("%zu byte head\n", request->size());
+
+    bench_scan("memchr", *request, false, iterations);
+
+    for (Http::Scan::Kernel kernel : kernels)
+    {
+      if (!Http::Scan::use(kernel)) continue;
+      bench_scan(Http::Scan::name(kernel), *request, true, iterations);
+    }
+
+    for (Http::Scan::Kernel kernel : kernels)
+    {
+      if (!Http::Scan::use(kernel)) continue;
+      bench_parse(Http::Scan::name(kernel), request->data(),
+          request->size(), iterations);
+    }
+  }
+
+  return 0;
+}
@@ -0,0 +1,157 @@
+/**
+ * Copy vs MSG_ZEROCOPY send benchmark, linux only.
+ *
+ * Pushes the same number of bytes over a loopback TCP connection in writes
+ * of each size, once with plain send() and once with Net::Socket's
+ * zero-copy mode, while a thread on the other end reads and discards. For
+ * each it reports throughput and the sending thread's CPU time per
+ * megabyte, which is what the copy costs; the zero-copy row also says how
+ * many of its sends the kernel ended up copying after all.
+ *
+ * Over loopback the receiving side gets a copy regardless, so the kernel
+ * reports most zero-copy sends as copied and the pinning and notification
+ * are pure overhead; the crossover printed here is where that overhead
+ * stops mattering. Across a NIC that can do scatter-gather the copy is
+ * actually skipped, and zero-copy starts winning sooner.
+ *
+ *   build/bench/zerocopy [megabytes per size]
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <thread>
+#include <memory>
+#include <sys/resource.h>
+
+#include "socket.h"
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// CPU seconds used by the calling thread, user and system
+static double cpu()
+{
+  struct rusage ru;
+  getrusage(RUSAGE_THREAD, &ru);
+
+  return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 +
+    ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+struct Result
+{
+  double seconds;
+  double cpu;
+  size_t sends;
+  size_t copied;
+};
+
+static Result run(size_t size, size_t total, bool zerocopy)
+{
+  Net::Socket server;
+  server.configure("127.0.0.1", 0);
+  server.bind();
+  server.listen();
+
+  struct sockaddr_in address;
+  socklen_t length = sizeof(address);
+  getsockname(server.fd(), (struct sockaddr *) &address, &length);
+
+  Net::Socket client;
+  client.configure();
+  client.connect("127.0.0.1", ntohs(address.sin_port));
+
+  Net::Socket reader(server.accept(), Net::Socket::ACCEPTED);
+
+  std::thread drain([&reader]()
+  {
+    std::unique_ptr<char[]> buf(new char[1 << 20]);
+    while (reader.recv(buf.get(), 1 << 20) > 0) {}
+  });
+
+  if (zerocopy) client.zerocopy(1);
+
+  std::shared_ptr<char> buffer(new char[size], std::default_delete<char[]>());
+  for (size_t i = 0; i < size; i++) buffer.get()[i] = (char) i;
+
+  double started = now();
+  double cpu_started = cpu();
+
+  for (size_t sent = 0; sent < total; )
+  {
+    size_t offset = 0;
+
+    while (offset < size)
+    {
+      int n = zerocopy ?
+        client.send(buffer.get() + offset, size - offset, buffer) :
+        client.send(buffer.get() + offset, size - offset);
+
+      if (n <= 0) break;
+
+      offset += n;
+    }
+
+    sent += size;
+
+    if (zerocopy) client.reap();
+  }
+
+  // done when the kernel has let go of every buffer
+  while (client.zerocopy_state().held() > 0)
+  {
+    client.reap();
+    std::this_thread::yield();
+  }
+
+  Result result = {
+    now() - started,
+    cpu() - cpu_started,
+    client.zerocopy_state().sends(),
+    client.zerocopy_state().copied()
+  };
+
+  client.close();
+  drain.join();
+
+  return result;
+}
+
+int main(int argc, char **argv)
+{
+  size_t megabytes = argc > 1 ? atol(argv[1]) : 512;
+  size_t total = megabytes << 20;
+
+  {
+    Net::Socket probe;
+    probe.configure();
+
+    if (!probe.zerocopy())
+    {
+      printf("SO_ZEROCOPY isn't available here\n");
+      return 1;
+    }
+  }
+
+  printf("%zu MB per size, threshold %zu\n", megabytes,
+      Net::ZeroCopy::THRESHOLD);
+  printf("%10s %12s %12s %12s %12s %10s\n", "write", "copy MB/s",
+      "zc MB/s", "copy cpu/MB", "zc cpu/MB", "zc copied");
+
+  for (size_t size = 4096; size <= (4 << 20); size *= 4)
+  {
+    Result copy = run(size, total, false);
+    Result zc = run(size, total, true);
+
+    printf("%10zu %12.0f %12.0f %10.0fus %10.0fus %9.0f%%\n", size,
+        megabytes / copy.seconds, megabytes / zc.seconds,
+        copy.cpu * 1e6 / megabytes, zc.cpu * 1e6 / megabytes,
+        zc.sends ? 100.0 * zc.copied / zc.sends : 0.0);
+  }
+
+  return 0;
+}
@@ -0,0 +1,88 @@
+#ifndef __BUDGET_H
+#define __BUDGET_H
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Net
+{
+
+/**
+ * A byte budget for the whole process, shared by every loop. Each loop
+ * charges what its connections hold as they grow and credits it back as
+ * they shrink or go; no loop asks before it allocates, the budget only
+ * says when the total has gone past the limit and it's time to push back.
+ *
+ * Pressure has two marks. It starts once more than the limit is in use and
+ * lasts until use is back down to LOW_PERCENT of it, so loops that stopped
+ * reading don't start again the moment one buffer is freed and put it
+ * straight back over.
+ *
+ * A limit of 0, the default, never pushes back; use is still counted.
+ */
+class Budget
+{
+  public:
+    Budget(size_t limit = 0) : m_limit(limit), m_used(0), m_pressure(false),
+      m_refused(0)
+    {}
+    Budget(Budget &) = delete;
+    Budget(Budget &&) = delete;
+
+    // set before any loop is charging
+    void setLimit(size_t limit) { m_limit = limit; }
+    size_t limit() const { return m_limit; }
+
+    // bytes now held, as charged and credited by every loop
+    size_t used() const { return m_used.load(std::memory_order_relaxed); }
+
+    // delta is signed, what a connection holds went up or down by it
+    void charge(int64_t delta)
+    {
+      m_used.fetch_add((size_t) delta, std::memory_order_relaxed);
+    }
+
+    /**
+     * Whether to push back: stop reading from the biggest connections,
+     * refuse new ones. True once use goes past the limit, and until it's
+     * back down to the low mark.
+     */
+    bool pressure()
+    {
+      if (m_limit == 0) return false;
+
+      size_t used = this->used();
+      bool pressure = m_pressure.load(std::memory_order_relaxed);
+
+      // written only when it flips, every loop reads it every iteration
+      if (!pressure && used > m_limit)
+      {
+        m_pressure.store(pressure = true, std::memory_order_relaxed);
+      }
+      else if (pressure && used <= m_limit / 100 * LOW_PERCENT)
+      {
+        m_pressure.store(pressure = false, std::memory_order_relaxed);
+      }
+
+      return pressure;
+    }
+
+    // connections closed as they came in, under pressure
+    void refused() { m_refused.fetch_add(1, std::memory_order_relaxed); }
+    uint64_t refusals() const
+    {
+      return m_refused.load(std::memory_order_relaxed);
+    }
+
+    static const unsigned LOW_PERCENT = 75;
+  private:
+    size_t m_limit;
+    std::atomic<size_t> m_used;
+    std::atomic<bool> m_pressure;
+    std::atomic<uint64_t> m_refused;
+}; // class
+
+}  // namespace
+
+#endif // __BUDGET_H
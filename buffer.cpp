@@ -0,0 +1,170 @@
+#include "buffer.h"
+
+#include <stdlib.h>
+#include <new>
+
+namespace Net
+{
+
+Pool::Pool() :
+  m_free(),
+  m_free_bytes(),
+  m_stats()
+{
+}
+
+Pool::~Pool()
+{
+  trim();
+}
+
+Pool &Pool::local()
+{
+  static thread_local Pool pool;
+
+  return pool;
+}
+
+unsigned Pool::hit_rate() const
+{
+  uint64_t taken = m_stats.hits + m_stats.misses;
+
+  return taken ? (unsigned) (m_stats.hits * 100 / taken) : 100;
+}
+
+void Pool::trim()
+{
+  for (size_t c = 0; c < CLASSES; c++)
+  {
+    while (m_free[c])
+    {
+      Block *block = m_free[c];
+      m_free[c] = block->next;
+
+      free(block);
+    }
+
+    m_stats.pooled -= m_free_bytes[c];
+    m_free_bytes[c] = 0;
+  }
+}
+
+size_t Pool::capacity(size_t size)
+{
+  size_t capacity = (size_t) 1 << MIN_SHIFT;
+
+  while (capacity < size && capacity < ((size_t) 1 << MAX_SHIFT))
+  {
+    capacity <<= 1;
+  }
+
+  return capacity < size ? size : capacity;
+}
+
+Pool::Block *Pool::take(size_t size)
+{
+  size_t capacity = Pool::capacity(size);
+  uint8_t size_class = UNPOOLED;
+
+  if (capacity <= ((size_t) 1 << MAX_SHIFT))
+  {
+    size_class = __builtin_ctzll(capacity) - MIN_SHIFT;
+  }
+
+  Block *block = size_class != UNPOOLED ? m_free[size_class] : NULL;
+
+  if (block)
+  {
+    m_free[size_class] = block->next;
+    m_free_bytes[size_class] -= capacity;
+    m_stats.pooled -= capacity;
+    m_stats.hits++;
+  }
+  else
+  {
+    block = (Block *) malloc(sizeof(Block) + capacity);
+
+    if (block == NULL) throw std::bad_alloc();
+
+    block->capacity = capacity;
+    block->size_class = size_class;
+    m_stats.misses++;
+  }
+
+  block->next = NULL;
+  block->refs = 1;
+
+  m_stats.in_use += capacity;
+
+  return block;
+}
+
+/**
+ * A class that already has KEEP_MAX free stops pooling, so a burst that
+ * needed a lot of blocks at once doesn't leave them all tied up after.
+ */
+void Pool::give(Block *block)
+{
+  uint8_t c = block->size_class;
+
+  // taken on another thread, its count there is off by this much
+  m_stats.in_use -= m_stats.in_use < block->capacity ? m_stats.in_use :
+    block->capacity;
+
+  if (c == UNPOOLED || m_free_bytes[c] + block->capacity > KEEP_MAX)
+  {
+    free(block);
+    return;
+  }
+
+  block->next = m_free[c];
+  m_free[c] = block;
+  m_free_bytes[c] += block->capacity;
+  m_stats.pooled += block->capacity;
+}
+
+void Chain::append(const char *data, size_t size)
+{
+  while (size > 0)
+  {
+    if (m_room == 0)
+    {
+      Buffer buffer(BLOCK);
+
+      m_slices.push_back(Slice(buffer, 0, 0));
+      m_room = buffer.capacity();
+    }
+
+    Slice &last = m_slices.back();
+    size_t n = size < m_room ? size : m_room;
+
+    memcpy(last.m_buffer.data() + last.m_offset + last.m_size, data, n);
+
+    last.m_size += n;
+    m_room -= n;
+    m_size += n;
+
+    data += n;
+    size -= n;
+  }
+}
+
+void Chain::append(const Slice &slice)
+{
+  if (slice.empty()) return;
+
+  m_slices.push_back(slice);
+  m_size += slice.size();
+
+  // the block isn't ours to write into
+  m_room = 0;
+}
+
+void Chain::clear()
+{
+  m_slices.clear();
+  m_room = 0;
+  m_size = 0;
+}
+
+}  // namespace
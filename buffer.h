@@ -0,0 +1,212 @@
+#ifndef __BUFFER_H
+#define __BUFFER_H
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+namespace Net
+{
+
+/**
+ * Memory for the I/O path, in blocks of a few size classes, powers of two
+ * from 1KB to 64KB. Each thread has a Pool of free blocks per class, so
+ * taking one and giving it back is a pop and a push on a list nobody else
+ * touches; malloc is only called while a class has nothing free, and for
+ * the odd block bigger than the largest class, which is never pooled.
+ *
+ * Blocks are reference counted by the Buffers and Slices pointing at them,
+ * and go back to the pool of whichever thread drops the last reference.
+ * The counts aren't atomic: a block and everything pointing into it stay
+ * on one loop thread.
+ */
+class Pool
+{
+  public:
+    struct Stats
+    {
+      uint64_t hits;    // blocks taken off a free list
+      uint64_t misses;  // blocks that had to be malloc'd
+      size_t in_use;    // bytes in blocks handed out, not yet back
+      size_t pooled;    // bytes in blocks on the free lists
+    };
+
+    Pool();
+    Pool(Pool &p) = delete;
+    Pool(Pool &&p) = delete;
+    ~Pool();
+
+    // the calling thread's
+    static Pool &local();
+
+    const Stats &stats() const { return m_stats; }
+
+    // percent of blocks taken without malloc, 100 before any were taken
+    unsigned hit_rate() const;
+
+    // free every pooled block
+    void trim();
+
+    // the capacity a request for size bytes gets
+    static size_t capacity(size_t size);
+
+    static const size_t MIN_SHIFT = 10;
+    static const size_t MAX_SHIFT = 16;
+    static const size_t CLASSES = MAX_SHIFT - MIN_SHIFT + 1;
+
+    // past this many bytes free in a class, blocks given back are freed
+    static const size_t KEEP_MAX = 1 << 20;
+  private:
+    friend class Buffer;
+
+    struct Block
+    {
+      Block *next;        // on a free list
+      size_t capacity;
+      uint32_t refs;
+      uint8_t size_class; // UNPOOLED for one bigger than the largest class
+
+      char *data() { return (char *) (this + 1); }
+    };
+
+    static const uint8_t UNPOOLED = 0xff;
+
+    Block *take(size_t size);
+    void give(Block *block);
+
+    Block *m_free[CLASSES];
+    size_t m_free_bytes[CLASSES];
+    Stats m_stats;
+}; // class
+
+/**
+ * A reference to a block from the pool, at least the capacity asked for.
+ * Copies share the block, the last one to go gives it back. What's in it
+ * and how much of it is used is up to the owner; Slices say which part of
+ * it means what.
+ */
+class Buffer
+{
+  public:
+    Buffer() : m_block(NULL) {}
+
+    // from the calling thread's pool
+    explicit Buffer(size_t capacity) : m_block(Pool::local().take(capacity))
+    {}
+
+    Buffer(const Buffer &b) : m_block(b.m_block)
+    {
+      if (m_block) m_block->refs++;
+    }
+
+    Buffer(Buffer &&b) : m_block(b.m_block) { b.m_block = NULL; }
+    ~Buffer() { reset(); }
+
+    Buffer &operator=(const Buffer &b)
+    {
+      if (b.m_block) b.m_block->refs++;
+
+      reset();
+      m_block = b.m_block;
+
+      return *this;
+    }
+
+    Buffer &operator=(Buffer &&b)
+    {
+      if (this == &b) return *this;
+
+      reset();
+      m_block = b.m_block;
+      b.m_block = NULL;
+
+      return *this;
+    }
+
+    // lets go of the block, the buffer is empty after
+    void reset()
+    {
+      if (m_block && --m_block->refs == 0) Pool::local().give(m_block);
+
+      m_block = NULL;
+    }
+
+    char *data() const { return m_block ? m_block->data() : NULL; }
+    size_t capacity() const { return m_block ? m_block->capacity : 0; }
+
+    // how many Buffers and Slices share the block
+    uint32_t refs() const { return m_block ? m_block->refs : 0; }
+
+    explicit operator bool() const { return m_block != NULL; }
+  private:
+    Pool::Block *m_block;
+}; // class
+
+/**
+ * Part of a Buffer, keeping the whole block alive: a parsed field that
+ * outlives the read it came in, a received body queued back out, with no
+ * copy made of either.
+ */
+class Slice
+{
+  public:
+    Slice() : m_buffer(), m_offset(0), m_size(0) {}
+
+    Slice(const Buffer &buffer, size_t offset, size_t size) :
+      m_buffer(buffer), m_offset(offset), m_size(size)
+    {}
+
+    const char *data() const { return m_buffer.data() + m_offset; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    // a part of this one, sharing the block
+    Slice slice(size_t offset, size_t size) const
+    {
+      return Slice(m_buffer, m_offset + offset, size);
+    }
+
+    const Buffer &buffer() const { return m_buffer; }
+  private:
+    friend class Chain;
+
+    Buffer m_buffer;
+    size_t m_offset;
+    size_t m_size;
+}; // class
+
+/**
+ * A body too big for one block, as slices in order. Bytes appended are
+ * copied into the room left in the last block, a new BLOCK sized one is
+ * taken when it's full; slices appended are linked in without a copy.
+ * Output::reference() queues the whole chain the same way.
+ */
+class Chain
+{
+  public:
+    Chain() : m_slices(), m_room(0), m_size(0) {}
+
+    void append(const char *data, size_t size);
+    void append(const Slice &slice);
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    const std::vector<Slice> &slices() const { return m_slices; }
+
+    // the blocks go back, unless something else holds on to them
+    void clear();
+
+    static const size_t BLOCK = 16 * 1024;
+  private:
+    std::vector<Slice> m_slices;
+
+    // free bytes at the end of the last slice's block, when it's ours
+    size_t m_room;
+    size_t m_size;
+}; // class
+
+}  // namespace
+
+#endif // __BUFFER_H
@@ -0,0 +1,74 @@
+#include "bundle.h"
+
+namespace Http
+{
+
+/**
+ * The identity is the fallback: it isn't weighed, and a client that
+ * turns it down with "identity;q=0" still gets it rather than a 406.
+ * Among the encodings the client takes, the smallest wins, so a
+ * preference between them only counts where one is refused.
+ */
+const Bundle::Representation &Bundle::Asset::choose(
+    const Headers &headers) const
+{
+  if (count == 1 || !headers.has(Known::ACCEPT_ENCODING))
+  {
+    return representations[0];
+  }
+
+  for (size_t i = 1; i < count; i++)
+  {
+    if (headers.quality(Known::ACCEPT_ENCODING,
+          representations[i].encoding) > 0)
+    {
+      return representations[i];
+    }
+  }
+
+  return representations[0];
+}
+
+const Bundle::Asset *Bundle::find(View path) const
+{
+  const char *query = (const char *) memchr(path.data(), '?', path.size());
+
+  if (query) path = View(path.data(), query - path.data());
+
+  if (count == 0 || path.size() > PATH_MAX_SIZE) return NULL;
+
+  uint16_t i = slots[slot(hash(path.data(), path.size(), seed), slot_bits)];
+
+  if (i == count) return NULL;
+
+  const Asset &asset = assets[i];
+
+  if (!path.equals(asset.path, asset.path_size)) return NULL;
+
+  return &asset;
+}
+
+void Bundle::queue(Net::Output &out, const Representation &representation,
+    bool not_modified, bool head_only, View date, View connection)
+{
+  if (not_modified)
+  {
+    out.reference(representation.not_modified,
+        representation.not_modified_size);
+  }
+  else
+  {
+    out.reference(representation.head, representation.head_size);
+  }
+
+  out.append(date.data(), date.size());
+  out.append(connection.data(), connection.size());
+  out.append("\r\n", 2);
+
+  if (!not_modified && !head_only && representation.body_size > 0)
+  {
+    out.reference(representation.body, representation.body_size);
+  }
+}
+
+} // namespace
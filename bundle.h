@@ -0,0 +1,109 @@
+#ifndef __BUNDLE_H
+#define __BUNDLE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include "view.h"
+#include "output.h"
+#include "headers.h"
+
+namespace Http
+{
+
+/**
+ * A directory compiled into the binary: `make embedded` runs tools/embed
+ * over EMBED_DIR and builds the translation unit it writes. Every asset is
+ * a constant array along with the heads that go in front of it, already
+ * serialized, so serving one touches no file system and builds nothing;
+ * the queue references the arrays and only the Date and Connection lines
+ * are copied.
+ *
+ * Assets that compress well also carry gzip and, where the generator was
+ * built with brotli, br versions, each with its own entity tag; choose()
+ * picks one by Accept-Encoding.
+ *
+ * Paths are looked up in a perfect hash table. The seed was searched for
+ * by the generator and the generated file rechecks it with static_asserts,
+ * so a lookup is one hash, one slot and one compare. Paths are matched as
+ * the generator wrote them, not percent-decoded.
+ *
+ * Everything here is constant data and is shared by every loop.
+ */
+struct Bundle
+{
+  struct Representation
+  {
+    const char *encoding;   // Content-Encoding, "" for the identity
+
+    /**
+     * The 200 from the status line up to and including Content-Length,
+     * and the 304 up to its last field; the Date and Connection lines and
+     * the blank line still have to follow either. See queue().
+     */
+    const char *head;
+    size_t head_size;
+    const char *not_modified;
+    size_t not_modified_size;
+
+    const char *body;
+    size_t body_size;
+
+    const char *etag;
+    size_t etag_size;
+
+    View etag_value() const { return View(etag, etag_size); }
+  };
+
+  struct Asset
+  {
+    const char *path;
+    size_t path_size;
+
+    time_t modified;
+
+    // the identity first, then smallest to largest
+    const Representation *representations;
+    size_t count;
+
+    // the smallest one the client accepts, the identity at worst
+    const Representation &choose(const Headers &headers) const;
+  };
+
+  const Asset *assets;
+  size_t count;
+
+  // perfect hash, see slot()
+  uint32_t seed;
+  unsigned slot_bits;
+  const uint16_t *slots;    // index into assets, count for an empty slot
+
+  // the asset at path, ignoring the query string, NULL without one
+  const Asset *find(View path) const;
+
+  /**
+   * A whole answer from representation, 304 or 200. date is the whole
+   * Date line and connection the Connection line, if any, both copied.
+   */
+  static void queue(Net::Output &out, const Representation &representation,
+      bool not_modified, bool head_only, View date, View connection);
+
+  // FNV-1a from seed instead of the usual offset basis
+  static constexpr uint32_t hash(const char *s, size_t size, uint32_t seed)
+  {
+    return size == 0 ? seed :
+      hash(s + 1, size - 1, (seed ^ (uint8_t) *s) * 16777619u);
+  }
+
+  static constexpr unsigned slot(uint32_t hash, unsigned bits)
+  {
+    return (uint32_t) (hash * 0x9e3779b1u) >> (32 - bits);
+  }
+
+  // the longest path the generator will take, hash() recurses per byte
+  static const size_t PATH_MAX_SIZE = 255;
+};
+
+} // namespace
+
+#endif /** __BUNDLE_H **/
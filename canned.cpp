@@ -0,0 +1,105 @@
+#include "canned.h"
+
+namespace Http
+{
+
+/**
+ * Serialized with a Response, one per Connection variant, so the status
+ * table, Content-Length and the bodyless statuses work out the same as for
+ * any other response.
+ */
+Canned::Canned(unsigned status, const char *content_type, View body,
+    std::initializer_list<Field> fields) :
+  m_status(0),
+  m_status_line(),
+  m_heads(),
+  m_body()
+{
+  for (int c = 0; c < CONNECTIONS; c++)
+  {
+    Response response(status);
+
+    if (content_type && *content_type)
+    {
+      response.header("Content-Type", content_type);
+    }
+
+    for (const Field &field : fields)
+    {
+      if (!field.value.empty()) response.header(field.name, field.value);
+    }
+
+    if (c == CLOSE)          response.header("Connection", "close");
+    if (c == KEEP_ALIVE_1_0) response.header("Connection", "keep-alive");
+
+    response.body(body);
+
+    struct iovec iov[2 + Response::BODY_MAX];
+    int count = response.iovecs(iov);
+
+    m_heads[c].assign((const char *) iov[1].iov_base, iov[1].iov_len);
+
+    if (c > 0) continue;
+
+    m_status = response.status();
+    m_status_line.assign((const char *) iov[0].iov_base, iov[0].iov_len);
+
+    // empty for a status that can't carry a body
+    if (count > 2) m_body.assign(body.data(), body.size());
+  }
+}
+
+/**
+ * keep goes with the last segment: the ones in front of it are written,
+ * and let go of, first.
+ */
+void Canned::queue(Net::Output &out, View date, Connection connection,
+    bool head_only, std::shared_ptr<const void> keep) const
+{
+  const std::string &head = m_heads[connection];
+
+  out.reference(m_status_line.data(), m_status_line.size());
+  out.append(date.data(), date.size());
+
+  if (head_only || m_body.empty())
+  {
+    out.reference(head.data(), head.size(), std::move(keep));
+    return;
+  }
+
+  out.reference(head.data(), head.size());
+  out.reference(m_body.data(), m_body.size(), std::move(keep));
+}
+
+void Canned::Table::add(const char *path, unsigned status,
+    const char *content_type, View body)
+{
+  std::unique_ptr<Canned> canned(new Canned(status, content_type, body));
+
+  for (auto &entry : m_entries)
+  {
+    if (entry.first == path)
+    {
+      entry.second = std::move(canned);
+      return;
+    }
+  }
+
+  m_entries.emplace_back(path, std::move(canned));
+}
+
+const Canned *Canned::Table::find(View path) const
+{
+  const char *query = (const char *) memchr(path.data(), '?', path.size());
+
+  if (query) path = View(path.data(), query - path.data());
+
+  for (const auto &entry : m_entries)
+  {
+    if (path == entry.first) return entry.second.get();
+  }
+
+  return NULL;
+}
+
+} // namespace
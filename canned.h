@@ -0,0 +1,105 @@
+#ifndef __CANNED_H
+#define __CANNED_H
+
+#include <initializer_list>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "view.h"
+#include "output.h"
+#include "response.h"
+
+namespace Http
+{
+
+/**
+ * A response whose bytes never change, serialized once up front: health
+ * checks, fixed error pages, the 400 for a request that didn't parse.
+ * Answering with one queues references to its buffers on the connection's
+ * Net::Output, only the Date line is copied.
+ *
+ * The head is kept once per Connection field a response can need, so none
+ * of them is patched per request:
+ *   KEEP_ALIVE - none, HTTP/1.1 stays open by default
+ *   CLOSE      - "Connection: close", the last response on a connection
+ *   KEEP_ALIVE_1_0 - "Connection: keep-alive", an HTTP/1.0 client asked
+ *
+ * A Canned is immutable once constructed and has to outlive every queue
+ * it's been referenced from, which in practice means it lives as long as
+ * the server. Loops share them without locking.
+ */
+class Canned
+{
+  public:
+    enum Connection {
+      KEEP_ALIVE,
+      CLOSE,
+      KEEP_ALIVE_1_0,
+      CONNECTIONS
+    };
+
+    // a header field beyond Content-Type and the ones worked out here,
+    // left out when the value is empty
+    struct Field
+    {
+      const char *name;
+      View value;
+    };
+
+    Canned(unsigned status, const char *content_type, View body,
+        std::initializer_list<Field> fields = {});
+    Canned(Canned &c) = delete;
+    Canned(Canned &&c) = delete;
+
+    /**
+     * date is the whole "Date: ...\r\n" line, see Http::Date. A HEAD
+     * answer leaves the body out. keep is held by the queue until the
+     * last of it is written, for a Canned that may be dropped before then.
+     */
+    void queue(Net::Output &out, View date, Connection connection,
+        bool head_only = false,
+        std::shared_ptr<const void> keep = nullptr) const;
+
+    unsigned status() const { return m_status; }
+
+    // bytes on the wire for a full answer, the Date line not counted
+    size_t size(Connection connection) const
+    {
+      return m_status_line.size() + m_heads[connection].size() +
+        m_body.size();
+    }
+
+    /**
+     * Canned responses by request path, filled in before the loops start
+     * and only read after. The query string doesn't take part in the
+     * lookup. A handful of entries is the expected size, so it's a list.
+     */
+    class Table
+    {
+      public:
+        Table() : m_entries() {}
+        Table(Table &t) = delete;
+        Table(Table &&t) = delete;
+
+        // replaces what was there for path
+        void add(const char *path, unsigned status, const char *content_type,
+            View body);
+
+        const Canned *find(View path) const;
+
+        size_t size() const { return m_entries.size(); }
+      private:
+        std::vector<std::pair<std::string, std::unique_ptr<Canned>>>
+          m_entries;
+    };
+  private:
+    unsigned m_status;
+    std::string m_status_line;
+    std::string m_heads[CONNECTIONS];
+    std::string m_body;
+};
+
+} // namespace
+
+#endif /** __CANNED_H **/
@@ -1,8 +1,7 @@
 #include <inttypes.h>
-//#include "buffer.h"
-#include <vector>
+#include "buffer.h"
 
-using Buffer = vector<uint8_t>;
+using Net::Buffer;
 
 class Client
 {
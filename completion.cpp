@@ -0,0 +1,191 @@
+#include "completion.h"
+
+#if defined(__linux__)
+
+namespace Net
+{
+
+CompletionTransport::CompletionTransport(unsigned entries) :
+  m_listen(),
+  m_ring(entries),
+  m_sends(),
+  m_free_sends()
+{
+}
+
+int CompletionTransport::listen(const char *addr, int port)
+{
+  if (m_ring.err() < 0)                   return m_ring.err();
+  if (m_listen.configure(addr, port) < 0) return m_listen.err();
+  if (m_listen.bind() < 0)                return m_listen.err();
+  if (m_listen.listen() < 0)              return m_listen.err();
+
+  int err = m_ring.provide(BUFFER_COUNT, BUFFER_SIZE, BUFFER_GROUP);
+
+  if (err < 0)
+  {
+    ERR("ring setup: %s", strerror(errno));
+    return err;
+  }
+
+  // one accept sqe keeps producing a completion per new client
+  m_ring.prep_accept(m_listen.fd(), pack(ACCEPT, m_listen.fd()));
+
+  return m_ring.submit();
+}
+
+/**
+ * One io_uring_enter per call: flushes every sqe queued since the last pump
+ * (new recvs, sends from the read handler, closes) and waits for at least
+ * one completion, then drains all that are ready.
+ */
+void CompletionTransport::pump()
+{
+  if (m_listen.state() != Socket::LISTENING)
+  {
+    ERR("must have a listening socket to read events, run setup");
+    return;
+  }
+
+  if (m_ring.submit(1) < 0 && errno != EINTR)
+  {
+    return;
+  }
+
+  struct io_uring_cqe *cqe;
+
+  while ((cqe = m_ring.peek()) != NULL)
+  {
+    switch ((Op) (cqe->user_data >> 32))
+    {
+      case ACCEPT: on_accept(cqe); break;
+      case RECV:   on_recv(cqe);   break;
+      case SEND:   on_send(cqe);   break;
+      case CLOSE:  break;
+    }
+
+    m_ring.seen();
+  }
+}
+
+void CompletionTransport::on_accept(struct io_uring_cqe *cqe)
+{
+  if (!(cqe->flags & IORING_CQE_F_MORE))
+  {
+    // the multishot accept was terminated, put it back
+    m_ring.prep_accept(m_listen.fd(), pack(ACCEPT, m_listen.fd()));
+  }
+
+  if (cqe->res < 0)
+  {
+    ERR("accept: %s", strerror(-cqe->res));
+    return;
+  }
+
+  int fd = cqe->res;
+
+  DEBUG("[0x%016" PRIXPTR "] client connect", (uintptr_t) fd);
+
+  m_connections++;
+  m_ring.prep_recv(fd, BUFFER_GROUP, pack(RECV, fd));
+}
+
+void CompletionTransport::on_recv(struct io_uring_cqe *cqe)
+{
+  int fd = cqe->user_data & 0xffffffff;
+
+  if (cqe->res > 0)
+  {
+    uint16_t id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+    if (m_on_data) m_on_data(fd, m_ring.buffer(id), cqe->res);
+
+    m_ring.recycle(id);
+
+    if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+      m_ring.prep_recv(fd, BUFFER_GROUP, pack(RECV, fd));
+    }
+
+    return;
+  }
+
+  if (cqe->res == -ENOBUFS)
+  {
+    // every provided buffer was in use, the data is still in the socket
+    m_ring.prep_recv(fd, BUFFER_GROUP, pack(RECV, fd));
+    return;
+  }
+
+  if (cqe->res < 0 && cqe->res != -ECONNRESET)
+  {
+    ERR("[0x%016" PRIXPTR "] client receive: %s", (uintptr_t) fd,
+        strerror(-cqe->res));
+  }
+
+  // zero bytes is an orderly shutdown, errors end the connection too
+  on_client_disconnect(fd);
+}
+
+int CompletionTransport::send(Socket::FD fd, const char *buf, size_t length)
+{
+  uint32_t slot;
+
+  if (m_free_sends.empty())
+  {
+    slot = m_sends.size();
+    m_sends.push_back(Send());
+  }
+  else
+  {
+    slot = m_free_sends.back();
+    m_free_sends.pop_back();
+  }
+
+  m_sends[slot] = Send{(int) fd, buf, length};
+  m_ring.prep_send(fd, buf, length, pack(SEND, slot));
+
+  return length;
+}
+
+void CompletionTransport::on_send(struct io_uring_cqe *cqe)
+{
+  uint32_t slot = cqe->user_data & 0xffffffff;
+  Send &s = m_sends[slot];
+
+  if (cqe->res < 0)
+  {
+    if (cqe->res != -EPIPE && cqe->res != -ECONNRESET)
+    {
+      ERR("[0x%016" PRIXPTR "] send: %s", (uintptr_t) s.fd,
+          strerror(-cqe->res));
+    }
+  }
+  else if ((size_t) cqe->res < s.len)
+  {
+    // short write, send the rest from the same slot
+    s.buf += cqe->res;
+    s.len -= cqe->res;
+    m_ring.prep_send(s.fd, s.buf, s.len, pack(SEND, slot));
+    return;
+  }
+
+  m_free_sends.push_back(slot);
+}
+
+void CompletionTransport::on_client_disconnect(int fd)
+{
+  DEBUG("[0x%016" PRIXPTR "] client disconnect", (uintptr_t) fd);
+
+  m_connections--;
+  m_ring.prep_close(fd, pack(CLOSE, fd));
+}
+
+CompletionTransport::~CompletionTransport()
+{
+  if (m_listen.state() == Socket::LISTENING) m_listen.close();
+}
+
+}
+
+#endif // __linux__
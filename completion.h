@@ -0,0 +1,99 @@
+#ifndef __COMPLETION_H
+#define __COMPLETION_H
+
+#if defined(__linux__)
+
+#include <inttypes.h>   // PRIXPTR (printing pointers)
+#include <vector>
+
+#include "socket.h"
+#include "transport.h"
+#include "ring.h"
+#include "log.h"
+
+namespace Net
+{
+
+/**
+ * Completion based counterpart to Transport, linux only.
+ *
+ * Where Transport waits for readiness and then does a recv() or send() per
+ * event, this keeps one multishot accept on the listening socket and one
+ * multishot recv per client armed in an io_uring. Receives land in provided
+ * buffers the kernel picks itself, sends are queued as sqes, and everything
+ * queued during an iteration goes to the kernel with the next wait in a
+ * single io_uring_enter.
+ *
+ * Same read handler shape as Transport. The bytes handed to it are only
+ * valid for the duration of the call, the buffer goes back to the kernel
+ * right after.
+ */
+class CompletionTransport
+{
+  public:
+    typedef Transport::ReadHandler ReadHandler;
+
+    CompletionTransport(unsigned entries = 256);
+    CompletionTransport(CompletionTransport &) = delete;
+    CompletionTransport(CompletionTransport &&) = delete;
+    ~CompletionTransport();
+
+    // listen - "server" specific
+    int listen(const char*, int);
+
+    // buf has to stay valid until the send completes
+    int send(Socket::FD, const char *, size_t);
+
+    void on_data(ReadHandler handler) { m_on_data = handler; }
+
+    void pump();
+
+    unsigned connections() { return m_connections; }
+    unsigned enters()      { return m_ring.enters(); }
+  protected:
+    enum Op : uint64_t
+    {
+      ACCEPT = 1,
+      RECV,
+      SEND,
+      CLOSE
+    };
+
+    // a send in flight, kept so a short write can be resubmitted
+    struct Send
+    {
+      int fd;
+      const char *buf;
+      size_t len;
+    };
+
+    static uint64_t pack(Op op, uint32_t value)
+    {
+      return (uint64_t) op << 32 | value;
+    }
+
+    void on_accept(struct io_uring_cqe *);
+    void on_recv(struct io_uring_cqe *);
+    void on_send(struct io_uring_cqe *);
+    void on_client_disconnect(int fd);
+
+    Socket m_listen;
+    Ring m_ring;
+
+    static const int BUFFER_COUNT = 1024;
+    static const int BUFFER_SIZE = 1024;
+    static const uint16_t BUFFER_GROUP = 0;
+
+    std::vector<Send> m_sends;
+    std::vector<uint32_t> m_free_sends;
+
+    unsigned m_connections = 0;
+
+    ReadHandler m_on_data;
+};
+
+}
+
+#endif // __linux__
+
+#endif // __COMPLETION_H
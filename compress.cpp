@@ -0,0 +1,222 @@
+#include "compress.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_BROTLI
+#include <brotli/encode.h>
+#endif
+
+namespace Http
+{
+
+namespace
+{
+
+const char *const COMPRESSIBLE[] = {
+  "application/javascript",
+  "application/json",
+  "application/xml",
+  "application/wasm",
+  "image/svg+xml",
+  "image/x-icon"
+};
+
+// a gzip wrapper instead of zlib's, with the most memory deflate takes
+const int GZIP_WINDOW = 15 + 16;
+const int MEMORY = 9;
+
+}
+
+Compressor::Compressor(int level) :
+  m_level(level),
+  m_ready(false),
+  m_stream(),
+  m_buffer(CHUNK)
+{
+}
+
+Compressor::~Compressor()
+{
+  if (m_ready) deflateEnd(&m_stream);
+}
+
+bool Compressor::begin()
+{
+  if (m_ready)
+  {
+    m_stream.next_out = NULL;
+    m_stream.avail_out = 0;
+
+    return deflateReset(&m_stream) == Z_OK;
+  }
+
+  memset(&m_stream, 0, sizeof(m_stream));
+
+  m_ready = deflateInit2(&m_stream, m_level, Z_DEFLATED, GZIP_WINDOW, MEMORY,
+      Z_DEFAULT_STRATEGY) == Z_OK;
+
+  if (!m_ready) ERR("deflateInit2: %s", m_stream.msg ? m_stream.msg : "");
+
+  return m_ready;
+}
+
+bool Compressor::write(View in, Net::Output &out)
+{
+  m_stream.next_in = (Bytef *) in.data();
+  m_stream.avail_in = in.size();
+
+  return deflate(Z_NO_FLUSH, out);
+}
+
+bool Compressor::finish(Net::Output &out)
+{
+  m_stream.next_in = NULL;
+  m_stream.avail_in = 0;
+
+  if (!deflate(Z_FINISH, out)) return false;
+
+  out.append("0\r\n\r\n", 5);
+
+  return true;
+}
+
+/**
+ * The buffer collects output across calls and only goes out as a chunk
+ * once it's full, or at the end, so a body written in small pieces isn't
+ * framed in small pieces.
+ */
+bool Compressor::deflate(int flush, Net::Output &out)
+{
+  if (!m_ready) return false;
+
+  for (;;)
+  {
+    if (m_stream.next_out == NULL || m_stream.avail_out == 0)
+    {
+      if (m_stream.next_out != NULL) chunk(out);
+
+      m_stream.next_out = (Bytef *) m_buffer.data();
+      m_stream.avail_out = m_buffer.size();
+    }
+
+    int rc = ::deflate(&m_stream, flush);
+
+    if (rc == Z_STREAM_END)
+    {
+      chunk(out);
+      m_stream.next_out = NULL;
+      return true;
+    }
+
+    if (rc != Z_OK && rc != Z_BUF_ERROR) return false;
+
+    // all of the input taken, and room left over: nothing more until the
+    // next call
+    if (flush == Z_NO_FLUSH && m_stream.avail_in == 0 &&
+        m_stream.avail_out > 0)
+    {
+      return true;
+    }
+  }
+}
+
+void Compressor::chunk(Net::Output &out)
+{
+  size_t size = m_buffer.size() - m_stream.avail_out;
+
+  if (size == 0) return;
+
+  char line[24];
+  int n = snprintf(line, sizeof(line), "%zx\r\n", size);
+
+  out.append(line, n);
+  out.append(m_buffer.data(), size);
+  out.append("\r\n", 2);
+
+  m_stream.next_out = (Bytef *) m_buffer.data();
+  m_stream.avail_out = m_buffer.size();
+}
+
+bool Compressor::gzip(View in, std::string &out, int level)
+{
+  z_stream z;
+  memset(&z, 0, sizeof(z));
+
+  if (deflateInit2(&z, level, Z_DEFLATED, GZIP_WINDOW, MEMORY,
+        Z_DEFAULT_STRATEGY) != Z_OK)
+  {
+    return false;
+  }
+
+  out.resize(deflateBound(&z, in.size()));
+
+  z.next_in = (Bytef *) in.data();
+  z.avail_in = in.size();
+  z.next_out = (Bytef *) &out[0];
+  z.avail_out = out.size();
+
+  int rc = ::deflate(&z, Z_FINISH);
+
+  out.resize(z.total_out);
+  deflateEnd(&z);
+
+  return rc == Z_STREAM_END;
+}
+
+bool Compressor::brotli(View in, bool text, std::string &out, int quality)
+{
+#ifdef HAVE_BROTLI
+  size_t size = BrotliEncoderMaxCompressedSize(in.size());
+  if (size == 0) return false;
+
+  out.resize(size);
+
+  if (!BrotliEncoderCompress(quality, BROTLI_DEFAULT_WINDOW,
+        text ? BROTLI_MODE_TEXT : BROTLI_MODE_GENERIC, in.size(),
+        (const uint8_t *) in.data(), &size, (uint8_t *) &out[0]))
+  {
+    return false;
+  }
+
+  out.resize(size);
+
+  return true;
+#else
+  (void) in;
+  (void) text;
+  (void) out;
+  (void) quality;
+
+  return false;
+#endif
+}
+
+bool Compressor::has_brotli()
+{
+#ifdef HAVE_BROTLI
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool Compressor::compressible(const char *type)
+{
+  View t(type);
+
+  if (t.size() >= 5 && View(type, 5).iequals("text/", 5)) return true;
+
+  // parameters don't matter, "application/json; charset=..." is json
+  const char *semicolon = strchr(type, ';');
+  if (semicolon) t = View(type, semicolon - type);
+
+  for (const char *c : COMPRESSIBLE)
+  {
+    if (t.iequals(c)) return true;
+  }
+
+  return false;
+}
+
+} // namespace
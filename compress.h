@@ -0,0 +1,84 @@
+#ifndef __COMPRESS_H
+#define __COMPRESS_H
+
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <zlib.h>
+#include "view.h"
+#include "output.h"
+
+namespace Http
+{
+
+/**
+ * Content codings. The statics compress a whole body as hard as they can,
+ * for a representation made once and kept: a file in the Files cache, an
+ * asset in a Bundle. br is there when built with HAVE_BROTLI.
+ *
+ * An instance is a gzip stream for bodies made per request, one for each
+ * body in progress, a few of them kept by the loop between bodies. The
+ * deflate state is a quarter of a megabyte, allocated on first use and
+ * reset, not rebuilt, for every body after that. What it produces goes on
+ * a Net::Output framed as HTTP/1.1 chunks, so the body needn't be known up
+ * front; see Response::chunked().
+ */
+class Compressor
+{
+  public:
+    Compressor(int level = LEVEL);
+    Compressor(Compressor &c) = delete;
+    Compressor(Compressor &&c) = delete;
+    ~Compressor();
+
+    // starts a body, dropping whatever the last one left unfinished
+    bool begin();
+
+    // compresses in, queuing whatever chunks fill up
+    bool write(View in, Net::Output &out);
+
+    // the rest of the body and the last chunk
+    bool finish(Net::Output &out);
+
+    // a whole gzip body at out, false if it couldn't be made
+    static bool gzip(View in, std::string &out, int level = GZIP_BEST);
+
+    // the same as br, always false without brotli
+    static bool brotli(View in, bool text, std::string &out,
+        int quality = BROTLI_BEST);
+
+    static bool has_brotli();
+
+    /**
+     * Whether a media type is worth compressing: text and the structured
+     * formats written as text. Images other than SVG, fonts and archives
+     * are compressed already.
+     */
+    static bool compressible(const char *type);
+
+    // a coding is kept only if it saves at least a tenth
+    static bool worth(size_t identity, size_t encoded)
+    {
+      return encoded < identity - identity / 10;
+    }
+
+    // for a stream, and for what's compressed once at build time
+    static const int LEVEL = 6;
+    static const int GZIP_BEST = 9;
+    static const int BROTLI_BEST = 11;
+
+    // compressed bytes per chunk, at most
+    static const size_t CHUNK = 16 * 1024;
+  private:
+    bool deflate(int flush, Net::Output &out);
+    void chunk(Net::Output &out);
+
+    int m_level;
+    bool m_ready;
+    z_stream m_stream;
+    std::vector<char> m_buffer;
+};
+
+} // namespace
+
+#endif /** __COMPRESS_H **/
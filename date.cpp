@@ -0,0 +1,79 @@
+#include "date.h"
+
+#include <string.h>
+
+namespace Http
+{
+
+namespace
+{
+
+const char DAYS[] = "SunMonTueWedThuFriSat";
+const char MONTHS[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+char *two(char *p, int value)
+{
+  *p++ = '0' + value / 10;
+  *p++ = '0' + value % 10;
+
+  return p;
+}
+
+}
+
+Date::Date() :
+  m_second(-1),
+  m_line()
+{
+  memcpy(m_line, "Date: ", NAME_SIZE);
+  memcpy(m_line + LINE_SIZE - 2, "\r\n", 2);
+
+  refresh(time(NULL));
+}
+
+bool Date::refresh(time_t now)
+{
+  if (now == m_second) return false;
+
+  m_second = now;
+  format(now, m_line + NAME_SIZE);
+
+  return true;
+}
+
+/**
+ * By hand rather than with strftime, which would follow the locale for the
+ * day and month names.
+ */
+void Date::format(time_t now, char *out)
+{
+  struct tm tm;
+  gmtime_r(&now, &tm);
+
+  char *p = out;
+
+  memcpy(p, DAYS + tm.tm_wday * 3, 3);
+  p += 3;
+  *p++ = ',';
+  *p++ = ' ';
+  p = two(p, tm.tm_mday);
+  *p++ = ' ';
+  memcpy(p, MONTHS + tm.tm_mon * 3, 3);
+  p += 3;
+  *p++ = ' ';
+
+  int year = tm.tm_year + 1900;
+
+  p = two(p, year / 100 % 100);
+  p = two(p, year % 100);
+  *p++ = ' ';
+  p = two(p, tm.tm_hour);
+  *p++ = ':';
+  p = two(p, tm.tm_min);
+  *p++ = ':';
+  p = two(p, tm.tm_sec);
+
+  memcpy(p, " GMT", 4);
+}
+
+} // namespace
@@ -0,0 +1,52 @@
+#ifndef __DATE_H
+#define __DATE_H
+
+#include <time.h>
+#include <stddef.h>
+#include "view.h"
+
+namespace Http
+{
+
+/**
+ * The Date header field every response carries, formatted once per second
+ * instead of once per request. Each loop keeps its own and calls refresh()
+ * with the wall clock every iteration; only a new second costs a format.
+ *
+ * line() is "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n", ready to go out as
+ * is. It's rewritten in place on the next second, so queue a copy of it,
+ * not a reference.
+ */
+class Date
+{
+  public:
+    Date();
+    Date(Date &d) = delete;
+    Date(Date &&d) = delete;
+
+    // true when the second changed and the line was rewritten
+    bool refresh(time_t now);
+
+    View line() const { return View(m_line, LINE_SIZE); }
+
+    // just the HTTP-date, without the name and line end
+    View value() const { return View(m_line + NAME_SIZE, VALUE_SIZE); }
+
+    /**
+     * now as an IMF-fixdate (RFC 7231 7.1.1.1), always VALUE_SIZE
+     * characters at out.
+     */
+    static void format(time_t now, char *out);
+
+    static const size_t VALUE_SIZE = 29;
+  private:
+    static const size_t NAME_SIZE = 6;
+    static const size_t LINE_SIZE = NAME_SIZE + VALUE_SIZE + 2;
+
+    time_t m_second;
+    char m_line[LINE_SIZE];
+};
+
+} // namespace
+
+#endif /** __DATE_H **/
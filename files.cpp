@@ -0,0 +1,584 @@
+#include "files.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+
+namespace Http
+{
+
+namespace
+{
+
+struct Type
+{
+  const char *extension;
+  const char *type;
+};
+
+const Type TYPES[] = {
+  { "html",  "text/html; charset=UTF-8" },
+  { "htm",   "text/html; charset=UTF-8" },
+  { "css",   "text/css; charset=UTF-8" },
+  { "js",    "text/javascript; charset=UTF-8" },
+  { "mjs",   "text/javascript; charset=UTF-8" },
+  { "json",  "application/json" },
+  { "map",   "application/json" },
+  { "txt",   "text/plain; charset=UTF-8" },
+  { "xml",   "application/xml" },
+  { "svg",   "image/svg+xml" },
+  { "png",   "image/png" },
+  { "jpg",   "image/jpeg" },
+  { "jpeg",  "image/jpeg" },
+  { "gif",   "image/gif" },
+  { "webp",  "image/webp" },
+  { "ico",   "image/x-icon" },
+  { "wasm",  "application/wasm" },
+  { "woff",  "font/woff" },
+  { "woff2", "font/woff2" },
+  { "pdf",   "application/pdf" }
+};
+
+int hex(char c)
+{
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+
+  return -1;
+}
+
+// digits from p up to end, false for none or too many
+bool number(const char *&p, const char *end, uint64_t &value)
+{
+  const char *start = p;
+  value = 0;
+
+  while (p < end && *p >= '0' && *p <= '9')
+  {
+    if (p - start == 19) return false;
+
+    value = value * 10 + (*p++ - '0');
+  }
+
+  return p > start;
+}
+
+#if defined(__linux__)
+// anything that can change what an entry would hold
+const uint32_t WATCHED = IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE |
+  IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF;
+#endif
+
+// all of fd into content, false if it isn't size bytes after all
+bool slurp(int fd, uint64_t size, std::string &content)
+{
+  content.resize(size);
+
+  size_t done = 0;
+
+  while (done < size)
+  {
+    ssize_t n = pread(fd, &content[done], size - done, done);
+
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+
+    done += n;
+  }
+
+  return true;
+}
+
+}
+
+Files::File::File(int fd, const struct stat &st, const char *type,
+    uint64_t now) :
+  fd(fd),
+  size(st.st_size),
+  modified(st.st_mtime),
+  device(st.st_dev),
+  inode(st.st_ino),
+  type(type),
+  checked(now),
+  watched(false),
+  etag(),
+  last_modified(),
+  not_modified(),
+  hot(),
+  encodings(),
+  hot_bytes(0)
+{
+}
+
+Files::File::~File()
+{
+  ::close(fd);
+}
+
+const Files::File::Encoding *Files::File::choose(const Headers &headers) const
+{
+  if (encodings.empty() || !headers.has(Known::ACCEPT_ENCODING)) return NULL;
+
+  for (const Encoding &encoding : encodings)
+  {
+    if (headers.quality(Known::ACCEPT_ENCODING, encoding.name) > 0)
+    {
+      return &encoding;
+    }
+  }
+
+  return NULL;
+}
+
+bool Files::File::same(const struct stat &st) const
+{
+  return st.st_ino == inode && st.st_dev == device &&
+    (uint64_t) st.st_size == size && st.st_mtime == modified;
+}
+
+Files::Files(const char *root) :
+  m_root(::open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC)),
+  m_root_path(root),
+  m_path(),
+  m_cache(),
+  m_hot_bytes(0),
+  m_watch(-1),
+  m_watches(),
+  m_directories()
+{
+  if (m_root < 0)
+  {
+    ERR("document root %s: %s", root, strerror(errno));
+    return;
+  }
+
+#if defined(__linux__)
+  m_watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+  if (m_watch < 0)
+  {
+    WARN("inotify: %s, checking files every %" PRIu64 "ms instead",
+        strerror(errno), REVALIDATE_MS);
+  }
+#endif
+}
+
+Files::~Files()
+{
+  if (m_watch >= 0) ::close(m_watch);
+  if (m_root >= 0) ::close(m_root);
+}
+
+std::shared_ptr<const Files::File> Files::open(View path, uint64_t now)
+{
+  if (m_root < 0 || !resolve(path, m_path)) return nullptr;
+
+  auto found = m_cache.find(m_path);
+
+  if (found != m_cache.end())
+  {
+    File &cached = *found->second;
+
+    if (cached.watched || now - cached.checked < REVALIDATE_MS)
+    {
+      return found->second;
+    }
+
+    struct stat st;
+
+    if (fstatat(m_root, m_path.c_str(), &st, 0) == 0 && cached.same(st))
+    {
+      cached.checked = now;
+      return found->second;
+    }
+
+    // gone or replaced, whoever is still sending the old one keeps it
+    forget(found);
+  }
+
+  // watched before it's opened, so a change in between isn't missed
+  size_t slash = m_path.rfind('/');
+  bool watched = watching(slash == std::string::npos ? std::string() :
+      m_path.substr(0, slash + 1));
+
+  int fd = openat(m_root, m_path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+
+  if (fd < 0)
+  {
+    DEBUG("open %s: %s", m_path.c_str(), strerror(errno));
+    return nullptr;
+  }
+
+  struct stat st;
+
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+  {
+    ::close(fd);
+    return nullptr;
+  }
+
+  // cheaper than tracking recency, and anything in flight stays open
+  if (m_cache.size() >= FILES_MAX) forget();
+
+  std::shared_ptr<File> file(new File(fd, st, type(m_path.c_str()), now));
+  file->watched = watched;
+
+  std::string content;
+  bool hot = file->size <= HOT_MAX && m_hot_bytes + file->size <= HOT_TOTAL &&
+    slurp(fd, file->size, content);
+
+  validators(*file, hot ? &content : NULL);
+
+  m_hot_bytes += file->hot_bytes;
+
+  m_cache.emplace(m_path, file);
+
+  return file;
+}
+
+/**
+ * All the answers are serialized here, once per version of the file. The
+ * tag is made from inode, size and mtime whether or not the file is held
+ * in memory, which depends on what else this loop has cached; so every
+ * loop comes up with the same one and a client can revalidate against any
+ * of them. A compressed copy is the same tag with the coding added, which
+ * makes it a different representation to a cache.
+ */
+void Files::validators(File &file, const std::string *content)
+{
+  char tag[64];
+
+  snprintf(tag, sizeof(tag), "\"%" PRIx64 "-%" PRIx64 "-%" PRIx64 "\"",
+      (uint64_t) file.inode, file.size, (uint64_t) file.modified);
+
+  file.etag = tag;
+  Date::format(file.modified, file.last_modified);
+
+  std::string encoded[2];
+
+  if (content && Compressor::compressible(file.type))
+  {
+    View identity(content->data(), content->size());
+
+    if (Compressor::gzip(identity, encoded[0]) &&
+        Compressor::worth(identity.size(), encoded[0].size()))
+    {
+      file.encodings.push_back(File::Encoding{"gzip", "", nullptr, nullptr});
+    }
+
+    if (Compressor::brotli(identity, true, encoded[1], BROTLI_QUALITY) &&
+        Compressor::worth(identity.size(), encoded[1].size()))
+    {
+      file.encodings.push_back(File::Encoding{"br", "", nullptr, nullptr});
+    }
+
+    if (file.encodings.size() == 2 && encoded[1].size() < encoded[0].size())
+    {
+      std::swap(file.encodings[0], file.encodings[1]);
+    }
+  }
+
+  View etag(file.etag.data(), file.etag.size());
+  View modified = file.last_modified_value();
+
+  // only says so where there's a choice
+  View vary = file.encodings.empty() ? View() : View("Accept-Encoding");
+
+  file.not_modified.reset(new Canned(304, NULL, View(), {
+    { "ETag", etag },
+    { "Last-Modified", modified },
+    { "Vary", vary }
+  }));
+
+  if (!content) return;
+
+  file.hot.reset(new Canned(200, file.type,
+      View(content->data(), content->size()), {
+    { "ETag", etag },
+    { "Last-Modified", modified },
+    { "Accept-Ranges", "bytes" },
+    { "Vary", vary }
+  }));
+
+  file.hot_bytes = content->size();
+
+  for (File::Encoding &encoding : file.encodings)
+  {
+    const std::string &body = encoded[encoding.name[0] == 'g' ? 0 : 1];
+
+    encoding.etag = file.etag;
+    encoding.etag.insert(encoding.etag.size() - 1,
+        std::string("-") + encoding.name);
+
+    View tag(encoding.etag.data(), encoding.etag.size());
+    View name(encoding.name);
+
+    encoding.not_modified.reset(new Canned(304, NULL, View(), {
+      { "ETag", tag },
+      { "Last-Modified", modified },
+      { "Vary", vary }
+    }));
+
+    // ranges are only served from the file as it is
+    encoding.hot.reset(new Canned(200, file.type,
+        View(body.data(), body.size()), {
+      { "ETag", tag },
+      { "Last-Modified", modified },
+      { "Content-Encoding", name },
+      { "Vary", vary }
+    }));
+
+    file.hot_bytes += body.size();
+  }
+}
+
+bool Files::watching(const std::string &directory)
+{
+  if (m_watch < 0) return false;
+
+  if (m_directories.count(directory)) return true;
+
+#if defined(__linux__)
+  std::string path = m_root_path + "/" + directory;
+  int wd = inotify_add_watch(m_watch, path.c_str(), WATCHED);
+
+  if (wd < 0)
+  {
+    DEBUG("inotify watch %s: %s", path.c_str(), strerror(errno));
+    return false;
+  }
+
+  // the same directory by another name, a symlink; one of them is checked
+  if (m_watches.count(wd)) return false;
+
+  m_watches[wd] = directory;
+  m_directories[directory] = wd;
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+/**
+ * Anything that happens to a directory itself, or that the kernel lost
+ * track of, drops the whole cache; it's rare and the next requests fill it
+ * again.
+ */
+void Files::changed()
+{
+#if defined(__linux__)
+  char buffer[4096]
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+  for (;;)
+  {
+    ssize_t n = read(m_watch, buffer, sizeof(buffer));
+
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return;
+
+    for (char *p = buffer; p < buffer + n; )
+    {
+      const struct inotify_event *e = (const struct inotify_event *) p;
+      p += sizeof(struct inotify_event) + e->len;
+
+      if (e->mask & (IN_IGNORED | IN_MOVE_SELF | IN_DELETE_SELF))
+      {
+        auto watch = m_watches.find(e->wd);
+
+        if (watch != m_watches.end())
+        {
+          if (!(e->mask & IN_IGNORED)) inotify_rm_watch(m_watch, e->wd);
+
+          m_directories.erase(watch->second);
+          m_watches.erase(watch);
+        }
+
+        forget();
+        continue;
+      }
+
+      if (e->mask & (IN_Q_OVERFLOW | IN_ISDIR))
+      {
+        forget();
+        continue;
+      }
+
+      auto watch = m_watches.find(e->wd);
+
+      if (watch == m_watches.end() || e->len == 0) continue;
+
+      m_path = watch->second;
+      m_path += e->name;
+
+      auto found = m_cache.find(m_path);
+      if (found != m_cache.end()) forget(found);
+    }
+  }
+#endif
+}
+
+void Files::forget(Cache::iterator entry)
+{
+  m_hot_bytes -= entry->second->hot_bytes;
+
+  m_cache.erase(entry);
+}
+
+void Files::forget()
+{
+  m_cache.clear();
+  m_hot_bytes = 0;
+}
+
+Files::Range Files::range(View value, uint64_t size, uint64_t &offset,
+    uint64_t &length)
+{
+  const char *p = value.begin();
+  const char *end = value.end();
+
+  if (value.size() < 6 || !View(p, 6).iequals("bytes=", 6))
+  {
+    return Range::FULL;
+  }
+
+  p += 6;
+
+  uint64_t first = 0;
+  uint64_t last = 0;
+  bool suffix = p < end && *p == '-';
+
+  if (suffix)
+  {
+    p++;
+
+    if (!number(p, end, last) || p != end) return Range::FULL;
+
+    // the last n bytes, none of them is something we can't send
+    if (last == 0 || size == 0) return Range::UNSATISFIABLE;
+
+    first = last < size ? size - last : 0;
+    last = size - 1;
+  }
+  else
+  {
+    if (!number(p, end, first) || p == end || *p++ != '-')
+    {
+      return Range::FULL;
+    }
+
+    if (p == end)
+    {
+      last = size - 1;
+    }
+    else if (!number(p, end, last) || p != end || last < first)
+    {
+      return Range::FULL;
+    }
+
+    if (first >= size) return Range::UNSATISFIABLE;
+    if (last >= size) last = size - 1;
+  }
+
+  offset = first;
+  length = last - first + 1;
+
+  return Range::PARTIAL;
+}
+
+const char *Files::type(View path)
+{
+  const char *dot = NULL;
+
+  for (const char *p = path.end(); p > path.begin(); p--)
+  {
+    if (p[-1] == '/') break;
+
+    if (p[-1] == '.')
+    {
+      dot = p;
+      break;
+    }
+  }
+
+  if (dot)
+  {
+    View extension(dot, path.end() - dot);
+
+    for (const Type &t : TYPES)
+    {
+      if (extension.iequals(t.extension)) return t.type;
+    }
+  }
+
+  return "application/octet-stream";
+}
+
+bool Files::resolve(View path, std::string &out)
+{
+  out.clear();
+
+  const char *query = (const char *) memchr(path.data(), '?', path.size());
+  const char *end = query ? query : path.end();
+  const char *p = path.begin();
+
+  if (p == end || *p != '/') return false;
+
+  p++;
+
+  while (p < end)
+  {
+    char c = *p++;
+
+    if (c == '%')
+    {
+      int high = end - p >= 2 ? hex(p[0]) : -1;
+      int low = end - p >= 2 ? hex(p[1]) : -1;
+
+      if (high < 0 || low < 0) return false;
+
+      c = (char) (high << 4 | low);
+      p += 2;
+
+      if (c == '\0') return false;
+    }
+
+    out += c;
+  }
+
+  if (out.empty() || out.back() == '/') out += "index.html";
+
+  if (out.size() >= PATH_MAX) return false;
+
+  // no way out of the root, and no aliases for what's in it. an empty
+  // segment up front would make the path absolute.
+  size_t start = 0;
+
+  while (start <= out.size())
+  {
+    size_t slash = out.find('/', start);
+    if (slash == std::string::npos) slash = out.size();
+
+    size_t length = slash - start;
+
+    if (length == 0 ||
+        (length == 1 && out[start] == '.') ||
+        (length == 2 && out[start] == '.' && out[start + 1] == '.'))
+    {
+      return false;
+    }
+
+    start = slash + 1;
+  }
+
+  return true;
+}
+
+} // namespace
@@ -0,0 +1,196 @@
+#ifndef __FILES_H
+#define __FILES_H
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "log.h"
+#include "view.h"
+#include "date.h"
+#include "canned.h"
+#include "headers.h"
+#include "compress.h"
+
+namespace Http
+{
+
+/**
+ * A document root, served from open file descriptors that are kept
+ * between requests along with what fstat() said about them. A hit costs a
+ * hash lookup and no syscall; bodies go out from the fd with sendfile(),
+ * see Net::Output::file().
+ *
+ * Every entry carries an ETag and Last-Modified, and a 304 answer made up
+ * front. Small files, up to HOT_MAX and HOT_TOTAL between them, are also
+ * read into memory once and kept as a whole 200 answer, a Canned, so a
+ * hit is queued without building anything and goes out in one writev.
+ * Text among them is compressed then too, gzip and br where built with
+ * it, and each coding that saves enough is kept as answers of its own for
+ * File::choose() to pick from by Accept-Encoding.
+ *
+ * On linux, inotify watches the directories entries came from and drops
+ * an entry as soon as its file changes; watch() is the fd to poll and
+ * changed() reads what happened. Elsewhere, or where a watch can't be
+ * had, an entry is checked against the file system again once it's
+ * REVALIDATE_MS old. Changes to a symlink's target outside a watched
+ * directory are only seen that way too.
+ *
+ * Entries are shared: one dropped from the cache stays open, and in
+ * memory, until the last queue sending from it lets go.
+ *
+ * One per loop, nothing in here is locked.
+ */
+class Files
+{
+  public:
+    struct File
+    {
+      File(int fd, const struct stat &st, const char *type, uint64_t now);
+      File(File &f) = delete;
+      File(File &&f) = delete;
+      ~File();
+
+      bool same(const struct stat &st) const;
+
+      int fd;
+      uint64_t size;
+      time_t modified;
+      dev_t device;
+      ino_t inode;
+      const char *type;   // media type, see Files::type()
+      uint64_t checked;   // ms, the caller's clock
+      bool watched;       // inotify drops it on change, never checked
+
+      /**
+       * Strong validators. The tag is made from inode, size and mtime,
+       * the same for a file held in memory as for one sent from its fd.
+       */
+      std::string etag;
+      char last_modified[Date::VALUE_SIZE];
+
+      View last_modified_value() const
+      {
+        return View(last_modified, sizeof(last_modified));
+      }
+
+      // the 304, with the validators
+      std::unique_ptr<Canned> not_modified;
+
+      // the whole 200 for a small file, NULL otherwise
+      std::unique_ptr<Canned> hot;
+
+      // a compressed copy of a hot file, tagged and answered on its own
+      struct Encoding
+      {
+        const char *name;   // Content-Encoding
+        std::string etag;
+        std::unique_ptr<Canned> not_modified;
+        std::unique_ptr<Canned> hot;
+      };
+
+      // smallest first, all of them smaller than the file
+      std::vector<Encoding> encodings;
+
+      // bytes held in memory for it, compressed copies included
+      size_t hot_bytes;
+
+      /**
+       * The smallest encoding the client takes, NULL for the file as it
+       * is. That's also the answer to "identity;q=0", rather than a 406.
+       */
+      const Encoding *choose(const Headers &headers) const;
+    };
+
+    enum class Range
+    {
+      FULL,           // no usable Range field, send it all
+      PARTIAL,        // offset and length say what
+      UNSATISFIABLE   // starts past the end, 416
+    };
+
+    Files(const char *root);
+    Files(Files &f) = delete;
+    Files(Files &&f) = delete;
+    ~Files();
+
+    bool valid() const { return m_root >= 0; }
+
+    /**
+     * The regular file a request path names, NULL when there isn't one or
+     * the path tries to leave the root. A path ending in a slash means its
+     * index.html. now is the caller's clock in ms.
+     */
+    std::shared_ptr<const File> open(View path, uint64_t now);
+
+    // inotify fd to poll for reading, -1 without one
+    int watch() const { return m_watch; }
+
+    // drop the entries whose files changed, when watch() is readable
+    void changed();
+
+    size_t size() const { return m_cache.size(); }
+    size_t hot_bytes() const { return m_hot_bytes; }
+
+    /**
+     * A Range field (RFC 7233) against a file of size bytes. Only a single
+     * byte range is honoured, anything else is answered in full, which the
+     * RFC allows.
+     */
+    static Range range(View value, uint64_t size, uint64_t &offset,
+        uint64_t &length);
+
+    // media type by extension, application/octet-stream when unknown
+    static const char *type(View path);
+
+    /**
+     * The request path decoded into a path relative to the root, in out.
+     * False for anything that isn't absolute, has an empty, "." or ".."
+     * segment, decodes to a NUL, or doesn't fit.
+     */
+    static bool resolve(View path, std::string &out);
+
+    static const uint64_t REVALIDATE_MS = 1000;
+    static const size_t FILES_MAX = 4096;
+
+    // files this small are kept in memory, until there's this much of them
+    static const size_t HOT_MAX = 64 * 1024;
+    static const size_t HOT_TOTAL = 16 * 1024 * 1024;
+
+    // br for them is made on the loop, at less than its slowest
+    static const int BROTLI_QUALITY = 9;
+  private:
+    typedef std::unordered_map<std::string, std::shared_ptr<File>> Cache;
+
+    bool watching(const std::string &directory);
+
+    // content is what's kept in memory, NULL for a file sent from its fd
+    void validators(File &file, const std::string *content);
+
+    void forget(Cache::iterator entry);
+    void forget();
+
+    int m_root;
+    std::string m_root_path;
+
+    // reused for every lookup so a hit doesn't allocate
+    std::string m_path;
+
+    Cache m_cache;
+    size_t m_hot_bytes;
+
+    // inotify, and the directory each watch is on, relative with a slash
+    int m_watch;
+    std::unordered_map<int, std::string> m_watches;
+    std::unordered_map<std::string, int> m_directories;
+};
+
+} // namespace
+
+#endif /** __FILES_H **/
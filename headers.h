@@ -2,12 +2,31 @@
 #define __HEADERS_H
 
 #include <string>
-#include <algorithm>
-#include <map>
+#include <stdint.h>
+#include <time.h>
+#include "view.h"
+#include "known.h"
+#include "arena.h"
 
 namespace Http
 {
 
+/**
+ * A parsed request head. Nothing is copied out of the request: the path
+ * and every field are offset/length pairs into the buffer the parser ran
+ * over, turned into Views against whatever base() currently is. Offsets
+ * rather than pointers so the buffer can grow and move while a request is
+ * still arriving; the parser rebases on every call.
+ *
+ * Well-known fields (known.h) go straight into a fixed slot each, so
+ * checking Host or Content-Length is an array load. Everything else, and
+ * repeats of a known field after the first, go to a flat overflow list in
+ * arrival order. Names are kept as sent; lookups by string compare
+ * case-insensitively in place.
+ *
+ * The overflow list lives in the arena of whoever owns the Headers (the
+ * parser, one per connection), and is dropped along with it on reset.
+ */
 class Headers
 {
   public:
@@ -22,7 +41,17 @@ class Headers
       TRACE,
       OPTIONS,
       CONNECT,
-      PATCH
+      PATCH,
+
+      // extensions, webdav and cache purging
+      PURGE,
+      MKCOL,
+      COPY,
+      MOVE,
+      LOCK,
+      UNLOCK,
+      REPORT,
+      SEARCH
     };
 
     enum class Upgrade
@@ -46,29 +75,136 @@ class Headers
       }
     };
 
-    Headers() : 
-      m_upgrade(Upgrade::NONE),
+    // where some bytes sit in the request buffer
+    struct Span
+    {
+      uint32_t offset;
+      uint32_t length;
+    };
+
+    struct Field
+    {
+      View name;
+      View value;
+    };
+
+    Headers(Arena &arena) :
+      m_arena(arena),
+      m_base(""),
       m_method(Method::NONE),
-      m_path(),
+      m_path{0, 0},
       m_http_version{0, 0, 0},
-      m_fields()
+      m_present(0),
+      m_other(NULL),
+      m_other_count(0),
+      m_other_capacity(0)
     {}
 
-    std::string& get_field(std::string name) 
-    { 
-      return m_fields[name]; 
+    Headers(Headers &h) = delete;
+    Headers(Headers &&h) = delete;
+
+    /**
+     * Back to an empty head. The overflow list is forgotten rather than
+     * freed, it goes when the arena is reset.
+     */
+    void clear()
+    {
+      m_base = "";
+      m_method = Method::NONE;
+      m_path = Span{0, 0};
+      m_http_version = Version{0, 0, 0};
+      m_present = 0;
+      m_other = NULL;
+      m_other_count = 0;
+      m_other_capacity = 0;
+    }
+
+    const char *base() const { return m_base; }
+    void rebase(const char *base) { m_base = base; }
+
+    bool has(Known k) const { return m_present & bit(k); }
+
+    // empty when the request doesn't have it
+    View get(Known k) const
+    {
+      return has(k) ? view(m_known[(size_t) k].value) : View();
     }
-    
-    void set_field(std::string &name, const std::string &value) 
+
+    View get_field(const char *name) const
     {
-      // http://goo.gl/gEA0Tn
-      std::transform(name.begin(), name.end(), name.begin(), ::tolower);
-      m_fields[name] = value;
+      size_t length = strlen(name);
+      Known k = known_header(name, length);
+
+      if (k != Known::UNKNOWN) return get(k);
+
+      for (size_t i = 0; i < m_other_count; i++)
+      {
+        const Entry &e = m_other[i];
+        if (view(e.name).iequals(name, length)) return view(e.value);
+      }
+
+      return View();
     }
 
-    Upgrade get_upgrade() 
-    { 
-      if (m_fields["upgrade"] == "websocket")
+    bool has_field(const char *name) const
+    {
+      size_t length = strlen(name);
+      Known k = known_header(name, length);
+
+      if (k != Known::UNKNOWN) return has(k);
+
+      for (size_t i = 0; i < m_other_count; i++)
+      {
+        if (view(m_other[i].name).iequals(name, length)) return true;
+      }
+
+      return false;
+    }
+
+    void add_field(Known k, Span name, Span value)
+    {
+      if (k != Known::UNKNOWN && !has(k))
+      {
+        m_known[(size_t) k] = Entry{name, value};
+        m_present |= bit(k);
+        return;
+      }
+
+      if (m_other_count == m_other_capacity)
+      {
+        size_t capacity = m_other_capacity ? m_other_capacity * 2 :
+          OTHER_RESERVED;
+
+        m_other = (Entry *) m_arena.reallocate(m_other,
+            m_other_capacity * sizeof(Entry), capacity * sizeof(Entry),
+            alignof(Entry));
+        m_other_capacity = capacity;
+      }
+
+      m_other[m_other_count++] = Entry{name, value};
+    }
+
+    size_t field_count() const
+    {
+      return __builtin_popcount(m_present) + m_other_count;
+    }
+
+    /**
+     * Known fields in table order, then the rest as they arrived.
+     */
+    Field field(size_t i) const
+    {
+      for (uint32_t present = m_present; present; present &= present - 1)
+      {
+        if (i-- == 0) return field(m_known[__builtin_ctz(present)]);
+      }
+
+      return field(m_other[i]);
+    }
+
+    Upgrade get_upgrade() const
+    {
+      if (get(Known::UPGRADE).iequals("websocket"))
       {
         return Upgrade::WEBSOCKET;
       }
@@ -76,21 +212,418 @@ class Headers
       return Upgrade::NONE;
     }
 
-    Method get_method() { return m_method; }
+    /**
+     * Whether a comma separated field like Connection lists token, in any
+     * case, in any of the lines it was sent on.
+     */
+    bool has_token(Known k, const char *token) const
+    {
+      if (!has(k)) return false;
+
+      size_t length = strlen(token);
+
+      if (lists(view(m_known[(size_t) k].value), token, length)) return true;
+
+      const char *name = known_name(k);
+
+      for (size_t i = 0; i < m_other_count; i++)
+      {
+        const Entry &e = m_other[i];
+
+        if (view(e.name).iequals(name) && lists(view(e.value), token, length))
+        {
+          return true;
+        }
+      }
+
+      return false;
+    }
+
+    /**
+     * The weight a list like Accept-Encoding gives token (RFC 7231 5.3.1),
+     * in thousandths: what its own item says, what "*" says when it has
+     * none, 0 when neither is there or q=0 turns it down.
+     */
+    unsigned quality(Known k, const char *token) const
+    {
+      if (!has(k)) return 0;
+
+      size_t length = strlen(token);
+      int named = -1;
+      int any = -1;
+
+      weigh(view(m_known[(size_t) k].value), token, length, named, any);
+
+      const char *name = known_name(k);
+
+      for (size_t i = 0; i < m_other_count; i++)
+      {
+        const Entry &e = m_other[i];
+
+        if (view(e.name).iequals(name))
+        {
+          weigh(view(e.value), token, length, named, any);
+        }
+      }
+
+      if (named >= 0) return named;
+
+      return any > 0 ? any : 0;
+    }
+
+    /**
+     * Whether the client expects the connection to stay open after this
+     * request: HTTP/1.1 and up unless it says close, HTTP/1.0 only when it
+     * asks for keep-alive.
+     */
+    bool keep_alive() const
+    {
+      const Version &v = m_http_version;
+
+      if (v.major > 1 || (v.major == 1 && v.minor >= 1))
+      {
+        return !has_token(Known::CONNECTION, "close");
+      }
+
+      if (v.major == 1)
+      {
+        return has_token(Known::CONNECTION, "keep-alive") &&
+          !has_token(Known::CONNECTION, "close");
+      }
+
+      return false;
+    }
+
+    /**
+     * The body length Content-Length gives, 0 without one. False when it's
+     * not a plain decimal or a repeat of it disagrees; where this request
+     * ends, and so where the next one starts, is unknown then.
+     */
+    bool content_length(uint64_t &length) const
+    {
+      length = 0;
+
+      if (!has(Known::CONTENT_LENGTH)) return true;
+
+      View value = view(m_known[(size_t) Known::CONTENT_LENGTH].value);
+
+      // 19 digits always fit
+      if (value.empty() || value.size() > 19) return false;
+
+      for (char c : value)
+      {
+        if (c < '0' || c > '9') return false;
+        length = length * 10 + (c - '0');
+      }
+
+      const char *name = known_name(Known::CONTENT_LENGTH);
+
+      for (size_t i = 0; i < m_other_count; i++)
+      {
+        const Entry &e = m_other[i];
+
+        if (view(e.name).iequals(name) && view(e.value) != value) return false;
+      }
+
+      return true;
+    }
+
+    /**
+     * Whether a GET or HEAD for a representation with this entity tag and
+     * modification time can be answered 304 (RFC 7232 6): If-None-Match
+     * lists the tag or "*", by weak comparison, or, only when there's no
+     * If-None-Match, If-Modified-Since isn't earlier than modified.
+     */
+    bool not_modified(View etag, time_t modified) const
+    {
+      if (has(Known::IF_NONE_MATCH))
+      {
+        if (tags(view(m_known[(size_t) Known::IF_NONE_MATCH].value), etag))
+        {
+          return true;
+        }
+
+        const char *name = known_name(Known::IF_NONE_MATCH);
+
+        for (size_t i = 0; i < m_other_count; i++)
+        {
+          const Entry &e = m_other[i];
+
+          if (view(e.name).iequals(name) && tags(view(e.value), etag))
+          {
+            return true;
+          }
+        }
+
+        return false;
+      }
+
+      time_t since;
+
+      return has(Known::IF_MODIFIED_SINCE) &&
+        http_date(get(Known::IF_MODIFIED_SINCE), since) && modified <= since;
+    }
+
+    /**
+     * Whether a Range field still applies (RFC 7233 3.2): there's no
+     * If-Range, or it names this entity tag exactly, or this modification
+     * time. Otherwise the whole representation is what the client wants.
+     */
+    bool if_range(View etag, time_t modified) const
+    {
+      if (!has(Known::IF_RANGE)) return true;
+
+      View value = get(Known::IF_RANGE);
+
+      if (!value.empty() && value[0] == '"') return value == etag;
+
+      time_t date;
+
+      return http_date(value, date) && date == modified;
+    }
+
+    /**
+     * An IMF-fixdate, "Sun, 06 Nov 1994 08:49:37 GMT", as seconds since
+     * the epoch. The obsolete RFC 850 and asctime forms aren't accepted.
+     */
+    static bool http_date(View value, time_t &t)
+    {
+      static const char MONTHS[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+
+      if (value.size() != 29 || value[3] != ',' || value[4] != ' ' ||
+          value[7] != ' ' || value[11] != ' ' || value[16] != ' ' ||
+          value[19] != ':' || value[22] != ':' ||
+          !View(value.data() + 25, 4).equals(" GMT", 4))
+      {
+        return false;
+      }
+
+      int month = 0;
+
+      while (month < 12 && memcmp(MONTHS + month * 3, value.data() + 8, 3))
+      {
+        month++;
+      }
+
+      int day, year, hour, minute, second;
+
+      if (month == 12 ||
+          !digits(value.data() + 5, 2, day) ||
+          !digits(value.data() + 12, 4, year) ||
+          !digits(value.data() + 17, 2, hour) ||
+          !digits(value.data() + 20, 2, minute) ||
+          !digits(value.data() + 23, 2, second))
+      {
+        return false;
+      }
+
+      // days from civil (Howard Hinnant), March based years, month from 0
+      int y = year - (month < 2);
+      int era = y / 400;
+      int yoe = y - era * 400;
+      int mp = (month + 10) % 12;
+      int doy = (153 * mp + 2) / 5 + day - 1;
+      int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+      int64_t days = (int64_t) era * 146097 + doe - 719468;
+
+      t = (time_t) (days * 86400 + hour * 3600 + minute * 60 + second);
+
+      return true;
+    }
+
+    Method get_method() const { return m_method; }
     void set_method(Method method) { m_method = method; }
 
-    Version get_http_version() { return m_http_version; }
+    Version get_http_version() const { return m_http_version; }
     void set_http_version(Version v) { m_http_version = v; }
 
-    std::string& get_path() { return m_path; }
-    void set_path(std::string &path) { m_path = path; }
+    View get_path() const { return view(m_path); }
+    void set_path(Span path) { m_path = path; }
+
+    // room for this many unknown fields on the first one, doubling after
+    static const size_t OTHER_RESERVED = 8;
 
   private:
+    struct Entry
+    {
+      Span name;
+      Span value;
+    };
+
+    static_assert((size_t) Known::COUNT <= 32, "m_present is 32 bits");
+
+    static uint32_t bit(Known k) { return (uint32_t) 1 << (size_t) k; }
+
+    View view(Span s) const { return View(m_base + s.offset, s.length); }
+
+    // token is one of the comma separated, whitespace padded items in list
+    static bool lists(View list, const char *token, size_t length)
+    {
+      const char *p = list.begin();
+      const char *end = list.end();
+
+      while (p < end)
+      {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+
+        const char *item = p;
+
+        while (p < end && *p != ',') p++;
+
+        const char *item_end = p;
+
+        while (item_end > item && (item_end[-1] == ' ' || item_end[-1] == '\t'))
+        {
+          item_end--;
+        }
+
+        if (View(item, item_end - item).iequals(token, length)) return true;
+      }
+
+      return false;
+    }
+
+    /**
+     * The weights of token and of "*" in list, into named and any when
+     * listed, the highest if more than once. A weight that doesn't parse
+     * counts as 1.
+     */
+    static void weigh(View list, const char *token, size_t length,
+        int &named, int &any)
+    {
+      const char *p = list.begin();
+      const char *end = list.end();
+
+      while (p < end)
+      {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+
+        const char *item = p;
+
+        while (p < end && *p != ',' && *p != ';' && *p != ' ' && *p != '\t')
+        {
+          p++;
+        }
+
+        View coding(item, p - item);
+        int q = 1000;
+
+        // parameters, only q is looked at
+        while (p < end && *p != ',')
+        {
+          while (p < end && (*p == ' ' || *p == '\t' || *p == ';')) p++;
+
+          if (end - p >= 2 && (p[0] == 'q' || p[0] == 'Q') && p[1] == '=')
+          {
+            q = weight(p + 2, end);
+          }
+
+          while (p < end && *p != ';' && *p != ',') p++;
+        }
+
+        if (coding.empty()) continue;
+
+        if (coding.iequals(token, length))
+        {
+          if (q > named) named = q;
+        }
+        else if (coding == "*")
+        {
+          if (q > any) any = q;
+        }
+      }
+    }
+
+    // a qvalue, "0", "0.5", "1.000", in thousandths
+    static int weight(const char *p, const char *end)
+    {
+      if (p == end || (*p != '0' && *p != '1')) return 1000;
+
+      int q = (*p++ - '0') * 1000;
+
+      if (p < end && *p == '.')
+      {
+        p++;
+
+        for (int scale = 100; scale > 0 && p < end && *p >= '0' && *p <= '9';
+            scale /= 10)
+        {
+          q += (*p++ - '0') * scale;
+        }
+      }
+
+      return q > 1000 ? 1000 : q;
+    }
+
+    /**
+     * etag is one of the entity tags in an If-None-Match list, or the list
+     * is "*". Weak comparison: a W/ prefix on either side doesn't count.
+     */
+    static bool tags(View list, View etag)
+    {
+      if (etag.size() > 2 && etag[0] == 'W' && etag[1] == '/')
+      {
+        etag = View(etag.data() + 2, etag.size() - 2);
+      }
+
+      const char *p = list.begin();
+      const char *end = list.end();
+
+      while (p < end)
+      {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == ',')) p++;
+
+        if (p < end && *p == '*') return true;
+
+        if (end - p > 2 && p[0] == 'W' && p[1] == '/') p += 2;
+
+        // an opaque tag is quoted and has no quotes inside
+        if (p == end || *p != '"') return false;
+
+        const char *close = (const char *) memchr(p + 1, '"', end - p - 1);
+
+        if (close == NULL) return false;
+
+        if (View(p, close + 1 - p) == etag) return true;
+
+        p = close + 1;
+      }
+
+      return false;
+    }
+
+    static bool digits(const char *p, int count, int &value)
+    {
+      value = 0;
+
+      for (int i = 0; i < count; i++)
+      {
+        if (p[i] < '0' || p[i] > '9') return false;
+        value = value * 10 + (p[i] - '0');
+      }
+
+      return true;
+    }
+
+    Field field(const Entry &e) const
+    {
+      return Field{view(e.name), view(e.value)};
+    }
+
+    Arena &m_arena;
+
+    const char *m_base;
     Method m_method;
-    std::string m_path;
-    Upgrade m_upgrade;
+    Span m_path;
     Version m_http_version;
-    std::map<std::string, std::string> m_fields;
+
+    // a slot is only read when its bit in m_present is set
+    uint32_t m_present;
+    Entry m_known[(size_t) Known::COUNT];
+
+    Entry *m_other;
+    size_t m_other_count;
+    size_t m_other_capacity;
 };
 
 
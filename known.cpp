@@ -0,0 +1,134 @@
+#include "known.h"
+#include "view.h"
+
+namespace Http
+{
+
+namespace
+{
+
+const size_t COUNT = (size_t) Known::COUNT;
+
+// in Known order
+constexpr const char *NAMES[] = {
+  "host",
+  "connection",
+  "content-length",
+  "content-type",
+  "transfer-encoding",
+  "upgrade",
+  "cookie",
+  "accept",
+  "accept-encoding",
+  "accept-language",
+  "user-agent",
+  "referer",
+  "authorization",
+  "cache-control",
+  "pragma",
+  "if-none-match",
+  "if-modified-since",
+  "range",
+  "if-range",
+  "expect",
+  "origin",
+  "keep-alive",
+  "te",
+  "x-forwarded-for",
+  "sec-websocket-key",
+  "sec-websocket-version",
+  "sec-websocket-extensions",
+  "sec-websocket-protocol"
+};
+
+static_assert(sizeof(NAMES) / sizeof(NAMES[0]) == COUNT,
+    "every Known needs a name");
+
+/**
+ * Table size and multiplier. The multiplier was found by search so that no
+ * two names land in the same slot; the static_assert below rechecks that
+ * on every build, pick a new one if a name added to the table breaks it.
+ */
+const unsigned SLOT_BITS = 6;
+const uint32_t SEED = 0x4c3fd;
+
+// | 0x20 lower-cases letters, every name starts and ends with one
+constexpr uint32_t key(size_t length, char first, char last)
+{
+  return ((uint32_t) length << 16) |
+    ((uint32_t) ((first | 0x20) & 0xff) << 8) |
+    (uint32_t) ((last | 0x20) & 0xff);
+}
+
+constexpr unsigned slot(uint32_t key)
+{
+  return (uint32_t) (key * SEED) >> (32 - SLOT_BITS);
+}
+
+constexpr size_t length(const char *s)
+{
+  return *s ? 1 + length(s + 1) : 0;
+}
+
+constexpr unsigned name_slot(size_t i)
+{
+  return slot(key(length(NAMES[i]), NAMES[i][0],
+        NAMES[i][length(NAMES[i]) - 1]));
+}
+
+constexpr bool distinct(size_t i, size_t j)
+{
+  return j == COUNT || (name_slot(i) != name_slot(j) && distinct(i, j + 1));
+}
+
+constexpr bool perfect(size_t i = 0)
+{
+  return i == COUNT || (distinct(i, i + 1) && perfect(i + 1));
+}
+
+static_assert(perfect(), "known header names collide, pick another SEED");
+
+// index of the name that hashes to s, COUNT for an empty slot
+constexpr uint8_t find(unsigned s, size_t i = 0)
+{
+  return i == COUNT ? COUNT : name_slot(i) == s ? i : find(s, i + 1);
+}
+
+#define FIND8(n) find(n), find(n + 1), find(n + 2), find(n + 3), \
+  find(n + 4), find(n + 5), find(n + 6), find(n + 7)
+
+static_assert(SLOT_BITS == 6, "SLOTS is spelled out for 64 entries");
+
+constexpr uint8_t SLOTS[1 << SLOT_BITS] = {
+  FIND8(0), FIND8(8), FIND8(16), FIND8(24),
+  FIND8(32), FIND8(40), FIND8(48), FIND8(56)
+};
+
+#undef FIND8
+
+}
+
+Known known_header(const char *name, size_t length)
+{
+  if (length == 0) return Known::UNKNOWN;
+
+  uint8_t i = SLOTS[slot(key(length, name[0], name[length - 1]))];
+
+  if (i == COUNT) return Known::UNKNOWN;
+
+  // a shorter table name stops the compare at its terminator, a longer
+  // one is caught by the terminator check
+  if (!View(name, length).iequals(NAMES[i], length) || NAMES[i][length])
+  {
+    return Known::UNKNOWN;
+  }
+
+  return (Known) i;
+}
+
+const char *known_name(Known known)
+{
+  return known < Known::COUNT ? NAMES[(size_t) known] : "";
+}
+
+} // namespace
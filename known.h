@@ -0,0 +1,61 @@
+#ifndef __KNOWN_H
+#define __KNOWN_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace Http
+{
+
+/**
+ * Header names common enough to get a fixed slot in Headers. The order is
+ * also the order Headers iterates them in.
+ */
+enum class Known : uint8_t
+{
+  HOST,
+  CONNECTION,
+  CONTENT_LENGTH,
+  CONTENT_TYPE,
+  TRANSFER_ENCODING,
+  UPGRADE,
+  COOKIE,
+  ACCEPT,
+  ACCEPT_ENCODING,
+  ACCEPT_LANGUAGE,
+  USER_AGENT,
+  REFERER,
+  AUTHORIZATION,
+  CACHE_CONTROL,
+  PRAGMA,
+  IF_NONE_MATCH,
+  IF_MODIFIED_SINCE,
+  RANGE,
+  IF_RANGE,
+  EXPECT,
+  ORIGIN,
+  KEEP_ALIVE,
+  TE,
+  X_FORWARDED_FOR,
+  SEC_WEBSOCKET_KEY,
+  SEC_WEBSOCKET_VERSION,
+  SEC_WEBSOCKET_EXTENSIONS,
+  SEC_WEBSOCKET_PROTOCOL,
+
+  COUNT,
+  UNKNOWN = COUNT
+};
+
+/**
+ * Case-insensitive name to Known, UNKNOWN for anything not in the table.
+ * One multiplicative hash of the length and the first and last byte picks
+ * the only possible candidate, a single compare confirms it.
+ */
+Known known_header(const char *name, size_t length);
+
+// lower case, as the table has it
+const char *known_name(Known known);
+
+}  // namespace
+
+#endif /** __KNOWN_H **/
@@ -1,6 +1,46 @@
+#include <stdlib.h>
+#include <string.h>
 #include "server.h"
 
-int main() {
+#ifdef EMBEDDED
+// written by tools/embed, see make embedded
+namespace Http { extern const Bundle embedded; }
+#endif
+
+int main(int argc, char **argv) {
+  // loop threads, 0 for one per core
+  unsigned threads = argc > 1 ? atoi(argv[1]) : 1;
+
+  // "acceptor" for one accepting thread feeding the workers
+  Http::Server::Dispatch dispatch = argc > 2 && !strcmp(argv[2], "acceptor")
+    ? Http::Server::Dispatch::ACCEPTOR
+    : Http::Server::Dispatch::REUSE_PORT;
+
+  // requests per connection (0 for no limit) and idle timeout in ms
+  unsigned max_requests = argc > 3 ? atoi(argv[3]) :
+    Http::Worker::KEEP_ALIVE_REQUESTS;
+  uint64_t idle_ms = argc > 4 ? atoll(argv[4]) :
+    Http::Worker::KEEP_ALIVE_IDLE_MS;
+
+  // a document root to serve files from, the default page otherwise
+  const char *root = argc > 5 ? argv[5] : NULL;
+
+  // gzip text files from it up to this size on the fly, 0 not to
+  uint64_t deflate_max = argc > 6 ? atoll(argv[6]) : 0;
+
+  // bytes all connections may hold in buffers, 0 for no limit
+  size_t budget = argc > 7 ? atoll(argv[7]) : 0;
+
   Http::Server s;
-  s.run();
+  s.setKeepAlive(max_requests, idle_ms);
+  s.serve("/health", 200, "text/plain", "OK\r\n");
+
+#ifdef EMBEDDED
+  s.setBundle(&Http::embedded);
+#endif
+
+  if (root) s.setRoot(root);
+  s.setDeflate(deflate_max);
+  s.setMemoryBudget(budget);
+  s.run(threads, dispatch);
 }
@@ -0,0 +1,69 @@
+#include "notifier.h"
+
+namespace Net
+{
+
+Notifier::Notifier() :
+  m_pending(false)
+{
+#if defined(__linux__)
+  m_read_fd = m_write_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+  if (m_read_fd < 0)
+  {
+    ERR("eventfd: %s", strerror(errno));
+  }
+#else
+  int fds[2];
+
+  if (pipe(fds) < 0)
+  {
+    ERR("pipe: %s", strerror(errno));
+    return;
+  }
+
+  m_read_fd = fds[0];
+  m_write_fd = fds[1];
+
+  fcntl(m_read_fd, F_SETFL, O_NONBLOCK);
+  fcntl(m_write_fd, F_SETFL, O_NONBLOCK);
+#endif
+}
+
+void Notifier::notify()
+{
+  // somebody already woke the loop and it hasn't drained yet
+  if (m_pending.exchange(true)) return;
+
+#if defined(__linux__)
+  uint64_t one = 1;
+  ssize_t err = write(m_write_fd, &one, sizeof(one));
+#else
+  char one = 1;
+  ssize_t err = write(m_write_fd, &one, sizeof(one));
+#endif
+
+  if (err < 0 && errno != EAGAIN)
+  {
+    ERR("notify: %s", strerror(errno));
+  }
+}
+
+void Notifier::drain()
+{
+  char buf[64];
+  while (read(m_read_fd, buf, sizeof(buf)) > 0);
+
+  // clear the flag only once the fd is empty, otherwise a notify() landing
+  // in between leaves it set with nothing left to wake us; the caller checks
+  // its queue after this, which covers anything that skipped the write
+  m_pending.store(false);
+}
+
+Notifier::~Notifier()
+{
+  if (m_read_fd >= 0) ::close(m_read_fd);
+  if (m_write_fd >= 0 && m_write_fd != m_read_fd) ::close(m_write_fd);
+}
+
+}
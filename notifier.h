@@ -0,0 +1,50 @@
+#ifndef __NOTIFIER_H
+#define __NOTIFIER_H
+
+#include <atomic>
+#include <string.h>     // strerror
+#include <errno.h>      // errno, set by syscalls
+#include <fcntl.h>      // fcntl, O_NONBLOCK
+#include <unistd.h>     // read, write, pipe, close
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+#include "log.h"
+
+namespace Net
+{
+
+/**
+ * Wakes a loop blocked in Poller::wait from another thread. Register fd()
+ * for READ with the loop's poller; notify() makes it readable, drain() on
+ * the loop side resets it.
+ *
+ * eventfd on linux, a nonblocking pipe elsewhere. A flag in front of the fd
+ * means only the first notify() between two drains costs a syscall.
+ */
+class Notifier
+{
+  public:
+    Notifier();
+    Notifier(Notifier &) = delete;
+    Notifier(Notifier &&) = delete;
+    ~Notifier();
+
+    void notify();
+
+    // call before looking at whatever was handed over, not after
+    void drain();
+
+    int fd() { return m_read_fd; }
+  private:
+    int m_read_fd  = -1;
+    int m_write_fd = -1;
+
+    std::atomic<bool> m_pending;
+}; // class
+
+}  // namespace
+
+#endif // __NOTIFIER_H
@@ -0,0 +1,285 @@
+#include "output.h"
+
+#if defined(__linux__)
+#include <sys/sendfile.h>
+#endif
+
+namespace Net
+{
+
+Output::Output() :
+  m_segments(),
+  m_storage(),
+  m_first(0),
+  m_sent(0),
+  m_size(0)
+{
+}
+
+void Output::append(const char *data, size_t size)
+{
+  if (size == 0) return;
+
+  if (m_first > 0 || m_sent > 0) compact();
+
+  // owned bytes are stored in queue order, the last owned segment ends
+  // where the storage does
+  if (!m_segments.empty() && m_segments.back().owned())
+  {
+    m_segments.back().size += size;
+  }
+  else
+  {
+    m_segments.push_back(Segment{NULL, m_storage.size(), size, -1, nullptr,
+        Buffer()});
+  }
+
+  m_storage.insert(m_storage.end(), data, data + size);
+  m_size += size;
+}
+
+void Output::reference(const char *data, size_t size,
+    std::shared_ptr<const void> keep)
+{
+  if (size == 0) return;
+
+  m_segments.push_back(Segment{data, 0, size, -1, std::move(keep),
+      Buffer()});
+  m_size += size;
+}
+
+void Output::reference(const Slice &slice)
+{
+  if (slice.empty()) return;
+
+  m_segments.push_back(Segment{slice.data(), 0, slice.size(), -1, nullptr,
+      slice.buffer()});
+  m_size += slice.size();
+}
+
+void Output::reference(const Chain &chain)
+{
+  for (const Slice &slice : chain.slices()) reference(slice);
+}
+
+void Output::file(int fd, off_t offset, size_t size,
+    std::shared_ptr<const void> keep)
+{
+  if (size == 0) return;
+
+  m_segments.push_back(Segment{NULL, (size_t) offset, size, fd,
+      std::move(keep), Buffer()});
+  m_size += size;
+}
+
+ssize_t Output::flush(int fd)
+{
+  ssize_t total = 0;
+
+  while (m_size > 0)
+  {
+    const Segment &head = m_segments[m_first];
+
+    size_t wanted = 0;
+    ssize_t written = head.fd >= 0
+      ? send_file(fd, head, wanted)
+      : write(fd, wanted);
+
+    if (written < 0)
+    {
+      if (errno == EINTR) continue;
+      if (errno == EIO) return -1;
+
+      return total > 0 ? total : -1;
+    }
+
+    total += written;
+    consume(written);
+
+    // the socket buffer is full, wait for it to drain
+    if ((size_t) written < wanted) break;
+  }
+
+  return total;
+}
+
+/**
+ * Memory segments from the front, up to IOV_BATCH of them or the next
+ * file. When a file follows, MSG_MORE holds a short head back so it can
+ * share a packet with the start of the file, where the peer is a socket.
+ */
+ssize_t Output::write(int fd, size_t &wanted)
+{
+  struct iovec iov[IOV_BATCH];
+  int count = 0;
+  bool more = false;
+
+  for (size_t i = m_first; i < m_segments.size() && count < IOV_BATCH; i++)
+  {
+    const Segment &s = m_segments[i];
+
+    if (s.fd >= 0)
+    {
+      more = true;
+      break;
+    }
+
+    const char *data = s.data ? s.data : m_storage.data() + s.offset;
+    size_t skip = i == m_first ? m_sent : 0;
+
+    iov[count].iov_base = (void *) (data + skip);
+    iov[count].iov_len = s.size - skip;
+
+    wanted += s.size - skip;
+    count++;
+  }
+
+#if defined(MSG_MORE)
+  if (more)
+  {
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+
+    ssize_t written = sendmsg(fd, &msg, MSG_MORE);
+
+    if (written >= 0 || errno != ENOTSOCK) return written;
+  }
+#else
+  (void) more;
+#endif
+
+  return writev(fd, iov, count);
+}
+
+ssize_t Output::send_file(int fd, const Segment &s, size_t &wanted)
+{
+  off_t offset = s.offset + m_sent;
+  size_t count = s.size - m_sent;
+
+  if (count > FILE_CHUNK) count = FILE_CHUNK;
+
+  wanted = count;
+
+#if defined(__linux__)
+  ssize_t written = sendfile(fd, s.fd, &offset, count);
+#elif defined(__APPLE__)
+  off_t length = count;
+  ssize_t written = sendfile(s.fd, fd, offset, &length, NULL, 0);
+
+  // a partial send still fails with EAGAIN, length says how much went
+  if (written == 0 || length > 0) written = length;
+#else
+  char buffer[16384];
+
+  if (count > sizeof(buffer)) count = wanted = sizeof(buffer);
+
+  ssize_t written = pread(s.fd, buffer, count, offset);
+
+  if (written > 0) written = ::write(fd, buffer, written);
+#endif
+
+  // end of file before the end of the range, it shrank under us
+  if (written == 0)
+  {
+    errno = EIO;
+    return -1;
+  }
+
+  return written;
+}
+
+void Output::consume(size_t bytes)
+{
+  m_size -= bytes;
+
+  if (m_size == 0)
+  {
+    clear();
+    return;
+  }
+
+  while (bytes > 0)
+  {
+    size_t left = m_segments[m_first].size - m_sent;
+
+    if (bytes < left)
+    {
+      m_sent += bytes;
+      return;
+    }
+
+    bytes -= left;
+    m_segments[m_first].keep.reset();
+    m_segments[m_first].buffer.reset();
+    m_first++;
+    m_sent = 0;
+  }
+}
+
+/**
+ * Trim the written part off the first unwritten segment, then drop the
+ * written copies in front of it when they're over half the storage, and
+ * the written segments when they're over half the list. Either move costs
+ * no more than the appends that filled that half.
+ */
+void Output::compact()
+{
+  Segment &head = m_segments[m_first];
+
+  if (head.data) head.data += m_sent;
+  else           head.offset += m_sent;
+
+  head.size -= m_sent;
+  m_sent = 0;
+
+  size_t dead = m_storage.size();
+
+  for (size_t i = m_first; i < m_segments.size(); i++)
+  {
+    if (m_segments[i].owned())
+    {
+      dead = m_segments[i].offset;
+      break;
+    }
+  }
+
+  if (dead * 2 >= m_storage.size() && dead >= COMPACT_MIN)
+  {
+    m_storage.erase(m_storage.begin(), m_storage.begin() + dead);
+
+    for (size_t i = m_first; i < m_segments.size(); i++)
+    {
+      if (m_segments[i].owned()) m_segments[i].offset -= dead;
+    }
+  }
+
+  if (m_first * 2 >= m_segments.size())
+  {
+    m_segments.erase(m_segments.begin(), m_segments.begin() + m_first);
+    m_first = 0;
+  }
+}
+
+void Output::clear()
+{
+  m_segments.clear();
+  m_storage.clear();
+
+  m_first = 0;
+  m_sent = 0;
+  m_size = 0;
+}
+
+void Output::release()
+{
+  std::vector<Segment>().swap(m_segments);
+  std::vector<char>().swap(m_storage);
+
+  m_first = 0;
+  m_sent = 0;
+  m_size = 0;
+}
+
+}  // namespace
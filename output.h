@@ -0,0 +1,134 @@
+#ifndef __OUTPUT_H
+#define __OUTPUT_H
+
+#include <memory>
+#include <vector>
+#include <string.h>     // strlen, strerror
+#include <errno.h>      // errno, set by syscalls
+#include <unistd.h>     // pread, write
+#include <sys/types.h>  // ssize_t, off_t
+#include <sys/uio.h>    // writev, struct iovec
+#include <sys/socket.h> // sendmsg, MSG_MORE
+
+#include "log.h"
+#include "buffer.h"
+
+namespace Net
+{
+
+/**
+ * Bytes waiting to go out on one connection, in order, as a list of
+ * segments. append() copies into storage the queue owns, running on from
+ * the previous copy, so a batch of small responses becomes one segment.
+ * reference() queues memory that outlives the queue, a static response
+ * say, or pooled buffers it holds a reference to, without copying it.
+ * file() queues a range of an open file, which
+ * goes out with sendfile() and never passes through user space.
+ *
+ * flush() hands up to IOV_BATCH segments per writev to the socket until it
+ * stops taking them. A short write leaves the rest queued from exactly
+ * where it stopped, the next flush() picks up there. Written copies are
+ * dropped from the front once they're most of the storage, so a queue
+ * that never quite empties doesn't grow without bound either.
+ */
+class Output
+{
+  public:
+    Output();
+    Output(Output &o) = delete;
+    Output(Output &&o) = delete;
+
+    void append(const char *data, size_t size);
+    void append(const char *s) { append(s, strlen(s)); }
+
+    /**
+     * data has to stay put until it's flushed or cleared. keep is held that
+     * long, for memory owned by something that may be dropped meanwhile.
+     */
+    void reference(const char *data, size_t size,
+        std::shared_ptr<const void> keep = nullptr);
+
+    // the slice's block is held until it's written or cleared
+    void reference(const Slice &slice);
+    void reference(const Chain &chain);
+
+    /**
+     * size bytes of fd from offset. keep is held until they're written or
+     * cleared, whoever owns the fd can use it to keep it open that long.
+     */
+    void file(int fd, off_t offset, size_t size,
+        std::shared_ptr<const void> keep = nullptr);
+
+    // bytes queued and not yet written
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    // bytes held for copies, written ones included until they're compacted,
+    // and for the list of what's queued
+    size_t reserved() const
+    {
+      return m_storage.capacity() +
+        m_segments.capacity() * sizeof(Segment);
+    }
+
+    /**
+     * Bytes written, -1 with errno set when the socket took none. A file
+     * that turns out shorter than what was queued from it fails with EIO,
+     * the peer was promised bytes that can't be sent any more.
+     */
+    ssize_t flush(int fd);
+
+    // drop everything queued, the storage is kept
+    void clear();
+
+    // drop everything queued, and the storage with it
+    void release();
+
+    static const int IOV_BATCH = 64;
+
+    // most of a file handed to one sendfile()
+    static const size_t FILE_CHUNK = 1 << 30;
+
+    // written copies smaller than this aren't worth moving the rest for
+    static const size_t COMPACT_MIN = 4096;
+
+    /**
+     * Backpressure thresholds for owners of a queue: stop reading from a
+     * peer once this much is waiting for it, start again when it's down to
+     * the low mark. The gap keeps a slow reader from flapping between the
+     * two on every write.
+     */
+    static const size_t HIGH_WATERMARK = 256 * 1024;
+    static const size_t LOW_WATERMARK = 64 * 1024;
+  private:
+    struct Segment
+    {
+      const char *data;   // NULL for bytes in m_storage or a file
+      size_t offset;      // into m_storage, or the file
+      size_t size;
+      int fd;             // -1 unless the bytes are in a file
+      std::shared_ptr<const void> keep;
+      Buffer buffer;      // pooled block holding data, if that's where it is
+
+      bool owned() const { return data == NULL && fd < 0; }
+    };
+
+    // one syscall's worth from the front, wanted says how much was asked
+    ssize_t write(int fd, size_t &wanted);
+    ssize_t send_file(int fd, const Segment &s, size_t &wanted);
+    void consume(size_t bytes);
+    void compact();
+
+    std::vector<Segment> m_segments;
+    std::vector<char> m_storage;
+
+    // segments before m_first are written, and m_sent bytes of that one
+    size_t m_first;
+    size_t m_sent;
+
+    size_t m_size;
+}; // class
+
+}  // namespace
+
+#endif // __OUTPUT_H
@@ -3,297 +3,425 @@
 namespace Http
 {
 
+Parser::Parser() :
+  m_state(State::METHOD),
+  m_buffer(NULL),
+  m_buffer_size(0),
+  m_index(0),
+  m_scan(0),
+  m_arena(),
+  m_headers(m_arena)
+{
+}
+
 Parser::Parser(const char *buffer, size_t size) :
-  m_index(),
+  m_state(State::METHOD),
   m_buffer(buffer),
   m_buffer_size(size),
-  m_state(State::METHOD)
+  m_index(0),
+  m_scan(0),
+  m_arena(),
+  m_headers(m_arena)
 {
-  m_headers = std::make_shared<Headers>();
+  m_headers.rebase(buffer);
 }
 
 Parser::State Parser::parse()
 {
-  DEBUG("parsing started for buffer len: %zu", m_buffer_size);
-  
-  while (m_index < m_buffer_size)
+  parse(m_buffer, m_buffer_size);
+
+  return finish();
+}
+
+Parser::State Parser::parse(const char *buffer, size_t size)
+{
+  DEBUG("parsing resumed at %zu for buffer len: %zu", m_scan, size);
+
+  m_buffer = buffer;
+  m_buffer_size = size;
+
+  // everything already parsed is an offset, it follows the buffer
+  m_headers.rebase(buffer);
+
+  while (m_state != State::DONE && m_state != State::BROKEN)
   {
-    switch (m_state)
+    const char *newline = find_line_end();
+
+    // whether or not the rest has arrived, it's already too long: a line
+    // that isn't finished needs at least one byte more than it has
+    if ((newline ? (size_t) (newline - m_buffer) : m_scan) >= HEAD_MAX)
     {
-      case State::METHOD:  parse_method();  break;
-      case State::PATH:    parse_path();    break;
-      case State::VERSION: parse_version(); break;
-      case State::FIELD:   parse_field();   break;
-      default: 
-        DEBUG("parser stopped");
-        return m_state;
-        break;
+      ERR("request head of %zu bytes or more", HEAD_MAX);
+      m_state = State::BROKEN;
+      break;
     }
-  }
 
-  m_state = State::DONE;
+    if (newline == NULL) break;
+
+    parse_line(m_buffer + m_index, newline);
+
+    m_index = m_scan = newline - m_buffer + 1;
+  }
 
   return m_state;
 }
 
-/**
- * If we see the string specified by next, we will advance the pointer forward
- * by that number of characters and return true, otherwise, we'll return false
- * and keep the pointer where it was.
- */
-bool Parser::parse_expect(const char *next)
+Parser::State Parser::finish()
 {
-  mark();
+  if (m_state == State::DONE || m_state == State::BROKEN) return m_state;
 
-  while (*next && !eof())
+  if (m_index < m_buffer_size)
   {
-    if(*next != curr()) {
-      return_to_mark();
-      return false;
-    }
-    next++;
-    advance();
+    parse_line(m_buffer + m_index, m_buffer + m_buffer_size);
+    m_index = m_scan = m_buffer_size;
   }
 
-  return true;
+  if (m_state != State::BROKEN) m_state = State::DONE;
+
+  return m_state;
 }
 
-void Parser::parse_method()
+void Parser::reset()
 {
-  if (parse_expect("GET")) {
-    m_headers->set_method(Headers::Method::GET);
-  } else if (parse_expect("HEAD")) {
-    m_headers->set_method(Headers::Method::HEAD);
-  } else if (parse_expect("POST")) {
-    m_headers->set_method(Headers::Method::POST); 
-  } else if (parse_expect("PUT")) {
-    m_headers->set_method(Headers::Method::PUT);
-  } else if (parse_expect("PATCH")) {
-    m_headers->set_method(Headers::Method::PATCH);
-  } else if (parse_expect("DELETE")) {
-    m_headers->set_method(Headers::Method::DELETE);
-  } else if (parse_expect("TRACE")) {
-    m_headers->set_method(Headers::Method::TRACE);
-  } else if (parse_expect("OPTIONS")) {
-    m_headers->set_method(Headers::Method::OPTIONS);
-  } else if (parse_expect("CONNECT")) {
-    m_headers->set_method(Headers::Method::CONNECT);
-  }
+  m_state = State::METHOD;
+  m_buffer = NULL;
+  m_buffer_size = 0;
+  m_index = 0;
+  m_scan = 0;
+
+  m_headers.clear();
+  m_arena.reset();
+}
+
+void Parser::release()
+{
+  reset();
+  m_arena.release();
+}
+
+/**
+ * One complete line, end points at the newline (or the end of input) and
+ * a carriage return in front of it is dropped.
+ */
+void Parser::parse_line(const char *begin, const char *end)
+{
+  if (end > begin && *(end - 1) == '\r') end--;
 
-  if (m_headers->get_method() == Headers::Method::NONE)
+  if (m_state == State::METHOD)
   {
-    ERR("bad http method at: %zu %c", m_index, curr());
-    m_state = State::BROKEN;
+    // stray blank lines ahead of the request line are allowed
+    if (begin == end) return;
+
+    const char *at = parse_method(begin, end);
+    if (at) at = parse_path(at, end);
+    if (at) at = parse_version(at, end);
+
+    if (at) m_state = State::FIELD;
   }
-  else
+  else if (m_state == State::FIELD)
   {
-    DEBUG("http method: %d", (int) m_headers->get_method());
-    m_state = State::PATH;
+    if (begin == end)
+    {
+      DEBUG("end of request head at %zu", (size_t) (end - m_buffer));
+      m_state = State::DONE;
+      return;
+    }
+
+    parse_field(begin, end);
   }
 }
 
-void Parser::eat_whitespace()
+const char *Parser::parse_method(const char *begin, const char *end)
 {
-  while (!eof() && (curr() == ' ' || curr() == '\r' || curr() == '\n'))
-    advance();
+  size_t length = 0;
+  Headers::Method method = match_method(begin, end, length);
+
+  if (method == Headers::Method::NONE)
+  {
+    ERR("bad http method at: %zu %c", (size_t) (begin - m_buffer), *begin);
+    m_state = State::BROKEN;
+
+    return NULL;
+  }
+
+  DEBUG("http method: %d", (int) method);
+  m_headers.set_method(method);
+
+  return begin + length;
 }
 
-void Parser::parse_path()
+namespace
 {
-  // eat the whitespace before the path
-  eat_whitespace();
 
-  DEBUG("parsing path at %zu '%c'", m_index, curr());
+struct MethodEntry
+{
+  uint64_t key;
+  Headers::Method method;
+};
 
-  // end of line, includes version
-  const char *newline = find_next('\n');
+/**
+ * A method and the space after it as the first bytes of a little endian
+ * word, which is what match_method compares against. Seven characters at
+ * most, anything longer shifts out of the word and won't compile.
+ */
+constexpr uint64_t method_key(const char *s, size_t i = 0)
+{
+  return s[i] == '\0'
+    ? (uint64_t) ' ' << (8 * i)
+    : ((uint64_t) (unsigned char) s[i] << (8 * i)) | method_key(s, i + 1);
+}
 
-  // end of path
-  const char *end_of_path = find_next(' ');
+constexpr MethodEntry METHODS[] = {
+  { method_key("GET"),     Headers::Method::GET },
+  { method_key("HEAD"),    Headers::Method::HEAD },
+  { method_key("POST"),    Headers::Method::POST },
+  { method_key("PUT"),     Headers::Method::PUT },
+  { method_key("PATCH"),   Headers::Method::PATCH },
+  { method_key("DELETE"),  Headers::Method::DELETE },
+  { method_key("TRACE"),   Headers::Method::TRACE },
+  { method_key("OPTIONS"), Headers::Method::OPTIONS },
+  { method_key("CONNECT"), Headers::Method::CONNECT },
+  { method_key("PURGE"),   Headers::Method::PURGE },
+  { method_key("MKCOL"),   Headers::Method::MKCOL },
+  { method_key("COPY"),    Headers::Method::COPY },
+  { method_key("MOVE"),    Headers::Method::MOVE },
+  { method_key("LOCK"),    Headers::Method::LOCK },
+  { method_key("UNLOCK"),  Headers::Method::UNLOCK },
+  { method_key("REPORT"),  Headers::Method::REPORT },
+  { method_key("SEARCH"),  Headers::Method::SEARCH }
+};
+
+const size_t METHOD_COUNT = sizeof(METHODS) / sizeof(METHODS[0]);
 
-  if (end_of_path == NULL)
-  {
-    DEBUG("parsing path failed, no whitespace before http version");
-    m_state = State::BROKEN;
-    return;
-  }
+/**
+ * Same scheme as the known header table: a multiplier found by search that
+ * gives every method its own slot, rechecked at compile time.
+ */
+const unsigned METHOD_BITS = 5;
+const uint64_t METHOD_SEED = 0x587fd2803bab6c39ull;
 
-  if (newline && end_of_path > newline)
-  {
-    DEBUG("parsing path failed, newline detected before whitespace");
-    m_state = State::BROKEN;
-    return;
-  }
+constexpr unsigned method_slot(uint64_t key)
+{
+  return (key * METHOD_SEED) >> (64 - METHOD_BITS);
+}
 
-  std::string path(pos(), end_of_path);
-  m_headers->set_path(path);
+constexpr bool method_distinct(size_t i, size_t j)
+{
+  return j == METHOD_COUNT || (method_slot(METHODS[i].key) !=
+      method_slot(METHODS[j].key) && method_distinct(i, j + 1));
+}
 
-  m_index = end_of_path - m_buffer;
-  m_state = State::VERSION;
+constexpr bool method_perfect(size_t i = 0)
+{
+  return i == METHOD_COUNT ||
+    (method_distinct(i, i + 1) && method_perfect(i + 1));
 }
 
-void Parser::parse_version()
+static_assert(method_perfect(), "methods collide, pick another METHOD_SEED");
+
+constexpr MethodEntry method_find(unsigned s, size_t i = 0)
 {
-  eat_whitespace();
+  return i == METHOD_COUNT
+    ? MethodEntry{ 0, Headers::Method::NONE }
+    : method_slot(METHODS[i].key) == s ? METHODS[i] : method_find(s, i + 1);
+}
 
-  if (!parse_expect("HTTP/"))
-  {
-    DEBUG("bad http version, missing HTTP/");
-    m_state = State::BROKEN;
-    return;
-  }
+#define FIND8(n) method_find(n), method_find(n + 1), method_find(n + 2), \
+  method_find(n + 3), method_find(n + 4), method_find(n + 5), \
+  method_find(n + 6), method_find(n + 7)
+
+static_assert(METHOD_BITS == 5, "METHOD_SLOTS is spelled out for 32 entries");
 
-  DEBUG("parsing version at %zu '%c'", m_index, curr());
+constexpr MethodEntry METHOD_SLOTS[1 << METHOD_BITS] = {
+  FIND8(0), FIND8(8), FIND8(16), FIND8(24)
+};
 
-  mark();
+#undef FIND8
 
-  int major = 0, minor = 0;
+}
 
-  if (!eof())
+/**
+ * Loads up to 8 bytes as one word, finds the first space in it without a
+ * loop, masks off everything after that space and looks the result up in
+ * a perfect hash: the same few instructions and one compare whatever the
+ * method. length is set to the method's length either way.
+ */
+Headers::Method Parser::match_method(const char *begin, const char *end,
+    size_t &length)
+{
+  uint64_t word = 0;
+
+  // a fixed size copy compiles to a single load
+  if (end - begin >= 8)
   {
-    major = static_cast<int>(curr()) - 48;
-    advance();
+    memcpy(&word, begin, 8);
   }
   else
   {
-    DEBUG("bad http version, missing major version");
-    return_to_mark();
-    m_state = State::BROKEN;
-    return;
+    memcpy(&word, begin, end - begin);
   }
 
-  // .
-  advance();
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  word = __builtin_bswap64(word);
+#endif
 
-  if (!eof())
-  {
-    minor = static_cast<int>(curr()) - 48;
-    advance();
-  } 
-  else
-  {
-    DEBUG("bad http version, missing minor version");
-    return_to_mark();
-    m_state = State::BROKEN;
-    return;
-  }
+  // high bit set in every byte that's a space, exact for the lowest one
+  uint64_t x = word ^ 0x2020202020202020ull;
+  uint64_t spaces = (x - 0x0101010101010101ull) & ~x & 0x8080808080808080ull;
+
+  // no space at all: take the whole word, no key has a byte where its
+  // space should be
+  spaces |= 0x8000000000000000ull;
+
+  unsigned bytes = __builtin_ctzll(spaces) / 8 + 1;
+  uint64_t key = word & (~0ull >> (64 - 8 * bytes));
+
+  const MethodEntry &entry = METHOD_SLOTS[method_slot(key)];
 
-  DEBUG("parse http version %d.%d", major, minor);
+  length = bytes - 1;
 
-  m_headers->set_http_version(Headers::Version{major, minor});
-  m_state = State::FIELD;
+  return entry.key == key ? entry.method : Headers::Method::NONE;
 }
 
-/**
- * Parse the remaining header fields
- *
- * 1. Find the first delimter (: for now)
- * 2. Mark the end of the field name
- * 3. Discard any whitespace
- * 4. Find the newline/end of field
- * 5. Mark the end of the value
- * 
- * BROKEN on null terminator
- */
-void Parser::parse_field()
+const char *Parser::parse_path(const char *begin, const char *end)
 {
-  eat_whitespace();
-  mark();
-  
-  const char *delim = find_next(':');
+  m_state = State::PATH;
+
+  // eat the whitespace before the path
+  begin = eat_whitespace(begin, end);
 
-  if (delim == NULL)
+  DEBUG("parsing path at %zu", (size_t) (begin - m_buffer));
+
+  const char *end_of_path = (const char *) memchr(begin, ' ', end - begin);
+
+  if (end_of_path == NULL || end_of_path == begin)
   {
+    DEBUG("parsing path failed, no whitespace before http version");
     m_state = State::BROKEN;
-    return;
+    return NULL;
   }
 
-  std::string field(pos(), delim);
+  m_headers.set_path(span(begin, end_of_path));
 
-  advance(delim + 1);
+  return end_of_path;
+}
+
+const char *Parser::parse_version(const char *begin, const char *end)
+{
+  m_state = State::VERSION;
+
+  begin = eat_whitespace(begin, end);
 
-  eat_whitespace();
+  DEBUG("parsing version at %zu", (size_t) (begin - m_buffer));
 
-  if (eof()) {
+  // HTTP/d.d
+  if (end - begin < 8 || memcmp(begin, "HTTP/", 5) != 0)
+  {
+    DEBUG("bad http version, missing HTTP/");
     m_state = State::BROKEN;
-    return;
+    return NULL;
   }
 
-  const char *newline = find_next('\n');
+  char major = begin[5], dot = begin[6], minor = begin[7];
 
-  if (newline == NULL)
+  if (major < '0' || major > '9' || dot != '.' || minor < '0' || minor > '9')
   {
+    DEBUG("bad http version, expected digit.digit");
     m_state = State::BROKEN;
-    return;
+    return NULL;
   }
 
-  size_t cr_offset = *(newline - 1) == '\r' ? 1 : 0;
-  
-  std::string value(pos(), newline - cr_offset);
+  // the line ends there, give or take trailing whitespace
+  if (eat_whitespace(begin + 8, end) != end)
+  {
+    DEBUG("bad http version, more after it");
+    m_state = State::BROKEN;
+    return NULL;
+  }
 
-  DEBUG("field: %s", field.c_str());
-  DEBUG("value: %s", value.c_str());
+  DEBUG("parse http version %c.%c", major, minor);
 
-  m_headers->set_field(field, value);
+  m_headers.set_http_version(Headers::Version{major - '0', minor - '0'});
 
-  advance(newline + 1);
+  return begin + 8;
 }
 
-inline const char & Parser::curr() const
+/**
+ * One header field line: a token for the name, colon, value with the
+ * surrounding whitespace trimmed. Empty values are fine, anything else
+ * before the colon (whitespace included) is not.
+ */
+void Parser::parse_field(const char *begin, const char *end)
 {
-  return m_buffer[m_index];
-}
+  const char *delim = Scan::token_end(begin, end);
 
-inline const char & Parser::next() const
-{
-  if (m_index+1 < m_buffer_size)
+  if (delim == end || *delim != ':' || delim == begin)
   {
-    return m_buffer[m_index+1];
+    DEBUG("bad header field name at %zu", (size_t) (delim - m_buffer));
+    m_state = State::BROKEN;
+    return;
   }
-  
-  return m_buffer[m_buffer_size];
-}
 
-inline const char & Parser::prev() const
-{
-  return m_buffer[m_index-1];
-}
+  const char *value = eat_whitespace(delim + 1, end);
 
-inline void Parser::mark()
-{
-  m_mark = m_index;
-}
+  while (end > value && (*(end - 1) == ' ' || *(end - 1) == '\t')) end--;
 
-inline void Parser::return_to_mark()
-{
-  m_index = m_mark;
-}
+  DEBUG("field: %.*s", (int) (delim - begin), begin);
 
-inline const char *Parser::pos() const
-{
-  return m_buffer + m_index;
+  m_headers.add_field(known_header(begin, delim - begin),
+      span(begin, delim), span(value, end));
 }
 
-inline const char *Parser::find_next(const char &find) const
+/**
+ * End of the line starting at m_index, NULL when it hasn't all arrived yet.
+ * m_scan is left where the next call should resume: at the end of the
+ * buffer, or on a '\r' that's the last byte so far.
+ *
+ * Control characters other than "\r\n" (and tab) break the request, so do
+ * bare carriage returns.
+ */
+const char *Parser::find_line_end()
 {
-  return strchr(m_buffer + m_index, find);
-}
+  const char *end = m_buffer + m_buffer_size;
+  const char *stop = Scan::line_end(m_buffer + m_scan, end);
 
-inline const char *Parser::advance()
-{
-  m_index++;
-  return m_buffer + m_index;
-} 
+  if (stop < end && *stop == '\r')
+  {
+    if (stop + 1 == end)
+    {
+      m_scan = stop - m_buffer;
+      return NULL;
+    }
+
+    stop++;
+  }
+
+  if (stop == end)
+  {
+    m_scan = m_buffer_size;
+    return NULL;
+  }
+
+  if (*stop != '\n')
+  {
+    DEBUG("bad character 0x%02x at %zu", (unsigned char) *stop,
+        (size_t) (stop - m_buffer));
+    m_state = State::BROKEN;
+    return NULL;
+  }
+
+  return stop;
+}
 
-inline const char *Parser::advance(const char *to)
+inline Headers::Span Parser::span(const char *begin, const char *end) const
 {
-  m_index = to - m_buffer;
-  return m_buffer + m_index;
+  return Headers::Span{(uint32_t) (begin - m_buffer), (uint32_t) (end - begin)};
 }
 
-inline bool Parser::eof() const
+inline const char *Parser::eat_whitespace(const char *begin, const char *end)
 {
-  return m_buffer_size < m_index;
+  while (begin < end && (*begin == ' ' || *begin == '\t')) begin++;
+  return begin;
 }
 
 } // namespace
@@ -2,12 +2,38 @@
 #define __PARSER_H
 
 #include <string>
+#include <string.h>
 #include "log.h"
 #include "headers.h"
+#include "scan.h"
+#include "arena.h"
 
 namespace Http
 {
 
+/**
+ * Request head parser that can be fed a connection's bytes as they arrive.
+ *
+ * parse(buffer, size) is called with everything received for the current
+ * request so far; the prefix it already saw must be unchanged but the
+ * buffer itself may have moved (grown, reallocated). Only whole lines are
+ * parsed and the newline search resumes where the last call stopped, so no
+ * byte is examined twice no matter how the request was split. Lines and
+ * field names are found with the vectorised scans in scan.h.
+ *
+ * Headers are views into that same buffer (see headers.h), valid for as
+ * long as the caller keeps the request bytes around.
+ *
+ * A Parser is meant to live as long as its connection: reset() readies it
+ * for the next request in O(1), rewinding the arena that holds everything
+ * request scoped. The owner can put its own request scoped data in arena()
+ * too, it goes at the same time.
+ *
+ * It returns DONE once the blank line ending the head is in, BROKEN on a
+ * malformed or oversized head, and otherwise the state it will resume in,
+ * meaning more bytes are needed. consumed() is the length of the head once
+ * DONE, anything past that belongs to a body or the next request.
+ */
 class Parser
 {
   public:
@@ -21,41 +47,64 @@ class Parser
       DONE
     };
 
+    Parser();
     Parser(const char *buffer, size_t size);
     Parser(Parser  &p) = delete;
     Parser(Parser &&p) = delete;
 
+    // the whole request is in the buffer given to the constructor
     State parse();
 
-    std::shared_ptr<Headers> get_headers() { return m_headers; }
+    // incremental, see above
+    State parse(const char *buffer, size_t size);
+
+    // no more bytes are coming, an unterminated last line ends the head
+    State finish();
+
+    // start over on a new request, Headers and arena are reused
+    void reset();
+
+    // start over, and give the arena's memory back; for an idle connection
+    void release();
+
+    size_t consumed() const { return m_index; }
+    State state() const { return m_state; }
+
+    Headers *get_headers() { return &m_headers; }
+
+    Arena &arena() { return m_arena; }
+
+    // the method starting at begin, NONE if it isn't one we know
+    static Headers::Method match_method(const char *begin, const char *end,
+        size_t &length);
+
+    // a request head is given up on once it's this long, newline or not
+    static const size_t HEAD_MAX = 64 * 1024;
   protected:
     State m_state;
     const char *m_buffer;
     size_t m_buffer_size = 0;
+
+    // start of the line being parsed, everything before it is consumed
     size_t m_index = 0;
-    size_t m_mark = 0;
 
-    std::shared_ptr<Headers> m_headers;
+    // where the search for the end of that line picks up again
+    size_t m_scan = 0;
+
+    Arena m_arena;
+    Headers m_headers;
 
-    bool parse_expect(const char *next);
+    void parse_line(const char *begin, const char *end);
 
-    void parse_method();
-    void parse_path();
-    void parse_version();
-    void parse_field();
+    const char *parse_method(const char *begin, const char *end);
+    const char *parse_path(const char *begin, const char *end);
+    const char *parse_version(const char *begin, const char *end);
+    void parse_field(const char *begin, const char *end);
 
-    inline const char & curr() const;
-    inline const char & next() const;
-    inline const char & prev() const;
+    const char *find_line_end();
+    Headers::Span span(const char *begin, const char *end) const;
 
-    void mark();
-    void eat_whitespace();
-    void return_to_mark();
-    const char *pos() const;
-    const char *find_next(const char &) const;
-    const char *advance();
-    const char *advance(const char *);
-    bool eof() const;
+    static const char *eat_whitespace(const char *begin, const char *end);
 }; // class
 
 }  // namespace
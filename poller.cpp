@@ -0,0 +1,224 @@
+#include "poller.h"
+
+namespace Net
+{
+
+#if defined(__linux__)
+
+/**
+ * epoll keeps one registration per fd with a mask of interests, so add and
+ * modify are a single epoll_ctl each. EPOLLRDHUP lets us see a peer that
+ * half-closed the same way EV_EOF shows up on kqueue. It's only asked for
+ * along with reads: it stays raised, and an owner that stopped reading
+ * from a peer that's done sending still has answers to write.
+ */
+static uint32_t to_epoll(uint32_t interest)
+{
+  uint32_t events = 0;
+
+  if (interest & Event::READ)  events |= EPOLLIN | EPOLLRDHUP;
+  if (interest & Event::WRITE) events |= EPOLLOUT;
+
+  return events;
+}
+
+Poller::Poller()
+{
+  m_fd = epoll_create1(EPOLL_CLOEXEC);
+
+  if (m_fd < 0)
+  {
+    m_err = m_fd;
+    ERR("epoll_create1: %s", strerror(errno));
+  }
+}
+
+int Poller::add(uintptr_t fd, uint32_t interest)
+{
+  struct epoll_event ev;
+  ev.events = to_epoll(interest);
+  ev.data.u64 = fd;
+
+  m_err = epoll_ctl(m_fd, EPOLL_CTL_ADD, fd, &ev);
+
+  if (m_err < 0)
+  {
+    ERR("[0x%016" PRIXPTR "] epoll add: %s", fd, strerror(errno));
+  }
+
+  return m_err;
+}
+
+int Poller::modify(uintptr_t fd, uint32_t interest)
+{
+  struct epoll_event ev;
+  ev.events = to_epoll(interest);
+  ev.data.u64 = fd;
+
+  m_err = epoll_ctl(m_fd, EPOLL_CTL_MOD, fd, &ev);
+
+  if (m_err < 0)
+  {
+    ERR("[0x%016" PRIXPTR "] epoll mod: %s", fd, strerror(errno));
+  }
+
+  return m_err;
+}
+
+int Poller::remove(uintptr_t fd)
+{
+  m_err = epoll_ctl(m_fd, EPOLL_CTL_DEL, fd, NULL);
+
+  if (m_err < 0)
+  {
+    ERR("[0x%016" PRIXPTR "] epoll del: %s", fd, strerror(errno));
+  }
+
+  return m_err;
+}
+
+int Poller::wait(Event *events, int max, int timeout_ms)
+{
+  if (max > NATIVE_MAX) max = NATIVE_MAX;
+
+  int count = epoll_wait(m_fd, m_native, max, timeout_ms);
+
+  if (count < 0)
+  {
+    m_err = count;
+    if (errno != EINTR) ERR("epoll_wait: %s", strerror(errno));
+    return count;
+  }
+
+  for (int i = 0; i < count; i++)
+  {
+    uint32_t native = m_native[i].events;
+    uint32_t flags = 0;
+
+    if (native & EPOLLIN)                 flags |= Event::READ;
+    if (native & EPOLLOUT)                flags |= Event::WRITE;
+    if (native & EPOLLRDHUP)              flags |= Event::HALF_CLOSED;
+    if (native & EPOLLHUP)                flags |= Event::HANGUP;
+    if (native & EPOLLERR)                flags |= Event::ERROR;
+
+    events[i].fd = m_native[i].data.u64;
+    events[i].flags = flags;
+  }
+
+  return count;
+}
+
+#else
+
+/**
+ * kqueue registers a filter per interest, so read and write are separate
+ * registrations that get enabled or disabled independently. A single kevent
+ * call submits both changes.
+ */
+Poller::Poller()
+{
+  m_fd = kqueue();
+
+  if (m_fd < 0)
+  {
+    m_err = m_fd;
+    ERR("kqueue: %s", strerror(errno));
+  }
+}
+
+int Poller::add(uintptr_t fd, uint32_t interest)
+{
+  struct kevent changes[2];
+
+  EV_SET(&changes[0], fd, EVFILT_READ,
+      EV_ADD | (interest & Event::READ ? EV_ENABLE : EV_DISABLE), 0, 0, NULL);
+  EV_SET(&changes[1], fd, EVFILT_WRITE,
+      EV_ADD | (interest & Event::WRITE ? EV_ENABLE : EV_DISABLE), 0, 0, NULL);
+
+  m_err = kevent(m_fd, changes, 2, NULL, 0, NULL);
+
+  if (m_err < 0)
+  {
+    ERR("[0x%016" PRIXPTR "] kqueue add: %s", fd, strerror(errno));
+  }
+
+  return m_err;
+}
+
+int Poller::modify(uintptr_t fd, uint32_t interest)
+{
+  // EV_ADD on an existing registration just updates its flags
+  return add(fd, interest);
+}
+
+int Poller::remove(uintptr_t fd)
+{
+  struct kevent changes[2];
+
+  EV_SET(&changes[0], fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+  EV_SET(&changes[1], fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+
+  m_err = kevent(m_fd, changes, 2, NULL, 0, NULL);
+
+  if (m_err < 0)
+  {
+    ERR("[0x%016" PRIXPTR "] kqueue unsub: %s", fd, strerror(errno));
+  }
+
+  return m_err;
+}
+
+int Poller::wait(Event *events, int max, int timeout_ms)
+{
+  if (max > NATIVE_MAX) max = NATIVE_MAX;
+
+  struct timespec timeout;
+  struct timespec *timeout_ptr = NULL;
+
+  if (timeout_ms >= 0)
+  {
+    timeout.tv_sec = timeout_ms / 1000;
+    timeout.tv_nsec = (timeout_ms % 1000) * 1000000;
+    timeout_ptr = &timeout;
+  }
+
+  int count = kevent(m_fd, NULL, 0, m_native, max, timeout_ptr);
+
+  if (count < 0)
+  {
+    m_err = count;
+    if (errno != EINTR) ERR("kevent read: %s", strerror(errno));
+    return count;
+  }
+
+  for (int i = 0; i < count; i++)
+  {
+    struct kevent &native = m_native[i];
+    uint32_t flags = 0;
+
+    if (native.filter == EVFILT_READ)  flags |= Event::READ;
+    if (native.filter == EVFILT_WRITE) flags |= Event::WRITE;
+    if (native.flags & EV_ERROR)       flags |= Event::ERROR;
+
+    // on a read only the peer's sending side is done, on a write it's gone
+    if (native.flags & EV_EOF)
+    {
+      flags |= native.filter == EVFILT_READ ? Event::HALF_CLOSED :
+        Event::HANGUP;
+    }
+
+    events[i].fd = native.ident;
+    events[i].flags = flags;
+  }
+
+  return count;
+}
+
+#endif
+
+Poller::~Poller()
+{
+  if (m_fd >= 0) ::close(m_fd);
+}
+
+}
@@ -0,0 +1,82 @@
+#ifndef __POLLER_H
+#define __POLLER_H
+
+#include <inttypes.h>   // uint32_t, uintptr_t, PRIXPTR
+#include <string.h>     // strerror
+#include <errno.h>      // errno, set by syscalls
+#include <unistd.h>     // close
+
+#if defined(__linux__)
+#include <sys/epoll.h>  // epoll_create1, epoll_ctl, epoll_wait
+#else
+#include <sys/event.h>  // kqueue, kevent
+#endif
+
+#include "log.h"
+
+namespace Net
+{
+
+/**
+ * A readiness event, translated from whatever the platform multiplexer
+ * handed back (struct kevent or struct epoll_event). The fd has the same
+ * width as a kevent ident so it can be printed with PRIXPTR.
+ */
+struct Event
+{
+  enum Flags : uint32_t
+  {
+    READ   = 1 << 0,  // data (or a pending connection) is available
+    WRITE  = 1 << 1,  // socket buffer has room
+    HANGUP = 1 << 2,  // gone both ways, EPOLLHUP / EV_EOF on a write
+    ERROR  = 1 << 3,  // EV_ERROR / EPOLLERR
+
+    // the peer is done sending but may still be reading, EPOLLRDHUP /
+    // EV_EOF on a read; what it sent before is still there to read
+    HALF_CLOSED = 1 << 4
+  };
+
+  uintptr_t fd;
+  uint32_t flags;
+};
+
+/**
+ * Thin wrapper over kqueue (BSD, macOS) or epoll (linux). Level triggered
+ * on both, so a handler that doesn't drain a socket gets called again on
+ * the next wait().
+ *
+ * Interest is a mask of Event::READ and Event::WRITE.
+ */
+class Poller
+{
+  public:
+    Poller();
+    Poller(Poller &) = delete;
+    Poller(Poller &&) = delete;
+    ~Poller();
+
+    int add(uintptr_t fd, uint32_t interest = Event::READ);
+    int modify(uintptr_t fd, uint32_t interest);
+    int remove(uintptr_t fd);
+
+    // fills at most max events, timeout_ms < 0 blocks indefinitely
+    int wait(Event *events, int max, int timeout_ms = -1);
+
+    int fd()  { return m_fd; }
+    int err() { return m_err; }
+
+    static const int NATIVE_MAX = 64;
+  private:
+    int m_fd  = -1;
+    int m_err = 0;
+
+#if defined(__linux__)
+    struct epoll_event m_native[NATIVE_MAX];
+#else
+    struct kevent m_native[NATIVE_MAX];
+#endif
+}; // class
+
+}  // namespace
+
+#endif // __POLLER_H
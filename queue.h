@@ -0,0 +1,152 @@
+#ifndef __QUEUE_H
+#define __QUEUE_H
+
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+
+namespace Net
+{
+
+/**
+ * Bounded lock-free queue for handing values between loop threads, after
+ * Dmitry Vyukov's bounded MPMC queue (1024cores).
+ *
+ * Every cell carries a sequence number that tells producers and consumers
+ * whose turn it is, so a push or pop is one CAS on the shared index plus a
+ * release store on the cell. Capacity is rounded up to a power of two.
+ * push() and pop() return false instead of blocking when full or empty.
+ */
+template <typename T>
+class Queue
+{
+  public:
+    Queue(size_t capacity = 4096) :
+      m_cells(round_up(capacity)),
+      m_mask(round_up(capacity) - 1)
+    {
+      for (size_t i = 0; i < m_cells.size(); i++)
+      {
+        m_cells[i].sequence.store(i, std::memory_order_relaxed);
+      }
+
+      m_enqueue.store(0, std::memory_order_relaxed);
+      m_dequeue.store(0, std::memory_order_relaxed);
+    }
+
+    Queue(Queue &) = delete;
+    Queue(Queue &&) = delete;
+
+    bool push(const T &value)
+    {
+      size_t pos = m_enqueue.load(std::memory_order_relaxed);
+      Cell *cell;
+
+      for (;;)
+      {
+        cell = &m_cells[pos & m_mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+        if (diff == 0)
+        {
+          if (m_enqueue.compare_exchange_weak(pos, pos + 1,
+                std::memory_order_relaxed))
+          {
+            break;
+          }
+        }
+        else if (diff < 0)
+        {
+          return false;
+        }
+        else
+        {
+          pos = m_enqueue.load(std::memory_order_relaxed);
+        }
+      }
+
+      cell->value = value;
+      cell->sequence.store(pos + 1, std::memory_order_release);
+
+      return true;
+    }
+
+    bool pop(T &value)
+    {
+      size_t pos = m_dequeue.load(std::memory_order_relaxed);
+      Cell *cell;
+
+      for (;;)
+      {
+        cell = &m_cells[pos & m_mask];
+        size_t seq = cell->sequence.load(std::memory_order_acquire);
+        intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+
+        if (diff == 0)
+        {
+          if (m_dequeue.compare_exchange_weak(pos, pos + 1,
+                std::memory_order_relaxed))
+          {
+            break;
+          }
+        }
+        else if (diff < 0)
+        {
+          return false;
+        }
+        else
+        {
+          pos = m_dequeue.load(std::memory_order_relaxed);
+        }
+      }
+
+      value = cell->value;
+      cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+
+      return true;
+    }
+
+    // approximate, only good for load balancing decisions
+    size_t size() const
+    {
+      size_t enqueued = m_enqueue.load(std::memory_order_relaxed);
+      size_t dequeued = m_dequeue.load(std::memory_order_relaxed);
+
+      return enqueued > dequeued ? enqueued - dequeued : 0;
+    }
+
+    size_t capacity() const { return m_mask + 1; }
+
+  private:
+    struct Cell
+    {
+      std::atomic<size_t> sequence;
+      T value;
+
+      Cell() : sequence(0), value() {}
+    };
+
+    static size_t round_up(size_t n)
+    {
+      size_t size = 2;
+      while (size < n) size <<= 1;
+      return size;
+    }
+
+    static const size_t CACHE_LINE = 64;
+
+    std::vector<Cell> m_cells;
+    const size_t m_mask;
+
+    // producers and consumers each get their own cache line
+    char m_pad0[CACHE_LINE];
+    std::atomic<size_t> m_enqueue;
+    char m_pad1[CACHE_LINE - sizeof(std::atomic<size_t>)];
+    std::atomic<size_t> m_dequeue;
+    char m_pad2[CACHE_LINE - sizeof(std::atomic<size_t>)];
+}; // class
+
+}  // namespace
+
+#endif // __QUEUE_H
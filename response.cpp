@@ -0,0 +1,297 @@
+#include "response.h"
+
+namespace Http
+{
+
+namespace
+{
+
+// what seal() appends at most: Content-Length with 20 digits, blank line
+const size_t SEALED = sizeof("Content-Length: \r\n\r\n") - 1 + 20;
+
+// two digits at a time, "00" to "99"
+const char DIGITS[] =
+  "0001020304050607080910111213141516171819"
+  "2021222324252627282930313233343536373839"
+  "4041424344454647484950515253545556575859"
+  "6061626364656667686970717273747576777879"
+  "8081828384858687888990919293949596979899";
+
+}
+
+Response::Response(unsigned status) :
+  m_status(0),
+  m_status_line(),
+  m_status_buffer(),
+  m_sealed(false),
+  m_head_only(false),
+  m_chunked(false),
+  m_head_size(0),
+  m_body_count(0),
+  m_content_length(0),
+  m_external(0)
+{
+  this->status(status);
+}
+
+#define STATUS(code, reason) \
+  case code: return View("HTTP/1.1 " #code " " reason "\r\n", \
+      sizeof("HTTP/1.1 " #code " " reason "\r\n") - 1)
+
+View Response::status_line(unsigned code)
+{
+  switch (code)
+  {
+    STATUS(100, "Continue");
+    STATUS(101, "Switching Protocols");
+    STATUS(200, "OK");
+    STATUS(201, "Created");
+    STATUS(202, "Accepted");
+    STATUS(204, "No Content");
+    STATUS(206, "Partial Content");
+    STATUS(301, "Moved Permanently");
+    STATUS(302, "Found");
+    STATUS(303, "See Other");
+    STATUS(304, "Not Modified");
+    STATUS(307, "Temporary Redirect");
+    STATUS(308, "Permanent Redirect");
+    STATUS(400, "Bad Request");
+    STATUS(401, "Unauthorized");
+    STATUS(403, "Forbidden");
+    STATUS(404, "Not Found");
+    STATUS(405, "Method Not Allowed");
+    STATUS(406, "Not Acceptable");
+    STATUS(408, "Request Timeout");
+    STATUS(409, "Conflict");
+    STATUS(410, "Gone");
+    STATUS(411, "Length Required");
+    STATUS(412, "Precondition Failed");
+    STATUS(413, "Content Too Large");
+    STATUS(414, "URI Too Long");
+    STATUS(415, "Unsupported Media Type");
+    STATUS(416, "Range Not Satisfiable");
+    STATUS(417, "Expectation Failed");
+    STATUS(426, "Upgrade Required");
+    STATUS(429, "Too Many Requests");
+    STATUS(431, "Request Header Fields Too Large");
+    STATUS(500, "Internal Server Error");
+    STATUS(501, "Not Implemented");
+    STATUS(502, "Bad Gateway");
+    STATUS(503, "Service Unavailable");
+    STATUS(504, "Gateway Timeout");
+    STATUS(505, "HTTP Version Not Supported");
+    default: return View();
+  }
+}
+
+#undef STATUS
+
+/**
+ * Codes outside the table still go out as sent, with an empty reason
+ * phrase, which HTTP allows. Anything that isn't three digits is a bug on
+ * our side and becomes a 500.
+ */
+void Response::status(unsigned code)
+{
+  if (code < 100 || code > 999)
+  {
+    WARN("status %u isn't a status code, sending 500", code);
+    code = 500;
+  }
+
+  m_status = code;
+  m_status_line = status_line(code);
+
+  if (m_status_line.empty())
+  {
+    char *p = m_status_buffer;
+
+    memcpy(p, "HTTP/1.1 ", 9);
+    p += 9;
+    p += format(code, p);
+    memcpy(p, " \r\n", 3);
+    p += 3;
+
+    m_status_line = View(m_status_buffer, p - m_status_buffer);
+  }
+}
+
+bool Response::header(const char *name, size_t name_size, const char *value,
+    size_t value_size)
+{
+  size_t needed = name_size + 2 + value_size + 2;
+
+  if (m_sealed || m_head_size + needed > HEAD_MAX - SEALED)
+  {
+    WARN("header block full, dropping %.*s", (int) name_size, name);
+    return false;
+  }
+
+  char *p = m_head + m_head_size;
+
+  memcpy(p, name, name_size);
+  p += name_size;
+  *p++ = ':';
+  *p++ = ' ';
+  memcpy(p, value, value_size);
+  p += value_size;
+  *p++ = '\r';
+  *p++ = '\n';
+
+  m_head_size += needed;
+
+  return true;
+}
+
+bool Response::header(const char *name, uint64_t value)
+{
+  char digits[20];
+
+  return header(name, strlen(name), digits, format(value, digits));
+}
+
+bool Response::body(const char *data, size_t size)
+{
+  if (m_sealed || m_body_count == BODY_MAX) return false;
+
+  if (size == 0) return true;
+
+  m_body[m_body_count++] = View(data, size);
+  m_content_length += size;
+
+  return true;
+}
+
+bool Response::body_length(uint64_t size)
+{
+  if (m_sealed) return false;
+
+  m_content_length += size;
+  m_external += size;
+
+  return true;
+}
+
+bool Response::bodyless() const
+{
+  return m_status < 200 || m_status == 204 || m_status == 304;
+}
+
+void Response::seal()
+{
+  if (m_sealed) return;
+
+  m_sealed = true;
+
+  char *p = m_head + m_head_size;
+
+  if (m_chunked && !bodyless())
+  {
+    memcpy(p, "Transfer-Encoding: chunked\r\n", 28);
+    p += 28;
+  }
+  else if (!bodyless())
+  {
+    memcpy(p, "Content-Length: ", 16);
+    p += 16;
+    p += format(m_content_length, p);
+    *p++ = '\r';
+    *p++ = '\n';
+  }
+
+  *p++ = '\r';
+  *p++ = '\n';
+
+  m_head_size = p - m_head;
+
+  if (bodyless()) m_head_only = true;
+}
+
+int Response::iovecs(struct iovec *iov)
+{
+  seal();
+
+  iov[0].iov_base = (void *) m_status_line.data();
+  iov[0].iov_len = m_status_line.size();
+  iov[1].iov_base = m_head;
+  iov[1].iov_len = m_head_size;
+
+  if (m_head_only) return 2;
+
+  for (int i = 0; i < m_body_count; i++)
+  {
+    iov[2 + i].iov_base = (void *) m_body[i].data();
+    iov[2 + i].iov_len = m_body[i].size();
+  }
+
+  return 2 + m_body_count;
+}
+
+/**
+ * The status line is static unless it was formatted into this object, the
+ * body belongs to the caller, only what lives in here gets copied.
+ */
+void Response::queue(Net::Output &out)
+{
+  seal();
+
+  if (m_status_line.data() == m_status_buffer)
+  {
+    out.append(m_status_line.data(), m_status_line.size());
+  }
+  else
+  {
+    out.reference(m_status_line.data(), m_status_line.size());
+  }
+
+  out.append(m_head, m_head_size);
+
+  if (m_head_only) return;
+
+  for (int i = 0; i < m_body_count; i++)
+  {
+    out.reference(m_body[i].data(), m_body[i].size());
+  }
+}
+
+size_t Response::size()
+{
+  seal();
+
+  return m_status_line.size() + m_head_size +
+    (m_head_only ? 0 : m_content_length - m_external);
+}
+
+size_t Response::format(uint64_t value, char *out)
+{
+  char buffer[20];
+  char *p = buffer + sizeof(buffer);
+
+  while (value >= 100)
+  {
+    unsigned pair = (value % 100) * 2;
+    value /= 100;
+
+    *--p = DIGITS[pair + 1];
+    *--p = DIGITS[pair];
+  }
+
+  if (value >= 10)
+  {
+    unsigned pair = value * 2;
+
+    *--p = DIGITS[pair + 1];
+    *--p = DIGITS[pair];
+  }
+  else
+  {
+    *--p = '0' + value;
+  }
+
+  size_t length = buffer + sizeof(buffer) - p;
+  memcpy(out, p, length);
+
+  return length;
+}
+
+} // namespace
@@ -0,0 +1,122 @@
+#ifndef __RESPONSE_H
+#define __RESPONSE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/uio.h>
+#include "log.h"
+#include "view.h"
+#include "output.h"
+
+namespace Http
+{
+
+/**
+ * A response put together without allocating and without copying the
+ * body. The status line comes from a static table, header fields are
+ * formatted into a block inside the object, body segments are only
+ * referenced: whoever provides them keeps them alive until the response
+ * has been written.
+ *
+ * Sealing appends Content-Length, counted from the body segments, and
+ * the blank line to the header block. Statuses that can't carry a body
+ * (1xx, 204, 304) get neither the length nor the body. iovecs() and
+ * queue() seal, after that the response is fixed.
+ *
+ * Laid out as at most 2 + BODY_MAX iovecs: status line, header block,
+ * body. Either written with one writev, or queued on a connection's
+ * Net::Output, which copies only the header block.
+ */
+class Response
+{
+  public:
+    Response(unsigned status = 200);
+    Response(Response &r) = delete;
+    Response(Response &&r) = delete;
+
+    void status(unsigned code);
+    unsigned status() const { return m_status; }
+
+    /**
+     * False, and nothing added, when the field doesn't fit in the header
+     * block any more.
+     */
+    bool header(const char *name, size_t name_size, const char *value,
+        size_t value_size);
+
+    bool header(const char *name, View value)
+    {
+      return header(name, strlen(name), value.data(), value.size());
+    }
+
+    bool header(const char *name, uint64_t value);
+
+    // referenced, not copied; false past BODY_MAX segments
+    bool body(const char *data, size_t size);
+    bool body(View data) { return body(data.data(), data.size()); }
+
+    /**
+     * Body bytes that go out some other way after the head, a file range
+     * queued with Net::Output::file() say. Counted in Content-Length, not
+     * laid out.
+     */
+    bool body_length(uint64_t size);
+
+    // a HEAD answer: Content-Length says how big the body is, the body stays
+    void head_only() { m_head_only = true; }
+
+    /**
+     * The body follows as HTTP/1.1 chunks the caller frames itself, a
+     * Compressor's output say: Transfer-Encoding instead of Content-Length.
+     * Nothing is laid out here for it.
+     */
+    void chunked() { m_chunked = true; }
+
+    uint64_t content_length() const { return m_content_length; }
+
+    // iovecs written, at most 2 + BODY_MAX
+    int iovecs(struct iovec *iov);
+
+    void queue(Net::Output &out);
+
+    // bytes on the wire, head and the body this lays out
+    size_t size();
+
+    /**
+     * value in decimal at out, which needs room for 20 digits. Returns how
+     * many it wrote.
+     */
+    static size_t format(uint64_t value, char *out);
+
+    // "HTTP/1.1 200 OK\r\n", empty for a code the table doesn't know
+    static View status_line(unsigned code);
+
+    static const size_t HEAD_MAX = 1024;
+    static const int BODY_MAX = 8;
+  private:
+    void seal();
+    bool bodyless() const;
+
+    unsigned m_status;
+    View m_status_line;
+
+    // "HTTP/1.1 nnn \r\n" for codes that aren't in the table
+    char m_status_buffer[16];
+
+    bool m_sealed;
+    bool m_head_only;
+    bool m_chunked;
+
+    size_t m_head_size;
+    char m_head[HEAD_MAX];
+
+    int m_body_count;
+    View m_body[BODY_MAX];
+    uint64_t m_content_length;
+    uint64_t m_external;
+};
+
+} // namespace
+
+#endif /** __RESPONSE_H **/
@@ -0,0 +1,282 @@
+#include "ring.h"
+
+#if defined(__linux__)
+
+namespace Net
+{
+
+/**
+ * The rings are shared memory with the kernel. We're the only producer of
+ * the sq tail and the cq head, the kernel is the only producer of the other
+ * two, so a release store on ours and an acquire load on theirs is all the
+ * ordering needed.
+ */
+static inline unsigned load_acquire(unsigned *p)
+{
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+static inline void store_release(unsigned *p, unsigned v)
+{
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+}
+
+Ring::Ring(unsigned entries) :
+  m_params()
+{
+  memset(&m_params, 0, sizeof(m_params));
+
+  // only this thread submits, which lets the kernel skip some locking
+  m_params.flags = IORING_SETUP_SINGLE_ISSUER;
+
+  m_fd = syscall(__NR_io_uring_setup, entries, &m_params);
+
+  if (m_fd < 0)
+  {
+    // older kernels reject flags they don't know
+    memset(&m_params, 0, sizeof(m_params));
+    m_fd = syscall(__NR_io_uring_setup, entries, &m_params);
+  }
+
+  if (m_fd < 0)
+  {
+    m_err = m_fd;
+    ERR("io_uring_setup: %s", strerror(errno));
+    return;
+  }
+
+  m_sq_size = m_params.sq_off.array + m_params.sq_entries * sizeof(unsigned);
+  m_cq_size = m_params.cq_off.cqes +
+    m_params.cq_entries * sizeof(struct io_uring_cqe);
+
+  bool single = m_params.features & IORING_FEAT_SINGLE_MMAP;
+
+  if (single)
+  {
+    if (m_cq_size > m_sq_size) m_sq_size = m_cq_size;
+    m_cq_size = m_sq_size;
+  }
+
+  m_sq_ptr = mmap(NULL, m_sq_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+
+  m_cq_ptr = single ? m_sq_ptr : mmap(NULL, m_cq_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+
+  m_sqes = (struct io_uring_sqe *) mmap(NULL,
+      m_params.sq_entries * sizeof(struct io_uring_sqe),
+      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+      IORING_OFF_SQES);
+
+  if (m_sq_ptr == MAP_FAILED || m_cq_ptr == MAP_FAILED || m_sqes == MAP_FAILED)
+  {
+    m_err = -1;
+    ERR("io_uring mmap: %s", strerror(errno));
+    return;
+  }
+
+  char *sq = (char *) m_sq_ptr;
+  char *cq = (char *) m_cq_ptr;
+
+  m_sq_head = (unsigned *) (sq + m_params.sq_off.head);
+  m_sq_tail = (unsigned *) (sq + m_params.sq_off.tail);
+  m_sq_mask = *(unsigned *) (sq + m_params.sq_off.ring_mask);
+
+  // sqe index i always lives in array slot i, so submitting is a tail bump
+  unsigned *array = (unsigned *) (sq + m_params.sq_off.array);
+  for (unsigned i = 0; i < m_params.sq_entries; i++) array[i] = i;
+
+  m_cq_head = (unsigned *) (cq + m_params.cq_off.head);
+  m_cq_tail = (unsigned *) (cq + m_params.cq_off.tail);
+  m_cq_mask = *(unsigned *) (cq + m_params.cq_off.ring_mask);
+  m_cqes = (struct io_uring_cqe *) (cq + m_params.cq_off.cqes);
+
+  m_sq_local = m_sq_flushed = *m_sq_tail;
+}
+
+struct io_uring_sqe *Ring::sqe()
+{
+  if (m_sq_local - load_acquire(m_sq_head) >= m_params.sq_entries)
+  {
+    submit();
+  }
+
+  struct io_uring_sqe *next = &m_sqes[m_sq_local & m_sq_mask];
+  memset(next, 0, sizeof(*next));
+  m_sq_local++;
+
+  return next;
+}
+
+int Ring::submit(unsigned wait)
+{
+  unsigned pending = m_sq_local - m_sq_flushed;
+
+  store_release(m_sq_tail, m_sq_local);
+  m_sq_flushed = m_sq_local;
+
+  if (pending == 0 && wait == 0) return 0;
+
+  unsigned flags = wait ? IORING_ENTER_GETEVENTS : 0;
+
+  m_enters++;
+  m_err = syscall(__NR_io_uring_enter, m_fd, pending, wait, flags, NULL, 0);
+
+  if (m_err < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY)
+  {
+    ERR("io_uring_enter: %s", strerror(errno));
+  }
+
+  return m_err;
+}
+
+struct io_uring_cqe *Ring::peek()
+{
+  unsigned head = *m_cq_head;
+
+  if (head == load_acquire(m_cq_tail)) return NULL;
+
+  return &m_cqes[head & m_cq_mask];
+}
+
+void Ring::seen()
+{
+  store_release(m_cq_head, *m_cq_head + 1);
+}
+
+/**
+ * Register a provided buffer ring: count buffers of size bytes each, all in
+ * one allocation. Multishot receives pick the next free buffer themselves,
+ * so idle connections don't pin any receive memory.
+ */
+int Ring::provide(unsigned count, unsigned size, uint16_t group)
+{
+  m_buf_count = count;
+  m_buf_size = size;
+  m_buf_group = group;
+
+  m_buf_ring_size = count * sizeof(struct io_uring_buf);
+
+  m_buf_ring = (struct io_uring_buf *) mmap(NULL, m_buf_ring_size,
+      PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+  m_bufs = (char *) mmap(NULL, (size_t) count * size,
+      PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+
+  if (m_buf_ring == MAP_FAILED || m_bufs == MAP_FAILED)
+  {
+    m_buf_ring = NULL;
+    m_bufs = NULL;
+    m_err = -1;
+    ERR("provided buffers mmap: %s", strerror(errno));
+    return m_err;
+  }
+
+  struct io_uring_buf_reg reg;
+  memset(&reg, 0, sizeof(reg));
+  reg.ring_addr = (uint64_t) (uintptr_t) m_buf_ring;
+  reg.ring_entries = count;
+  reg.bgid = group;
+
+  m_err = syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PBUF_RING,
+      &reg, 1);
+
+  if (m_err < 0)
+  {
+    ERR("register buffer ring: %s", strerror(errno));
+    return m_err;
+  }
+
+  // struct io_uring_buf_ring declares bufs as a flex array behind an empty
+  // struct, which is a byte in C++ and shifts every entry. Index the ring as
+  // plain io_uring_buf entries instead, the tail overlays bufs[0].resv.
+  m_buf_tail = &m_buf_ring[0].resv;
+  *m_buf_tail = 0;
+
+  for (unsigned i = 0; i < count; i++) recycle(i);
+
+  return m_err;
+}
+
+void Ring::recycle(uint16_t id)
+{
+  uint16_t tail = *m_buf_tail;
+  struct io_uring_buf *buf = &m_buf_ring[tail & (m_buf_count - 1)];
+
+  buf->addr = (uint64_t) (uintptr_t) buffer(id);
+  buf->len = m_buf_size;
+  buf->bid = id;
+
+  __atomic_store_n(m_buf_tail, (uint16_t) (tail + 1), __ATOMIC_RELEASE);
+}
+
+void Ring::prep_accept(int fd, uint64_t data)
+{
+  struct io_uring_sqe *s = sqe();
+  s->opcode = IORING_OP_ACCEPT;
+  s->fd = fd;
+  s->ioprio = IORING_ACCEPT_MULTISHOT;
+  s->accept_flags = SOCK_CLOEXEC;
+  s->user_data = data;
+}
+
+void Ring::prep_recv(int fd, uint16_t group, uint64_t data)
+{
+  struct io_uring_sqe *s = sqe();
+  s->opcode = IORING_OP_RECV;
+  s->fd = fd;
+  s->ioprio = IORING_RECV_MULTISHOT;
+  s->flags = IOSQE_BUFFER_SELECT;
+  s->buf_group = group;
+  s->user_data = data;
+}
+
+void Ring::prep_send(int fd, const char *buf, size_t len, uint64_t data)
+{
+  struct io_uring_sqe *s = sqe();
+  s->opcode = IORING_OP_SEND;
+  s->fd = fd;
+  s->addr = (uint64_t) (uintptr_t) buf;
+  s->len = len;
+  s->msg_flags = MSG_NOSIGNAL;
+  s->user_data = data;
+}
+
+void Ring::prep_close(int fd, uint64_t data)
+{
+  struct io_uring_sqe *s = sqe();
+  s->opcode = IORING_OP_CLOSE;
+  s->fd = fd;
+  s->user_data = data;
+}
+
+void Ring::prep_nop(uint64_t data)
+{
+  struct io_uring_sqe *s = sqe();
+  s->opcode = IORING_OP_NOP;
+  s->user_data = data;
+}
+
+Ring::~Ring()
+{
+  if (m_bufs) munmap(m_bufs, (size_t) m_buf_count * m_buf_size);
+  if (m_buf_ring) munmap(m_buf_ring, m_buf_ring_size);
+
+  if (m_sqes && m_sqes != MAP_FAILED)
+  {
+    munmap(m_sqes, m_params.sq_entries * sizeof(struct io_uring_sqe));
+  }
+
+  if (m_cq_ptr && m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr)
+  {
+    munmap(m_cq_ptr, m_cq_size);
+  }
+
+  if (m_sq_ptr && m_sq_ptr != MAP_FAILED) munmap(m_sq_ptr, m_sq_size);
+
+  if (m_fd >= 0) ::close(m_fd);
+}
+
+}  // namespace
+
+#endif // __linux__
@@ -0,0 +1,99 @@
+#ifndef __RING_H
+#define __RING_H
+
+#if defined(__linux__)
+
+#include <inttypes.h>       // uint32_t, uint64_t
+#include <string.h>         // memset, strerror
+#include <errno.h>          // errno, set by syscalls
+#include <unistd.h>         // syscall, close
+#include <sys/mman.h>       // mmap
+#include <sys/socket.h>     // MSG_NOSIGNAL, SOCK_CLOEXEC
+#include <sys/syscall.h>    // __NR_io_uring_*
+#include <linux/io_uring.h> // io_uring_sqe, io_uring_cqe, IORING_*
+
+#include "log.h"
+
+namespace Net
+{
+
+/**
+ * Bare io_uring instance, no liburing. Owns the submission and completion
+ * rings plus one provided buffer ring the kernel picks receive buffers from.
+ *
+ * Usage is prep a batch of sqes, then submit(wait) once per loop iteration,
+ * then walk the completions with peek()/seen(). Nothing here is thread safe,
+ * one ring per loop.
+ */
+class Ring
+{
+  public:
+    Ring(unsigned entries = 256);
+    Ring(Ring &) = delete;
+    Ring(Ring &&) = delete;
+    ~Ring();
+
+    // next free submission entry, zeroed, flushes to the kernel when full
+    struct io_uring_sqe *sqe();
+
+    // hand queued sqes to the kernel, optionally blocking for completions
+    int submit(unsigned wait = 0);
+
+    // NULL when there's nothing to reap
+    struct io_uring_cqe *peek();
+    void seen();
+
+    // provided buffers, count must be a power of two
+    int provide(unsigned count, unsigned size, uint16_t group);
+    char *buffer(uint16_t id) { return m_bufs + (size_t) id * m_buf_size; }
+    void recycle(uint16_t id);
+
+    void prep_accept(int fd, uint64_t data);
+    void prep_recv(int fd, uint16_t group, uint64_t data);
+    void prep_send(int fd, const char *buf, size_t len, uint64_t data);
+    void prep_close(int fd, uint64_t data);
+    void prep_nop(uint64_t data);
+
+    int fd()  { return m_fd; }
+    int err() { return m_err; }
+
+    unsigned enters() { return m_enters; }
+  private:
+    int m_fd  = -1;
+    int m_err = 0;
+
+    struct io_uring_params m_params;
+
+    void *m_sq_ptr = NULL;
+    void *m_cq_ptr = NULL;
+    size_t m_sq_size = 0;
+    size_t m_cq_size = 0;
+
+    unsigned *m_sq_head;
+    unsigned *m_sq_tail;
+    unsigned m_sq_mask;
+    unsigned m_sq_local = 0;      // tail we've prepared up to
+    unsigned m_sq_flushed = 0;    // tail the kernel has seen
+    struct io_uring_sqe *m_sqes = NULL;
+
+    unsigned *m_cq_head;
+    unsigned *m_cq_tail;
+    unsigned m_cq_mask;
+    struct io_uring_cqe *m_cqes;
+
+    struct io_uring_buf *m_buf_ring = NULL;
+    uint16_t *m_buf_tail = NULL;
+    size_t m_buf_ring_size = 0;
+    char *m_bufs = NULL;
+    unsigned m_buf_count = 0;
+    unsigned m_buf_size = 0;
+    uint16_t m_buf_group = 0;
+
+    unsigned m_enters = 0;
+}; // class
+
+}  // namespace
+
+#endif // __linux__
+
+#endif // __RING_H
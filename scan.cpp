@@ -0,0 +1,278 @@
+#include "scan.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace Http
+{
+
+namespace Scan
+{
+
+/**
+ * RFC 9110 tchar: "!#$%&'*+-.^_`|~", digits and letters.
+ */
+struct TokenMap
+{
+  bool token[256];
+
+  // bit h of low[l] is set when (h << 4 | l) is a token, for the pshufb
+  // lookup; high nibbles 8..f are never tokens
+  unsigned char low[16];
+
+  TokenMap() : token(), low()
+  {
+    const char *special = "!#$%&'*+-.^_`|~";
+
+    for (int c = '0'; c <= '9'; c++) token[c] = true;
+    for (int c = 'a'; c <= 'z'; c++) token[c] = true;
+    for (int c = 'A'; c <= 'Z'; c++) token[c] = true;
+    for (const char *s = special; *s; s++) token[(unsigned char) *s] = true;
+
+    for (int c = 0; c < 128; c++)
+    {
+      if (token[c]) low[c & 0x0f] |= 1 << (c >> 4);
+    }
+  }
+};
+
+static const TokenMap token_map;
+
+static inline bool is_line_stop(unsigned char c)
+{
+  return (c < 0x20 && c != '\t') || c == 0x7f;
+}
+
+static inline bool is_token(unsigned char c)
+{
+  return token_map.token[c];
+}
+
+static const char *line_end_scalar(const char *begin, const char *end)
+{
+  while (begin < end && !is_line_stop(*begin)) begin++;
+  return begin;
+}
+
+static const char *token_end_scalar(const char *begin, const char *end)
+{
+  while (begin < end && is_token(*begin)) begin++;
+  return begin;
+}
+
+#if defined(SCAN_X86)
+
+/**
+ * pcmpestri against a list of byte ranges, the index of the first byte in
+ * the 16 that falls in one of them (16 for none).
+ */
+__attribute__((target("sse4.2")))
+static const char *line_end_sse42(const char *begin, const char *end)
+{
+  static const char ranges[16] = "\x00\x08" "\x0a\x1f" "\x7f\x7f";
+  const __m128i set = _mm_loadu_si128((const __m128i *) ranges);
+
+  while (end - begin >= 16)
+  {
+    __m128i chunk = _mm_loadu_si128((const __m128i *) begin);
+    int index = _mm_cmpestri(set, 6, chunk, 16,
+        _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+
+    if (index < 16) return begin + index;
+
+    begin += 16;
+  }
+
+  return line_end_scalar(begin, end);
+}
+
+/**
+ * Only 8 ranges fit, so "{\xff" also catches '|' and '~'. Those are tokens,
+ * a stop on one of them is checked and the scan carries on after it.
+ */
+__attribute__((target("sse4.2")))
+static const char *token_end_sse42(const char *begin, const char *end)
+{
+  static const char ranges[16] = {
+    '\x00', ' ', '"', '"', '(', ')', ',', ',',
+    '/', '/', ':', '@', '[', ']', '{', '\xff'
+  };
+  const __m128i set = _mm_loadu_si128((const __m128i *) ranges);
+
+  while (end - begin >= 16)
+  {
+    __m128i chunk = _mm_loadu_si128((const __m128i *) begin);
+    int index = _mm_cmpestri(set, 16, chunk, 16,
+        _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+
+    if (index == 16)
+    {
+      begin += 16;
+    }
+    else if (is_token(begin[index]))
+    {
+      begin += index + 1;
+    }
+    else
+    {
+      return begin + index;
+    }
+  }
+
+  return token_end_scalar(begin, end);
+}
+
+__attribute__((target("avx2")))
+static const char *line_end_avx2(const char *begin, const char *end)
+{
+  const __m256i below = _mm256_set1_epi8(0x1f);
+  const __m256i tab = _mm256_set1_epi8('\t');
+  const __m256i del = _mm256_set1_epi8(0x7f);
+
+  while (end - begin >= 32)
+  {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *) begin);
+
+    // unsigned c <= 0x1f, there's no unsigned compare
+    __m256i control = _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, below), chunk);
+    control = _mm256_andnot_si256(_mm256_cmpeq_epi8(chunk, tab), control);
+
+    __m256i stop = _mm256_or_si256(control, _mm256_cmpeq_epi8(chunk, del));
+    unsigned mask = _mm256_movemask_epi8(stop);
+
+    if (mask) return begin + __builtin_ctz(mask);
+
+    begin += 32;
+  }
+
+  return line_end_sse42(begin, end);
+}
+
+/**
+ * Token check as a 16x8 bitmap: the low nibble picks a byte of row bits,
+ * the high nibble picks the bit. Two pshufb and an and per 32 bytes.
+ */
+__attribute__((target("avx2")))
+static const char *token_end_avx2(const char *begin, const char *end)
+{
+  const __m128i low_row = _mm_loadu_si128((const __m128i *) token_map.low);
+  const __m256i low_lut = _mm256_broadcastsi128_si256(low_row);
+  const __m256i high_lut = _mm256_setr_epi8(
+      1, 2, 4, 8, 16, 32, 64, (char) 128, 0, 0, 0, 0, 0, 0, 0, 0,
+      1, 2, 4, 8, 16, 32, 64, (char) 128, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i nibble = _mm256_set1_epi8(0x0f);
+  const __m256i zero = _mm256_setzero_si256();
+
+  while (end - begin >= 32)
+  {
+    __m256i chunk = _mm256_loadu_si256((const __m256i *) begin);
+
+    __m256i low = _mm256_and_si256(chunk, nibble);
+    __m256i high = _mm256_and_si256(_mm256_srli_epi16(chunk, 4), nibble);
+
+    __m256i bits = _mm256_and_si256(
+        _mm256_shuffle_epi8(low_lut, low),
+        _mm256_shuffle_epi8(high_lut, high));
+
+    unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(bits, zero));
+
+    if (mask) return begin + __builtin_ctz(mask);
+
+    begin += 32;
+  }
+
+  return token_end_sse42(begin, end);
+}
+
+#endif
+
+typedef const char *(*ScanFn)(const char *, const char *);
+
+// constant initialised, so the scalar kernel is in place before any
+// dynamic initialiser could call in here
+static ScanFn line_end_fn = line_end_scalar;
+static ScanFn token_end_fn = token_end_scalar;
+static Kernel current = Kernel::SCALAR;
+
+bool supported(Kernel kernel)
+{
+  switch (kernel)
+  {
+    case Kernel::SCALAR: return true;
+#if defined(SCAN_X86)
+    case Kernel::SSE42:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse4.2");
+    case Kernel::AVX2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2") &&
+        __builtin_cpu_supports("sse4.2");
+#endif
+    default: return false;
+  }
+}
+
+bool use(Kernel kernel)
+{
+  if (!supported(kernel)) return false;
+
+  switch (kernel)
+  {
+#if defined(SCAN_X86)
+    case Kernel::AVX2:
+      line_end_fn = line_end_avx2;
+      token_end_fn = token_end_avx2;
+      break;
+    case Kernel::SSE42:
+      line_end_fn = line_end_sse42;
+      token_end_fn = token_end_sse42;
+      break;
+#endif
+    default:
+      line_end_fn = line_end_scalar;
+      token_end_fn = token_end_scalar;
+      break;
+  }
+
+  current = kernel;
+
+  return true;
+}
+
+static bool detect()
+{
+  return use(Kernel::AVX2) || use(Kernel::SSE42) || use(Kernel::SCALAR);
+}
+
+static const bool detected = detect();
+
+const char *line_end(const char *begin, const char *end)
+{
+  return line_end_fn(begin, end);
+}
+
+const char *token_end(const char *begin, const char *end)
+{
+  return token_end_fn(begin, end);
+}
+
+Kernel kernel()
+{
+  return current;
+}
+
+const char *name(Kernel kernel)
+{
+  switch (kernel)
+  {
+    case Kernel::SSE42: return "sse4.2";
+    case Kernel::AVX2:  return "avx2";
+    default:            return "scalar";
+  }
+}
+
+} // namespace Scan
+
+} // namespace
@@ -0,0 +1,51 @@
+#ifndef __SCAN_H
+#define __SCAN_H
+
+#include <stddef.h>
+
+namespace Http
+{
+
+/**
+ * Delimiter scanning for the parser, 16 (SSE4.2) or 32 (AVX2) bytes per
+ * step with a byte at a time fallback. The kernel is picked once from what
+ * the CPU reports; anything that isn't x86 gets the scalar one.
+ *
+ * Both scans return the first byte in [begin, end) they have to stop at, or
+ * end when there isn't one. They never read outside the range.
+ */
+namespace Scan
+{
+  enum class Kernel
+  {
+    SCALAR,
+    SSE42,
+    AVX2
+  };
+
+  /**
+   * Stops at anything that can't appear inside a request line or header
+   * line: the '\n' ending it, '\r', any other control character except tab,
+   * and DEL. Bytes from 0x80 up are allowed (obs-text).
+   */
+  const char *line_end(const char *begin, const char *end);
+
+  /**
+   * Stops at the first byte that isn't an RFC 9110 token character, e.g. the
+   * ':' after a field name.
+   */
+  const char *token_end(const char *begin, const char *end);
+
+  Kernel kernel();
+
+  // false, and nothing changes, when the CPU doesn't have it
+  bool use(Kernel kernel);
+
+  bool supported(Kernel kernel);
+
+  const char *name(Kernel kernel);
+}
+
+}  // namespace
+
+#endif /** __SCAN_H **/
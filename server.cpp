@@ -1,242 +1,146 @@
 #include "server.h"
 
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace Http
 {
 
 Server::Server(const char *addr, int port, int backlog) :
   m_address(),
-  m_sock(),
   m_backlog(backlog),
-  m_sock_reuse(1),
-  m_kqueue(),
-  m_event_subs(),
-  m_event_list(),
-  m_receive_buf(),
-  m_sock_state(),
-  m_clients()
+  m_max_requests(Worker::KEEP_ALIVE_REQUESTS),
+  m_idle_ms(Worker::KEEP_ALIVE_IDLE_MS),
+  m_canned(),
+  m_root(),
+  m_bundle(NULL),
+  m_deflate_max(0),
+  m_input_max(Worker::INPUT_MAX),
+  m_budget(),
+  m_workers()
 {
   m_address.sin_family = AF_INET;
   m_address.sin_addr.s_addr = inet_addr(addr);
   m_address.sin_port = htons(port);
-
-  m_sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
-
-  if (m_sock < 0)
-  {
-    ERR("socket: %s", strerror(errno));
-    return;
-  }
-
-  m_sock_state = INITIALIZED;
-  m_sock_reuse = 1;
-
-  setsockopt(m_sock, SOL_SOCKET, SO_REUSEADDR, &m_sock_reuse,
-      sizeof(m_sock_reuse));
-
-  fcntl(m_sock, F_SETFL, O_NONBLOCK);
 }
 
-int Server::bind()
+void Server::setKeepAlive(unsigned max_requests, uint64_t idle_ms)
 {
-  int err = ::bind(m_sock, (struct sockaddr *) &m_address,
-      sizeof(m_address));
-
-  if (err < 0)
-  {
-    ERR("bind: %s", strerror(errno));
-  }
-  else
-  {
-    m_sock_state = BOUND;
-  }
-
-  return err;
+  m_max_requests = max_requests;
+  m_idle_ms = idle_ms;
 }
 
-int Server::listen()
+void Server::serve(const char *path, unsigned status,
+    const char *content_type, View body)
 {
-  int err = ::listen(m_sock, m_backlog);
-
-  if (err < 0)
-  {
-    ERR("listen: %s", strerror(errno));
-  }
-  else
-  {
-    m_sock_state = LISTENING;
-  }
-
-  return err;
+  m_canned.add(path, status, content_type, body);
 }
 
-int Server::setupRun()
+void Server::setRoot(const char *root)
 {
-  int err = 0;
-
-  if (m_sock_state < BOUND)
-  {
-    if ((err = bind()) < 0) return err;
-    if ((err = listen()) < 0) return err;
-  }
-
-  m_kqueue = kqueue();
-
-  EV_SET(&m_event_subs, m_sock, EVFILT_READ, EV_ADD, 0, 0, NULL);
-
-  err = kevent(m_kqueue, &m_event_subs, 1, NULL, 0, NULL);
-
-  if (err < 0)
-  {
-    ERR("kqueue setup: %s", strerror(errno));
-    ERR("  m_sock: %d", m_sock);
-    ERR("  m_kqueue: %d", m_kqueue);
-  }
-
-  return err;
+  m_root = root;
 }
 
-void Server::run()
+void Server::setBundle(const Bundle *bundle)
 {
-  if (setupRun() < 0 && m_sock_state == LISTENING)
-  {
-    ERR("aborting run loop");
-    return;
-  }
-
-  int event_count = 0;
-  int event_iter = 0;
-  struct kevent curr_event;
-
-  for(;;)
-  { 
-    event_count = kevent(m_kqueue, NULL, 0, m_event_list, EVENTS_MAX, NULL);
-
-    if (event_count < 1)
-    {
-      ERR("kevent read: %s", strerror(errno));
-      return;
-    }
-
-    for (event_iter = 0; event_iter < event_count; event_iter++)
-    {
-      curr_event = m_event_list[event_iter];
-
-      if (curr_event.ident == m_sock)
-      {
-        onClientConnect(curr_event);
-      }
-      else
-      {
-        if (curr_event.flags & EVFILT_READ) onRead(curr_event);
-        if (curr_event.flags & EV_EOF)      onEOF(curr_event);
-      }
-    }
-  }
+  m_bundle = bundle;
 }
 
-int Server::onClientConnect(struct kevent& event)
+void Server::setDeflate(uint64_t max)
 {
-  int client_sock = ::accept(event.ident, NULL, NULL);
-
-  DEBUG("[0x%016" PRIXPTR "] client connect", (unsigned long) client_sock);
-
-  if (client_sock < 0)
-  {
-    ERR("[0x%016" PRIXPTR "] client connect: %s", event.ident, 
-        strerror(errno));
-  }
-
-  fcntl(client_sock, F_SETFL, O_NONBLOCK);
+  m_deflate_max = max;
+}
 
-  EV_SET(&m_event_subs, client_sock, EVFILT_READ, EV_ADD, 0, 0, NULL);
-  int err = kevent(m_kqueue, &m_event_subs, 1, NULL, 0, NULL);
+void Server::setInputLimit(size_t max)
+{
+  m_input_max = max;
+}
 
-  if (err < 0)
-  {
-    ERR("[0x%016" PRIXPTR  "] sub: %s", event.ident, strerror(errno));
-  }
-  
-  return err;
+void Server::setMemoryBudget(size_t bytes)
+{
+  m_budget.setLimit(bytes);
 }
 
-int Server::onClientDisconnect(struct kevent& event)
+/**
+ * Keep a loop on one core so its connection table and buffers stay in that
+ * core's cache. Only linux exposes thread affinity this way, elsewhere the
+ * scheduler decides.
+ */
+static void pin(unsigned core)
 {
-  DEBUG("[0x%016" PRIXPTR "] client disconnect", event.ident);
+#if defined(__linux__)
+  unsigned cores = std::thread::hardware_concurrency();
 
-  EV_SET(&m_event_subs, event.ident, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cores ? core % cores : 0, &set);
 
-  int err = kevent(m_kqueue, &m_event_subs, 1, NULL, 0, NULL);
+  int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
 
-  if (err < 0)
+  if (err != 0)
   {
-    ERR("[0x%016" PRIXPTR "] kqueue unsub", event.ident);
+    WARN("pin to core %u: %s", core, strerror(err));
   }
-
-  return ::close(event.ident);
+#endif
 }
 
-void Server::onRead(struct kevent& event)
+void Server::run(unsigned threads, Dispatch dispatch)
 {
-  DEBUG("[0x%016" PRIXPTR "] client read", event.ident);
+  if (threads == 0) threads = std::thread::hardware_concurrency();
+  if (threads == 0) threads = 1;
 
-  int bytes_read = recv(event.ident, m_receive_buf, 
-      sizeof(m_receive_buf) - 1, 0);
+  bool acceptor = dispatch == Dispatch::ACCEPTOR;
 
-  if (bytes_read <= 0)
-  {
-    ERR("[0x%016" PRIXPTR "] client receive: %s", event.ident, 
-        strerror(errno));
-    return;
-  }
+  Worker::Listener listener = Worker::OWN_LISTENER;
 
-  m_receive_buf[bytes_read] = '\0';
+  if (acceptor)         listener = Worker::NO_LISTENER;
+  else if (threads > 1) listener = Worker::SHARED_LISTENER;
 
-  DEBUG("%s", m_receive_buf);
+  for (unsigned i = 0; i < threads; i++)
+  {
+    m_workers.emplace_back(new Worker(m_address, m_backlog, listener));
+    m_workers.back()->setKeepAlive(m_max_requests, m_idle_ms);
+    m_workers.back()->setCanned(&m_canned);
+    m_workers.back()->setBundle(m_bundle);
+    m_workers.back()->setDeflate(m_deflate_max);
+    m_workers.back()->setInputLimit(m_input_max);
+    m_workers.back()->setBudget(&m_budget);
 
-  Parser p(m_receive_buf, bytes_read);
-  p.parse();
+    if (!m_root.empty()) m_workers.back()->setRoot(m_root.c_str());
+  }
 
-  std::string response;
+  std::vector<std::thread> loops;
 
-  if (p.get_headers()->get_method() == Headers::Method::NONE)
+  // the caller's thread runs worker 0, or the acceptor
+  for (unsigned i = acceptor ? 0 : 1; i < threads; i++)
   {
-    response += "HTTP/1.1 400 Bad Request\r\n";
+    Worker *worker = m_workers[i].get();
+
+    loops.emplace_back([worker, i]()
+    {
+      pin(i);
+      worker->run();
+    });
   }
-  else
+
+  if (acceptor)
   {
-    response += "HTTP/1.1 200 OK\r\n";
-    response += "Content-Type: text/html; charset=UTF-8\r\n";
-    response += "\r\n";
-    response += "Hello, world!\r\n";
+    Acceptor a(m_address, m_workers, m_backlog);
+    a.run();
   }
-
-  int bytes_sent = send(event.ident, response.c_str(), response.size(), 0);
-
-  event.flags |= EV_EOF;
-}
-
-void Server::onEOF(struct kevent& event)
-{
-  DEBUG("[0x%016" PRIXPTR "] client eof", event.ident);
-
-  onClientDisconnect(event);
-}
-
-int Server::close()
-{
-  int err = ::close(m_sock);
-
-  if (err < 0)
+  else
   {
-    ERR("close: %s", strerror(errno));
+    if (threads > 1) pin(0);
+    m_workers[0]->run();
   }
 
-  return err;
+  for (auto &loop : loops) loop.join();
 }
 
 Server::~Server()
 {
-  if (m_sock_state == LISTENING) close();
 }
 
 } // namepsace
@@ -1,26 +1,39 @@
 #ifndef __SERVER_H
 #define __SERVER_H
 
+#include <memory>
 #include <string>
-#include <unordered_map>
+#include <vector>
+#include <thread>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-#include <sys/socket.h>
-#include <sys/types.h>
-#include <sys/event.h>
-#include <unistd.h>
-#include <errno.h>
-#include <inttypes.h>
-#include <fcntl.h>
 #include "log.h"
-#include "parser.h"
+#include "worker.h"
+#include "acceptor.h"
 
 namespace Http
 {
 
+/**
+ * Owns the listen address and one Worker per loop thread. With a single
+ * thread the loop runs on the caller, with more every worker gets its own
+ * thread, pinned to a core where the platform lets us.
+ *
+ * How connections reach the workers:
+ *   REUSE_PORT - every worker has its own SO_REUSEPORT listener and the
+ *                kernel spreads connections by hash
+ *   ACCEPTOR   - the caller's thread runs an Acceptor that owns the only
+ *                listener and hands fds to the least loaded worker
+ */
 class Server
 {
   public:
+    enum class Dispatch
+    {
+      REUSE_PORT,
+      ACCEPTOR
+    };
+
     Server(
         const char *addr = "0.0.0.0", 
         const int port = 8080, 
@@ -29,44 +42,55 @@ class Server
     Server(Server &&s) = delete;
     ~Server();
 
-    void onRead(struct kevent& event);
-    void onEOF(struct kevent& event);
+    // persistent connection limits for every worker, see Worker
+    void setKeepAlive(unsigned max_requests, uint64_t idle_ms);
 
-    int onClientConnect(struct kevent& event);
-    int onClientDisconnect(struct kevent& event);
+    /**
+     * Answer path with a response serialized now, before run(), and shared
+     * by every worker: health checks, fixed error pages. The body is
+     * copied.
+     */
+    void serve(const char *path, unsigned status, const char *content_type,
+        View body);
 
-    void run();
-  private:
-    int listen();
-    int bind();
-    int shutdown();
-    int close();
+    // serve files from this directory, see Worker::setRoot()
+    void setRoot(const char *root);
+
+    // serve assets compiled in, see Worker::setBundle()
+    void setBundle(const Bundle *bundle);
+
+    // gzip bigger text files as they're sent, see Worker::setDeflate()
+    void setDeflate(uint64_t max);
 
-    int setupRun();
+    // request bytes held per connection, see Worker::setInputLimit()
+    void setInputLimit(size_t max);
 
+    /**
+     * Most bytes every worker's connections hold in buffers between them,
+     * 0 for no limit; see Worker::setBudget(). Idle connections give
+     * theirs back either way.
+     */
+    void setMemoryBudget(size_t bytes);
+
+    // 0 threads means one per core
+    void run(unsigned threads = 1, Dispatch dispatch = Dispatch::REUSE_PORT);
+  private:
     struct sockaddr_in m_address;
-    int m_sock_reuse;
-    int m_sock;
     int m_backlog;
 
-    int m_kqueue;
-    struct kevent m_event_subs;
-    static const int EVENTS_MAX = 32;
-    struct kevent m_event_list[EVENTS_MAX];
+    unsigned m_max_requests;
+    uint64_t m_idle_ms;
 
-    static const int RECEIVE_MAX = 1024;
-    char m_receive_buf[RECEIVE_MAX];
-
-    enum SocketState {
-      INITIALIZED,
-      BOUND,
-      LISTENING,
-      CLOSED
-    };
+    Canned::Table m_canned;
+    std::string m_root;
+    const Bundle *m_bundle;
+    uint64_t m_deflate_max;
+    size_t m_input_max;
 
-    SocketState m_sock_state;
+    // shared by the workers, it has to outlive them
+    Net::Budget m_budget;
 
-    std::unordered_map<std::string, std::string> m_clients;
+    std::vector<std::unique_ptr<Worker>> m_workers;
 };
 
 } // namspace
@@ -0,0 +1,206 @@
+#ifndef __SLAB_H
+#define __SLAB_H
+
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+namespace Net
+{
+
+/**
+ * Per connection state indexed by fd. The kernel hands out the lowest free
+ * descriptor, so fds stay dense and the fd itself is the index: a lookup is
+ * a shift, a mask and a bit test, with no hashing and no probing.
+ *
+ * Each entry is split in two. Hot is what the event path touches on every
+ * wakeup and should fit a cache line; Cold is the rest, bulky and only
+ * needed once there are bytes to deal with. They live in separate arrays of
+ * the same page, so walking or touching hot entries doesn't drag the cold
+ * ones through the cache.
+ *
+ * Storage comes in pages of PAGE slots, allocated the first time an fd in
+ * their range is added and kept until the slab goes. Entries never move,
+ * pointers to them stay good until they're erased. Adding and erasing
+ * construct and destroy in place, nothing is allocated for an fd whose page
+ * is already there.
+ */
+template <typename Hot, typename Cold>
+class Slab
+{
+  public:
+    Slab() : m_pages(), m_size(0) {}
+    Slab(Slab &) = delete;
+    Slab(Slab &&) = delete;
+
+    ~Slab()
+    {
+      for (size_t i = 0; i < m_pages.size(); i++)
+      {
+        Page *page = m_pages[i];
+
+        if (page == NULL) continue;
+
+        for (size_t slot = 0; slot < PAGE; slot++)
+        {
+          if (page->used(slot)) page->destroy(slot);
+        }
+
+        page->~Page();
+        free(page);
+      }
+    }
+
+    // NULL when there's nothing for fd
+    Hot *find(int fd)
+    {
+      size_t index = fd;
+
+      if (fd < 0 || (index >> SHIFT) >= m_pages.size()) return NULL;
+
+      Page *page = m_pages[index >> SHIFT];
+
+      if (page == NULL || !page->used(index & MASK)) return NULL;
+
+      return page->hot(index & MASK);
+    }
+
+    // fd has to be in the slab
+    Cold &cold(int fd)
+    {
+      return *m_pages[(size_t) fd >> SHIFT]->cold((size_t) fd & MASK);
+    }
+
+    /**
+     * Construct a default Cold and a Hot from args for fd, in place of
+     * whatever was there for it before. A Hot that can be constructed
+     * with its Cold ahead of args gets it, to keep a reference. NULL for a
+     * negative fd, or when there's no memory for its page.
+     */
+    template <typename... Args>
+    Hot *emplace(int fd, Args&&... args)
+    {
+      if (fd < 0) return NULL;
+
+      size_t index = fd;
+      size_t number = index >> SHIFT;
+
+      if (number >= m_pages.size()) m_pages.resize(number + 1, NULL);
+
+      Page *page = m_pages[number];
+
+      if (page == NULL)
+      {
+        void *memory = NULL;
+
+        if (posix_memalign(&memory, alignof(Page), sizeof(Page)) != 0)
+        {
+          return NULL;
+        }
+
+        page = m_pages[number] = new (memory) Page();
+      }
+
+      size_t slot = index & MASK;
+
+      if (page->used(slot)) page->destroy(slot);
+      else                  m_size++;
+
+      Cold *cold = new (page->cold(slot)) Cold();
+
+      construct(page->hot(slot), *cold,
+          std::is_constructible<Hot, Cold &, Args...>(),
+          std::forward<Args>(args)...);
+
+      page->mark(slot);
+
+      return page->hot(slot);
+    }
+
+    // false when there was nothing for fd
+    bool erase(int fd)
+    {
+      if (find(fd) == NULL) return false;
+
+      size_t index = fd;
+
+      m_pages[index >> SHIFT]->destroy(index & MASK);
+      m_size--;
+
+      return true;
+    }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    // bytes of pages allocated, in use or not
+    size_t reserved() const
+    {
+      size_t pages = 0;
+
+      for (Page *page : m_pages) pages += page != NULL;
+
+      return pages * sizeof(Page);
+    }
+
+    static const size_t SHIFT = 8;
+    static const size_t PAGE = 1 << SHIFT;
+    static const size_t MASK = PAGE - 1;
+  private:
+    template <typename... Args>
+    static void construct(Hot *at, Cold &cold, std::true_type,
+        Args&&... args)
+    {
+      new (at) Hot(cold, std::forward<Args>(args)...);
+    }
+
+    template <typename... Args>
+    static void construct(Hot *at, Cold &, std::false_type, Args&&... args)
+    {
+      new (at) Hot(std::forward<Args>(args)...);
+    }
+
+    struct Page
+    {
+      typename std::aligned_storage<sizeof(Hot), alignof(Hot)>::type
+        hots[PAGE];
+      typename std::aligned_storage<sizeof(Cold), alignof(Cold)>::type
+        colds[PAGE];
+
+      uint64_t bits[PAGE / 64];
+
+      Page() : bits() {}
+
+      Hot *hot(size_t slot) { return (Hot *) &hots[slot]; }
+      Cold *cold(size_t slot) { return (Cold *) &colds[slot]; }
+
+      bool used(size_t slot) const
+      {
+        return bits[slot / 64] & ((uint64_t) 1 << (slot % 64));
+      }
+
+      void mark(size_t slot)
+      {
+        bits[slot / 64] |= (uint64_t) 1 << (slot % 64);
+      }
+
+      void destroy(size_t slot)
+      {
+        hot(slot)->~Hot();
+        cold(slot)->~Cold();
+
+        bits[slot / 64] &= ~((uint64_t) 1 << (slot % 64));
+      }
+    };
+
+    std::vector<Page *> m_pages;
+    size_t m_size;
+}; // class
+
+}  // namespace
+
+#endif // __SLAB_H
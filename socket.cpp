@@ -1,28 +1,254 @@
 #include "socket.h"
 
+#include <vector>
+
+#if defined(__linux__)
+#include <netinet/in.h>
+#include <linux/errqueue.h>
+#endif
+
+#if defined(__linux__) && defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY)
+#define HAVE_ZEROCOPY 1
+#endif
+
 namespace Net
 {
 
+namespace
+{
+
+/**
+ * Sockets closed with zero-copy sends still in flight, on this thread.
+ * The kernel may yet transmit from the pages their keeps hold, and only
+ * says it's done through the socket's error queue, so the fd stays open
+ * until the last of them is reported and the keeps go with it. Looked at
+ * whenever another socket on the thread closes; whatever's left when the
+ * thread exits is closed then.
+ */
+class Lingering
+{
+  public:
+    ~Lingering()
+    {
+      for (Entry &e : m_entries) ::close(e.fd);
+    }
+
+    void add(int fd, std::unique_ptr<ZeroCopy> zerocopy)
+    {
+      m_entries.push_back(Entry{fd, std::move(zerocopy)});
+    }
+
+    // closes the ones with nothing held any more
+    void sweep()
+    {
+      for (size_t i = 0; i < m_entries.size(); )
+      {
+        Entry &e = m_entries[i];
+
+        e.zerocopy->reap(e.fd);
+
+        if (e.zerocopy->held() > 0)
+        {
+          i++;
+          continue;
+        }
+
+        ::close(e.fd);
+
+        if (i + 1 < m_entries.size()) e = std::move(m_entries.back());
+        m_entries.pop_back();
+      }
+    }
+
+    size_t size() const { return m_entries.size(); }
+  private:
+    struct Entry
+    {
+      int fd;
+      std::unique_ptr<ZeroCopy> zerocopy;
+    };
+
+    std::vector<Entry> m_entries;
+};
+
+thread_local Lingering held_open;
+
+}
+
+bool ZeroCopy::enable(int fd, size_t threshold)
+{
+#ifdef HAVE_ZEROCOPY
+  int on = 1;
+
+  if (setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on)) < 0)
+  {
+    DEBUG("SO_ZEROCOPY: %s", strerror(errno));
+    return false;
+  }
+
+  m_threshold = threshold > 0 ? threshold : 1;
+
+  return true;
+#else
+  (void) fd;
+  (void) threshold;
+
+  return false;
+#endif
+}
+
+/**
+ * Only a send the kernel took counts against its numbering, one that
+ * failed didn't happen. Out of option memory for notifications it's
+ * ENOBUFS; a reap and the next try clear that, copying now is as good.
+ */
+ssize_t ZeroCopy::send(int fd, const struct iovec *iov, int count,
+    std::shared_ptr<const void> keep, int flags)
+{
+  struct msghdr msg = {};
+  msg.msg_iov = (struct iovec *) iov;
+  msg.msg_iovlen = count;
+
+  size_t size = 0;
+
+  for (int i = 0; i < count; i++) size += iov[i].iov_len;
+
+#ifdef HAVE_ZEROCOPY
+  if (m_threshold > 0 && size >= m_threshold)
+  {
+    ssize_t sent = sendmsg(fd, &msg, flags | MSG_ZEROCOPY);
+
+    if (sent >= 0)
+    {
+      m_held.push_back(Held{m_next++, std::move(keep)});
+      m_sends++;
+
+      return sent;
+    }
+
+    if (errno != ENOBUFS) return sent;
+
+    reap(fd);
+  }
+#endif
+
+  return sendmsg(fd, &msg, flags);
+}
+
+/**
+ * Each notification is a range of send numbers, in the order the kernel
+ * finished them, which is almost always the order they were made; the
+ * front of the queue is where they're looked for first.
+ */
+int ZeroCopy::reap(int fd)
+{
+  int released = 0;
+
+#ifdef HAVE_ZEROCOPY
+  for (;;)
+  {
+    char control[128];
+    struct msghdr msg = {};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) break;
+
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm;
+        cm = CMSG_NXTHDR(&msg, cm))
+    {
+      if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+            (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR)))
+      {
+        continue;
+      }
+
+      const struct sock_extended_err *e =
+        (const struct sock_extended_err *) CMSG_DATA(cm);
+
+      if (e->ee_origin != SO_EE_ORIGIN_ZEROCOPY || e->ee_errno != 0)
+      {
+        continue;
+      }
+
+      // first to last, inclusive, in wrapping 32 bit arithmetic
+      uint32_t first = e->ee_info;
+      uint32_t count = e->ee_data - first + 1;
+
+      if (e->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) m_copied += count;
+
+      for (auto held = m_held.begin(); held != m_held.end(); )
+      {
+        if (held->id - first < count)
+        {
+          held = m_held.erase(held);
+          released++;
+        }
+        else
+        {
+          ++held;
+        }
+      }
+    }
+  }
+#else
+  (void) fd;
+#endif
+
+  return released;
+}
+
 Socket::Socket(FD fd, State state, Type type)
   : m_fd(fd),
-    m_listen_addr(),
-    m_send_addr(),
-    m_type(type),
     m_state(state),
-    m_buf()
+    m_type(type),
+    m_address(),
+    m_zerocopy()
 {
-  DEBUG("construct: %zu, %d, %d", m_fd, m_state, m_type);
+  DEBUG("construct: %d, %d, %d", m_fd, m_state, m_type);
 }
 
 Socket::Socket(Type type)
-  : m_listen_addr(),
-    m_type(type),
-    m_send_addr(),
-    m_buf()
+  : m_type(type),
+    m_address(),
+    m_zerocopy()
 {
   DEBUG("construct: %d", m_type);
 }
 
+Socket::Socket(Socket &&s)
+  : m_fd(s.m_fd),
+    m_err(s.m_err),
+    m_backlog(s.m_backlog),
+    m_state(s.m_state),
+    m_type(s.m_type),
+    m_address(s.m_address),
+    m_zerocopy(std::move(s.m_zerocopy))
+{
+  s.m_fd = -1;
+  s.m_state = CLOSED;
+}
+
+Socket &Socket::operator=(Socket &&s)
+{
+  if (this == &s) return *this;
+
+  close();
+
+  m_fd = s.m_fd;
+  m_err = s.m_err;
+  m_backlog = s.m_backlog;
+  m_state = s.m_state;
+  m_type = s.m_type;
+  m_address = s.m_address;
+  m_zerocopy = std::move(s.m_zerocopy);
+
+  s.m_fd = -1;
+  s.m_state = CLOSED;
+
+  return *this;
+}
+
 void Socket::ipv4(IPV4 &ipv4, const char *addr, int &port)
 {
   // For the curious mind
@@ -40,7 +266,7 @@ void Socket::ipv4(IPV4 &ipv4, const char *addr, int &port)
 
 int Socket::configure(const char *addr, int port)
 {
-  Socket::ipv4(m_listen_addr, addr, port);
+  Socket::ipv4(m_address, addr, port);
   return configure();
 }
 
@@ -61,8 +287,9 @@ int Socket::configure()
 
   // allow binding to wildcard addresses, while also using specific addresses
   // so 0.0.0.0:80 and 192.168.0.1:80 are two different addresses
-  m_err = setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &m_reuse,
-      sizeof(int));
+  int reuse = 1;
+
+  m_err = setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(int));
 
   if (m_err < 0) 
   {
@@ -96,7 +323,7 @@ int Socket::configure()
 
 int Socket::bind()
 {
-  m_err = ::bind(m_fd, (struct sockaddr *) &m_listen_addr,
+  m_err = ::bind(m_fd, (struct sockaddr *) &m_address,
       sizeof(IPV4));
 
   if (m_err < 0)
@@ -140,16 +367,21 @@ int Socket::accept()
 
   if (m_err < 0) 
   {
-    ERR("accept: %s", strerror(errno));
+    // a nonblocking listener that has run out of pending connections
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+      ERR("accept: %s", strerror(errno));
+    }
+
     return m_err;
   }
 
-  m_accepted = m_err;
+  int accepted = m_err;
   
   // set the new client connection to non-blocking
   if (m_type == NONBLOCKING)
   {
-    m_err = fcntl(m_accepted, F_SETFL, O_NONBLOCK);
+    m_err = fcntl(accepted, F_SETFL, O_NONBLOCK);
     
     if (m_err < 0)
     {
@@ -159,14 +391,44 @@ int Socket::accept()
     } 
   }
 
-  return m_accepted;
+  return accepted;
+}
+
+size_t Socket::lingering()
+{
+  return held_open.size();
 }
 
+/**
+ * A socket with zero-copy sends the kernel hasn't finished with isn't
+ * closed yet, see Lingering: it's shut for writing, which still sends
+ * what's queued, and closed along with its keeps once that's all done.
+ * To the caller it's closed either way.
+ */
 int Socket::close()
 {
-  DEBUG("close: %lu", fd());
-  
-  if (m_state != INVALID) 
+  DEBUG("close: %d", m_fd);
+
+  if (held_open.size() > 0) held_open.sweep();
+
+  if (m_state != INVALID && m_state != CLOSED && m_zerocopy &&
+      m_zerocopy->held() > 0)
+  {
+    m_zerocopy->reap(m_fd);
+
+    if (m_zerocopy->held() > 0)
+    {
+      ::shutdown(m_fd, SHUT_WR);
+      held_open.add(m_fd, std::move(m_zerocopy));
+
+      m_state = CLOSED;
+      m_err = 0;
+
+      return m_err;
+    }
+  }
+
+  if (m_state != INVALID && m_state != CLOSED) 
   {
     m_err = ::close(fd());
 
@@ -186,9 +448,10 @@ int Socket::close()
 
 int Socket::connect(const char *addr, int port)
 {
-  Socket::ipv4(m_send_addr, addr, port);
+  IPV4 address = IPV4();
+  Socket::ipv4(address, addr, port);
 
-  m_err = ::connect(m_fd, (struct sockaddr *) &m_send_addr, sizeof(IPV4));
+  m_err = ::connect(m_fd, (struct sockaddr *) &address, sizeof(IPV4));
 
   // EINPROGRESS returned when socket is nonblocking
   if (m_err < 0 && errno != EINPROGRESS)
@@ -214,7 +477,8 @@ int Socket::send(const char *buf, size_t length)
 {
   m_err = ::send(m_fd, buf, length, 0);
 
-  if (m_err < 0)
+  // a full socket buffer on a nonblocking socket is for the caller to handle
+  if (m_err < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
   {
     ERR("send: %s", strerror(errno));
   }
@@ -223,11 +487,47 @@ int Socket::send(const char *buf, size_t length)
   return m_err;
 }
 
+bool Socket::zerocopy(size_t threshold)
+{
+  if (!m_zerocopy) m_zerocopy.reset(new ZeroCopy());
+
+  if (m_zerocopy->enable(m_fd, threshold)) return true;
+
+  // nothing can have been held by a socket that never had it
+  if (m_zerocopy->sends() == 0) m_zerocopy.reset();
+
+  return false;
+}
+
+const ZeroCopy &Socket::zerocopy_state() const
+{
+  static const ZeroCopy none;
+
+  return m_zerocopy ? *m_zerocopy : none;
+}
+
+int Socket::send(const char *buf, size_t length,
+    std::shared_ptr<const void> keep)
+{
+  struct iovec iov = { (void *) buf, length };
+
+  m_err = m_zerocopy ? m_zerocopy->send(m_fd, &iov, 1, std::move(keep)) :
+    ::send(m_fd, buf, length, 0);
+
+  if (m_err < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+  {
+    ERR("send: %s", strerror(errno));
+  }
+
+  return m_err;
+}
+
 int Socket::recv(char *buf, size_t length)
 {
   m_err = ::recv(m_fd, buf, length, 0);
 
-  if (m_err < 0)
+  // nothing left to read on a nonblocking socket isn't worth a log line
+  if (m_err < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
   {
     ERR("recv: %s", strerror(errno));
   }
@@ -1,6 +1,9 @@
 #ifndef __SOCKET_H
 #define __SOCKET_H
 
+#include <deque>
+#include <memory>
+#include <inttypes.h>   // uintptr_t
 #include <netinet/in.h> // sockaddr_in
 #include <arpa/inet.h>  // inet_addr
 #include <string.h>     // strerror
@@ -8,16 +11,88 @@
 #include <fcntl.h>      // fcntl, F_SETFL, O_NONBLOCK
 #include <sys/socket.h> // bind, listen, accept, connect
 #include <unistd.h>     // close, read, write
+#include <sys/uio.h>    // struct iovec
 
 #include "log.h"
 
 namespace Net
 {
 
+/**
+ * MSG_ZEROCOPY bookkeeping for one socket (linux 4.14 and up, TCP). A
+ * zero-copy send pins the caller's pages instead of copying them into the
+ * socket buffer, so they have to stay untouched until the kernel says,
+ * through the socket's error queue, that it's done with them. Each send
+ * holds its keep until then; reap() reads the notifications and lets go.
+ *
+ * Pinning and the notification cost more than copying a small buffer, so
+ * sends below the threshold given to enable() copy as usual; see
+ * bench/zerocopy.cpp for where the two cross. Over loopback the kernel
+ * copies anyway when the data is delivered, and says so, copied() counts
+ * those.
+ *
+ * Elsewhere, or where the kernel refuses SO_ZEROCOPY, enable() is false
+ * and every send copies.
+ */
+class ZeroCopy
+{
+  public:
+    ZeroCopy() : m_threshold(0), m_next(0), m_held(), m_sends(0), m_copied(0)
+    {}
+
+    // zero-copy sends of threshold bytes and up, false if unavailable
+    bool enable(int fd, size_t threshold = THRESHOLD);
+    bool enabled() const { return m_threshold > 0; }
+
+    /**
+     * Like sendmsg() for these iovecs, zero-copy if they add up to the
+     * threshold. keep is held until the kernel is done with the pages.
+     */
+    ssize_t send(int fd, const struct iovec *iov, int count,
+        std::shared_ptr<const void> keep, int flags = 0);
+
+    // what the error queue reports done is released, returns how many
+    int reap(int fd);
+
+    // zero-copy sends not yet reported done
+    size_t held() const { return m_held.size(); }
+
+    size_t sends() const { return m_sends; }
+    size_t copied() const { return m_copied; }
+
+    // below this copying wins, see bench/zerocopy.cpp
+    static const size_t THRESHOLD = 64 * 1024;
+  private:
+    struct Held
+    {
+      uint32_t id;
+      std::shared_ptr<const void> keep;
+    };
+
+    size_t m_threshold;
+
+    // the kernel numbers zero-copy sends per socket from 0
+    uint32_t m_next;
+    std::deque<Held> m_held;
+
+    size_t m_sends;
+    size_t m_copied;
+};
+
+/**
+ * A socket descriptor and the little state the berkeley api makes us keep
+ * between calls, nothing more. Move-only: exactly one Socket owns an fd
+ * and closes it on destruct, a moved-from one is CLOSED and owns nothing.
+ *
+ * Nothing is read into the socket itself, recv() fills the caller's
+ * buffer, which belongs to the connection or the loop. Zero-copy
+ * bookkeeping is allocated the first time zerocopy() asks for it, the
+ * sockets that never send large bodies don't carry it.
+ */
 class Socket
 {
   public:
-    enum State {
+    enum State : uint8_t {
       INVALID,
       INITIALIZED,
       BOUND,
@@ -28,7 +103,7 @@ class Socket
       CLOSED
     };
 
-    enum Type {
+    enum Type : uint8_t {
       BLOCKING,
       NONBLOCKING
     };
@@ -38,8 +113,13 @@ class Socket
 
     Socket(FD fd, State state = INVALID, Type type = BLOCKING);
     Socket(Type type = BLOCKING);
+    Socket(const Socket &s) = delete;
+    Socket(Socket &&s);
     ~Socket() { close(); }
 
+    Socket &operator=(const Socket &s) = delete;
+    Socket &operator=(Socket &&s);
+
     int configure(const char *, int); 
     int configure(); 
     int bind();
@@ -51,26 +131,52 @@ class Socket
     int send(const char *, size_t);
     int recv(char *, size_t);
 
+    /**
+     * Zero-copy mode, see ZeroCopy: sends of threshold bytes and up that
+     * come with a keep go out with MSG_ZEROCOPY. False where it can't be
+     * had, sends copy then.
+     *
+     * Completions arrive on the error queue, which a poller reports as
+     * Event::ERROR. Transport reaps them there and only disconnects on a
+     * real error; any other loop has to do the same, Http::Worker writes
+     * its own fds and doesn't use this.
+     *
+     * Closing with sends in flight doesn't let go of their keeps, the fd
+     * is kept open until the kernel is done with them; see close().
+     */
+    bool zerocopy(size_t threshold = ZeroCopy::THRESHOLD);
+
+    // buf stays valid, and keep held, until the kernel is done with it
+    int send(const char *, size_t, std::shared_ptr<const void> keep);
+
+    // releases the buffers of finished zero-copy sends, see ZeroCopy::reap
+    int reap() { return m_zerocopy ? m_zerocopy->reap(m_fd) : 0; }
+
+    // all zeroes until zerocopy() succeeds
+    const ZeroCopy &zerocopy_state() const;
+
+    // closed on this thread with zero-copy sends in flight, not yet done
+    static size_t lingering();
+
     State state()           { return m_state; }
     Type type()             { return m_type; }
     int err()               { return m_err; }
     FD fd()                 { return m_fd; }
 
+    void backlog(int backlog) { m_backlog = backlog; }
+
     static void ipv4(IPV4&, const char *, int&);
   private:
+    int m_fd        = -1;
+    int m_err       = -1;
+    int m_backlog   = 1000;
     State m_state   = INVALID;
-    FD m_fd       = 0;
-    FD m_accepted = 0;
-    int m_reuse   = 1;
-    int m_backlog = 1000;
-    Type m_type   = BLOCKING;
-    int m_err     = -1;
-
-    IPV4 m_listen_addr;
-    IPV4 m_send_addr;
-
-    static const int RECEIVE_SIZE = 1024;
-    char m_buf[RECEIVE_SIZE];
+    Type m_type     = BLOCKING;
+
+    // where configure() said to bind
+    IPV4 m_address;
+
+    std::unique_ptr<ZeroCopy> m_zerocopy;
 }; // class
 
 }  // namespace
@@ -0,0 +1,115 @@
+#include "bandit/bandit.h"
+#include "arena.h"
+#include <iostream>
+#include <string>
+
+using namespace bandit;
+using namespace Http;
+using namespace std;
+
+go_bandit([]()
+{
+  describe("Arena", []()
+  {
+    it("should not allocate until asked to", []
+    {
+      Arena a;
+      AssertThat(a.reserved(), Equals((size_t) 0));
+      AssertThat(a.used(), Equals((size_t) 0));
+    });
+
+    it("should hand out aligned, non-overlapping memory", []
+    {
+      Arena a;
+
+      char *c = (char *) a.allocate(3, 1);
+      uint64_t *u = a.allocate<uint64_t>(4);
+      char *d = (char *) a.allocate(1, 1);
+
+      AssertThat((uintptr_t) u % alignof(uint64_t), Equals((uintptr_t) 0));
+      AssertThat((char *) u, IsGreaterThan(c + 2));
+      AssertThat(d, IsGreaterThan((char *) (u + 3)));
+    });
+
+    it("should reuse the same memory after a reset", []
+    {
+      Arena a;
+
+      void *first = a.allocate(100);
+      a.allocate(200);
+      size_t reserved = a.reserved();
+
+      a.reset();
+
+      AssertThat(a.used(), Equals((size_t) 0));
+      AssertThat(a.allocate(100), Equals(first));
+      AssertThat(a.reserved(), Equals(reserved));
+    });
+
+    it("should keep every chunk across resets", []
+    {
+      Arena a(256);
+
+      for (int i = 0; i < 20; i++) a.allocate(100);
+
+      size_t reserved = a.reserved();
+      a.reset();
+
+      for (int i = 0; i < 20; i++) a.allocate(100);
+
+      AssertThat(a.reserved(), Equals(reserved));
+    });
+
+    it("should take allocations bigger than a chunk", []
+    {
+      Arena a(256);
+
+      char *big = (char *) a.allocate(10000);
+      memset(big, 'x', 10000);
+
+      AssertThat(a.reserved(), IsGreaterThan((size_t) 10000));
+    });
+
+    it("should grow the last allocation in place", []
+    {
+      Arena a;
+
+      char *p = (char *) a.allocate(16, 1);
+      memcpy(p, "0123456789abcdef", 16);
+
+      char *q = (char *) a.reallocate(p, 16, 64, 1);
+
+      AssertThat(q, Equals(p));
+      AssertThat(string(q, 16), Equals("0123456789abcdef"));
+    });
+
+    it("should move an allocation that can't grow in place", []
+    {
+      Arena a;
+
+      char *p = (char *) a.allocate(16, 1);
+      memcpy(p, "0123456789abcdef", 16);
+      a.allocate(1, 1);
+
+      char *q = (char *) a.reallocate(p, 16, 64, 1);
+
+      AssertThat(q, !Equals(p));
+      AssertThat(string(q, 16), Equals("0123456789abcdef"));
+    });
+
+    it("should give its memory back on release", []
+    {
+      Arena a;
+      a.allocate(100);
+      a.release();
+
+      AssertThat(a.reserved(), Equals((size_t) 0));
+      AssertThat(a.allocate(10), !Equals((void *) NULL));
+    });
+  });
+});
+
+int main(int argc, char **argv)
+{
+  return run(argc, argv);
+}
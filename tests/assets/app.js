@@ -0,0 +1,41 @@
+// every line looks like the last, so this compresses well
+export function handler0(request) { return request.path + '0'; }
+export function handler1(request) { return request.path + '1'; }
+export function handler2(request) { return request.path + '2'; }
+export function handler3(request) { return request.path + '3'; }
+export function handler4(request) { return request.path + '4'; }
+export function handler5(request) { return request.path + '5'; }
+export function handler6(request) { return request.path + '6'; }
+export function handler7(request) { return request.path + '7'; }
+export function handler8(request) { return request.path + '8'; }
+export function handler9(request) { return request.path + '9'; }
+export function handler10(request) { return request.path + '10'; }
+export function handler11(request) { return request.path + '11'; }
+export function handler12(request) { return request.path + '12'; }
+export function handler13(request) { return request.path + '13'; }
+export function handler14(request) { return request.path + '14'; }
+export function handler15(request) { return request.path + '15'; }
+export function handler16(request) { return request.path + '16'; }
+export function handler17(request) { return request.path + '17'; }
+export function handler18(request) { return request.path + '18'; }
+export function handler19(request) { return request.path + '19'; }
+export function handler20(request) { return request.path + '20'; }
+export function handler21(request) { return request.path + '21'; }
+export function handler22(request) { return request.path + '22'; }
+export function handler23(request) { return request.path + '23'; }
+export function handler24(request) { return request.path + '24'; }
+export function handler25(request) { return request.path + '25'; }
+export function handler26(request) { return request.path + '26'; }
+export function handler27(request) { return request.path + '27'; }
+export function handler28(request) { return request.path + '28'; }
+export function handler29(request) { return request.path + '29'; }
+export function handler30(request) { return request.path + '30'; }
+export function handler31(request) { return request.path + '31'; }
+export function handler32(request) { return request.path + '32'; }
+export function handler33(request) { return request.path + '33'; }
+export function handler34(request) { return request.path + '34'; }
+export function handler35(request) { return request.path + '35'; }
+export function handler36(request) { return request.path + '36'; }
+export function handler37(request) { return request.path + '37'; }
+export function handler38(request) { return request.path + '38'; }
+export function handler39(request) { return request.path + '39'; }
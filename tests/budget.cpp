@@ -0,0 +1,94 @@
+#include "bandit/bandit.h"
+#include "budget.h"
+#include <thread>
+#include <vector>
+
+using namespace bandit;
+using namespace Net;
+using namespace std;
+
+go_bandit([]()
+{
+  describe("Budget", []()
+  {
+    it("should count what's charged and credited", []
+    {
+      Budget budget;
+
+      budget.charge(4096);
+      budget.charge(1024);
+      budget.charge(-4096);
+
+      AssertThat(budget.used(), Equals((size_t) 1024));
+    });
+
+    it("should never push back without a limit", []
+    {
+      Budget budget;
+
+      budget.charge(1 << 30);
+
+      AssertThat(budget.pressure(), IsFalse());
+    });
+
+    it("should push back past the limit until it's down to the low mark", []
+    {
+      Budget budget(1000);
+
+      budget.charge(1000);
+      AssertThat(budget.pressure(), IsFalse());
+
+      budget.charge(1);
+      AssertThat(budget.pressure(), IsTrue());
+
+      // under the limit again, but not yet under the low mark
+      budget.charge(-200);
+      AssertThat(budget.used(), Equals((size_t) 801));
+      AssertThat(budget.pressure(), IsTrue());
+
+      budget.charge(-51);
+      AssertThat(budget.pressure(), IsFalse());
+
+      // and it takes going over again to start over
+      budget.charge(200);
+      AssertThat(budget.pressure(), IsFalse());
+    });
+
+    it("should add up charges from every thread", []
+    {
+      Budget budget;
+      vector<thread> threads;
+
+      for (int t = 0; t < 4; t++)
+      {
+        threads.emplace_back([&budget]()
+        {
+          for (int i = 0; i < 10000; i++)
+          {
+            budget.charge(1024);
+            budget.charge(-1000);
+          }
+        });
+      }
+
+      for (thread &t : threads) t.join();
+
+      AssertThat(budget.used(), Equals((size_t) 4 * 10000 * 24));
+    });
+
+    it("should count the connections it refused", []
+    {
+      Budget budget(1);
+
+      budget.refused();
+      budget.refused();
+
+      AssertThat(budget.refusals(), Equals((uint64_t) 2));
+    });
+  });
+});
+
+int main(int argc, char **argv)
+{
+  return run(argc, argv);
+}
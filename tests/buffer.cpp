@@ -1,104 +1,209 @@
-#include <cstdint>
-#include <cstdio>
-#include <cstring>
-#include <vector>
-#include <iostream>
+#include "bandit/bandit.h"
+#include "buffer.h"
+#include <string>
+#include <thread>
 
-using std::uint8_t;
-using std::vector;
+using namespace bandit;
+using namespace Net;
+using namespace std;
 
-int main()
+static string contents(const Slice &slice)
 {
-  uint8_t ui8_buffer[10] = "hello\0";
-  unsigned char uc_buffer[10] = "hello\0";
+  return string(slice.data(), slice.size());
+}
 
-  printf("%s %s\n", ui8_buffer, uc_buffer);
+static string contents(const Chain &chain)
+{
+  string bytes;
 
-  if (ui8_buffer[1] == 'e')
-  {
-    printf("ui8 as expected\n");
-  }
-  else
-  {
-    printf("ui8 not as expected\n");
-  }
+  for (const Slice &slice : chain.slices()) bytes += contents(slice);
 
-  if (uc_buffer[1] == 'e')
-  {
-    printf("uc as expected\n");
-  }
-  else
-  {
-    printf("uc not as expected\n");
-  }
-
-  // c++11 only - vector initializer list
-  vector<uint8_t> ui8_vec = {'h', 'e', 'l', 'l', 'o', '\0'};
-  vector<unsigned char> uc_vec = {'h', 'e', 'l', 'l', 'o', '\0'};
-
-  // no workie
-  // vector<uint8_t> ui8_vec_string = "hello\0";
-  // vector<unsigned char> uc_vec_string = "hello\0";
-
-  printf("sizeof buffer[10] = %lu %lu\n", sizeof(uc_buffer), sizeof(ui8_buffer)); 
-  vector<unsigned char> uc_vec_str(uc_buffer, uc_buffer + sizeof(uc_buffer));
-  vector<uint8_t> ui8_vec_str(ui8_buffer, ui8_buffer + sizeof(ui8_buffer));
-
-  // okay - vector contiguous memory
-  printf("%s %s\n", uc_vec_str.data(), ui8_vec_str.data());
-  // seg fault - treating the value of [0] as pointer (i think?)
-  // printf("%s %s\n", uc_vec_str[0], ui8_vec_str[0]);
-  // okay - use subscript operator to pass reference to first location
-  printf("%s %s\n", &uc_vec_str[0], &ui8_vec_str[0]);
-
-  // hello, hello
-  for(auto c : uc_vec_str)
+  return bytes;
+}
+
+go_bandit([]()
+{
+  describe("Buffer", []()
   {
-    std::cout << c;
-  }
+    before_each([]()
+    {
+      Pool::local().trim();
+    });
 
-  std::cout << std::endl;
+    it("should round sizes up to a class", []
+    {
+      AssertThat(Pool::capacity(1), Equals((size_t) 1024));
+      AssertThat(Pool::capacity(1024), Equals((size_t) 1024));
+      AssertThat(Pool::capacity(1025), Equals((size_t) 2048));
+      AssertThat(Pool::capacity(65536), Equals((size_t) 65536));
 
-  for (auto c : ui8_vec_str)
-  {
-    std::cout << c;
-  }
+      // past the largest class it's exactly what was asked for
+      AssertThat(Pool::capacity(100000), Equals((size_t) 100000));
+
+      AssertThat(Buffer(3000).capacity(), Equals((size_t) 4096));
+    });
+
+    it("should reuse a block that was given back", []
+    {
+      Pool &pool = Pool::local();
+      uint64_t misses = pool.stats().misses;
+      char *first;
+
+      {
+        Buffer buffer(4096);
+        first = buffer.data();
+
+        AssertThat(pool.stats().in_use, Equals((size_t) 4096));
+      }
+
+      AssertThat(pool.stats().in_use, Equals((size_t) 0));
+      AssertThat(pool.stats().pooled, Equals((size_t) 4096));
+
+      uint64_t hits = pool.stats().hits;
+      Buffer again(4000);
+
+      AssertThat(again.data(), Equals(first));
+      AssertThat(pool.stats().hits, Equals(hits + 1));
+      AssertThat(pool.stats().misses, Equals(misses + 1));
+      AssertThat(pool.stats().pooled, Equals((size_t) 0));
+    });
+
+    it("should give the block back when the last reference goes", []
+    {
+      Pool &pool = Pool::local();
+      Buffer buffer(1024);
+      Buffer copy = buffer;
 
-  std::cout << std::endl;
+      AssertThat(buffer.refs(), Equals((uint32_t) 2));
 
-  // hello, hello
-  std::cout << uc_vec_str.data() << std::endl;
-  std::cout << ui8_vec_str.data() << std::endl;
+      buffer.reset();
 
-  // hello, hello
-  std::cout << &uc_vec_str[0] << std::endl;
-  std::cout << &ui8_vec_str[0] << std::endl;
+      AssertThat(bool(buffer), IsFalse());
+      AssertThat(copy.refs(), Equals((uint32_t) 1));
+      AssertThat(pool.stats().pooled, Equals((size_t) 0));
 
-  // 5, 5
-  std::cout << strlen((char *)uc_vec_str.data()) << std::endl;
-  std::cout << strlen((char *)ui8_vec_str.data()) << std::endl;
+      Buffer moved = std::move(copy);
+      copy.reset();
 
-  // works? coincidence?
-  vector<uint8_t> test = {'n', 'o', ' ', 'n', 'u', 'l', 'l'};
-  std::cout << test.data() << std::endl;
+      AssertThat(moved.refs(), Equals((uint32_t) 1));
+      AssertThat(pool.stats().pooled, Equals((size_t) 0));
 
-  vector<uint8_t> t(1);
+      moved = Buffer();
 
-  // Still reports size 1, not crashing -- def coincidence
-  t[0] = 't';
-  t[1] = 'e';
-  t[2] = 's';
+      AssertThat(pool.stats().pooled, Equals((size_t) 1024));
+    });
 
-  std::cout << t.data() << " " << t.size() << std::endl;
+    it("should not pool blocks past the largest class", []
+    {
+      Pool &pool = Pool::local();
 
-  // no sefault, 1 more zero produces a segfault
-  for (auto i = 3; i < 1000000; i++)
+      {
+        Buffer big(1 << 20);
+        AssertThat(big.capacity(), Equals((size_t) 1 << 20));
+      }
+
+      AssertThat(pool.stats().pooled, Equals((size_t) 0));
+    });
+
+    it("should only keep so much free in a class", []
+    {
+      Pool &pool = Pool::local();
+      size_t size = 65536, keep = Pool::KEEP_MAX;
+
+      {
+        vector<Buffer> burst;
+
+        for (size_t i = 0; i < 2 * keep / size; i++)
+        {
+          burst.push_back(Buffer(size));
+        }
+      }
+
+      AssertThat(pool.stats().pooled, Equals(keep));
+
+      pool.trim();
+
+      AssertThat(pool.stats().pooled, Equals((size_t) 0));
+    });
+
+    it("should give each thread its own pool", []
+    {
+      Pool *here = &Pool::local();
+      Pool *there = NULL;
+
+      thread t([&there]() { there = &Pool::local(); });
+      t.join();
+
+      AssertThat(here != there, IsTrue());
+    });
+  });
+
+  describe("Slice", []()
   {
-    t[i] = 't';
-  }
+    it("should keep its block alive", []
+    {
+      Slice slice;
+
+      {
+        Buffer buffer(1024);
+        memcpy(buffer.data(), "GET /index.html HTTP/1.1", 24);
+
+        slice = Slice(buffer, 4, 11);
+      }
+
+      AssertThat(slice.buffer().refs(), Equals((uint32_t) 1));
+      AssertThat(contents(slice), Equals("/index.html"));
 
-  // capcity still 1
-  std::cout << t.data() << " " << t.capacity() << std::endl;
-  
-  return 0;
+      Slice part = slice.slice(1, 5);
+
+      AssertThat(contents(part), Equals("index"));
+      AssertThat(part.buffer().refs(), Equals((uint32_t) 2));
+    });
+  });
+
+  describe("Chain", []()
+  {
+    it("should copy bytes into as few blocks as it can", []
+    {
+      Chain chain;
+      string body(40000, 'x');
+      size_t block = Chain::BLOCK;
+
+      for (size_t i = 0; i < body.size(); i += 1000)
+      {
+        chain.append(body.data() + i, 1000);
+      }
+
+      AssertThat(chain.size(), Equals(body.size()));
+      AssertThat(chain.slices().size(), Equals((size_t) 3));
+      AssertThat(chain.slices()[0].size(), Equals(block));
+      AssertThat(contents(chain), Equals(body));
+    });
+
+    it("should link slices without copying them", []
+    {
+      Buffer buffer(1024);
+      memcpy(buffer.data(), "world", 5);
+
+      Chain chain;
+      chain.append("hello ", 6);
+      chain.append(Slice(buffer, 0, 5));
+      chain.append("!", 1);
+
+      AssertThat(contents(chain), Equals("hello world!"));
+      AssertThat(chain.slices()[1].data(), Equals((const char *)
+            buffer.data()));
+      AssertThat(chain.slices().size(), Equals((size_t) 3));
+
+      chain.clear();
+
+      AssertThat(chain.empty(), IsTrue());
+      AssertThat(buffer.refs(), Equals((uint32_t) 1));
+    });
+  });
+});
+
+int main(int argc, char **argv)
+{
+  return run(argc, argv);
 }
@@ -0,0 +1,206 @@
+#include "bandit/bandit.h"
+#include "bundle.h"
+#include "parser.h"
+#include <string>
+#include <unistd.h>
+#include <stdio.h>
+
+using namespace bandit;
+using namespace Http;
+using namespace std;
+
+// generated from tests/assets by the bundle_tests target
+namespace Http { extern const Bundle test_bundle; }
+
+static string contents(const char *path)
+{
+  string bytes;
+  FILE *f = fopen(path, "rb");
+  char buf[4096];
+  size_t n;
+
+  while (f && (n = fread(buf, 1, sizeof(buf), f)) > 0) bytes.append(buf, n);
+
+  if (f) fclose(f);
+
+  return bytes;
+}
+
+static string body(const Bundle::Representation &r)
+{
+  return string(r.body, r.body_size);
+}
+
+// the encoding chosen for a GET of path with these fields
+static string chosen(const char *path, const char *fields)
+{
+  string request = string("GET ") + path + " HTTP/1.1\r\n" + fields + "\r\n";
+  Parser p(request.data(), request.size());
+  p.parse();
+
+  return test_bundle.find(path)->choose(*p.get_headers()).encoding;
+}
+
+// what queue() puts on the wire
+static string answer(const Bundle::Representation &r, bool not_modified,
+    bool head_only, const char *connection = "")
+{
+  Net::Output out;
+  Bundle::queue(out, r, not_modified, head_only, "Date: x\r\n", connection);
+
+  int fds[2];
+  pipe(fds);
+  out.flush(fds[1]);
+  close(fds[1]);
+
+  string bytes;
+  char buf[8192];
+  ssize_t n;
+
+  while ((n = read(fds[0], buf, sizeof(buf))) > 0) bytes.append(buf, n);
+
+  close(fds[0]);
+
+  return bytes;
+}
+
+go_bandit([]()
+{
+  describe("Bundle", []()
+  {
+    it("should find every file by its path", []
+    {
+      const Bundle::Asset *index = test_bundle.find("/index.html");
+
+      AssertThat(index != NULL, IsTrue());
+      AssertThat(body(index->representations[0]), Equals("<h1>index</h1>"));
+
+      AssertThat(test_bundle.find("/app.js") != NULL, IsTrue());
+      AssertThat(test_bundle.find("/logo.png") != NULL, IsTrue());
+      const Bundle::Asset *docs = test_bundle.find("/docs/index.html");
+
+      AssertThat(body(docs->representations[0]), Equals("<h1>docs</h1>"));
+    });
+
+    it("should answer for a directory with its index", []
+    {
+      AssertThat(test_bundle.find("/")->representations,
+          Equals(test_bundle.find("/index.html")->representations));
+      AssertThat(test_bundle.find("/docs/")->representations,
+          Equals(test_bundle.find("/docs/index.html")->representations));
+      AssertThat(test_bundle.find("/docs") == NULL, IsTrue());
+    });
+
+    it("should ignore the query string", []
+    {
+      AssertThat(test_bundle.find("/app.js?v=2"),
+          Equals(test_bundle.find("/app.js")));
+      AssertThat(test_bundle.find("/?x")->path, Equals(string("/")));
+    });
+
+    it("should find nothing for anything else", []
+    {
+      AssertThat(test_bundle.find("/missing.html") == NULL, IsTrue());
+      AssertThat(test_bundle.find("/.hidden") == NULL, IsTrue());
+      AssertThat(test_bundle.find("/app.j") == NULL, IsTrue());
+      AssertThat(test_bundle.find("") == NULL, IsTrue());
+      AssertThat(test_bundle.find(string(300, '/').c_str()) == NULL,
+          IsTrue());
+    });
+
+    it("should hold the bytes as they are on disk", []
+    {
+      AssertThat(body(test_bundle.find("/app.js")->representations[0]),
+          Equals(contents("tests/assets/app.js")));
+      AssertThat(body(test_bundle.find("/logo.png")->representations[0]),
+          Equals(contents("tests/assets/logo.png")));
+    });
+
+    it("should only keep encodings that pay for themselves", []
+    {
+      const Bundle::Asset *app = test_bundle.find("/app.js");
+
+      AssertThat(app->count, IsGreaterThan((size_t) 1));
+      AssertThat(test_bundle.find("/index.html")->count, Equals((size_t) 1));
+      AssertThat(test_bundle.find("/logo.png")->count, Equals((size_t) 1));
+
+      for (size_t i = 1; i < app->count; i++)
+      {
+        const Bundle::Representation &r = app->representations[i];
+
+        AssertThat(r.body_size, IsLessThan(app->representations[0].body_size));
+        AssertThat(r.etag_value() != app->representations[0].etag_value(),
+            IsTrue());
+
+        if (string(r.encoding) == "gzip")
+        {
+          AssertThat(body(r).substr(0, 2), Equals("\x1f\x8b"));
+        }
+      }
+    });
+
+    it("should pick the smallest encoding the client takes", []
+    {
+      const Bundle::Asset *app = test_bundle.find("/app.js");
+      string smallest = app->representations[1].encoding;
+
+      AssertThat(chosen("/app.js", ""), Equals(""));
+      AssertThat(chosen("/app.js", "Accept-Encoding: gzip, br\r\n"),
+          Equals(smallest));
+      AssertThat(chosen("/app.js", "Accept-Encoding: gzip\r\n"),
+          Equals("gzip"));
+      AssertThat(chosen("/app.js", "Accept-Encoding: gzip;q=0\r\n"),
+          Equals(""));
+      AssertThat(chosen("/app.js", "Accept-Encoding: identity\r\n"),
+          Equals(""));
+      AssertThat(chosen("/index.html", "Accept-Encoding: gzip\r\n"),
+          Equals(""));
+    });
+
+    it("should queue a whole answer from the arrays", []
+    {
+      const Bundle::Representation &r =
+        test_bundle.find("/index.html")->representations[0];
+
+      string head(r.head, r.head_size);
+
+      AssertThat(head.find("HTTP/1.1 200 OK\r\n"), Equals((size_t) 0));
+      string etag = "ETag: " + r.etag_value().str() + "\r\n";
+
+      AssertThat(head.find("Content-Type: text/html; charset=UTF-8\r\n") !=
+          string::npos, IsTrue());
+      AssertThat(head.find(etag) != string::npos, IsTrue());
+      AssertThat(head.find("Vary"), Equals(string::npos));
+
+      AssertThat(answer(r, false, false), Equals(head +
+            "Date: x\r\n"
+            "\r\n"
+            "<h1>index</h1>"));
+
+      AssertThat(answer(r, false, true, "Connection: close\r\n"), Equals(
+            head + "Date: x\r\nConnection: close\r\n\r\n"));
+    });
+
+    it("should queue the 304 for a representation", []
+    {
+      const Bundle::Asset *app = test_bundle.find("/app.js");
+      const Bundle::Representation &r = app->representations[1];
+
+      string not_modified(r.not_modified, r.not_modified_size);
+
+      AssertThat(not_modified.find("HTTP/1.1 304 Not Modified\r\n"),
+          Equals((size_t) 0));
+      AssertThat(not_modified.find("Vary: Accept-Encoding\r\n") !=
+          string::npos, IsTrue());
+      AssertThat(not_modified.find("Content-Length"), Equals(string::npos));
+
+      AssertThat(answer(r, true, false),
+          Equals(not_modified + "Date: x\r\n\r\n"));
+    });
+  });
+});
+
+int main(int argc, char **argv)
+{
+  return run(argc, argv);
+}
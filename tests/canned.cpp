@@ -0,0 +1,142 @@
+#include "bandit/bandit.h"
+#include "canned.h"
+#include <string>
+#include <unistd.h>
+
+using namespace bandit;
+using namespace Http;
+using namespace std;
+
+static const char DATE[] = "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n";
+
+// everything queued, written through a pipe
+static string written(Net::Output &out)
+{
+  int fds[2];
+  pipe(fds);
+
+  out.flush(fds[1]);
+  ::close(fds[1]);
+
+  string bytes;
+  char buf[4096];
+  ssize_t n;
+
+  while ((n = read(fds[0], buf, sizeof(buf))) > 0) bytes.append(buf, n);
+
+  ::close(fds[0]);
+
+  return bytes;
+}
+
+static string answer(const Canned &canned, Canned::Connection connection,
+    bool head_only = false)
+{
+  Net::Output out;
+  canned.queue(out, DATE, connection, head_only);
+  return written(out);
+}
+
+go_bandit([]()
+{
+  describe("Canned", []()
+  {
+    it("should serialize once per Connection field", []
+    {
+      Canned c(200, "text/plain", "OK\r\n");
+
+      AssertThat(answer(c, Canned::KEEP_ALIVE), Equals(
+            "HTTP/1.1 200 OK\r\n"
+            "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+            "Content-Type: text/plain\r\n"
+            "Content-Length: 4\r\n"
+            "\r\n"
+            "OK\r\n"));
+
+      AssertThat(answer(c, Canned::CLOSE), Equals(
+            "HTTP/1.1 200 OK\r\n"
+            "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+            "Content-Type: text/plain\r\n"
+            "Connection: close\r\n"
+            "Content-Length: 4\r\n"
+            "\r\n"
+            "OK\r\n"));
+
+      AssertThat(answer(c, Canned::KEEP_ALIVE_1_0), Equals(
+            "HTTP/1.1 200 OK\r\n"
+            "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+            "Content-Type: text/plain\r\n"
+            "Connection: keep-alive\r\n"
+            "Content-Length: 4\r\n"
+            "\r\n"
+            "OK\r\n"));
+
+      AssertThat(c.size(Canned::CLOSE) + sizeof(DATE) - 1,
+          Equals(answer(c, Canned::CLOSE).size()));
+    });
+
+    it("should leave the body out of a HEAD answer", []
+    {
+      Canned c(404, "text/html", "<h1>Not Found</h1>");
+
+      AssertThat(answer(c, Canned::KEEP_ALIVE, true), Equals(
+            "HTTP/1.1 404 Not Found\r\n"
+            "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+            "Content-Type: text/html\r\n"
+            "Content-Length: 18\r\n"
+            "\r\n"));
+    });
+
+    it("should drop the body of a status that can't have one", []
+    {
+      Canned c(204, NULL, "ignored");
+
+      AssertThat(answer(c, Canned::KEEP_ALIVE), Equals(
+            "HTTP/1.1 204 No Content\r\n"
+            "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+            "\r\n"));
+    });
+
+    it("should copy only the Date line into the queue", []
+    {
+      Canned c(200, "text/plain", string(8192, 'x').c_str());
+      Net::Output out;
+
+      c.queue(out, DATE, Canned::KEEP_ALIVE);
+
+      AssertThat(out.size(), Equals(c.size(Canned::KEEP_ALIVE) +
+            sizeof(DATE) - 1));
+      AssertThat(out.reserved(), IsLessThan((size_t) 8192));
+    });
+
+    it("should look paths up without the query string", []
+    {
+      Canned::Table table;
+
+      table.add("/health", 200, "text/plain", "OK\r\n");
+      table.add("/gone", 410, NULL, View());
+
+      AssertThat(table.find("/health") != NULL, IsTrue());
+      AssertThat(table.find("/health?probe=1") != NULL, IsTrue());
+      AssertThat(table.find("/gone")->status(), Equals(410u));
+      AssertThat(table.find("/healthz") == NULL, IsTrue());
+      AssertThat(table.find("/") == NULL, IsTrue());
+    });
+
+    it("should replace an entry added for the same path", []
+    {
+      Canned::Table table;
+
+      table.add("/status", 200, NULL, View());
+      table.add("/status", 503, NULL, View());
+
+      AssertThat(table.size(), Equals((size_t) 1));
+      AssertThat(table.find("/status")->status(), Equals(503u));
+    });
+  });
+});
+
+int main(int argc, char **argv)
+{
+  return run(argc, argv);
+}
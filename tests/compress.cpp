@@ -0,0 +1,222 @@
+#include "bandit/bandit.h"
+#include "compress.h"
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <zlib.h>
+
+using namespace bandit;
+using namespace Http;
+using namespace std;
+
+// everything queued, read back through a pipe as it's written
+static string drain(Net::Output &out)
+{
+  int fds[2];
+  pipe(fds);
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+  string bytes;
+  char buf[65536];
+
+  while (!out.empty())
+  {
+    out.flush(fds[1]);
+
+    ssize_t n;
+    while ((n = read(fds[0], buf, sizeof(buf))) > 0) bytes.append(buf, n);
+  }
+
+  close(fds[0]);
+  close(fds[1]);
+
+  return bytes;
+}
+
+static string gunzip(const string &in)
+{
+  z_stream z = z_stream();
+  inflateInit2(&z, 15 + 16);
+
+  string out;
+  char buf[65536];
+
+  z.next_in = (Bytef *) in.data();
+  z.avail_in = in.size();
+
+  int rc;
+
+  do
+  {
+    z.next_out = (Bytef *) buf;
+    z.avail_out = sizeof(buf);
+
+    rc = inflate(&z, Z_NO_FLUSH);
+    out.append(buf, sizeof(buf) - z.avail_out);
+  }
+  while (rc == Z_OK);
+
+  inflateEnd(&z);
+
+  return rc == Z_STREAM_END ? out : "<broken>";
+}
+
+// the body of a chunked message, and how many chunks it came in
+static string dechunk(const string &in, size_t &chunks, size_t &largest)
+{
+  string out;
+  size_t p = 0;
+
+  chunks = 0;
+  largest = 0;
+
+  for (;;)
+  {
+    size_t size = strtoul(in.c_str() + p, NULL, 16);
+    p = in.find("\r\n", p) + 2;
+
+    if (size == 0) return in.compare(p, string::npos, "\r\n") == 0 ?
+      out : "<trailing>";
+
+    out.append(in, p, size);
+    p += size + 2;
+
+    chunks++;
+    if (size > largest) largest = size;
+  }
+}
+
+static string text(size_t size)
+{
+  string s;
+
+  while (s.size() < size) s += "the quick brown fox jumps over the lazy dog ";
+
+  return s.substr(0, size);
+}
+
+static string noise(size_t size)
+{
+  string s(size, 0);
+  uint32_t x = 2463534242u;
+
+  for (char &c : s)
+  {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    c = (char) x;
+  }
+
+  return s;
+}
+
+go_bandit([]()
+{
+  describe("Compressor", []()
+  {
+    it("should gzip a whole body", []
+    {
+      string in = text(10000), out;
+
+      AssertThat(Compressor::gzip(View(in.data(), in.size()), out), IsTrue());
+      AssertThat(out.size(), IsLessThan(in.size() / 10));
+      AssertThat(gunzip(out), Equals(in));
+    });
+
+    it("should make br only where it was built with it", []
+    {
+      string in = text(10000), out;
+      bool made = Compressor::brotli(View(in.data(), in.size()), true, out);
+
+      AssertThat(made, Equals(Compressor::has_brotli()));
+
+      if (made) AssertThat(out.size(), IsLessThan(in.size() / 10));
+    });
+
+    it("should only compress what isn't already", []
+    {
+      AssertThat(Compressor::compressible("text/html; charset=UTF-8"),
+          IsTrue());
+      AssertThat(Compressor::compressible("application/json"), IsTrue());
+      AssertThat(Compressor::compressible("image/svg+xml"), IsTrue());
+      AssertThat(Compressor::compressible("image/png"), IsFalse());
+      AssertThat(Compressor::compressible("font/woff2"), IsFalse());
+      AssertThat(Compressor::compressible("application/octet-stream"),
+          IsFalse());
+
+      AssertThat(Compressor::worth(1000, 899), IsTrue());
+      AssertThat(Compressor::worth(1000, 900), IsFalse());
+      AssertThat(Compressor::worth(0, 0), IsFalse());
+    });
+
+    it("should stream a body as chunks", []
+    {
+      Compressor compressor;
+      Net::Output out;
+      string in = text(100000);
+
+      AssertThat(compressor.begin(), IsTrue());
+
+      // in small pieces, the chunks still come out whole
+      for (size_t p = 0; p < in.size(); p += 1000)
+      {
+        AssertThat(compressor.write(View(in.data() + p, 1000), out),
+            IsTrue());
+      }
+
+      AssertThat(compressor.finish(out), IsTrue());
+
+      size_t chunks, largest;
+      AssertThat(gunzip(dechunk(drain(out), chunks, largest)), Equals(in));
+      AssertThat(chunks, Equals((size_t) 1));
+    });
+
+    it("should frame what doesn't compress at most a chunk at a time", []
+    {
+      Compressor compressor;
+      Net::Output out;
+      string in = noise(100000);
+
+      compressor.begin();
+      compressor.write(View(in.data(), in.size()), out);
+      compressor.finish(out);
+
+      size_t chunks, largest, chunk = Compressor::CHUNK;
+      AssertThat(gunzip(dechunk(drain(out), chunks, largest)), Equals(in));
+      AssertThat(chunks, IsGreaterThan((size_t) 5));
+      AssertThat(largest, Equals(chunk));
+    });
+
+    it("should start every body afresh", []
+    {
+      Compressor compressor;
+      Net::Output abandoned, out;
+      string first = noise(50000), second = text(5000);
+
+      compressor.begin();
+      compressor.write(View(first.data(), first.size()), abandoned);
+
+      compressor.begin();
+      compressor.write(View(second.data(), second.size()), out);
+      compressor.finish(out);
+
+      size_t chunks, largest;
+      AssertThat(gunzip(dechunk(drain(out), chunks, largest)),
+          Equals(second));
+
+      // an empty one is still a valid gzip stream
+      compressor.begin();
+      compressor.finish(out);
+
+      AssertThat(gunzip(dechunk(drain(out), chunks, largest)), Equals(""));
+    });
+  });
+});
+
+int main(int argc, char **argv)
+{
+  return run(argc, argv);
+}
@@ -0,0 +1,66 @@
+#include "bandit/bandit.h"
+#include "date.h"
+#include <string>
+#include <time.h>
+
+using namespace bandit;
+using namespace Http;
+using namespace std;
+
+static string formatted(time_t t)
+{
+  char out[Date::VALUE_SIZE];
+  Date::format(t, out);
+  return string(out, sizeof(out));
+}
+
+go_bandit([]()
+{
+  describe("Date", []()
+  {
+    it("should format an IMF-fixdate", []
+    {
+      // the example in RFC 7231 7.1.1.1
+      AssertThat(formatted(784111777), Equals("Sun, 06 Nov 1994 08:49:37 GMT"));
+      AssertThat(formatted(0), Equals("Thu, 01 Jan 1970 00:00:00 GMT"));
+      AssertThat(formatted(951782400), Equals("Tue, 29 Feb 2000 00:00:00 GMT"));
+      AssertThat(formatted(4102444799), Equals("Thu, 31 Dec 2099 23:59:59 GMT"));
+    });
+
+    it("should agree with strftime in the C locale", []
+    {
+      time_t t = time(NULL);
+      struct tm tm;
+      char expected[64];
+
+      gmtime_r(&t, &tm);
+      strftime(expected, sizeof(expected), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+
+      AssertThat(formatted(t), Equals(string(expected)));
+    });
+
+    it("should hold a whole header line", []
+    {
+      Date d;
+      d.refresh(784111777);
+
+      AssertThat(d.line(), Equals("Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"));
+      AssertThat(d.value(), Equals("Sun, 06 Nov 1994 08:49:37 GMT"));
+    });
+
+    it("should only reformat when the second changes", []
+    {
+      Date d;
+
+      AssertThat(d.refresh(784111777), IsTrue());
+      AssertThat(d.refresh(784111777), IsFalse());
+      AssertThat(d.refresh(784111778), IsTrue());
+      AssertThat(d.value(), Equals("Sun, 06 Nov 1994 08:49:38 GMT"));
+    });
+  });
+});
+
+int main(int argc, char **argv)
+{
+  return run(argc, argv);
+}
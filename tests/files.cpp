@@ -0,0 +1,363 @@
+#include "bandit/bandit.h"
+#include "files.h"
+#include <inttypes.h>
+#include <string>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+using namespace bandit;
+using namespace Http;
+using namespace std;
+
+static string root;
+
+static void put(const string &name, const string &content)
+{
+  FILE *f = fopen((root + "/" + name).c_str(), "w");
+  fwrite(content.data(), 1, content.size(), f);
+  fclose(f);
+}
+
+// what a canned answer puts on the wire
+static string answer(const Canned &canned, bool head_only = false)
+{
+  Net::Output out;
+  canned.queue(out, "Date: x\r\n", Canned::KEEP_ALIVE, head_only);
+
+  int fds[2];
+  pipe(fds);
+  out.flush(fds[1]);
+  close(fds[1]);
+
+  string bytes;
+  char buf[4096];
+  ssize_t n;
+
+  while ((n = read(fds[0], buf, sizeof(buf))) > 0) bytes.append(buf, n);
+
+  close(fds[0]);
+
+  return bytes;
+}
+
+static string resolved(const char *path)
+{
+  string out;
+  return Files::resolve(path, out) ? out : "<refused>";
+}
+
+static string ranged(const char *value, uint64_t size)
+{
+  uint64_t offset = 0, length = 0;
+
+  switch (Files::range(value, size, offset, length))
+  {
+    case Files::Range::FULL:          return "full";
+    case Files::Range::UNSATISFIABLE: return "416";
+    default:
+      return to_string(offset) + "+" + to_string(length);
+  }
+}
+
+go_bandit([]()
+{
+  describe("Files", []()
+  {
+    before_each([]
+    {
+      char dir[] = "/tmp/files_test_XXXXXX";
+      root = mkdtemp(dir);
+
+      mkdir((root + "/css").c_str(), 0755);
+      put("index.html", "<h1>index</h1>");
+      put("css/site.css", "body {}");
+    });
+
+    after_each([]
+    {
+      system(("rm -rf " + root).c_str());
+    });
+
+    it("should map request paths into the root", []
+    {
+      AssertThat(resolved("/"), Equals("index.html"));
+      AssertThat(resolved("/css/site.css"), Equals("css/site.css"));
+      AssertThat(resolved("/css/"), Equals("css/index.html"));
+      AssertThat(resolved("/a%20b.txt?x=1"), Equals("a b.txt"));
+    });
+
+    it("should refuse paths that could leave the root", []
+    {
+      AssertThat(resolved("/../etc/passwd"), Equals("<refused>"));
+      AssertThat(resolved("/css/../../x"), Equals("<refused>"));
+      AssertThat(resolved("/%2e%2e/x"), Equals("<refused>"));
+      AssertThat(resolved("/..%2fx"), Equals("<refused>"));
+      AssertThat(resolved("//etc/passwd"), Equals("<refused>"));
+      AssertThat(resolved("/./index.html"), Equals("<refused>"));
+      AssertThat(resolved("/a%00b"), Equals("<refused>"));
+      AssertThat(resolved("/a%zz"), Equals("<refused>"));
+      AssertThat(resolved("index.html"), Equals("<refused>"));
+      AssertThat(resolved("*"), Equals("<refused>"));
+    });
+
+    it("should parse a single byte range", []
+    {
+      AssertThat(ranged("bytes=0-99", 1000), Equals("0+100"));
+      AssertThat(ranged("bytes=500-", 1000), Equals("500+500"));
+      AssertThat(ranged("bytes=-100", 1000), Equals("900+100"));
+      AssertThat(ranged("bytes=-5000", 1000), Equals("0+1000"));
+      AssertThat(ranged("bytes=900-5000", 1000), Equals("900+100"));
+      AssertThat(ranged("Bytes=1-1", 1000), Equals("1+1"));
+    });
+
+    it("should answer in full what it doesn't honour", []
+    {
+      AssertThat(ranged("bytes=0-1,5-6", 1000), Equals("full"));
+      AssertThat(ranged("bytes=5-1", 1000), Equals("full"));
+      AssertThat(ranged("bytes=x-1", 1000), Equals("full"));
+      AssertThat(ranged("items=0-1", 1000), Equals("full"));
+      AssertThat(ranged("bytes=", 1000), Equals("full"));
+    });
+
+    it("should refuse ranges past the end", []
+    {
+      AssertThat(ranged("bytes=1000-", 1000), Equals("416"));
+      AssertThat(ranged("bytes=-0", 1000), Equals("416"));
+      AssertThat(ranged("bytes=0-", 0), Equals("416"));
+    });
+
+    it("should pick a media type by extension", []
+    {
+      AssertThat(string(Files::type("/a/index.HTML")),
+          Equals("text/html; charset=UTF-8"));
+      AssertThat(string(Files::type("app.js")),
+          Equals("text/javascript; charset=UTF-8"));
+      AssertThat(string(Files::type("logo.png")), Equals("image/png"));
+      AssertThat(string(Files::type("v1.2/README")),
+          Equals("application/octet-stream"));
+    });
+
+    it("should reuse the open file until it's due a check", []
+    {
+      Files files(root.c_str());
+      AssertThat(files.valid(), IsTrue());
+
+      auto first = files.open("/css/site.css", 0);
+
+      AssertThat(first != nullptr, IsTrue());
+      AssertThat(first->size, Equals((uint64_t) 7));
+      AssertThat(string(first->type), Equals("text/css; charset=UTF-8"));
+
+      AssertThat(files.open("/css/site.css", 10) == first, IsTrue());
+
+      // unchanged on disk, still the same fd after the check
+      AssertThat(files.open("/css/site.css", Files::REVALIDATE_MS) == first,
+          IsTrue());
+      AssertThat(files.size(), Equals((size_t) 1));
+    });
+
+    it("should pick up a file replaced on disk", []
+    {
+      Files files(root.c_str());
+
+      auto first = files.open("/index.html", 0);
+
+      put("next.html", "<h1>replaced</h1>");
+      rename((root + "/next.html").c_str(), (root + "/index.html").c_str());
+
+      AssertThat(files.open("/", 1) == first, IsTrue());
+
+      // inotify drops it once the events are read, the check finds it
+      // otherwise
+      if (files.watch() >= 0) files.changed();
+
+      auto second = files.open("/", 1 + Files::REVALIDATE_MS);
+
+      AssertThat(second != first, IsTrue());
+      AssertThat(second->size, Equals((uint64_t) 17));
+
+      // the old one is still open for whoever was sending it
+      char buf[32];
+      AssertThat(pread(first->fd, buf, sizeof(buf), 0), Equals((ssize_t) 14));
+    });
+
+    it("should keep small files in memory, answers serialized", []
+    {
+      Files files(root.c_str());
+      auto file = files.open("/index.html", 0);
+
+      AssertThat(file->hot != nullptr, IsTrue());
+      AssertThat(files.hot_bytes(), Equals((size_t) 14));
+
+      char tag[64];
+      snprintf(tag, sizeof(tag), "\"%" PRIx64 "-%" PRIx64 "-%" PRIx64 "\"",
+          (uint64_t) file->inode, file->size, (uint64_t) file->modified);
+
+      AssertThat(file->etag, Equals(string(tag)));
+
+      char modified[Date::VALUE_SIZE];
+      Date::format(file->modified, modified);
+
+      AssertThat(file->last_modified_value(),
+          Equals(string(modified, sizeof(modified))));
+
+      string validators =
+        "ETag: " + file->etag + "\r\n"
+        "Last-Modified: " + string(modified, sizeof(modified)) + "\r\n";
+
+      AssertThat(answer(*file->hot), Equals(
+            "HTTP/1.1 200 OK\r\n"
+            "Date: x\r\n"
+            "Content-Type: text/html; charset=UTF-8\r\n" + validators +
+            "Accept-Ranges: bytes\r\n"
+            "Content-Length: 14\r\n"
+            "\r\n"
+            "<h1>index</h1>"));
+
+      AssertThat(answer(*file->not_modified), Equals(
+            "HTTP/1.1 304 Not Modified\r\n"
+            "Date: x\r\n" + validators + "\r\n"));
+    });
+
+    it("should keep compressed copies of text that shrinks", []
+    {
+      string css;
+      while (css.size() < 4000) css += "p { margin: 0; padding: 0 }\n";
+
+      put("css/big.css", css);
+      put("logo.png", css);
+
+      Files files(root.c_str());
+      auto file = files.open("/css/big.css", 0);
+
+      AssertThat(file->encodings.empty(), IsFalse());
+      AssertThat(string(file->encodings[0].name), Equals(
+            Compressor::has_brotli() ? "br" : "gzip"));
+
+      size_t held = file->size;
+
+      for (auto &encoding : file->encodings)
+      {
+        AssertThat(encoding.etag, Equals(
+              file->etag.substr(0, file->etag.size() - 1) + "-" +
+              encoding.name + "\""));
+        AssertThat(answer(*encoding.hot).find(
+              string("Content-Encoding: ") + encoding.name + "\r\n") !=
+            string::npos, IsTrue());
+
+        held += answer(*encoding.hot, false).size() -
+          answer(*encoding.hot, true).size();
+      }
+
+      AssertThat(files.hot_bytes(), Equals(held));
+      AssertThat(answer(*file->hot).find("Vary: Accept-Encoding\r\n") !=
+          string::npos, IsTrue());
+      AssertThat(answer(*file->not_modified).find("Vary") != string::npos,
+          IsTrue());
+
+      // already compressed, by its type
+      AssertThat(files.open("/logo.png", 0)->encodings.empty(), IsTrue());
+      AssertThat(files.open("/index.html", 0)->encodings.empty(), IsTrue());
+    });
+
+    it("should give every loop the same tags for the same file", []
+    {
+      Files one(root.c_str()), other(root.c_str());
+
+      put("big.bin", string(Files::HOT_MAX + 1, 'b'));
+
+      AssertThat(one.open("/index.html", 0)->etag,
+          Equals(other.open("/index.html", 0)->etag));
+      AssertThat(one.open("/big.bin", 0)->etag,
+          Equals(other.open("/big.bin", 0)->etag));
+    });
+
+    it("should tag a file the same whether or not it's held in memory", []
+    {
+      Files one(root.c_str()), other(root.c_str());
+
+      // other has no room left for it
+      string filler(Files::HOT_MAX, 'f');
+      size_t count = Files::HOT_TOTAL / Files::HOT_MAX;
+
+      for (size_t i = 0; i < count; i++)
+      {
+        string name = "filler" + to_string(i) + ".bin";
+
+        put(name, filler);
+        other.open(("/" + name).c_str(), 0);
+      }
+
+      auto hot = one.open("/index.html", 0);
+      auto cold = other.open("/index.html", 0);
+
+      AssertThat(hot->hot != nullptr, IsTrue());
+      AssertThat(cold->hot == nullptr, IsTrue());
+      AssertThat(cold->etag, Equals(hot->etag));
+
+      for (size_t i = 0; i < count; i++)
+      {
+        unlink((root + "/filler" + to_string(i) + ".bin").c_str());
+      }
+    });
+
+    it("should send bigger files from the fd", []
+    {
+      put("big.bin", string(Files::HOT_MAX + 1, 'b'));
+
+      Files files(root.c_str());
+      auto file = files.open("/big.bin", 0);
+
+      AssertThat(file->hot == nullptr, IsTrue());
+      AssertThat(file->not_modified != nullptr, IsTrue());
+      AssertThat(files.hot_bytes(), Equals((size_t) 0));
+      AssertThat(file->etag.find('-') != string::npos, IsTrue());
+    });
+
+    it("should drop an entry as soon as its file changes", []
+    {
+      Files files(root.c_str());
+
+      if (files.watch() < 0) return;
+
+      auto first = files.open("/css/site.css", 0);
+
+      AssertThat(first->watched, IsTrue());
+
+      put("css/site.css", "body { margin: 0 }");
+      files.changed();
+
+      AssertThat(files.size(), Equals((size_t) 0));
+      AssertThat(files.hot_bytes(), Equals((size_t) 0));
+
+      auto second = files.open("/css/site.css", 1);
+
+      AssertThat(second != first, IsTrue());
+      AssertThat(second->size, Equals((uint64_t) 18));
+      AssertThat(second->etag != first->etag, IsTrue());
+    });
+
+    it("should find only regular files", []
+    {
+      Files files(root.c_str());
+
+      AssertThat(files.open("/missing.html", 0) == nullptr, IsTrue());
+      AssertThat(files.open("/css", 0) == nullptr, IsTrue());
+      AssertThat(files.open("/../", 0) == nullptr, IsTrue());
+    });
+
+    it("should serve nothing without a root", []
+    {
+      Files files("/nonexistent/root");
+
+      AssertThat(files.valid(), IsFalse());
+      AssertThat(files.open("/index.html", 0) == nullptr, IsTrue());
+    });
+  });
+});
+
+int main(int argc, char **argv)
+{
+  return run(argc, argv);
+}
@@ -0,0 +1,67 @@
+#include "bandit/bandit.h"
+#include "known.h"
+#include <iostream>
+#include <string>
+#include <string.h>
+
+using namespace bandit;
+using namespace Http;
+using namespace std;
+
+static Known lookup(const string &name)
+{
+  return known_header(name.data(), name.size());
+}
+
+go_bandit([]()
+{
+  describe("Known", []()
+  {
+    it("should map every name in the table back to itself", []
+    {
+      int mismatches = 0;
+
+      for (size_t i = 0; i < (size_t) Known::COUNT; i++)
+      {
+        if (lookup(known_name((Known) i)) != (Known) i) mismatches++;
+      }
+
+      AssertThat(mismatches, Equals(0));
+    });
+
+    it("should ignore case", []
+    {
+      AssertThat(lookup("Host") == Known::HOST, IsTrue());
+      AssertThat(lookup("CONTENT-LENGTH") == Known::CONTENT_LENGTH, IsTrue());
+      AssertThat(lookup("Sec-WebSocket-Key") == Known::SEC_WEBSOCKET_KEY,
+          IsTrue());
+    });
+
+    it("should not match names that are merely close", []
+    {
+      const char *names[] = {
+        "", "h", "hos", "hosts", "xost", "content-lengthx", "content-lengt",
+        "x-custom", "accept-charset", "if-match", "sec-websocket-accept",
+        "hoSt\x80"
+      };
+
+      for (const char *name : names)
+      {
+        AssertThat(lookup(name) == Known::UNKNOWN, IsTrue());
+      }
+
+      AssertThat(lookup(string("te\0", 3)) == Known::UNKNOWN, IsTrue());
+    });
+
+    it("should give the lower case name", []
+    {
+      AssertThat(known_name(Known::USER_AGENT), Equals("user-agent"));
+      AssertThat(known_name(Known::UNKNOWN), Equals(""));
+    });
+  });
+});
+
+int main(int argc, char **argv)
+{
+  return run(argc, argv);
+}
@@ -0,0 +1,77 @@
+#include "bandit/bandit.h"
+#include "notifier.h"
+#include "poller.h"
+#include <iostream>
+#include <string>
+#include <thread>
+
+using namespace bandit;
+using namespace Net;
+using namespace std;
+
+go_bandit([]()
+{
+  describe("Notifier", []()
+  {
+    it("should not be readable until notified", []
+    {
+      Notifier n;
+      Poller p;
+      p.add(n.fd(), Event::READ);
+
+      Event events[4];
+      AssertThat(p.wait(events, 4, 0), Equals(0));
+    });
+
+    it("should wake a poller when notified", []
+    {
+      Notifier n;
+      Poller p;
+      p.add(n.fd(), Event::READ);
+
+      n.notify();
+
+      Event events[4];
+      AssertThat(p.wait(events, 4, 1000), Equals(1));
+      AssertThat(events[0].fd, Equals((uintptr_t) n.fd()));
+    });
+
+    it("should stop being readable once drained", []
+    {
+      Notifier n;
+      Poller p;
+      p.add(n.fd(), Event::READ);
+
+      n.notify();
+      n.notify();
+      n.drain();
+
+      Event events[4];
+      AssertThat(p.wait(events, 4, 0), Equals(0));
+    });
+
+    it("should wake a poller blocked on another thread", []
+    {
+      Notifier n;
+      Poller p;
+      p.add(n.fd(), Event::READ);
+
+      thread waker([&n]()
+      {
+        this_thread::sleep_for(chrono::milliseconds(20));
+        n.notify();
+      });
+
+      Event events[4];
+      int count = p.wait(events, 4, 5000);
+      waker.join();
+
+      AssertThat(count, Equals(1));
+    });
+  });
+});
+
+int main(int argc, char **argv)
+{
+  return run(argc, argv);
+}
@@ -0,0 +1,340 @@
+#include "bandit/bandit.h"
+#include "output.h"
+#include <iostream>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+using namespace bandit;
+using namespace Net;
+using namespace std;
+
+// a connected pair, the write end nonblocking with a small send buffer
+static void connected(int fds[2])
+{
+  socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+  fcntl(fds[0], F_SETFL, O_NONBLOCK);
+  fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+  int size = 4096;
+  setsockopt(fds[0], SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+}
+
+// an unlinked temporary file holding content
+static int temporary(const string &content)
+{
+  char path[] = "/tmp/output_test_XXXXXX";
+  int fd = mkstemp(path);
+
+  unlink(path);
+  write(fd, content.data(), content.size());
+
+  return fd;
+}
+
+static string drain(int fd)
+{
+  string out;
+  char buf[4096];
+  ssize_t n;
+
+  while ((n = read(fd, buf, sizeof(buf))) > 0) out.append(buf, n);
+
+  return out;
+}
+
+go_bandit([]()
+{
+  describe("Output", []()
+  {
+    it("should write nothing when empty", []
+    {
+      int fds[2];
+      connected(fds);
+
+      Output out;
+
+      AssertThat(out.empty(), IsTrue());
+      AssertThat(out.flush(fds[0]), Equals((ssize_t) 0));
+
+      close(fds[0]);
+      close(fds[1]);
+    });
+
+    it("should write copies and references in the order queued", []
+    {
+      int fds[2];
+      connected(fds);
+
+      static const char STATIC[] = "<static>";
+      char scratch[] = "copied";
+
+      Output out;
+      out.append(scratch);
+      out.reference(STATIC, sizeof(STATIC) - 1);
+      out.append(" and ");
+      out.append("more");
+
+      // a copy is a copy, the scratch buffer is free to change
+      scratch[0] = 'X';
+
+      AssertThat(out.size(), Equals((size_t) 23));
+      AssertThat(out.flush(fds[0]), Equals((ssize_t) 23));
+      AssertThat(out.empty(), IsTrue());
+      AssertThat(drain(fds[1]), Equals("copied<static> and more"));
+
+      close(fds[0]);
+      close(fds[1]);
+    });
+
+    it("should keep what a full socket didn't take", []
+    {
+      int fds[2];
+      connected(fds);
+
+      string payload;
+      for (int i = 0; payload.size() < 512 * 1024; i++)
+      {
+        payload += to_string(i) + ",";
+      }
+
+      Output out;
+      out.append(payload.data(), payload.size());
+
+      ssize_t first = out.flush(fds[0]);
+
+      AssertThat(first, IsGreaterThan((ssize_t) 0));
+      AssertThat((size_t) first, IsLessThan(payload.size()));
+      AssertThat(out.size(), Equals(payload.size() - first));
+
+      // nothing read on the other end yet, no room at all
+      AssertThat(out.flush(fds[0]), Equals((ssize_t) -1));
+      AssertThat(errno == EAGAIN || errno == EWOULDBLOCK, IsTrue());
+
+      string received;
+
+      while (!out.empty())
+      {
+        received += drain(fds[1]);
+        out.flush(fds[0]);
+      }
+
+      received += drain(fds[1]);
+
+      AssertThat(received == payload, IsTrue());
+
+      close(fds[0]);
+      close(fds[1]);
+    });
+
+    it("should resume a short write inside a referenced segment", []
+    {
+      int fds[2];
+      connected(fds);
+
+      string big(256 * 1024, 'r');
+      big.back() = '!';
+
+      Output out;
+      out.append("head:");
+      out.reference(big.data(), big.size());
+      out.append(":tail");
+
+      string received;
+
+      while (!out.empty())
+      {
+        out.flush(fds[0]);
+        received += drain(fds[1]);
+      }
+
+      AssertThat(received == "head:" + big + ":tail", IsTrue());
+
+      close(fds[0]);
+      close(fds[1]);
+    });
+
+    it("should not grow while a slow reader keeps it from emptying", []
+    {
+      int fds[2];
+      connected(fds);
+
+      string chunk(1000, 'c');
+      string expected, received;
+      size_t most = 0;
+
+      Output out;
+
+      for (int i = 0; i < 2000; i++)
+      {
+        chunk[0] = 'a' + i % 26;
+        out.append(chunk.data(), chunk.size());
+        expected += chunk;
+
+        out.flush(fds[0]);
+
+        // never let it drain completely, storage is only reset then
+        if (out.size() > 64 * 1024)
+        {
+          char buf[8192];
+          ssize_t n = read(fds[1], buf, sizeof(buf));
+          if (n > 0) received.append(buf, n);
+        }
+
+        if (out.reserved() > most) most = out.reserved();
+      }
+
+      while (!out.empty())
+      {
+        out.flush(fds[0]);
+        received += drain(fds[1]);
+      }
+
+      received += drain(fds[1]);
+
+      AssertThat(received == expected, IsTrue());
+      AssertThat(most, IsLessThan(expected.size() / 4));
+
+      close(fds[0]);
+      close(fds[1]);
+    });
+
+    it("should batch more segments than fit in one writev", []
+    {
+      int fds[2];
+      connected(fds);
+
+      static const char A[] = "a";
+      static const char B[] = "b";
+
+      Output out;
+      string expected;
+
+      // alternating so nothing coalesces
+      for (int i = 0; i < Output::IOV_BATCH * 3; i++)
+      {
+        out.reference(i % 2 ? B : A, 1);
+        expected += i % 2 ? "b" : "a";
+      }
+
+      AssertThat(out.flush(fds[0]), Equals((ssize_t) expected.size()));
+      AssertThat(drain(fds[1]), Equals(expected));
+
+      close(fds[0]);
+      close(fds[1]);
+    });
+
+    it("should send a file range between memory segments", []
+    {
+      int fds[2];
+      connected(fds);
+
+      string content;
+      for (int i = 0; content.size() < 300 * 1024; i++)
+      {
+        content += to_string(i) + ";";
+      }
+
+      int file = temporary(content);
+      shared_ptr<int> owner = make_shared<int>(file);
+
+      Output out;
+      out.append("head:");
+      out.file(file, 100, content.size() - 200, owner);
+      out.append(":tail");
+
+      AssertThat(owner.use_count(), Equals(2));
+
+      string received;
+
+      while (!out.empty())
+      {
+        AssertThat(out.flush(fds[0]) != 0, IsTrue());
+        received += drain(fds[1]);
+      }
+
+      AssertThat(received == "head:" + content.substr(100,
+            content.size() - 200) + ":tail", IsTrue());
+
+      // written, so the queue doesn't hold the file open any more
+      AssertThat(owner.use_count(), Equals(1));
+
+      close(file);
+      close(fds[0]);
+      close(fds[1]);
+    });
+
+    it("should fail when a file is shorter than what was queued", []
+    {
+      int fds[2];
+      connected(fds);
+
+      int file = temporary("short");
+
+      Output out;
+      out.file(file, 0, 100);
+
+      // what's there goes, the end of file shows on the next try
+      AssertThat(out.flush(fds[0]), Equals((ssize_t) 5));
+      AssertThat(out.flush(fds[0]), Equals((ssize_t) -1));
+      AssertThat(errno, Equals(EIO));
+
+      close(file);
+      close(fds[0]);
+      close(fds[1]);
+    });
+
+    it("should hold a pooled block until it's written", []
+    {
+      int fds[2];
+      connected(fds);
+
+      Output out;
+      Chain chain;
+
+      {
+        Buffer buffer(1024);
+        memcpy(buffer.data(), "GET /echo HTTP/1.1", 18);
+
+        out.reference(Slice(buffer, 4, 5));
+        chain.append(Slice(buffer, 9, 9));
+      }
+
+      chain.append(" copied", 7);
+      out.reference(chain);
+
+      AssertThat(out.size(), Equals((size_t) 21));
+      AssertThat(chain.slices()[0].buffer().refs(), Equals((uint32_t) 3));
+
+      chain.clear();
+
+      AssertThat(out.flush(fds[0]), Equals((ssize_t) 21));
+      AssertThat(drain(fds[1]), Equals("/echo HTTP/1.1 copied"));
+
+      // written, the block went back to the pool
+      AssertThat(Pool::local().stats().in_use, Equals((size_t) 0));
+
+      close(fds[0]);
+      close(fds[1]);
+    });
+
+    it("should give its memory back on release", []
+    {
+      Output out;
+      out.append(string(10000, 'x').c_str());
+
+      AssertThat(out.reserved(), IsGreaterThan((size_t) 0));
+
+      out.release();
+
+      AssertThat(out.empty(), IsTrue());
+      AssertThat(out.reserved(), Equals((size_t) 0));
+    });
+  });
+});
+
+int main(int argc, char **argv)
+{
+  return run(argc, argv);
+}
@@ -223,6 +223,595 @@ go_bandit([]()
           Equals("permessage-deflate; client_max_window_bits, "
             "x-webkit-deflate-frame"));
     });
+
+    it("should ask for more until the blank line arrives", []
+    {
+      const char request[] =
+        "GET /split HTTP/1.1\r\n"
+        "Host: localhost\r\n";
+
+      Parser p;
+      auto state = p.parse(request, strlen(request));
+
+      AssertThat(state, Equals(Parser::State::FIELD));
+      AssertThat(p.get_headers()->get_path(), Equals(std::string("/split")));
+      AssertThat(p.get_headers()->get_field("host"), Equals("localhost"));
+    });
+
+    it("should give the same result however the request is split", []
+    {
+      const char request[] =
+        "POST /upload HTTP/1.1\r\n"
+        "Host: localhost:8080\r\n"
+        "Cookie: a=1; b=2; c=3\r\n"
+        "Authorization: Bearer abc.def.ghi\r\n"
+        "\r\n";
+
+      size_t length = strlen(request);
+
+      for (size_t chunk = 1; chunk <= length; chunk++)
+      {
+        Parser p;
+        Parser::State state = Parser::State::METHOD;
+
+        for (size_t size = chunk; ; size += chunk)
+        {
+          if (size > length) size = length;
+          state = p.parse(request, size);
+          if (size == length || state == Parser::State::DONE) break;
+          AssertThat(state, !Equals(Parser::State::BROKEN));
+        }
+
+        auto h = p.get_headers();
+
+        AssertThat(state, Equals(Parser::State::DONE));
+        AssertThat(p.consumed(), Equals(length));
+        AssertThat(h->get_method(), Equals(Headers::Method::POST));
+        AssertThat(h->get_path(), Equals(std::string("/upload")));
+        AssertThat(h->get_field("cookie"), Equals("a=1; b=2; c=3"));
+        AssertThat(h->get_field("authorization"),
+            Equals("Bearer abc.def.ghi"));
+      }
+    });
+
+    it("should keep going when the buffer moves between calls", []
+    {
+      std::string buffer = "GET /moved HTTP/1.1\r\nHo";
+
+      Parser p;
+      p.parse(buffer.data(), buffer.size());
+
+      buffer += "st: example.com\r\n\r\n";
+      buffer.shrink_to_fit();
+
+      AssertThat(p.parse(buffer.data(), buffer.size()),
+          Equals(Parser::State::DONE));
+      AssertThat(p.get_headers()->get_field("host"), Equals("example.com"));
+    });
+
+    it("should report where the head ends", []
+    {
+      const char request[] =
+        "PUT /body HTTP/1.1\r\n"
+        "Content-Length: 5\r\n"
+        "\r\n"
+        "hello";
+
+      Parser p;
+
+      AssertThat(p.parse(request, strlen(request)),
+          Equals(Parser::State::DONE));
+      AssertThat(p.consumed(), Equals(strlen(request) - 5));
+    });
+
+    it("should not read past the size it was given", []
+    {
+      // no terminator anywhere, the newline is just beyond the size
+      const char request[] = { 'G', 'E', 'T', ' ', '/', ' ', 'H', 'T', 'T',
+        'P', '/', '1', '.', '1', '\n' };
+
+      Parser p;
+
+      AssertThat(p.parse(request, sizeof(request) - 1),
+          Equals(Parser::State::METHOD));
+      AssertThat(p.consumed(), Equals((size_t) 0));
+    });
+
+    it("should reject a head that never ends", []
+    {
+      std::string request = "GET / HTTP/1.1\r\nCookie: ";
+      request.append(Parser::HEAD_MAX, 'x');
+
+      Parser p;
+
+      AssertThat(p.parse(request.data(), request.size()),
+          Equals(Parser::State::BROKEN));
+    });
+
+    it("should reject a head of exactly HEAD_MAX bytes with no newline", []
+    {
+      // as much as the smallest input a connection may keep holds
+      std::string request = "GET /";
+      request.append(Parser::HEAD_MAX - request.size(), 'x');
+
+      Parser p;
+
+      AssertThat(p.parse(request.data(), request.size()),
+          Equals(Parser::State::BROKEN));
+    });
+
+    it("should wait on a head one byte short of HEAD_MAX", []
+    {
+      std::string request = "GET /";
+      request.append(Parser::HEAD_MAX - 1 - request.size(), 'x');
+
+      Parser p;
+
+      AssertThat(p.parse(request.data(), request.size()),
+          Equals(Parser::State::METHOD));
+    });
+
+    it("should reject a long head even when it's all there", []
+    {
+      std::string request = "GET / HTTP/1.1\r\nCookie: ";
+      request.append(Parser::HEAD_MAX, 'x');
+      request.append("\r\n\r\n");
+
+      Parser p;
+
+      AssertThat(p.parse(request.data(), request.size()),
+          Equals(Parser::State::BROKEN));
+    });
+
+    it("should reject a request line with more after the version", []
+    {
+      const char request[] =
+        "GET / HTTP/1.1garbage\r\n"
+        "Host: x\r\n\r\n";
+
+      Parser p;
+
+      AssertThat(p.parse(request, strlen(request)),
+          Equals(Parser::State::BROKEN));
+    });
+
+    it("should allow whitespace after the version", []
+    {
+      const char request[] =
+        "GET / HTTP/1.1 \t\r\n"
+        "Host: x\r\n\r\n";
+
+      Parser p;
+
+      AssertThat(p.parse(request, strlen(request)),
+          Equals(Parser::State::DONE));
+    });
+
+    it("should reject a field without a colon", []
+    {
+      const char request[] =
+        "GET / HTTP/1.1\r\n"
+        "not a header\r\n\r\n";
+
+      Parser p;
+
+      AssertThat(p.parse(request, strlen(request)),
+          Equals(Parser::State::BROKEN));
+    });
+
+    it("should parse the next request after a reset", []
+    {
+      const char first[] = "GET /one HTTP/1.1\r\n\r\n";
+      const char second[] = "HEAD /two HTTP/1.0\r\n\r\n";
+
+      Parser p;
+      p.parse(first, strlen(first));
+      p.reset();
+
+      AssertThat(p.parse(second, strlen(second)),
+          Equals(Parser::State::DONE));
+      AssertThat(p.get_headers()->get_method(),
+          Equals(Headers::Method::HEAD));
+      AssertThat(p.get_headers()->get_path(), Equals(std::string("/two")));
+    });
+
+    it("should wait for the newline after a trailing carriage return", []
+    {
+      const char request[] = "GET / HTTP/1.1\r\nHost: a\r\n\r\n";
+
+      Parser p;
+
+      AssertThat(p.parse(request, 15), Equals(Parser::State::METHOD));
+      AssertThat(p.parse(request, strlen(request)),
+          Equals(Parser::State::DONE));
+    });
+
+    it("should reject control characters and bare carriage returns", []
+    {
+      const char *requests[] = {
+        "GET / HTTP/1.1\r\nHost: a\x01b\r\n\r\n",
+        "GET / HTTP/1.1\r\nHost: a\rb\r\n\r\n",
+        "GET / HTTP/1.1\r\nHost : a\r\n\r\n"
+      };
+
+      for (const char *request : requests)
+      {
+        Parser p;
+        AssertThat(p.parse(request, strlen(request)),
+            Equals(Parser::State::BROKEN));
+      }
+    });
+
+    it("should list known fields first, then the rest in arrival order", []
+    {
+      const char request[] =
+        "GET / HTTP/1.1\r\n"
+        "X-Second: b\r\n"
+        "accept: c\r\n"
+        "X-First: a\r\n"
+        "Host: d\r\n\r\n";
+
+      Parser p;
+      p.parse(request, strlen(request));
+
+      auto h = p.get_headers();
+
+      AssertThat(h->field_count(), Equals((size_t) 4));
+      AssertThat(h->field(0).name, Equals("Host"));
+      AssertThat(h->field(1).name, Equals("accept"));
+      AssertThat(h->field(2).name, Equals("X-Second"));
+      AssertThat(h->field(2).value, Equals("b"));
+      AssertThat(h->field(3).name, Equals("X-First"));
+    });
+
+    it("should put well-known fields in their slots", []
+    {
+      const char request[] =
+        "POST / HTTP/1.1\r\n"
+        "HOST: example.com\r\n"
+        "Content-Length: 12\r\n"
+        "Cookie: a=1\r\n"
+        "Cookie: b=2\r\n\r\n";
+
+      Parser p;
+      p.parse(request, strlen(request));
+
+      auto h = p.get_headers();
+
+      AssertThat(h->has(Known::HOST), IsTrue());
+      AssertThat(h->get(Known::HOST), Equals("example.com"));
+      AssertThat(h->get(Known::CONTENT_LENGTH), Equals("12"));
+      AssertThat(h->has(Known::TRANSFER_ENCODING), IsFalse());
+
+      // the first one has the slot, repeats are kept with the rest
+      AssertThat(h->get(Known::COOKIE), Equals("a=1"));
+      AssertThat(h->field_count(), Equals((size_t) 4));
+      AssertThat(h->field(3).value, Equals("b=2"));
+    });
+
+    it("should look fields up in any case without adding them", []
+    {
+      const char request[] =
+        "GET / HTTP/1.1\r\n"
+        "Content-TYPE: text/plain\r\n\r\n";
+
+      Parser p;
+      p.parse(request, strlen(request));
+
+      auto h = p.get_headers();
+
+      AssertThat(h->get_field("content-type"), Equals("text/plain"));
+      AssertThat(h->get_field("CONTENT-type"), Equals("text/plain"));
+      AssertThat(h->get_field("x-missing").empty(), IsTrue());
+      AssertThat(h->has_field("x-missing"), IsFalse());
+      AssertThat(h->field_count(), Equals((size_t) 1));
+    });
+
+    it("should point into the request buffer rather than copy", []
+    {
+      const char request[] = "GET /in-place HTTP/1.1\r\nHost: a\r\n\r\n";
+
+      Parser p;
+      p.parse(request, strlen(request));
+
+      auto h = p.get_headers();
+
+      AssertThat((size_t) (h->get_path().data() - request), Equals((size_t) 4));
+      AssertThat((size_t) (h->get_field("host").data() - request),
+          Equals((size_t) 30));
+    });
+
+    it("should start the next request with nothing left of the last", []
+    {
+      const char first[] =
+        "GET /first HTTP/1.1\r\n"
+        "Host: a\r\n"
+        "X-One: 1\r\n"
+        "X-Two: 2\r\n\r\n";
+      const char second[] = "PUT /second HTTP/1.0\r\n\r\n";
+
+      Parser p;
+      p.parse(first, strlen(first));
+
+      AssertThat(p.arena().used(), IsGreaterThan((size_t) 0));
+
+      p.reset();
+
+      AssertThat(p.arena().used(), Equals((size_t) 0));
+      AssertThat(p.get_headers()->field_count(), Equals((size_t) 0));
+      AssertThat(p.get_headers()->get_method(),
+          Equals(Headers::Method::NONE));
+
+      p.parse(second, strlen(second));
+
+      AssertThat(p.get_headers()->get_path(), Equals("/second"));
+      AssertThat(p.get_headers()->has_field("x-one"), IsFalse());
+    });
+
+    it("should give its arena back on release and parse again after", []
+    {
+      const char first[] =
+        "GET /first HTTP/1.1\r\n"
+        "X-One: 1\r\n\r\n";
+      const char second[] = "GET /second HTTP/1.1\r\nX-Two: 2\r\n\r\n";
+
+      Parser p;
+      p.parse(first, strlen(first));
+
+      AssertThat(p.arena().reserved(), IsGreaterThan((size_t) 0));
+
+      p.release();
+
+      AssertThat(p.arena().reserved(), Equals((size_t) 0));
+      AssertThat(p.state(), Equals(Parser::State::METHOD));
+
+      AssertThat(p.parse(second, strlen(second)),
+          Equals(Parser::State::DONE));
+      AssertThat(p.get_headers()->get_path(), Equals("/second"));
+      AssertThat(p.get_headers()->get_field("x-two"), Equals("2"));
+      AssertThat(p.get_headers()->has_field("x-one"), IsFalse());
+    });
+
+    it("should keep many unknown fields in its arena", []
+    {
+      std::string request = "GET / HTTP/1.1\r\n";
+
+      for (int i = 0; i < 100; i++)
+      {
+        request += "X-Field-" + std::to_string(i) + ": " +
+          std::to_string(i * 3) + "\r\n";
+      }
+
+      request += "\r\n";
+
+      Parser p;
+
+      AssertThat(p.parse(request.data(), request.size()),
+          Equals(Parser::State::DONE));
+
+      auto h = p.get_headers();
+
+      AssertThat(h->field_count(), Equals((size_t) 100));
+      AssertThat(h->get_field("x-field-0"), Equals("0"));
+      AssertThat(h->get_field("x-field-99"), Equals("297"));
+      AssertThat(h->field(57).value, Equals("171"));
+    });
+
+    it("should recognise every method, extensions included", []
+    {
+      struct { const char *line; Headers::Method method; } cases[] = {
+        { "GET / HTTP/1.1",     Headers::Method::GET },
+        { "HEAD / HTTP/1.1",    Headers::Method::HEAD },
+        { "POST / HTTP/1.1",    Headers::Method::POST },
+        { "PUT / HTTP/1.1",     Headers::Method::PUT },
+        { "PATCH / HTTP/1.1",   Headers::Method::PATCH },
+        { "DELETE / HTTP/1.1",  Headers::Method::DELETE },
+        { "TRACE / HTTP/1.1",   Headers::Method::TRACE },
+        { "OPTIONS * HTTP/1.1", Headers::Method::OPTIONS },
+        { "CONNECT a:1 HTTP/1.1", Headers::Method::CONNECT },
+        { "PURGE / HTTP/1.1",   Headers::Method::PURGE },
+        { "MKCOL / HTTP/1.1",   Headers::Method::MKCOL },
+        { "COPY / HTTP/1.1",    Headers::Method::COPY },
+        { "MOVE / HTTP/1.1",    Headers::Method::MOVE },
+        { "LOCK / HTTP/1.1",    Headers::Method::LOCK },
+        { "UNLOCK / HTTP/1.1",  Headers::Method::UNLOCK },
+        { "REPORT / HTTP/1.1",  Headers::Method::REPORT },
+        { "SEARCH / HTTP/1.1",  Headers::Method::SEARCH }
+      };
+
+      for (auto &c : cases)
+      {
+        Parser p(c.line, strlen(c.line));
+
+        AssertThat(p.parse(), Equals(Parser::State::DONE));
+        AssertThat(p.get_headers()->get_method(), Equals(c.method));
+      }
+    });
+
+    it("should reject methods that only start like a known one", []
+    {
+      const char *lines[] = {
+        "GETS / HTTP/1.1",
+        "GE / HTTP/1.1",
+        "get / HTTP/1.1",
+        "OPTIONSX / HTTP/1.1",
+        "CONNECTED / HTTP/1.1",
+        " GET / HTTP/1.1",
+        "GET",
+        "PUT"
+      };
+
+      for (const char *line : lines)
+      {
+        Parser p(line, strlen(line));
+
+        AssertThat(p.parse(), Equals(Parser::State::BROKEN));
+        AssertThat(p.get_headers()->get_method(),
+            Equals(Headers::Method::NONE));
+      }
+    });
+
+    it("should keep the connection open by the version's default", []
+    {
+      struct { const char *request; bool keep_alive; } cases[] = {
+        { "GET / HTTP/1.1\r\n\r\n", true },
+        { "GET / HTTP/1.1\r\nConnection: close\r\n\r\n", false },
+        { "GET / HTTP/1.1\r\nConnection: Upgrade, CLOSE\r\n\r\n", false },
+        { "GET / HTTP/1.1\r\nConnection: closed\r\n\r\n", true },
+        { "GET / HTTP/1.0\r\n\r\n", false },
+        { "GET / HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n", true },
+        { "GET / HTTP/1.0\r\nConnection: te ,\tkeep-alive \r\n\r\n", true },
+        { "GET / HTTP/1.0\r\nConnection: keep-alive\r\n"
+          "Connection: close\r\n\r\n", false },
+        { "GET / HTTP/0.9\r\nConnection: keep-alive\r\n\r\n", false },
+        { "GET / HTTP/2.0\r\n\r\n", true }
+      };
+
+      for (auto &c : cases)
+      {
+        Parser p(c.request, strlen(c.request));
+
+        AssertThat(p.parse(), Equals(Parser::State::DONE));
+        AssertThat(p.get_headers()->keep_alive(), Equals(c.keep_alive));
+      }
+    });
+
+    it("should read the body length from Content-Length", []
+    {
+      struct { const char *request; bool valid; uint64_t length; } cases[] = {
+        { "POST / HTTP/1.1\r\n\r\n", true, 0 },
+        { "POST / HTTP/1.1\r\nContent-Length: 42\r\n\r\n", true, 42 },
+        { "POST / HTTP/1.1\r\nContent-Length: 42\r\n"
+          "content-length: 42\r\n\r\n", true, 42 },
+        { "POST / HTTP/1.1\r\nContent-Length: 42\r\n"
+          "Content-Length: 43\r\n\r\n", false, 0 },
+        { "POST / HTTP/1.1\r\nContent-Length: -1\r\n\r\n", false, 0 },
+        { "POST / HTTP/1.1\r\nContent-Length: 4 2\r\n\r\n", false, 0 },
+        { "POST / HTTP/1.1\r\nContent-Length:\r\n\r\n", false, 0 },
+        { "POST / HTTP/1.1\r\nContent-Length: 99999999999999999999\r\n\r\n",
+          false, 0 }
+      };
+
+      for (auto &c : cases)
+      {
+        Parser p(c.request, strlen(c.request));
+        uint64_t length = 7;
+
+        AssertThat(p.parse(), Equals(Parser::State::DONE));
+        AssertThat(p.get_headers()->content_length(length), Equals(c.valid));
+
+        if (c.valid) AssertThat(length, Equals(c.length));
+      }
+    });
+
+    it("should read IMF-fixdates", []
+    {
+      time_t t = 0;
+
+      AssertThat(Headers::http_date("Sun, 06 Nov 1994 08:49:37 GMT", t),
+          IsTrue());
+      AssertThat((long) t, Equals(784111777L));
+      AssertThat(Headers::http_date("Thu, 01 Jan 1970 00:00:00 GMT", t),
+          IsTrue());
+      AssertThat((long) t, Equals(0L));
+      AssertThat(Headers::http_date("Tue, 29 Feb 2000 12:00:00 GMT", t),
+          IsTrue());
+      AssertThat((long) t, Equals(951825600L));
+
+      AssertThat(Headers::http_date("Sunday, 06-Nov-94 08:49:37 GMT", t),
+          IsFalse());
+      AssertThat(Headers::http_date("Sun Nov  6 08:49:37 1994", t),
+          IsFalse());
+      AssertThat(Headers::http_date("Sun, 06 Foo 1994 08:49:37 GMT", t),
+          IsFalse());
+      AssertThat(Headers::http_date("Sun, 06 Nov 1994 08:49:37 UTC", t),
+          IsFalse());
+    });
+
+    it("should answer conditional requests from the validators", []
+    {
+      const char *etag = "\"abc\"";
+      time_t modified = 784111777;
+
+      struct { const char *fields; bool not_modified; } cases[] = {
+        { "", false },
+        { "If-None-Match: \"abc\"\r\n", true },
+        { "If-None-Match: \"x\", W/\"abc\"\r\n", true },
+        { "If-None-Match: *\r\n", true },
+        { "If-None-Match: \"abcd\"\r\n", false },
+        { "If-None-Match: abc\r\n", false },
+        { "If-None-Match: \"x\"\r\nIf-None-Match: \"abc\"\r\n", true },
+        { "If-Modified-Since: Sun, 06 Nov 1994 08:49:37 GMT\r\n", true },
+        { "If-Modified-Since: Sun, 06 Nov 1994 08:49:36 GMT\r\n", false },
+        { "If-Modified-Since: yesterday\r\n", false },
+
+        // If-None-Match wins over If-Modified-Since
+        { "If-None-Match: \"x\"\r\n"
+          "If-Modified-Since: Sun, 06 Nov 1994 08:49:37 GMT\r\n", false }
+      };
+
+      for (auto &c : cases)
+      {
+        string request = string("GET / HTTP/1.1\r\n") + c.fields + "\r\n";
+        Parser p(request.data(), request.size());
+
+        AssertThat(p.parse(), Equals(Parser::State::DONE));
+        AssertThat(p.get_headers()->not_modified(etag, modified),
+            Equals(c.not_modified));
+      }
+    });
+
+    it("should only apply a range the If-Range validator allows", []
+    {
+      const char *etag = "\"abc\"";
+      time_t modified = 784111777;
+
+      struct { const char *fields; bool applies; } cases[] = {
+        { "", true },
+        { "If-Range: \"abc\"\r\n", true },
+        { "If-Range: \"abd\"\r\n", false },
+        { "If-Range: W/\"abc\"\r\n", false },
+        { "If-Range: Sun, 06 Nov 1994 08:49:37 GMT\r\n", true },
+        { "If-Range: Sun, 06 Nov 1994 08:49:38 GMT\r\n", false }
+      };
+
+      for (auto &c : cases)
+      {
+        string request = string("GET / HTTP/1.1\r\n") + c.fields + "\r\n";
+        Parser p(request.data(), request.size());
+
+        AssertThat(p.parse(), Equals(Parser::State::DONE));
+        AssertThat(p.get_headers()->if_range(etag, modified),
+            Equals(c.applies));
+      }
+    });
+
+    it("should weigh the codings Accept-Encoding lists", []
+    {
+      struct { const char *fields; unsigned gzip, br; } cases[] = {
+        { "", 0, 0 },
+        { "Accept-Encoding: gzip, deflate, br\r\n", 1000, 1000 },
+        { "Accept-Encoding: GZIP;q=0.5\r\n", 500, 0 },
+        { "Accept-Encoding: gzip ; q=0.25, br;q=0\r\n", 250, 0 },
+        { "Accept-Encoding: *;q=0.1, br;q=1.0\r\n", 100, 1000 },
+        { "Accept-Encoding: gzip;q=0, *\r\n", 0, 1000 },
+        { "Accept-Encoding: gzip;level=1;q=0.8\r\n", 800, 0 },
+        { "Accept-Encoding: x-gzip\r\n", 0, 0 },
+        { "Accept-Encoding: identity\r\nAccept-Encoding: br\r\n", 0, 1000 }
+      };
+
+      for (auto &c : cases)
+      {
+        string request = string("GET / HTTP/1.1\r\n") + c.fields + "\r\n";
+        Parser p(request.data(), request.size());
+
+        AssertThat(p.parse(), Equals(Parser::State::DONE));
+        AssertThat(p.get_headers()->quality(Known::ACCEPT_ENCODING, "gzip"),
+            Equals(c.gzip));
+        AssertThat(p.get_headers()->quality(Known::ACCEPT_ENCODING, "br"),
+            Equals(c.br));
+      }
+    });
   });
 });
 
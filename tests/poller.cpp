@@ -0,0 +1,144 @@
+#include "bandit/bandit.h"
+#include "poller.h"
+#include <sys/socket.h>
+#include <iostream>
+#include <string>
+
+using namespace bandit;
+using namespace Net;
+using namespace std;
+
+go_bandit([]()
+{
+  describe("Poller", []()
+  {
+    it("should acquire a multiplexer on construct", []
+    {
+      Poller p;
+      AssertThat(p.fd(), IsGreaterThan(-1));
+      AssertThat(p.err(), Equals(0));
+    });
+
+    it("should time out with no events when nothing is ready", []
+    {
+      Poller p;
+      int pair[2];
+      socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+
+      p.add(pair[0], Event::READ);
+
+      Event events[4];
+      AssertThat(p.wait(events, 4, 0), Equals(0));
+
+      close(pair[0]);
+      close(pair[1]);
+    });
+
+    it("should report a read event when data arrives", []
+    {
+      Poller p;
+      int pair[2];
+      socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+
+      AssertThat(p.add(pair[0], Event::READ), Equals(0));
+      write(pair[1], "ping", 4);
+
+      Event events[4];
+      int count = p.wait(events, 4, 1000);
+
+      AssertThat(count, Equals(1));
+      AssertThat(events[0].fd, Equals((uintptr_t) pair[0]));
+      AssertThat(events[0].flags & Event::READ, Equals((uint32_t) Event::READ));
+
+      close(pair[0]);
+      close(pair[1]);
+    });
+
+    it("should report write readiness only once it is asked for", []
+    {
+      Poller p;
+      int pair[2];
+      socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+
+      Event events[4];
+
+      p.add(pair[0], Event::READ);
+      AssertThat(p.wait(events, 4, 0), Equals(0));
+
+      AssertThat(p.modify(pair[0], Event::READ | Event::WRITE), Equals(0));
+      AssertThat(p.wait(events, 4, 1000), Equals(1));
+      AssertThat(events[0].flags & Event::WRITE,
+          Equals((uint32_t) Event::WRITE));
+
+      close(pair[0]);
+      close(pair[1]);
+    });
+
+    it("should report a hangup when the peer closes", []
+    {
+      Poller p;
+      int pair[2];
+      socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+
+      // kqueue says the peer is gone on the write filter
+      p.add(pair[0], Event::READ | Event::WRITE);
+      close(pair[1]);
+
+      Event events[4];
+      uint32_t flags = 0;
+      int count = p.wait(events, 4, 1000);
+
+      for (int i = 0; i < count; i++) flags |= events[i].flags;
+
+      AssertThat(count, IsGreaterThan(0));
+      AssertThat(flags & Event::HANGUP, Equals((uint32_t) Event::HANGUP));
+
+      close(pair[0]);
+    });
+
+    it("should tell a peer that's only done sending from one that's gone", []
+    {
+      Poller p;
+      int pair[2];
+      socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+
+      p.add(pair[0], Event::READ);
+      shutdown(pair[1], SHUT_WR);
+
+      Event events[4];
+      AssertThat(p.wait(events, 4, 1000), Equals(1));
+      AssertThat(events[0].flags & Event::HALF_CLOSED,
+          Equals((uint32_t) Event::HALF_CLOSED));
+      AssertThat(events[0].flags & Event::HANGUP, Equals((uint32_t) 0));
+
+      // not reading any more, nothing more to hear about it
+      p.modify(pair[0], 0);
+      AssertThat(p.wait(events, 4, 0), Equals(0));
+
+      close(pair[0]);
+      close(pair[1]);
+    });
+
+    it("should stop reporting events once an fd is removed", []
+    {
+      Poller p;
+      int pair[2];
+      socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+
+      p.add(pair[0], Event::READ);
+      AssertThat(p.remove(pair[0]), Equals(0));
+      write(pair[1], "ping", 4);
+
+      Event events[4];
+      AssertThat(p.wait(events, 4, 0), Equals(0));
+
+      close(pair[0]);
+      close(pair[1]);
+    });
+  });
+});
+
+int main(int argc, char **argv)
+{
+  return run(argc, argv);
+}
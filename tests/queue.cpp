@@ -0,0 +1,105 @@
+#include "bandit/bandit.h"
+#include "queue.h"
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace bandit;
+using namespace Net;
+using namespace std;
+
+go_bandit([]()
+{
+  describe("Queue", []()
+  {
+    it("should round capacity up to a power of two", []
+    {
+      Queue<int> q(1000);
+      AssertThat(q.capacity(), Equals((size_t) 1024));
+    });
+
+    it("should pop nothing when empty", []
+    {
+      Queue<int> q(8);
+      int value = 0;
+      AssertThat(q.pop(value), IsFalse());
+      AssertThat(q.size(), Equals((size_t) 0));
+    });
+
+    it("should pop values in the order they were pushed", []
+    {
+      Queue<int> q(8);
+      int value = 0;
+
+      q.push(1);
+      q.push(2);
+      q.push(3);
+
+      AssertThat(q.size(), Equals((size_t) 3));
+
+      q.pop(value);
+      AssertThat(value, Equals(1));
+      q.pop(value);
+      AssertThat(value, Equals(2));
+      q.pop(value);
+      AssertThat(value, Equals(3));
+    });
+
+    it("should refuse a push when full", []
+    {
+      Queue<int> q(4);
+
+      for (int i = 0; i < 4; i++) AssertThat(q.push(i), IsTrue());
+
+      AssertThat(q.push(4), IsFalse());
+
+      int value = 0;
+      q.pop(value);
+      AssertThat(q.push(4), IsTrue());
+    });
+
+    it("should deliver every value from several producers exactly once", []
+    {
+      Queue<int> q(1024);
+      const int PRODUCERS = 4, EACH = 10000;
+
+      vector<thread> producers;
+
+      for (int p = 0; p < PRODUCERS; p++)
+      {
+        producers.emplace_back([&q, p, EACH]()
+        {
+          for (int i = 0; i < EACH; i++)
+          {
+            while (!q.push(p * EACH + i)) this_thread::yield();
+          }
+        });
+      }
+
+      vector<int> seen(PRODUCERS * EACH, 0);
+      int received = 0, value = 0;
+
+      while (received < PRODUCERS * EACH)
+      {
+        if (q.pop(value))
+        {
+          seen[value]++;
+          received++;
+        }
+      }
+
+      for (auto &t : producers) t.join();
+
+      int duplicates = 0;
+      for (int count : seen) if (count != 1) duplicates++;
+
+      AssertThat(duplicates, Equals(0));
+    });
+  });
+});
+
+int main(int argc, char **argv)
+{
+  return run(argc, argv);
+}
@@ -0,0 +1,251 @@
+#include "bandit/bandit.h"
+#include "response.h"
+#include <iostream>
+#include <string>
+#include <stdint.h>
+#include <unistd.h>
+
+using namespace bandit;
+using namespace Http;
+using namespace std;
+
+static string joined(const struct iovec *iov, int count)
+{
+  string out;
+
+  for (int i = 0; i < count; i++)
+  {
+    out.append((const char *) iov[i].iov_base, iov[i].iov_len);
+  }
+
+  return out;
+}
+
+static string formatted(uint64_t value)
+{
+  char digits[20];
+  return string(digits, Response::format(value, digits));
+}
+
+go_bandit([]()
+{
+  describe("Response", []()
+  {
+    it("should format integers like printf does", []
+    {
+      uint64_t values[] = {
+        0, 7, 9, 10, 42, 99, 100, 101, 999, 1000, 65535, 1234567890,
+        10000000000000000000ull, UINT64_MAX
+      };
+
+      for (uint64_t v : values)
+      {
+        AssertThat(formatted(v), Equals(to_string(v)));
+      }
+    });
+
+    it("should take status lines from the table", []
+    {
+      AssertThat(Response::status_line(200), Equals("HTTP/1.1 200 OK\r\n"));
+      AssertThat(Response::status_line(404),
+          Equals("HTTP/1.1 404 Not Found\r\n"));
+      AssertThat(Response::status_line(299).empty(), IsTrue());
+    });
+
+    it("should lay out status line, header block and body", []
+    {
+      static const char BODY[] = "Hello, world!\r\n";
+
+      Response r(200);
+      r.header("Content-Type", "text/plain");
+      r.body(BODY, sizeof(BODY) - 1);
+
+      struct iovec iov[2 + Response::BODY_MAX];
+
+      AssertThat(r.iovecs(iov), Equals(3));
+
+      // the body is referenced, not copied
+      AssertThat(iov[2].iov_base == (void *) BODY, IsTrue());
+
+      AssertThat(joined(iov, 3), Equals(
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Type: text/plain\r\n"
+            "Content-Length: 15\r\n"
+            "\r\n"
+            "Hello, world!\r\n"));
+      AssertThat(r.size(), Equals(joined(iov, 3).size()));
+    });
+
+    it("should count every body segment in Content-Length", []
+    {
+      Response r(201);
+      r.header("X-Id", (uint64_t) 12345);
+      r.body("abc", 3);
+      r.body("", 0);
+      r.body("defgh", 5);
+
+      struct iovec iov[2 + Response::BODY_MAX];
+      int count = r.iovecs(iov);
+
+      AssertThat(count, Equals(4));
+      AssertThat(r.content_length(), Equals((size_t) 8));
+      AssertThat(joined(iov, count), Equals(
+            "HTTP/1.1 201 Created\r\n"
+            "X-Id: 12345\r\n"
+            "Content-Length: 8\r\n"
+            "\r\n"
+            "abcdefgh"));
+    });
+
+    it("should leave the body out of a HEAD answer but keep its length", []
+    {
+      Response r;
+      r.body("0123456789", 10);
+      r.head_only();
+
+      struct iovec iov[2 + Response::BODY_MAX];
+      int count = r.iovecs(iov);
+
+      AssertThat(count, Equals(2));
+      AssertThat(joined(iov, count), Equals(
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Length: 10\r\n"
+            "\r\n"));
+    });
+
+    it("should announce chunks instead of a length when asked", []
+    {
+      Response r;
+      r.header("Content-Encoding", "gzip");
+      r.chunked();
+
+      struct iovec iov[2 + Response::BODY_MAX];
+      int count = r.iovecs(iov);
+
+      AssertThat(joined(iov, count), Equals(
+            "HTTP/1.1 200 OK\r\n"
+            "Content-Encoding: gzip\r\n"
+            "Transfer-Encoding: chunked\r\n"
+            "\r\n"));
+
+      Response not_modified(304);
+      not_modified.chunked();
+
+      count = not_modified.iovecs(iov);
+
+      AssertThat(joined(iov, count), Equals(
+            "HTTP/1.1 304 Not Modified\r\n"
+            "\r\n"));
+    });
+
+    it("should send no length or body with statuses that can't have one", []
+    {
+      Response r(304);
+      r.header("ETag", "\"abc\"");
+      r.body("ignored", 7);
+
+      struct iovec iov[2 + Response::BODY_MAX];
+      int count = r.iovecs(iov);
+
+      AssertThat(joined(iov, count), Equals(
+            "HTTP/1.1 304 Not Modified\r\n"
+            "ETag: \"abc\"\r\n"
+            "\r\n"));
+    });
+
+    it("should format codes that aren't in the table", []
+    {
+      Response r(299);
+
+      struct iovec iov[2 + Response::BODY_MAX];
+      int count = r.iovecs(iov);
+
+      AssertThat(joined(iov, count), Equals(
+            "HTTP/1.1 299 \r\n"
+            "Content-Length: 0\r\n"
+            "\r\n"));
+    });
+
+    it("should refuse a header that doesn't fit and keep the rest intact", []
+    {
+      string big(Response::HEAD_MAX, 'x');
+
+      Response r;
+      AssertThat(r.header("X-Small", "1"), IsTrue());
+      AssertThat(r.header("X-Big", View(big.data(), big.size())), IsFalse());
+
+      struct iovec iov[2 + Response::BODY_MAX];
+      int count = r.iovecs(iov);
+
+      AssertThat(joined(iov, count), Equals(
+            "HTTP/1.1 200 OK\r\n"
+            "X-Small: 1\r\n"
+            "Content-Length: 0\r\n"
+            "\r\n"));
+    });
+
+    it("should count a body sent separately without laying it out", []
+    {
+      Response r(206);
+      r.header("Content-Range", "bytes 0-99/1000");
+      r.body_length(100);
+
+      struct iovec iov[2 + Response::BODY_MAX];
+      int count = r.iovecs(iov);
+
+      AssertThat(count, Equals(2));
+      AssertThat(joined(iov, count), Equals(
+            "HTTP/1.1 206 Partial Content\r\n"
+            "Content-Range: bytes 0-99/1000\r\n"
+            "Content-Length: 100\r\n"
+            "\r\n"));
+      AssertThat(r.size(), Equals(joined(iov, count).size()));
+    });
+
+    it("should stop taking body segments past BODY_MAX", []
+    {
+      Response r;
+
+      for (int i = 0; i < Response::BODY_MAX; i++)
+      {
+        AssertThat(r.body("x", 1), IsTrue());
+      }
+
+      AssertThat(r.body("x", 1), IsFalse());
+      AssertThat(r.content_length(), Equals((size_t) Response::BODY_MAX));
+    });
+
+    it("should queue the same bytes it lays out", []
+    {
+      static const char BODY[] = "queued body";
+
+      Response r(404);
+      r.header("Connection", "close");
+      r.body(BODY, sizeof(BODY) - 1);
+
+      struct iovec iov[2 + Response::BODY_MAX];
+      string expected = joined(iov, r.iovecs(iov));
+
+      Net::Output out;
+      r.queue(out);
+
+      int fds[2];
+      pipe(fds);
+
+      AssertThat(out.flush(fds[1]), Equals((ssize_t) expected.size()));
+
+      char buf[256];
+      ssize_t n = read(fds[0], buf, sizeof(buf));
+
+      AssertThat(string(buf, n), Equals(expected));
+
+      close(fds[0]);
+      close(fds[1]);
+    });
+  });
+});
+
+int main(int argc, char **argv)
+{
+  return run(argc, argv);
+}
@@ -0,0 +1,120 @@
+#include "bandit/bandit.h"
+#include "ring.h"
+#include <sys/socket.h>
+#include <iostream>
+#include <string>
+
+using namespace bandit;
+using namespace Net;
+using namespace std;
+
+go_bandit([]()
+{
+  describe("Ring", []()
+  {
+    it("should set up an io_uring on construct", []
+    {
+      Ring r;
+      AssertThat(r.fd(), IsGreaterThan(-1));
+      AssertThat(r.err(), Equals(0));
+    });
+
+    it("should have nothing to reap before anything is submitted", []
+    {
+      Ring r;
+      AssertThat(r.peek() == NULL, IsTrue());
+    });
+
+    it("should complete a batch of nops in one enter", []
+    {
+      Ring r;
+
+      r.prep_nop(1);
+      r.prep_nop(2);
+      r.prep_nop(3);
+
+      AssertThat(r.submit(3), Equals(3));
+      AssertThat(r.enters(), Equals(1u));
+
+      uint64_t sum = 0;
+      int reaped = 0;
+      struct io_uring_cqe *cqe;
+
+      while ((cqe = r.peek()) != NULL)
+      {
+        sum += cqe->user_data;
+        reaped++;
+        r.seen();
+      }
+
+      AssertThat(reaped, Equals(3));
+      AssertThat(sum, Equals((uint64_t) 6));
+    });
+
+    it("should receive into a provided buffer", []
+    {
+      Ring r;
+      int pair[2];
+      socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+
+      AssertThat(r.provide(8, 64, 0), Equals(0));
+
+      write(pair[1], "ping", 4);
+      r.prep_recv(pair[0], 0, 42);
+      r.submit(1);
+
+      struct io_uring_cqe *cqe = r.peek();
+
+      AssertThat(cqe == NULL, IsFalse());
+      AssertThat(cqe->user_data, Equals((uint64_t) 42));
+      AssertThat(cqe->res, Equals(4));
+      AssertThat(cqe->flags & IORING_CQE_F_BUFFER,
+          Equals((uint32_t) IORING_CQE_F_BUFFER));
+
+      uint16_t id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+      AssertThat(string(r.buffer(id), 4), Equals("ping"));
+
+      r.seen();
+      r.recycle(id);
+
+      close(pair[0]);
+      close(pair[1]);
+    });
+
+    it("should keep a multishot receive armed across reads", []
+    {
+      Ring r;
+      int pair[2];
+      socketpair(AF_UNIX, SOCK_STREAM, 0, pair);
+
+      r.provide(8, 64, 0);
+      r.prep_recv(pair[0], 0, 7);
+
+      write(pair[1], "one", 3);
+      r.submit(1);
+
+      struct io_uring_cqe *cqe = r.peek();
+      AssertThat(cqe->res, Equals(3));
+      AssertThat(cqe->flags & IORING_CQE_F_MORE,
+          Equals((uint32_t) IORING_CQE_F_MORE));
+      r.recycle(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+      r.seen();
+
+      write(pair[1], "two!", 4);
+      r.submit(1);
+
+      cqe = r.peek();
+      AssertThat(cqe->user_data, Equals((uint64_t) 7));
+      AssertThat(cqe->res, Equals(4));
+      r.seen();
+
+      close(pair[0]);
+      close(pair[1]);
+    });
+  });
+});
+
+int main(int argc, char **argv)
+{
+  return run(argc, argv);
+}
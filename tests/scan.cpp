@@ -0,0 +1,156 @@
+#include "bandit/bandit.h"
+#include "scan.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <stdlib.h>
+
+using namespace bandit;
+using namespace Http;
+using namespace std;
+
+static const Scan::Kernel kernels[] = {
+  Scan::Kernel::SCALAR,
+  Scan::Kernel::SSE42,
+  Scan::Kernel::AVX2
+};
+
+static size_t line_end(const string &s, size_t from = 0)
+{
+  return Scan::line_end(s.data() + from, s.data() + s.size()) - s.data();
+}
+
+static size_t token_end(const string &s, size_t from = 0)
+{
+  return Scan::token_end(s.data() + from, s.data() + s.size()) - s.data();
+}
+
+go_bandit([]()
+{
+  describe("Scan", []()
+  {
+    Scan::Kernel detected = Scan::kernel();
+
+    after_each([detected]()
+    {
+      Scan::use(detected);
+    });
+
+    it("should always support the scalar kernel", []
+    {
+      AssertThat(Scan::supported(Scan::Kernel::SCALAR), IsTrue());
+    });
+
+    for (Scan::Kernel kernel : kernels)
+    {
+      if (!Scan::supported(kernel)) continue;
+
+      string prefix = string(Scan::name(kernel)) + ": ";
+
+      it((prefix + "should find the newline past a long line").c_str(),
+          [kernel]
+      {
+        Scan::use(kernel);
+
+        string line = "Cookie: " + string(100, 'a') + "\n";
+        AssertThat(line_end(line), Equals(line.size() - 1));
+      });
+
+      it((prefix + "should stop at control characters but not tab").c_str(),
+          [kernel]
+      {
+        Scan::use(kernel);
+
+        string line = string(40, 'x') + "\t\x80\xff" + string(40, 'y');
+
+        AssertThat(line_end(line), Equals(line.size()));
+
+        for (char c : string("\r\x01\x1f\x7f", 4))
+        {
+          string stop = line;
+          stop[50] = c;
+          AssertThat(line_end(stop), Equals((size_t) 50));
+        }
+
+        string nul = line;
+        nul[33] = '\0';
+        AssertThat(line_end(nul), Equals((size_t) 33));
+      });
+
+      it((prefix + "should end a field name at the colon").c_str(),
+          [kernel]
+      {
+        Scan::use(kernel);
+
+        string field = "X-Some-Rather-Long-Header-Name|With~Ticks`: v";
+        AssertThat(token_end(field), Equals(field.find(':')));
+      });
+
+      it((prefix + "should stop at separators and high bytes").c_str(),
+          [kernel]
+      {
+        Scan::use(kernel);
+
+        for (char c : string(" \t\"(),/;<=>?@[\\]{}\x7f\x80\xff"))
+        {
+          string name = string(48, 'a');
+          name[37] = c;
+          AssertThat(token_end(name), Equals((size_t) 37));
+        }
+      });
+
+      it((prefix + "should not look past the end it was given").c_str(),
+          [kernel]
+      {
+        Scan::use(kernel);
+
+        string buffer = string(64, 'a') + ":\n";
+
+        for (size_t size = 0; size <= 64; size++)
+        {
+          const char *begin = buffer.data(), *end = begin + size;
+
+          AssertThat((size_t) (Scan::line_end(begin, end) - begin),
+              Equals(size));
+          AssertThat((size_t) (Scan::token_end(begin, end) - begin),
+              Equals(size));
+        }
+      });
+
+      it((prefix + "should agree with the scalar kernel").c_str(),
+          [kernel]
+      {
+        srand(42);
+
+        // mostly token characters, now and then something that isn't
+        const string common = "abcdefghijklmnopqrstuvwxyz0123456789-_.|~";
+        const string rare = ":; \t\r\n\x01\x7f\x80\xff\"{}";
+
+        for (int round = 0; round < 2000; round++)
+        {
+          string s(rand() % 100, 'a');
+
+          for (char &c : s)
+          {
+            c = rand() % 32 ? common[rand() % common.size()]
+                            : rare[rand() % rare.size()];
+          }
+
+          size_t from = s.empty() ? 0 : rand() % s.size();
+
+          Scan::use(Scan::Kernel::SCALAR);
+          size_t line = line_end(s, from), token = token_end(s, from);
+
+          Scan::use(kernel);
+          AssertThat(line_end(s, from), Equals(line));
+          AssertThat(token_end(s, from), Equals(token));
+        }
+      });
+    }
+  });
+});
+
+int main(int argc, char **argv)
+{
+  return run(argc, argv);
+}
@@ -0,0 +1,156 @@
+#include "bandit/bandit.h"
+#include "slab.h"
+#include <string>
+
+using namespace bandit;
+using namespace Net;
+using namespace std;
+
+static int constructed = 0;
+static int destroyed = 0;
+
+struct Cold
+{
+  Cold() : name("cold") { constructed++; }
+  ~Cold() { destroyed++; }
+
+  string name;
+};
+
+struct alignas(64) Hot
+{
+  Hot(int fd, int value) : fd(fd), value(value), cold(NULL) {}
+
+  int fd;
+  int value;
+  Cold *cold;
+};
+
+// one that wants a reference to its cold half
+struct Linked
+{
+  Linked(Cold &cold, int fd) : fd(fd), cold(cold) {}
+
+  int fd;
+  Cold &cold;
+};
+
+go_bandit([]()
+{
+  describe("Slab", []()
+  {
+    before_each([]()
+    {
+      constructed = 0;
+      destroyed = 0;
+    });
+
+    it("should find nothing it wasn't given", []
+    {
+      Slab<Hot, Cold> slab;
+
+      AssertThat(slab.find(0) == NULL, IsTrue());
+      AssertThat(slab.find(-1) == NULL, IsTrue());
+      AssertThat(slab.find(100000) == NULL, IsTrue());
+      AssertThat(slab.empty(), IsTrue());
+      AssertThat(slab.reserved(), Equals((size_t) 0));
+    });
+
+    it("should find an entry by its fd", []
+    {
+      Slab<Hot, Cold> slab;
+
+      Hot *a = slab.emplace(3, 3, 30);
+      Hot *b = slab.emplace(700, 700, 7000);
+
+      AssertThat(slab.find(3), Equals(a));
+      AssertThat(slab.find(700), Equals(b));
+      AssertThat(slab.find(3)->value, Equals(30));
+      AssertThat(slab.find(700)->value, Equals(7000));
+      AssertThat(slab.find(4) == NULL, IsTrue());
+      AssertThat(slab.size(), Equals((size_t) 2));
+
+      AssertThat(slab.cold(3).name, Equals("cold"));
+      AssertThat(&slab.cold(3) != &slab.cold(700), IsTrue());
+    });
+
+    it("should keep entries where they are as it grows", []
+    {
+      Slab<Hot, Cold> slab;
+
+      Hot *first = slab.emplace(1, 1, 1);
+      Cold *cold = &slab.cold(1);
+
+      for (int fd = 2; fd < 5000; fd++) slab.emplace(fd, fd, fd);
+
+      AssertThat(slab.find(1), Equals(first));
+      AssertThat(&slab.cold(1), Equals(cold));
+      AssertThat(slab.size(), Equals((size_t) 4999));
+    });
+
+    it("should align hot entries to a cache line", []
+    {
+      Slab<Hot, Cold> slab;
+
+      for (int fd = 0; fd < 10; fd++)
+      {
+        uintptr_t at = (uintptr_t) slab.emplace(fd, fd, 0);
+        AssertThat(at % 64, Equals((uintptr_t) 0));
+      }
+    });
+
+    it("should destroy an entry when it's erased or replaced", []
+    {
+      {
+        Slab<Hot, Cold> slab;
+
+        slab.emplace(5, 5, 1);
+        slab.emplace(6, 6, 1);
+
+        AssertThat(slab.erase(5), IsTrue());
+        AssertThat(slab.erase(5), IsFalse());
+        AssertThat(slab.find(5) == NULL, IsTrue());
+        AssertThat(destroyed, Equals(1));
+
+        // the fd came back before the old one was erased
+        slab.emplace(6, 6, 2);
+
+        AssertThat(slab.find(6)->value, Equals(2));
+        AssertThat(slab.size(), Equals((size_t) 1));
+        AssertThat(destroyed, Equals(2));
+      }
+
+      AssertThat(constructed, Equals(3));
+      AssertThat(destroyed, Equals(3));
+    });
+
+    it("should hand the cold half to a hot one that takes it", []
+    {
+      Slab<Linked, Cold> slab;
+
+      Linked *linked = slab.emplace(9, 9);
+
+      AssertThat(&linked->cold, Equals(&slab.cold(9)));
+      AssertThat(linked->fd, Equals(9));
+    });
+
+    it("should keep its pages once they're empty", []
+    {
+      Slab<Hot, Cold> slab;
+
+      slab.emplace(0, 0, 0);
+      size_t reserved = slab.reserved();
+
+      slab.erase(0);
+
+      AssertThat(slab.reserved(), Equals(reserved));
+      AssertThat(reserved, IsGreaterThan((size_t) 0));
+      AssertThat(slab.emplace(-1, -1, 0) == NULL, IsTrue());
+    });
+  });
+});
+
+int main(int argc, char **argv)
+{
+  return run(argc, argv);
+}
@@ -2,6 +2,8 @@
 #include "socket.h"
 #include <iostream>
 #include <string>
+#include <memory>
+#include <unistd.h>
 
 using namespace bandit;
 using namespace Net;
@@ -115,6 +117,130 @@ go_bandit([]()
       client.connect("127.0.0.1", 8080);
       AssertThat(client.state(), Equals(Socket::INVALID));
     });
+
+    it("should hand its fd over when moved, and close it only once", []
+    {
+      Socket s;
+      s.configure();
+      Socket::FD fd = s.fd();
+
+      Socket moved(std::move(s));
+
+      AssertThat(moved.fd(), Equals(fd));
+      AssertThat(moved.state(), Equals(Socket::INITIALIZED));
+      AssertThat(s.state(), Equals(Socket::CLOSED));
+
+      // the moved-from one closing doesn't touch the fd
+      s.close();
+      AssertThat(fcntl(fd, F_GETFD) >= 0, IsTrue());
+
+      Socket other;
+      other.configure();
+      Socket::FD other_fd = other.fd();
+
+      // assigning over a socket closes the one it had
+      other = std::move(moved);
+
+      AssertThat(other.fd(), Equals(fd));
+      AssertThat(fcntl(other_fd, F_GETFD), Equals(-1));
+
+      other.close();
+      AssertThat(fcntl(fd, F_GETFD), Equals(-1));
+    });
+
+    it("should hold a zero-copy buffer until the kernel lets go of it", []
+    {
+      Socket server;
+      Socket client;
+
+      server.configure("127.0.0.1", 8091);
+      server.bind();
+      server.listen();
+
+      client.configure();
+      client.connect("127.0.0.1", 8091);
+
+      // without SO_ZEROCOPY sends just copy, and nothing is held
+      bool zerocopy = client.zerocopy(1);
+
+      shared_ptr<string> body(new string(100000, 'z'));
+      weak_ptr<string> watch(body);
+
+      int sent = client.send(body->data(), body->size(), body);
+      body.reset();
+
+      Socket connection(server.accept(), Socket::ACCEPTED);
+      string received;
+      char buf[65536];
+
+      while (received.size() < (size_t) sent)
+      {
+        int n = connection.recv(buf, sizeof(buf));
+        if (n <= 0) break;
+        received.append(buf, n);
+      }
+
+      AssertThat(received.size(), Equals((size_t) sent));
+      AssertThat(received, Equals(string(sent, 'z')));
+
+      for (int i = 0; i < 1000 && client.zerocopy_state().held() > 0; i++)
+      {
+        client.reap();
+        usleep(1000);
+      }
+
+      AssertThat(client.zerocopy_state().held(), Equals((size_t) 0));
+      AssertThat(watch.expired(), IsTrue());
+      AssertThat(client.zerocopy_state().sends(),
+          Equals((size_t) (zerocopy ? 1 : 0)));
+    });
+
+    it("should hold a zero-copy buffer past close until the kernel is done", []
+    {
+      Socket server;
+      Socket client;
+
+      server.configure("127.0.0.1", 8092);
+      server.bind();
+      server.listen();
+
+      client.configure();
+      client.connect("127.0.0.1", 8092);
+      client.zerocopy(1);
+
+      shared_ptr<string> body(new string(100000, 'z'));
+      weak_ptr<string> watch(body);
+
+      int sent = client.send(body->data(), body->size(), body);
+      body.reset();
+
+      client.close();
+
+      // not taken yet, unless it was copied after all
+      AssertThat(watch.expired(), Equals(Socket::lingering() == 0));
+
+      Socket connection(server.accept(), Socket::ACCEPTED);
+      string received;
+      char buf[65536];
+
+      for (int n; (n = connection.recv(buf, sizeof(buf))) > 0; )
+      {
+        received.append(buf, n);
+      }
+
+      // shut for writing, the peer sees the end after all of it
+      AssertThat(received, Equals(string(sent, 'z')));
+
+      // any socket closing on the thread looks at the lingering ones
+      for (int i = 0; i < 1000 && Socket::lingering() > 0; i++)
+      {
+        Socket().close();
+        usleep(1000);
+      }
+
+      AssertThat(Socket::lingering(), Equals((size_t) 0));
+      AssertThat(watch.expired(), IsTrue());
+    });
   });
 });
 
@@ -0,0 +1,307 @@
+#include "bandit/bandit.h"
+#include "worker.h"
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <zlib.h>
+
+using namespace bandit;
+using namespace Http;
+using namespace std;
+
+static const int PORT = 8094;
+
+// bigger than any socket buffer between the two ends
+static const size_t BIG = 4 * 1024 * 1024;
+static const size_t SMALL = 16 * 1024;
+
+// compressed, still more than the socket buffers take in
+static const size_t TEXT = 16 * 1024 * 1024;
+
+static string root;
+
+// letters at random, a text file that compresses to more than half
+static string text;
+
+// what the worker's buffers hold, nothing's ever refused
+static Net::Budget budget;
+
+/**
+ * One worker for every test, serving a temporary root. It runs on its own
+ * thread until the process exits.
+ */
+static void start()
+{
+  static Worker *worker = NULL;
+
+  if (worker) return;
+
+  char dir[] = "/tmp/worker_test_XXXXXX";
+  root = mkdtemp(dir);
+
+  FILE *f = fopen((root + "/big.bin").c_str(), "w");
+  for (size_t i = 0; i < BIG; i++) fputc('a' + i % 26, f);
+  fclose(f);
+
+  uint32_t x = 2463534242u;
+
+  for (size_t i = 0; i < TEXT; i++)
+  {
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    text += (char) ('a' + x % 26);
+  }
+
+  f = fopen((root + "/big.txt").c_str(), "w");
+  fwrite(text.data(), 1, text.size(), f);
+  fclose(f);
+
+  f = fopen((root + "/small.txt").c_str(), "w");
+  for (size_t i = 0; i < SMALL; i++) fputc('x', f);
+  fclose(f);
+
+  struct sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(PORT);
+
+  worker = new Worker(address);
+  worker->setKeepAlive(0, 0);
+
+  // the smallest input there is, so a head can fill it
+  worker->setInputLimit(0);
+  worker->setRoot(root.c_str());
+  worker->setDeflate(TEXT);
+  worker->setBudget(&budget);
+
+  thread([]() { worker->run(); }).detach();
+  usleep(100000);
+}
+
+// a blocking client with a small receive buffer, so the server has to wait
+static int connect_client()
+{
+  int fd = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+  int size = 16 * 1024;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+
+  struct timeval timeout = { 5, 0 };
+  setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+  struct sockaddr_in to = {};
+  to.sin_family = AF_INET;
+  to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  to.sin_port = htons(PORT);
+
+  if (connect(fd, (struct sockaddr *) &to, sizeof(to)) < 0)
+  {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+// everything until the server closes, or the timeout
+static string drain(int fd)
+{
+  string received;
+  char buf[65536];
+  ssize_t got;
+
+  while ((got = recv(fd, buf, sizeof(buf), 0)) > 0) received.append(buf, got);
+
+  return received;
+}
+
+static string gunzip(const string &in)
+{
+  z_stream z = z_stream();
+  inflateInit2(&z, 15 + 16);
+
+  string out;
+  char buf[65536];
+
+  z.next_in = (Bytef *) in.data();
+  z.avail_in = in.size();
+
+  int rc;
+
+  do
+  {
+    z.next_out = (Bytef *) buf;
+    z.avail_out = sizeof(buf);
+
+    rc = inflate(&z, Z_NO_FLUSH);
+    out.append(buf, sizeof(buf) - z.avail_out);
+  }
+  while (rc == Z_OK);
+
+  inflateEnd(&z);
+
+  return rc == Z_STREAM_END ? out : "<broken>";
+}
+
+// the chunked body starting at p, which is left just past it
+static string dechunk(const string &in, size_t &p)
+{
+  string out;
+
+  for (;;)
+  {
+    size_t size = strtoul(in.c_str() + p, NULL, 16);
+    size_t line = in.find("\r\n", p);
+
+    if (line == string::npos) return "<truncated>";
+
+    p = line + 2;
+
+    if (size == 0)
+    {
+      p += 2;
+      return out;
+    }
+
+    out.append(in, p, size);
+    p += size + 2;
+  }
+}
+
+static size_t count(const string &haystack, const string &needle)
+{
+  size_t n = 0;
+
+  for (size_t at = haystack.find(needle); at != string::npos;
+      at = haystack.find(needle, at + 1))
+  {
+    n++;
+  }
+
+  return n;
+}
+
+go_bandit([]()
+{
+  describe("Worker", []()
+  {
+    before_each([]()
+    {
+      start();
+    });
+
+    it("should write a big answer out to a peer that's done sending", []
+    {
+      int fd = connect_client();
+      AssertThat(fd, IsGreaterThan(-1));
+
+      string request = "GET /big.bin HTTP/1.1\r\nHost: x\r\n\r\n";
+      send(fd, request.data(), request.size(), 0);
+      shutdown(fd, SHUT_WR);
+
+      // let the half close reach the server before any of it is read
+      usleep(200000);
+
+      string response = drain(fd);
+      size_t head = response.find("\r\n\r\n");
+
+      AssertThat(response.compare(0, 15, "HTTP/1.1 200 OK"), Equals(0));
+      AssertThat(head, IsLessThan(response.size()));
+      AssertThat(response.size() - head - 4, Equals(BIG));
+
+      close(fd);
+    });
+
+    it("should answer a whole pipeline from a peer that's done sending", []
+    {
+      int fd = connect_client();
+      AssertThat(fd, IsGreaterThan(-1));
+
+      // far past the high watermark, the rest is held back for a while
+      string requests;
+      size_t pipelined = 100;
+
+      for (size_t i = 0; i < pipelined; i++)
+      {
+        requests += "GET /small.txt HTTP/1.1\r\nHost: x\r\n\r\n";
+      }
+
+      send(fd, requests.data(), requests.size(), 0);
+      shutdown(fd, SHUT_WR);
+      usleep(200000);
+
+      string responses = drain(fd);
+
+      AssertThat(count(responses, "HTTP/1.1 200 OK"), Equals(pipelined));
+      AssertThat(responses.size(), IsGreaterThan(pipelined * SMALL));
+
+      close(fd);
+    });
+
+    it("should compress a big file a watermark at a time", []
+    {
+      int fd = connect_client();
+      AssertThat(fd, IsGreaterThan(-1));
+
+      // the second waits for all of the first to be compressed
+      string requests =
+        "GET /big.txt HTTP/1.1\r\nHost: x\r\nAccept-Encoding: gzip\r\n\r\n"
+        "GET /small.txt HTTP/1.1\r\nHost: x\r\nConnection: close\r\n\r\n";
+
+      send(fd, requests.data(), requests.size(), 0);
+
+      // once it's started, the worker fills the socket and has to wait;
+      // what it holds then is what it compressed ahead of the peer
+      char buf[4096];
+      ssize_t got = recv(fd, buf, sizeof(buf), 0);
+      AssertThat(got, IsGreaterThan(0));
+
+      usleep(200000);
+
+      size_t high = Net::Output::HIGH_WATERMARK;
+      AssertThat(budget.used(), IsLessThan(4 * high));
+
+      string responses = string(buf, got) + drain(fd);
+      size_t head = responses.find("\r\n\r\n");
+
+      AssertThat(responses.compare(0, 15, "HTTP/1.1 200 OK"), Equals(0));
+      AssertThat(responses.find("Content-Encoding: gzip\r\n"),
+          IsLessThan(head));
+
+      size_t p = head + 4;
+      AssertThat(gunzip(dechunk(responses, p)) == text, IsTrue());
+
+      head = responses.find("\r\n\r\n", p);
+
+      AssertThat(responses.compare(p, 15, "HTTP/1.1 200 OK"), Equals(0));
+      AssertThat(head, IsLessThan(responses.size()));
+      AssertThat(responses.size() - head - 4, Equals(SMALL));
+
+      close(fd);
+    });
+
+    it("should answer and close a head that fills the input", []
+    {
+      int fd = connect_client();
+      AssertThat(fd, IsGreaterThan(-1));
+
+      string request = "GET /";
+      request.append(Parser::HEAD_MAX - request.size(), 'x');
+
+      send(fd, request.data(), request.size(), 0);
+
+      // a close without an answer, or none at all, leaves this empty
+      string response = drain(fd);
+
+      AssertThat(response.compare(0, 12, "HTTP/1.1 400"), Equals(0));
+
+      close(fd);
+    });
+  });
+});
+
+int main(int argc, char **argv)
+{
+  return run(argc, argv);
+}
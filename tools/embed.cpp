@@ -0,0 +1,531 @@
+/**
+ * Asset bundle generator.
+ *
+ * Writes a C++ translation unit that defines an Http::Bundle holding every
+ * file under a directory, see bundle.h. For each file that's the bytes as
+ * a constant array, gzip and, when built with HAVE_BROTLI, br versions
+ * where Compressor::worth() says so, and the 200 and 304 heads for each,
+ * serialized with a Response. Dot files are skipped; an index.html also
+ * answers for its directory.
+ *
+ * The perfect hash seed is searched for here and the generated file checks
+ * every path against its slot with a static_assert.
+ *
+ *   build/tools/embed directory [name] > assets.cpp
+ *
+ * name is the Bundle's, in namespace Http, "embedded" by default.
+ */
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include "bundle.h"
+#include "compress.h"
+#include "date.h"
+#include "files.h"
+#include "response.h"
+
+using namespace Http;
+
+struct Representation
+{
+  std::string encoding;
+  std::string body;
+  std::string etag;
+  std::string head;
+  std::string not_modified;
+};
+
+struct Asset
+{
+  std::string relative;     // to the directory, for Files::type()
+  std::vector<std::string> paths;
+  time_t modified;
+  std::vector<Representation> representations;
+};
+
+static bool read(const std::string &path, std::string &content)
+{
+  FILE *f = fopen(path.c_str(), "rb");
+  if (f == NULL) return false;
+
+  char buf[65536];
+  size_t n;
+
+  content.clear();
+
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) content.append(buf, n);
+
+  bool ok = !ferror(f);
+  fclose(f);
+
+  return ok;
+}
+
+// every regular file below directory, relative to root, in name order
+static bool walk(const std::string &root, const std::string &directory,
+    std::vector<std::string> &files)
+{
+  DIR *dir = opendir((root + "/" + directory).c_str());
+
+  if (dir == NULL)
+  {
+    fprintf(stderr, "embed: can't open %s/%s: %s\n", root.c_str(),
+        directory.c_str(), strerror(errno));
+    return false;
+  }
+
+  std::vector<std::string> names;
+
+  while (struct dirent *e = readdir(dir))
+  {
+    if (e->d_name[0] != '.') names.push_back(e->d_name);
+  }
+
+  closedir(dir);
+  std::sort(names.begin(), names.end());
+
+  for (const std::string &name : names)
+  {
+    std::string relative = directory.empty() ? name : directory + "/" + name;
+    struct stat st;
+
+    if (stat((root + "/" + relative).c_str(), &st) < 0) continue;
+
+    if (S_ISDIR(st.st_mode))
+    {
+      if (!walk(root, relative, files)) return false;
+    }
+    else if (S_ISREG(st.st_mode))
+    {
+      files.push_back(relative);
+    }
+  }
+
+  return true;
+}
+
+// FNV-1a of the bytes: an asset has no inode or mtime to go by, and the
+// same bytes get the same tag from every build; unrelated to Files' tags
+static std::string etag(const std::string &content, const char *suffix)
+{
+  uint64_t hash = 14695981039346656037ull;
+
+  for (unsigned char c : content)
+  {
+    hash = (hash ^ c) * 1099511628211ull;
+  }
+
+  char tag[64];
+  snprintf(tag, sizeof(tag), "\"%016" PRIx64 "%s\"", hash, suffix);
+
+  return tag;
+}
+
+// a serialized head without the blank line that ends it
+static std::string head(Response &response)
+{
+  struct iovec iov[2 + Response::BODY_MAX];
+  response.iovecs(iov);
+
+  std::string out((const char *) iov[0].iov_base, iov[0].iov_len);
+  out.append((const char *) iov[1].iov_base, iov[1].iov_len - 2);
+
+  return out;
+}
+
+static void heads(Representation &r, const char *type, View modified,
+    bool vary)
+{
+  View etag(r.etag.data(), r.etag.size());
+
+  Response ok(200);
+
+  ok.header("Content-Type", type);
+  ok.header("ETag", etag);
+  ok.header("Last-Modified", modified);
+
+  if (!r.encoding.empty())
+  {
+    ok.header("Content-Encoding", View(r.encoding.data(), r.encoding.size()));
+  }
+
+  if (vary) ok.header("Vary", "Accept-Encoding");
+
+  ok.body(View(r.body.data(), r.body.size()));
+  r.head = head(ok);
+
+  Response not_modified(304);
+
+  not_modified.header("ETag", etag);
+  not_modified.header("Last-Modified", modified);
+
+  if (vary) not_modified.header("Vary", "Accept-Encoding");
+
+  r.not_modified = head(not_modified);
+}
+
+static bool load(const std::string &root, Asset &asset)
+{
+  std::string path = root + "/" + asset.relative;
+  std::string content;
+  struct stat st;
+
+  if (stat(path.c_str(), &st) < 0 || !read(path, content))
+  {
+    fprintf(stderr, "embed: can't read %s: %s\n", path.c_str(),
+        strerror(errno));
+    return false;
+  }
+
+  asset.modified = st.st_mtime;
+
+  const char *type = Files::type(asset.relative.c_str());
+  Representation identity{"", content, etag(content, ""), "", ""};
+
+  std::vector<Representation> encoded;
+  std::string compressed;
+
+  View bytes(content.data(), content.size());
+  bool text = strncmp(type, "text/", 5) == 0;
+
+  // worth a Vary and a second copy only if it saves enough
+  if (Compressor::gzip(bytes, compressed) &&
+      Compressor::worth(content.size(), compressed.size()))
+  {
+    encoded.push_back({"gzip", compressed, etag(content, "-gzip"), "", ""});
+  }
+
+  if (Compressor::brotli(bytes, text, compressed) &&
+      Compressor::worth(content.size(), compressed.size()))
+  {
+    encoded.push_back({"br", compressed, etag(content, "-br"), "", ""});
+  }
+
+  std::sort(encoded.begin(), encoded.end(),
+      [](const Representation &a, const Representation &b)
+      {
+        return a.body.size() < b.body.size();
+      });
+
+  asset.representations.push_back(identity);
+  asset.representations.insert(asset.representations.end(), encoded.begin(),
+      encoded.end());
+
+  char modified[Date::VALUE_SIZE];
+  Date::format(asset.modified, modified);
+
+  for (Representation &r : asset.representations)
+  {
+    heads(r, type, View(modified, sizeof(modified)),
+        asset.representations.size() > 1);
+  }
+
+  return true;
+}
+
+/**
+ * The smallest table, at least twice the paths, for which some seed puts
+ * every path in its own slot.
+ */
+static bool search(const std::vector<std::string> &paths, uint32_t &seed,
+    unsigned &bits)
+{
+  bits = 1;
+
+  while ((1u << bits) < 2 * paths.size()) bits++;
+
+  for (; bits <= 16; bits++)
+  {
+    std::vector<bool> used(1u << bits);
+
+    // a fixed sequence, the same tree always gets the same table
+    uint32_t candidate = 2166136261u;
+
+    for (unsigned tries = 0; tries < 100000; tries++)
+    {
+      candidate = candidate * 1664525u + 1013904223u;
+      std::fill(used.begin(), used.end(), false);
+
+      bool perfect = true;
+
+      for (const std::string &path : paths)
+      {
+        unsigned s = Bundle::slot(
+            Bundle::hash(path.data(), path.size(), candidate), bits);
+
+        if (used[s])
+        {
+          perfect = false;
+          break;
+        }
+
+        used[s] = true;
+      }
+
+      if (perfect)
+      {
+        seed = candidate;
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+// for inside a string literal, octal escapes for all but plain ASCII
+static std::string escape(unsigned char c)
+{
+  // ? for trigraphs
+  if (c >= 0x20 && c < 0x7f && c != '"' && c != '\\' && c != '?')
+  {
+    return std::string(1, c);
+  }
+
+  char octal[8];
+  snprintf(octal, sizeof(octal), "\\%03o", c);
+
+  return octal;
+}
+
+static std::string escape(const std::string &bytes)
+{
+  std::string out;
+
+  for (unsigned char c : bytes) out += escape(c);
+
+  return out;
+}
+
+// a string literal, broken over lines
+static void literal(FILE *out, const std::string &bytes)
+{
+  size_t column = 0;
+
+  fputs("\n  \"", out);
+
+  for (unsigned char c : bytes)
+  {
+    if (column >= 72)
+    {
+      fputs("\"\n  \"", out);
+      column = 0;
+    }
+
+    std::string escaped = escape(c);
+
+    fputs(escaped.c_str(), out);
+    column += escaped.size();
+  }
+
+  fputs("\"", out);
+}
+
+static void array(FILE *out, const char *name, size_t i, size_t r,
+    const std::string &bytes)
+{
+  fprintf(out, "constexpr char %s_%zu_%zu[] =", name, i, r);
+  literal(out, bytes);
+  fputs(";\n\n", out);
+}
+
+int main(int argc, char **argv)
+{
+  if (argc < 2)
+  {
+    fprintf(stderr, "usage: %s directory [name]\n", argv[0]);
+    return 1;
+  }
+
+  std::string root = argv[1];
+  const char *name = argc > 2 ? argv[2] : "embedded";
+
+  std::vector<std::string> files;
+  if (!walk(root, "", files)) return 1;
+
+  std::vector<Asset> assets;
+
+  for (const std::string &relative : files)
+  {
+    Asset asset;
+    asset.relative = relative;
+    asset.paths.push_back("/" + relative);
+
+    // the directory answers with its index, as Files::resolve() has it
+    const std::string index = "index.html";
+
+    if (relative == index)
+    {
+      asset.paths.push_back("/");
+    }
+    else if (relative.size() > index.size() &&
+        relative.compare(relative.size() - index.size() - 1, std::string::npos,
+          "/" + index) == 0)
+    {
+      asset.paths.push_back("/" +
+          relative.substr(0, relative.size() - index.size()));
+    }
+
+    for (const std::string &path : asset.paths)
+    {
+      if (path.size() > Bundle::PATH_MAX_SIZE)
+      {
+        fprintf(stderr, "embed: %s is longer than %zu\n", path.c_str(),
+            Bundle::PATH_MAX_SIZE);
+        return 1;
+      }
+    }
+
+    if (!load(root, asset)) return 1;
+
+    assets.push_back(std::move(asset));
+  }
+
+  // one entry per path, aliases share the representations
+  std::vector<std::string> paths;
+  std::vector<size_t> owners;
+
+  for (size_t i = 0; i < assets.size(); i++)
+  {
+    for (const std::string &path : assets[i].paths)
+    {
+      paths.push_back(path);
+      owners.push_back(i);
+    }
+  }
+
+  if (paths.size() >= UINT16_MAX)
+  {
+    fprintf(stderr, "embed: %zu paths, the most a bundle takes is %u\n",
+        paths.size(), UINT16_MAX - 1);
+    return 1;
+  }
+
+  uint32_t seed = 0;
+  unsigned bits = 1;
+
+  if (!search(paths, seed, bits))
+  {
+    fprintf(stderr, "embed: no perfect hash for %zu paths\n", paths.size());
+    return 1;
+  }
+
+  FILE *out = stdout;
+
+  fprintf(out,
+      "// generated by tools/embed from %s, don't edit\n"
+      "#include \"bundle.h\"\n"
+      "\n"
+      "namespace Http\n"
+      "{\n"
+      "\n"
+      "namespace\n"
+      "{\n"
+      "\n", root.c_str());
+
+  for (size_t i = 0; i < assets.size(); i++)
+  {
+    const Asset &asset = assets[i];
+
+    fprintf(out, "// %s\n", escape(asset.relative).c_str());
+
+    for (size_t r = 0; r < asset.representations.size(); r++)
+    {
+      const Representation &rep = asset.representations[r];
+
+      array(out, "BODY", i, r, rep.body);
+      array(out, "HEAD", i, r, rep.head);
+      array(out, "NOT_MODIFIED", i, r, rep.not_modified);
+      array(out, "ETAG", i, r, rep.etag);
+    }
+
+    fprintf(out, "constexpr Bundle::Representation REPRESENTATIONS_%zu[] = {\n",
+        i);
+
+    for (size_t r = 0; r < asset.representations.size(); r++)
+    {
+      const char *encoding = asset.representations[r].encoding.c_str();
+
+#define FIELD(NAME) NAME "_%zu_%zu, sizeof(" NAME "_%zu_%zu) - 1"
+      fprintf(out, "  { \"%s\", " FIELD("HEAD") ", " FIELD("NOT_MODIFIED")
+          ",\n    " FIELD("BODY") ", " FIELD("ETAG") " }%s\n", encoding,
+          i, r, i, r, i, r, i, r, i, r, i, r, i, r, i, r,
+          r + 1 < asset.representations.size() ? "," : "");
+#undef FIELD
+    }
+
+    fputs("};\n\n", out);
+  }
+
+  fputs("constexpr Bundle::Asset ASSETS[] = {\n", out);
+
+  for (size_t p = 0; p < paths.size(); p++)
+  {
+    const Asset &asset = assets[owners[p]];
+
+    fprintf(out, "  { \"%s\", %zu, %" PRId64 ", REPRESENTATIONS_%zu, %zu }%s\n",
+        escape(paths[p]).c_str(), paths[p].size(), (int64_t) asset.modified,
+        owners[p], asset.representations.size(),
+        p + 1 < paths.size() ? "," : "");
+  }
+
+  if (paths.empty()) fputs("  { \"\", 0, 0, NULL, 0 }\n", out);
+
+  fprintf(out,
+      "};\n"
+      "\n"
+      "const size_t COUNT = %zu;\n"
+      "const uint32_t SEED = 0x%" PRIx32 ";\n"
+      "const unsigned SLOT_BITS = %u;\n"
+      "\n"
+      "constexpr uint16_t SLOTS[1 << SLOT_BITS] = {", paths.size(), seed, bits);
+
+  std::vector<size_t> slots(1u << bits, paths.size());
+
+  for (size_t p = 0; p < paths.size(); p++)
+  {
+    slots[Bundle::slot(Bundle::hash(paths[p].data(), paths[p].size(), seed),
+        bits)] = p;
+  }
+
+  for (size_t s = 0; s < slots.size(); s++)
+  {
+    fprintf(out, "%s%zu", s == 0 ? "\n  " : s % 12 == 0 ? ",\n  " : ", ",
+        slots[s]);
+  }
+
+  fputs("\n", out);
+
+  fputs("};\n\n", out);
+
+  fputs("// each path in its own slot\n", out);
+
+  for (size_t p = 0; p < paths.size(); p++)
+  {
+    fprintf(out,
+        "static_assert(SLOTS[Bundle::slot(Bundle::hash(\"%s\", %zu, SEED),\n"
+        "      SLOT_BITS)] == %zu, \"%s\");\n",
+        escape(paths[p]).c_str(), paths[p].size(), p,
+        escape(paths[p]).c_str());
+  }
+
+  fprintf(out,
+      "\n"
+      "}\n"
+      "\n"
+      "extern const Bundle %s;\n"
+      "\n"
+      "const Bundle %s = { ASSETS, COUNT, SEED, SLOT_BITS, SLOTS };\n"
+      "\n"
+      "} // namespace\n", name, name);
+
+  return ferror(out) ? 1 : 0;
+}
@@ -1,5 +1,7 @@
 #include "transport.h"
 
+#include <sys/ioctl.h>
+
 namespace Net
 {
 
@@ -18,12 +20,14 @@ namespace Net
  * 0.0.0.0 means "any local IP address"
  */
 Transport::Transport() :
-  m_listen(Socket()),
+  m_clients(),
+  m_listen(Socket::NONBLOCKING),
   m_backlog(),
-  m_kqueue(),
-  m_event_subs(),
+  m_poller(),
+  m_receive(),
+  m_small_reads(0),
   m_event_list(),
-  m_receive_buf()
+  m_on_data()
 {
 }
 
@@ -38,17 +42,13 @@ int Transport::listen(const char *addr, int port)
     return m_listen.err(); 
   }
 
-  m_kqueue = kqueue();
-
-  EV_SET(&m_event_subs, m_listen.fd(), EVFILT_READ, EV_ADD, 0, 0, NULL);
-
-  int err = kevent(m_kqueue, &m_event_subs, 1, NULL, 0, NULL);
+  int err = m_poller.add(m_listen.fd(), Event::READ);
 
   if (err < 0)
   {
-    ERR("kqueue setup: %s", strerror(errno));
+    ERR("poller setup: %s", strerror(errno));
     ERR("  m_listen: %lu", m_listen.fd());
-    ERR("  m_kqueue: %d", m_kqueue);
+    ERR("  m_poller: %d", m_poller.fd());
   }
 
   return err;
@@ -64,13 +64,13 @@ void Transport::pump()
 
   int event_count = 0;
   int event_iter = 0;
-  struct kevent event;
+  Event event;
 
-  event_count = kevent(m_kqueue, NULL, 0, m_event_list, EVENTS_MAX, NULL);
+  event_count = m_poller.wait(m_event_list, EVENTS_MAX);
 
   if (event_count < 1)
   {
-    ERR("kevent read: %s", strerror(errno));
+    if (errno != EINTR) ERR("poller read: %s", strerror(errno));
     return;
   }
 
@@ -78,102 +78,278 @@ void Transport::pump()
   {
     event = m_event_list[event_iter];
 
-    if (event.ident == m_listen.fd())
+    if (event.fd == m_listen.fd())
     {
-      on_client_connect(add_client(event));
+      Socket *client = add_client(event);
+      if (client) on_client_connect(*client);
+      continue;
     }
-    else
+
+    Socket *client = find_client(event);
+
+    if (client == NULL) continue;
+
+    Pending &pending = m_clients.cold(event.fd);
+
+    // finished zero-copy sends are reported on the error queue, reaped
+    // here; only an error the socket really has disconnects
+    if ((event.flags & Event::ERROR) && client->zerocopy_state().enabled())
     {
-      if (event.flags & EVFILT_READ) 
+      client->reap();
+
+      int error = 0;
+      socklen_t size = sizeof(error);
+
+      if (getsockopt(event.fd, SOL_SOCKET, SO_ERROR, &error, &size) == 0 &&
+          error == 0)
       {
-        on_read(find_client(event));
+        event.flags &= ~Event::ERROR;
       }
-      if (event.flags & EV_EOF)
+    }
+
+    // reported before a pause took effect, it'll come round again
+    if ((event.flags & (Event::READ | Event::HALF_CLOSED)) &&
+        !pending.paused && !pending.ended)
+    {
+      int bytes = on_read(*client);
+
+      // zero bytes is the peer done sending; it may still be reading, so
+      // what's queued for it goes out before the connection is closed
+      if (bytes == 0)
       {
-        on_client_disconnect(find_client(event));
+        pending.ended = true;
+        watch(event.fd, pending);
       }
+      else if (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+      {
+        event.flags |= Event::HANGUP;
+      }
+    }
+
+    if ((event.flags & Event::WRITE) && !(event.flags & Event::HANGUP))
+    {
+      int bytes = on_write(*client);
+
+      if (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+      {
+        event.flags |= Event::HANGUP;
+      }
+    }
+
+    if ((event.flags & (Event::HANGUP | Event::ERROR)) ||
+        (pending.ended && pending.output.empty()))
+    {
+      on_client_disconnect(*client);
     }
   }
 }
 
-Socket Transport::add_client(struct kevent &e)
+/**
+ * Accept the pending connection on the listening socket and construct its
+ * Socket in place in the client table, a temporary would close the fd on
+ * its way out.
+ */
+Socket *Transport::add_client(Event &e)
 {
-  Socket client(e.ident);
-  client.accept();
+  int fd = m_listen.accept();
+
+  if (fd < 0) return NULL;
 
-  m_clients[client.fd()] = client;
+  Socket *client = m_clients.emplace(fd, fd, Socket::ACCEPTED,
+      Socket::NONBLOCKING);
+
+  if (client == NULL) ::close(fd);
 
   return client;
 }
 
-Socket Transport::find_client(struct kevent &e)
+Socket *Transport::find_client(Event &e)
 {
-  return m_clients[e.ident];
+  return m_clients.find(e.fd);
 }
 
-int Transport::on_client_connect(Socket client)
+int Transport::on_client_connect(Socket &client)
 {
-  client.accept();
-
   DEBUG("[0x%016" PRIXPTR "] client connect", (unsigned long) client.fd());
 
-  if (client.err() < 0)
-  {
-    ERR("[0x%016" PRIXPTR "] client connect: %s", client.fd(), 
-        strerror(errno));
-  }
-
-  // fill out of event subscription struct, so that we receive events for
+  // register our interest with the poller, so that we receive events for
   // the new client socket as well as our own
-  EV_SET(&m_event_subs, client.fd(), EVFILT_READ, EV_ADD, 0, 0, NULL);
-  
-  // call kqueue with new event struct, registering out interests
-  int err = kevent(m_kqueue, &m_event_subs, 1, NULL, 0, NULL);
+  int err = m_poller.add(client.fd(), Event::READ);
 
   if (err < 0)
   {
     ERR("[0x%016" PRIXPTR  "] sub: %s", client.fd(), strerror(errno));
+    m_clients.erase(client.fd());
   }
   
   return err;
 }
 
-int Transport::on_client_disconnect(Socket client)
+int Transport::on_client_disconnect(Socket &client)
 {
   DEBUG("[0x%016" PRIXPTR "] client disconnect", client.fd());
 
-  // since we've been notified a client disconnected, unregister out interest
-  EV_SET(&m_event_subs, client.fd(), EVFILT_READ, EV_DELETE, 0, 0, NULL);
+  Socket::FD fd = client.fd();
 
-  int err = kevent(m_kqueue, &m_event_subs, 1, NULL, 0, NULL);
+  // since we've been notified a client disconnected, unregister out interest
+  int err = m_poller.remove(fd);
 
   if (err < 0)
   {
-    ERR("[0x%016" PRIXPTR "] kqueue unsub", client.fd());
+    ERR("[0x%016" PRIXPTR "] poller unsub", fd);
   }
 
-  // finally now that we don't receive events from kqueue, close the socket
-  return client.close();
+  // finally now that we don't receive events from the poller, close the socket
+  err = client.close();
+
+  m_clients.erase(fd);
+
+  return err;
 }
 
-int Transport::on_read(Socket client)
+/**
+ * Send without blocking or losing anything. Whatever the socket doesn't
+ * take right away is copied to the client's queue and written as the
+ * socket drains, ahead of anything sent after it. Returns length once
+ * it's all sent or queued, -1 when the socket failed.
+ */
+int Transport::send(Socket::FD fd, const char *buf, size_t length)
 {
-  DEBUG("[1x%016" PRIXPTR "] client read", client.fd());
+  Socket *client = m_clients.find(fd);
+
+  if (client == NULL) return -1;
+
+  Pending &pending = m_clients.cold(fd);
+  size_t sent = 0;
+
+  // only straight to the socket when nothing is waiting in front
+  if (pending.output.empty())
+  {
+    int bytes = client->send(buf, length);
 
-  int bytes = client.recv(m_receive_buf, RECEIVE_MAX);
+    if (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK) return bytes;
+    if (bytes > 0) sent = bytes;
+    if (sent == length) return length;
+  }
+
+  pending.output.append(buf + sent, length - sent);
+  watch(fd, pending);
+
+  return length;
+}
+
+int Transport::on_write(Socket &client)
+{
+  Pending &p = m_clients.cold(client.fd());
+
+  if (p.output.empty()) return 0;
+
+  ssize_t bytes = p.output.flush(client.fd());
+
+  if (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK) return bytes;
+
+  watch(client.fd(), p);
+
+  // a client that caught up doesn't keep a queue's worth of memory
+  if (p.output.empty()) p.output.release();
+
+  return bytes;
+}
+
+/**
+ * Point the poller at what a client with queued output waits on. Write
+ * interest only while something is queued; reads stop at the high
+ * watermark and start again at the low one, so a peer that doesn't read
+ * can't make us hold more than that for it. A peer that's done sending is
+ * only written to.
+ */
+void Transport::watch(Socket::FD fd, Pending &p)
+{
+  size_t queued = p.output.size();
+
+  if (queued >= Output::HIGH_WATERMARK)     p.paused = true;
+  else if (queued <= Output::LOW_WATERMARK) p.paused = false;
+
+  uint32_t interest = (p.paused || p.ended ? 0 : Event::READ) |
+    (queued ? Event::WRITE : 0);
+
+  if (interest == p.interest) return;
+
+  if (m_poller.modify(fd, interest) == 0) p.interest = interest;
+}
+
+int Transport::on_read(Socket &client)
+{
+  DEBUG("[0x%016" PRIXPTR "] client read", client.fd());
+
+  if (!m_receive) m_receive = Buffer(RECEIVE_MIN);
+
+  int bytes = client.recv(m_receive.data(), m_receive.capacity());
 
   if (bytes <= 0)
   {
-    ERR("[0x%016" PRIXPTR "] client receive: %s", client.fd(), 
-        strerror(errno));
     return bytes;
   }
 
-  DEBUG("received: %s", m_receive_buf);
+  DEBUG("received: %.*s", bytes, m_receive.data());
+
+  if (m_on_data) m_on_data(client.fd(), m_receive.data(), bytes);
+
+  int queued = 0;
+
+  // filled, and more behind it: one more read, in a buffer that fits
+  if ((size_t) bytes == m_receive.capacity() &&
+      ioctl(client.fd(), FIONREAD, &queued) == 0 && queued > 0)
+  {
+    if ((size_t) queued > m_receive.capacity()) fit(queued);
+
+    int more = client.recv(m_receive.data(), m_receive.capacity());
+
+    if (more > 0)
+    {
+      if (m_on_data) m_on_data(client.fd(), m_receive.data(), more);
+
+      bytes += more;
+    }
+  }
+  else
+  {
+    fit(bytes);
+  }
 
   return bytes;
 }
 
+/**
+ * Size the receive buffer for reads of about this many bytes: doubled as
+ * far as it takes, or halved once reads have stayed small for a while.
+ * The old one goes back to the pool either way.
+ */
+void Transport::fit(size_t bytes)
+{
+  size_t capacity = m_receive.capacity();
+
+  if (bytes > capacity && capacity < RECEIVE_MAX)
+  {
+    while (capacity < bytes && capacity < RECEIVE_MAX) capacity *= 2;
+
+    m_receive = Buffer(capacity);
+    m_small_reads = 0;
+    return;
+  }
+
+  if (bytes > capacity / 4 || capacity <= RECEIVE_MIN)
+  {
+    m_small_reads = 0;
+    return;
+  }
+
+  if (++m_small_reads < SHRINK_AFTER) return;
+
+  m_receive = Buffer(capacity / 2);
+  m_small_reads = 0;
+}
+
 int Transport::close()
 {
   m_listen.close();
@@ -1,50 +1,86 @@
 #ifndef __TRANSPORT_H
 #define __TRANSPORT_H
 
-#include <sys/event.h>  // kevent
 #include <string>       // std::string
 #include <inttypes.h>   // PRIXPTR (printing pointers)
-#include <unordered_map>
+#include <functional>   // std::function
 
 #include "socket.h"
+#include "poller.h"
+#include "output.h"
+#include "slab.h"
+#include "buffer.h"
 #include "log.h"
 
 namespace Net
 {
 
 class Transport {
+  public:
+    // called with every chunk of bytes received from a client
+    typedef std::function<void(Socket::FD, const char *, size_t)> ReadHandler;
+
   protected:
-    std::unordered_map<Socket::FD, Socket> m_clients;
+    // output a client hasn't taken yet, the cold half of its slot
+    struct Pending
+    {
+      Output output;
+      bool paused = false;
+
+      // the peer is done sending, closed once the output is written
+      bool ended = false;
+      uint32_t interest = Event::READ;
+    };
+
+    Slab<Socket, Pending> m_clients;
     Socket m_listen;
     int m_backlog;
 
-    int m_kqueue;
-    struct kevent m_event_subs;
+    Poller m_poller;
 
-    static const int RECEIVE_MAX = 1024;
-    char m_receive_buf[RECEIVE_MAX];
+    /**
+     * Taken from the pool of the thread that pumps, on the first read.
+     * A read that fills it and leaves more queued gets it doubled, up to
+     * RECEIVE_MAX, for one more read that takes the rest; SHRINK_AFTER
+     * reads in a row that use a quarter of it or less halve it again.
+     */
+    static const size_t RECEIVE_MIN = 1024;
+    static const size_t RECEIVE_MAX = 256 * 1024;
+    static const unsigned SHRINK_AFTER = 16;
+    Buffer m_receive;
+    unsigned m_small_reads;
 
     static const int EVENTS_MAX = 32;
-    struct kevent m_event_list[EVENTS_MAX];
+    Event m_event_list[EVENTS_MAX];
+
+    ReadHandler m_on_data;
 
     int bind();
     int shutdown();
     int close();
+
+    void watch(Socket::FD, Pending&);
   public:
     Transport();
     Transport(Transport &) = delete;
     Transport(Transport &&) = delete;
     ~Transport();
 
-    int send(Socket, const char *, size_t);
+    // all of it is sent or queued, or -1, see transport.cpp
+    int send(Socket::FD, const char *, size_t);
+
+    // NULL when the event doesn't map to a connected client
+    Socket *find_client(Event&);
+    Socket *add_client(Event&);
 
-    Socket find_client(struct kevent&);
-    Socket add_client(struct kevent&);
+    int on_read(Socket&);
+    void fit(size_t bytes);
+    int on_write(Socket&);
+    int on_eof(Socket&);
+    int on_client_connect(Socket&);
+    int on_client_disconnect(Socket&);
 
-    int on_read(Socket);
-    int on_eof(Socket);
-    int on_client_connect(Socket);
-    int on_client_disconnect(Socket);
+    void on_data(ReadHandler handler) { m_on_data = handler; }
 
     // listen - "server" specific
     int listen(const char*, int);  
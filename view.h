@@ -0,0 +1,83 @@
+#ifndef __VIEW_H
+#define __VIEW_H
+
+#include <string>
+#include <ostream>
+#include <string.h>
+#include <stddef.h>
+
+namespace Http
+{
+
+/**
+ * Read-only window onto bytes someone else owns, usually the receive
+ * buffer a request was parsed from. Nothing is copied or terminated, so a
+ * View is only good for as long as those bytes stay where they are.
+ */
+class View
+{
+  public:
+    View() : m_data(""), m_size(0) {}
+    View(const char *data, size_t size) : m_data(data), m_size(size) {}
+    View(const char *s) : m_data(s), m_size(strlen(s)) {}
+
+    const char *data() const { return m_data; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    const char *begin() const { return m_data; }
+    const char *end() const { return m_data + m_size; }
+
+    char operator[](size_t i) const { return m_data[i]; }
+
+    // a copy, for when the bytes need to outlive the buffer
+    std::string str() const { return std::string(m_data, m_size); }
+
+    bool equals(const char *s, size_t n) const
+    {
+      return m_size == n && memcmp(m_data, s, n) == 0;
+    }
+
+    // ascii only, which is all header names and most values need
+    bool iequals(const char *s, size_t n) const
+    {
+      if (m_size != n) return false;
+
+      for (size_t i = 0; i < n; i++)
+      {
+        if (lower(m_data[i]) != lower(s[i])) return false;
+      }
+
+      return true;
+    }
+
+    bool iequals(const char *s) const { return iequals(s, strlen(s)); }
+
+    bool operator==(const View &o) const { return equals(o.m_data, o.m_size); }
+    bool operator==(const char *s) const { return equals(s, strlen(s)); }
+    bool operator==(const std::string &s) const
+    {
+      return equals(s.data(), s.size());
+    }
+
+    template <typename T>
+    bool operator!=(const T &o) const { return !(*this == o); }
+
+    static char lower(char c)
+    {
+      return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+    }
+
+  private:
+    const char *m_data;
+    size_t m_size;
+};
+
+inline std::ostream &operator<<(std::ostream &out, const View &v)
+{
+  return out.write(v.data(), v.size());
+}
+
+} // namespace
+
+#endif /** __VIEW_H **/
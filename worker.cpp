@@ -0,0 +1,1601 @@
+#include "worker.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <sys/ioctl.h>
+
+namespace Http
+{
+
+// paths nothing was registered for, and requests that didn't parse or
+// didn't fit
+static const Canned HELLO(200, "text/html; charset=UTF-8",
+    "Hello, world!\r\n");
+static const Canned BAD_REQUEST(400, NULL, View());
+static const Canned TOO_LARGE(431, NULL, View());
+static const Canned NOT_FOUND(404, "text/plain; charset=UTF-8",
+    "Not Found\r\n");
+
+static uint64_t now_ms()
+{
+  using namespace std::chrono;
+
+  return duration_cast<milliseconds>(
+      steady_clock::now().time_since_epoch()).count();
+}
+
+Worker::Worker(const struct sockaddr_in &address, int backlog,
+    Listener listener) :
+  m_address(address),
+  m_sock_reuse(1),
+  m_listener(listener),
+  m_sock(-1),
+  m_backlog(backlog),
+  m_poller(),
+  m_event_list(),
+  m_receive(),
+  m_sock_state(CLOSED),
+  m_clients(),
+  m_oldest(NULL),
+  m_newest(NULL),
+  m_reclaimed(NULL),
+  m_max_requests(KEEP_ALIVE_REQUESTS),
+  m_idle_ms(KEEP_ALIVE_IDLE_MS),
+  m_canned(NULL),
+  m_bundle(NULL),
+  m_files(),
+  m_compressors(),
+  m_deflate_max(0),
+  m_input_max(INPUT_MAX),
+  m_budget(NULL),
+  m_starved(),
+  m_flush(),
+  m_now(now_ms()),
+  m_date(),
+  m_inbox(),
+  m_notifier(),
+  m_active(0),
+  m_shed_count(0),
+  m_shed_to(NULL)
+{
+  // fed by an acceptor, no socket of our own
+  if (m_listener == NO_LISTENER) return;
+
+  m_sock = socket(PF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+  if (m_sock < 0)
+  {
+    ERR("socket: %s", strerror(errno));
+    return;
+  }
+
+  m_sock_state = INITIALIZED;
+  m_sock_reuse = 1;
+
+  setsockopt(m_sock, SOL_SOCKET, SO_REUSEADDR, &m_sock_reuse,
+      sizeof(m_sock_reuse));
+
+  // every worker gets its own accept queue on the same port. linux hashes
+  // connections across them, other platforms may just favour one listener.
+  if (m_listener == SHARED_LISTENER && setsockopt(m_sock, SOL_SOCKET, SO_REUSEPORT,
+        &m_sock_reuse, sizeof(m_sock_reuse)) < 0)
+  {
+    ERR("setsockopt SO_REUSEPORT: %s", strerror(errno));
+  }
+
+  fcntl(m_sock, F_SETFL, O_NONBLOCK);
+}
+
+int Worker::bind()
+{
+  int err = ::bind(m_sock, (struct sockaddr *) &m_address,
+      sizeof(m_address));
+
+  if (err < 0)
+  {
+    ERR("bind: %s", strerror(errno));
+  }
+  else
+  {
+    m_sock_state = BOUND;
+  }
+
+  return err;
+}
+
+int Worker::listen()
+{
+  int err = ::listen(m_sock, m_backlog);
+
+  if (err < 0)
+  {
+    ERR("listen: %s", strerror(errno));
+  }
+  else
+  {
+    m_sock_state = LISTENING;
+  }
+
+  return err;
+}
+
+void Worker::setKeepAlive(unsigned max_requests, uint64_t idle_ms)
+{
+  m_max_requests = max_requests;
+  m_idle_ms = idle_ms;
+}
+
+void Worker::setCanned(const Canned::Table *canned)
+{
+  m_canned = canned;
+}
+
+void Worker::setBundle(const Bundle *bundle)
+{
+  m_bundle = bundle;
+}
+
+void Worker::setDeflate(uint64_t max)
+{
+  m_deflate_max = max;
+}
+
+void Worker::setInputLimit(size_t max)
+{
+  m_input_max = max > Parser::HEAD_MAX ? max : Parser::HEAD_MAX;
+}
+
+void Worker::setBudget(Net::Budget *budget)
+{
+  m_budget = budget;
+}
+
+void Worker::setRoot(const char *root)
+{
+  m_files.reset(new Files(root));
+
+  if (m_files->watch() >= 0) m_poller.add(m_files->watch(), Net::Event::READ);
+}
+
+int Worker::setupRun()
+{
+  int err = 0;
+
+  // a client that hangs up before we respond shouldn't take the process down
+  signal(SIGPIPE, SIG_IGN);
+
+  if ((err = m_poller.add(m_notifier.fd(), Net::Event::READ)) < 0) return err;
+
+  if (m_listener == NO_LISTENER) return err;
+
+  if (m_sock_state < BOUND)
+  {
+    if ((err = bind()) < 0) return err;
+    if ((err = listen()) < 0) return err;
+  }
+
+  err = m_poller.add(m_sock, Net::Event::READ);
+
+  if (err < 0)
+  {
+    ERR("poller setup: %s", strerror(errno));
+    ERR("  m_sock: %d", m_sock);
+    ERR("  m_poller: %d", m_poller.fd());
+  }
+
+  return err;
+}
+
+void Worker::run()
+{
+  if (setupRun() < 0)
+  {
+    ERR("aborting run loop");
+    return;
+  }
+
+  // from this thread's pool, like every buffer the loop takes
+  m_receive = Net::Buffer(RECEIVE_SIZE);
+
+  int event_count = 0;
+  int event_iter = 0;
+  Net::Event curr_event;
+
+  for(;;)
+  { 
+    event_count = m_poller.wait(m_event_list, EVENTS_MAX, timeout());
+
+    if (event_count < 0 && errno == EINTR) continue;
+
+    if (event_count < 0)
+    {
+      ERR("poller read: %s", strerror(errno));
+      return;
+    }
+
+    m_now = now_ms();
+    m_date.refresh(time(NULL));
+
+    for (event_iter = 0; event_iter < event_count; event_iter++)
+    {
+      curr_event = m_event_list[event_iter];
+
+      if (curr_event.fd == (uintptr_t) m_notifier.fd())
+      {
+        onNotify();
+      }
+      else if (curr_event.fd == (uintptr_t) m_sock)
+      {
+        onClientConnect(curr_event);
+      }
+      else if (m_files && curr_event.fd == (uintptr_t) m_files->watch())
+      {
+        m_files->changed();
+      }
+      else
+      {
+        // a peer that half closed has a read of 0 waiting, see end()
+        if (curr_event.flags & (Net::Event::READ | Net::Event::HALF_CLOSED))
+        {
+          onRead(curr_event);
+        }
+
+        if (curr_event.flags & Net::Event::WRITE)  onWrite(curr_event);
+        if (curr_event.flags & (Net::Event::HANGUP | Net::Event::ERROR))
+        {
+          onEOF(curr_event);
+        }
+      }
+    }
+
+    flush();
+    expire();
+    govern();
+  }
+}
+
+/**
+ * Write out the responses queued during this loop iteration, one writev
+ * per connection however many requests it pipelined. Whatever a socket
+ * doesn't take waits for it to become writable.
+ *
+ * By index, a connection that resumes reading here can queue more and
+ * come round again.
+ */
+void Worker::flush()
+{
+  for (size_t i = 0; i < m_flush.size(); i++)
+  {
+    int fd = m_flush[i];
+
+    Connection *client = m_clients.find(fd);
+    if (client == NULL) continue;
+
+    client->flushing = false;
+
+    if (!flushClient(*client)) removeClient(fd);
+  }
+
+  m_flush.clear();
+}
+
+/**
+ * Whether a connection has nothing left to do but close: the response that
+ * said close is out, or the peer is done sending and everything it asked
+ * for has been answered and written. One paused with requests held back
+ * still has those to answer.
+ */
+bool Worker::done(const Connection &client)
+{
+  return client.stream.output.empty() && !client.stream.deflating &&
+    (client.closing || (client.ended && !client.paused));
+}
+
+/**
+ * Write what a connection has queued. False once it should be closed: the
+ * socket failed, or it's done().
+ */
+bool Worker::flushClient(Connection &client)
+{
+  ssize_t written = client.stream.output.flush(client.fd);
+
+  if (written < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+  {
+    DEBUG("[0x%016" PRIXPTR "] client send: %s", (uintptr_t) client.fd,
+        strerror(errno));
+    return false;
+  }
+
+  // a slow reader that keeps taking bytes isn't idle
+  if (written > 0) touch(client);
+
+  if (done(client)) return false;
+
+  pace(client);
+
+  // what was held back is answered, or can't be now the peer's done
+  if (done(client)) return false;
+
+  account(client);
+
+  return true;
+}
+
+/**
+ * Reading follows writing. A peer with HIGH_WATERMARK of responses it
+ * hasn't taken gets no more requests read until it's down to
+ * LOW_WATERMARK, then the requests held back meanwhile go first. A body
+ * being compressed is topped up at LOW_WATERMARK too, and holds back what
+ * comes after it until it's all queued.
+ */
+void Worker::pace(Connection &client)
+{
+  Stream &stream = client.stream;
+
+  if (stream.deflating && stream.output.size() <=
+      Net::Output::LOW_WATERMARK && !deflate(client))
+  {
+    client.closing = true;
+  }
+
+  size_t queued = stream.output.size();
+
+  if (queued >= Net::Output::HIGH_WATERMARK)
+  {
+    client.paused = true;
+  }
+  else if (client.paused && !client.closing && !stream.deflating &&
+      queued <= Net::Output::LOW_WATERMARK)
+  {
+    client.paused = false;
+
+    if (client.stream.input_size > 0)
+    {
+      handle(client, client.stream.input.data(), client.stream.input_size);
+    }
+  }
+
+  watch(client);
+}
+
+/**
+ * Have the poller report what the connection is waiting on: requests
+ * unless it's closing or paused, room in the socket while output is
+ * queued. Write interest is dropped as soon as the queue is empty, an
+ * idle socket is always writable and would wake the loop for nothing.
+ */
+void Worker::watch(Connection &client)
+{
+  uint32_t interest = 0;
+
+  if (!client.closing && !client.paused && !client.starved && !client.ended)
+  {
+    interest |= Net::Event::READ;
+  }
+
+  if (!client.stream.output.empty()) interest |= Net::Event::WRITE;
+
+  if (interest == client.interest) return;
+
+  if (m_poller.modify(client.fd, interest) == 0) client.interest = interest;
+}
+
+/**
+ * How long the poller may sleep before there's something to do without an
+ * event: the oldest connection runs out of idle time, the next one is due
+ * to give its buffers back, starved ones may be read from again. Forever
+ * when none of that can happen.
+ */
+int Worker::timeout()
+{
+  uint64_t now = now_ms();
+  uint64_t wake = UINT64_MAX;
+
+  if (m_idle_ms > 0 && m_oldest)
+  {
+    wake = m_oldest->last_active + m_idle_ms;
+  }
+
+  Connection *next = m_reclaimed ? m_reclaimed->newer : m_oldest;
+
+  if (next && next->last_active + RECLAIM_IDLE_MS < wake)
+  {
+    wake = next->last_active + RECLAIM_IDLE_MS;
+  }
+
+  if (!m_starved.empty() && now + RELIEVE_MS < wake)
+  {
+    wake = now + RELIEVE_MS;
+  }
+
+  if (wake == UINT64_MAX) return -1;
+  if (wake <= now) return 0;
+
+  return wake - now < INT_MAX ? (int) (wake - now) : INT_MAX;
+}
+
+/**
+ * Close connections that have been quiet for the idle limit. The list is
+ * in order of last activity, so this only ever looks at the ones it closes
+ * and the first one it doesn't.
+ */
+void Worker::expire()
+{
+  if (m_idle_ms == 0) return;
+
+  while (m_oldest && m_now - m_oldest->last_active >= m_idle_ms)
+  {
+    DEBUG("[0x%016" PRIXPTR "] client idle", (uintptr_t) m_oldest->fd);
+    removeClient(m_oldest->fd);
+  }
+}
+
+/**
+ * Once a loop iteration, after the writes: connections that went quiet
+ * give their buffers back, and under pressure every one between requests
+ * does, however recently it was active. Starved connections are read from
+ * again once the budget is out of pressure.
+ */
+void Worker::govern()
+{
+  bool pressure = m_budget && m_budget->pressure();
+
+  reclaim(pressure);
+
+  if (!pressure && !m_starved.empty()) relieve();
+}
+
+/**
+ * Walk the activity list from where the last sweep stopped, shrinking the
+ * connections that have been quiet for RECLAIM_IDLE_MS, or all of them.
+ * Everything up to m_reclaimed has been looked at since it was last
+ * active; a connection that's touched moves past the mark and comes round
+ * again, so a quiet one is shrunk once and each sweep only looks at what
+ * it shrinks and the first one it doesn't.
+ */
+void Worker::reclaim(bool all)
+{
+  Connection *c = m_reclaimed ? m_reclaimed->newer : m_oldest;
+
+  while (c && (all || m_now - c->last_active >= RECLAIM_IDLE_MS))
+  {
+    shrink(*c);
+
+    m_reclaimed = c;
+    c = c->newer;
+  }
+}
+
+/**
+ * Give back what a connection holds between requests: its input, the
+ * parser's arena and the storage for its output. All of it is taken again
+ * as it's needed, from the loop's pool or the allocator, so a quiet
+ * connection is down to its place in the slab. One halfway through a
+ * request, or with responses still queued, keeps what that needs.
+ */
+void Worker::shrink(Connection &client)
+{
+  Stream &stream = client.stream;
+
+  if (stream.input_size == 0)
+  {
+    stream.input.reset();
+    stream.parser.release();
+  }
+
+  if (stream.output.empty()) stream.output.release();
+
+  account(client);
+}
+
+/**
+ * Bring the budget up to date with what the connection's buffers hold.
+ * One that's grown to STARVE_MIN or more while the process is under
+ * pressure isn't read from again until the pressure's gone: the biggest
+ * are the ones that keep growing, and what they already have is still
+ * answered and written out. One that can't finish without reading more
+ * stops moving, and the idle limit closes it like any other.
+ */
+void Worker::account(Connection &client)
+{
+  if (m_budget == NULL) return;
+
+  Stream &stream = client.stream;
+  size_t held = stream.input.capacity() + stream.output.reserved() +
+    stream.parser.arena().reserved();
+  uint32_t footprint = held < UINT32_MAX ? held : UINT32_MAX;
+
+  if (footprint == client.footprint) return;
+
+  bool grew = footprint > client.footprint;
+
+  m_budget->charge((int64_t) footprint - client.footprint);
+  client.footprint = footprint;
+
+  if (grew && !client.starved && footprint >= STARVE_MIN &&
+      m_budget->pressure())
+  {
+    DEBUG("[0x%016" PRIXPTR "] client starved", (uintptr_t) client.fd);
+
+    client.starved = true;
+    m_starved.push_back(client.fd);
+    watch(client);
+  }
+}
+
+// read from the starved connections again, their fds may have been reused
+void Worker::relieve()
+{
+  for (int fd : m_starved)
+  {
+    Connection *client = m_clients.find(fd);
+
+    if (client == NULL || !client->starved) continue;
+
+    client->starved = false;
+    watch(*client);
+  }
+
+  m_starved.clear();
+}
+
+int Worker::onClientConnect(Net::Event& event)
+{
+  int client_sock = ::accept(event.fd, NULL, NULL);
+
+  DEBUG("[0x%016" PRIXPTR "] client connect", (unsigned long) client_sock);
+
+  if (client_sock < 0)
+  {
+    // another SO_REUSEPORT sibling or an earlier wakeup got there first
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+    {
+      ERR("[0x%016" PRIXPTR "] client connect: %s", event.fd, 
+          strerror(errno));
+    }
+
+    return client_sock;
+  }
+
+  return addClient(client_sock);
+}
+
+int Worker::addClient(int fd)
+{
+  // turned away until the budget is out of pressure, rather than grown
+  if (m_budget && m_budget->pressure())
+  {
+    DEBUG("[0x%016" PRIXPTR "] client refused", (uintptr_t) fd);
+
+    m_budget->refused();
+    ::close(fd);
+    return -1;
+  }
+
+  fcntl(fd, F_SETFL, O_NONBLOCK);
+
+  // responses are batched per loop iteration already, Nagle holding back
+  // the tail of a pipeline for an ack only adds latency
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  int err = m_poller.add(fd, Net::Event::READ);
+
+  if (err < 0)
+  {
+    ERR("[0x%016" PRIXPTR  "] sub: %s", (uintptr_t) fd, strerror(errno));
+    ::close(fd);
+    return err;
+  }
+
+  Connection *stale = m_clients.find(fd);
+
+  if (stale != NULL) drop(*stale);
+
+  Connection *added = m_clients.emplace(fd, fd, m_now);
+
+  if (added == NULL)
+  {
+    ERR("[0x%016" PRIXPTR  "] no memory for the client", (uintptr_t) fd);
+    m_poller.remove(fd);
+    ::close(fd);
+    return -1;
+  }
+
+  touch(*added);
+  m_active.fetch_add(1, std::memory_order_relaxed);
+  
+  return err;
+}
+
+int Worker::onClientDisconnect(Net::Event& event)
+{
+  DEBUG("[0x%016" PRIXPTR "] client disconnect", event.fd);
+
+  return removeClient(event.fd);
+}
+
+/**
+ * Close a connection of ours. An fd that isn't one any more is left alone:
+ * migrate() may have handed it to another worker earlier in the same poll
+ * batch, and closing it here would close their live connection.
+ */
+int Worker::removeClient(int fd)
+{
+  Connection *found = m_clients.find(fd);
+
+  if (found == NULL) return 0;
+
+  int err = m_poller.remove(fd);
+
+  if (err < 0)
+  {
+    ERR("[0x%016" PRIXPTR "] poller unsub", (uintptr_t) fd);
+  }
+
+  drop(*found);
+
+  return ::close(fd);
+}
+
+/**
+ * Stamp a connection with the loop clock and move it to the newest end of
+ * the activity list.
+ */
+void Worker::touch(Connection &client)
+{
+  client.last_active = m_now;
+
+  // in use again, the reclaim sweep has to come back to it
+  if (m_reclaimed == &client) m_reclaimed = client.older;
+
+  if (m_newest == &client) return;
+
+  unlink(client);
+
+  client.older = m_newest;
+
+  if (m_newest) m_newest->newer = &client;
+  else          m_oldest = &client;
+
+  m_newest = &client;
+}
+
+void Worker::unlink(Connection &client)
+{
+  if (m_reclaimed == &client) m_reclaimed = client.older;
+
+  if (client.older)             client.older->newer = client.newer;
+  else if (m_oldest == &client) m_oldest = client.newer;
+
+  if (client.newer)             client.newer->older = client.older;
+  else if (m_newest == &client) m_newest = client.older;
+
+  client.older = client.newer = NULL;
+}
+
+// forget a connection that's closed or moved on, its buffers with it
+void Worker::drop(Connection &client)
+{
+  int fd = client.fd;
+
+  endDeflate(client.stream);
+
+  if (m_budget) m_budget->charge(-(int64_t) client.footprint);
+
+  unlink(client);
+  m_clients.erase(fd);
+  m_active.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/**
+ * Hand a connected socket to this worker. Called from the acceptor thread
+ * or from a worker that's shedding connections; the fd is registered with
+ * our poller once the loop wakes up and drains the inbox.
+ *
+ * False when the inbox is full, the caller still owns the fd then.
+ */
+bool Worker::adopt(int fd)
+{
+  if (!m_inbox.push(fd)) return false;
+
+  m_notifier.notify();
+
+  return true;
+}
+
+/**
+ * Ask this worker to move up to count idle connections to another worker.
+ * Only a request, the loop picks the connections on its own thread.
+ */
+void Worker::shed(unsigned count, Worker *to)
+{
+  if (to == this) return;
+
+  m_shed_to.store(to);
+  m_shed_count.store(count);
+
+  m_notifier.notify();
+}
+
+void Worker::onNotify()
+{
+  m_notifier.drain();
+
+  int fd;
+
+  while (m_inbox.pop(fd))
+  {
+    DEBUG("[0x%016" PRIXPTR "] client adopted", (uintptr_t) fd);
+    addClient(fd);
+  }
+
+  if (m_shed_count.load(std::memory_order_relaxed) > 0) migrate();
+}
+
+/**
+ * Give away connections that have been quiet for MIGRATE_IDLE_MS and sit
+ * between requests with nothing buffered on our side, so the fd is all the
+ * state there is to move; the new owner's poller picks up any bytes that
+ * arrive in the meantime. Oldest first, which are also the likeliest to
+ * stay quiet.
+ */
+void Worker::migrate()
+{
+  unsigned count = m_shed_count.exchange(0);
+  Worker *to = m_shed_to.load();
+
+  if (to == NULL) return;
+
+  Connection *c = m_oldest;
+
+  while (count > 0 && c && m_now - c->last_active >= MIGRATE_IDLE_MS)
+  {
+    Connection *next = c->newer;
+
+    // a half received request or body stays with the parser that has it,
+    // unwritten responses with the queue that has them
+    if (c->stream.input_size > 0 || c->discard > 0 ||
+        !c->stream.output.empty() || c->stream.deflating || c->closing ||
+        c->ended)
+    {
+      c = next;
+      continue;
+    }
+
+    int fd = c->fd;
+
+    m_poller.remove(fd);
+
+    if (!to->adopt(fd))
+    {
+      // their inbox is full, keep it and stop trying
+      m_poller.add(fd, Net::Event::READ);
+      break;
+    }
+
+    DEBUG("[0x%016" PRIXPTR "] client migrated", (uintptr_t) fd);
+
+    drop(*c);
+    count--;
+
+    c = next;
+  }
+}
+
+/**
+ * Most requests arrive in one read and are parsed straight out of the
+ * receive buffer. Only when the head is incomplete do the bytes get copied
+ * to the connection's arena, later reads are appended there and the parser
+ * resumes where it stopped rather than starting over.
+ */
+void Worker::onRead(Net::Event& event)
+{
+  DEBUG("[0x%016" PRIXPTR "] client read", event.fd);
+
+  Connection *found = m_clients.find(event.fd);
+  if (found == NULL) return;
+
+  Connection &client = *found;
+  touch(client);
+
+  // the poller may have reported it before we stopped asking
+  if (client.closing || client.paused || client.starved || client.ended)
+  {
+    return;
+  }
+
+  Stream &stream = client.stream;
+  ssize_t got;
+  bool full = false;
+
+  if (stream.input_size == 0 && client.hint == 0)
+  {
+    got = recv(event.fd, m_receive.data(), m_receive.capacity(), 0);
+
+    // the common case, a request or a few that fit: parsed where they are
+    if (got > 0 && (size_t) got < m_receive.capacity())
+    {
+      DEBUG("%.*s", (int) got, m_receive.data());
+
+      handle(client, m_receive.data(), got);
+      account(client);
+      return;
+    }
+
+    if (got > 0)
+    {
+      keep(client, m_receive.data(), got);
+      full = true;
+    }
+  }
+  else
+  {
+    got = receive(client, client.hint, full);
+  }
+
+  size_t total = got > 0 ? got : 0;
+
+  // a read that took all the room it had likely left more behind; ask the
+  // socket how much, and take it in one more read, up to the limit
+  while (full && stream.input_size < m_input_max)
+  {
+    int queued = 0;
+
+    if (ioctl(event.fd, FIONREAD, &queued) < 0 || queued <= 0) break;
+
+    got = receive(client, queued, full);
+
+    if (got > 0) total += got;
+  }
+
+  int error = got < 0 ? errno : 0;
+
+  if (total > 0)
+  {
+    learn(client, total);
+    handle(client, stream.input.data(), stream.input_size);
+  }
+
+  account(client);
+
+  if (got > 0 || error == EAGAIN || error == EWOULDBLOCK) return;
+
+  if (got == 0)
+  {
+    // closed already, a HANGUP on the same event mustn't close the fd
+    // number again, it may be someone else's by now
+    if (!end(client))
+    {
+      event.flags &= ~(Net::Event::HANGUP | Net::Event::ERROR);
+    }
+
+    return;
+  }
+
+  ERR("[0x%016" PRIXPTR "] client receive: %s", event.fd, strerror(error));
+
+  // the socket failed, make sure the run loop tears the connection down
+  event.flags |= Net::Event::HANGUP;
+}
+
+/**
+ * The peer shut down its sending side, nothing more is coming. It may
+ * still be reading: whatever it sent before is answered and written out,
+ * writes waiting on room in the socket as usual, and flushClient() closes
+ * the connection once that's all gone. With nothing left it's closed now,
+ * and false says so.
+ */
+bool Worker::end(Connection &client)
+{
+  DEBUG("[0x%016" PRIXPTR "] client done sending", (uintptr_t) client.fd);
+
+  client.ended = true;
+
+  if (done(client))
+  {
+    removeClient(client.fd);
+    return false;
+  }
+
+  watch(client);
+
+  return true;
+}
+
+/**
+ * One read into the connection's own input, after what's kept there, with
+ * room made for want bytes more if the limit allows. full says whether it
+ * took all the room there was.
+ */
+ssize_t Worker::receive(Connection &client, size_t want, bool &full)
+{
+  Stream &stream = client.stream;
+
+  full = false;
+
+  if (stream.input_size >= m_input_max)
+  {
+    errno = EAGAIN;
+    return -1;
+  }
+
+  if (want < INPUT_MIN) want = INPUT_MIN;
+
+  want = std::min(want, m_input_max - stream.input_size);
+
+  reserve(stream, stream.input_size + want);
+
+  size_t room = std::min(stream.input.capacity(), m_input_max) -
+    stream.input_size;
+
+  ssize_t got = recv(client.fd, stream.input.data() + stream.input_size,
+      room, 0);
+
+  if (got <= 0) return got;
+
+  DEBUG("%.*s", (int) got, stream.input.data() + stream.input_size);
+
+  stream.input_size += got;
+  full = (size_t) got == room;
+
+  return got;
+}
+
+/**
+ * Remember how much a wakeup brought in, when it was more than the loop's
+ * buffer holds. Until that's forgotten the connection reads straight into
+ * its own input, sized for as much again, rather than filling the loop's
+ * buffer and copying. Each wakeup that needs a quarter of that or less
+ * halves it; under the loop's buffer it's back to reading there.
+ */
+void Worker::learn(Connection &client, size_t total)
+{
+  if (total > client.hint)
+  {
+    client.hint = std::min(total, m_input_max);
+  }
+  else if (total <= client.hint / 4)
+  {
+    client.hint /= 2;
+  }
+
+  if (client.hint < RECEIVE_SIZE) client.hint = 0;
+}
+
+/**
+ * Answer every request that's complete in data, either the receive buffer
+ * or the connection's kept input, in one pass. Body bytes are skipped
+ * unread, a request that's still arriving is held for the next read.
+ * Stops at a response that closes the connection, and holds the rest
+ * back once the peer is a high watermark behind on its responses.
+ */
+void Worker::handle(Connection &client, const char *data, size_t size)
+{
+  while (size > 0)
+  {
+    if (client.discard > 0)
+    {
+      size_t skip = client.discard < size ? client.discard : size;
+
+      client.discard -= skip;
+      data += skip;
+      size -= skip;
+      continue;
+    }
+
+    // or while a body is still being compressed into the queue
+    if (client.stream.output.size() >= Net::Output::HIGH_WATERMARK ||
+        client.stream.deflating)
+    {
+      client.paused = true;
+      hold(client, data, size);
+      return;
+    }
+
+    Parser::State state = client.stream.parser.parse(data, size);
+
+    if (state != Parser::State::DONE && state != Parser::State::BROKEN)
+    {
+      // no room to read the rest of it into, it would never be finished
+      if (size >= m_input_max)
+      {
+        tooLarge(client);
+        return;
+      }
+
+      hold(client, data, size);
+      return;
+    }
+
+    if (!respond(client))
+    {
+      client.closing = true;
+      return;
+    }
+
+    size_t head = client.stream.parser.consumed();
+
+    data = finish(client, data + head, size - head);
+    size -= head;
+  }
+
+  client.stream.input_size = 0;
+}
+
+/**
+ * The head that's arriving has filled all the input a connection may
+ * hold. Reads would stop at the limit and the level triggered poller would
+ * keep reporting the socket, so answer 431 and close instead. The parser
+ * already gives up on a head at HEAD_MAX, which the limit never goes
+ * under; this is what stops the spin should the two ever disagree.
+ */
+void Worker::tooLarge(Connection &client)
+{
+  WARN("[0x%016" PRIXPTR "] client head too large", (uintptr_t) client.fd);
+
+  TOO_LARGE.queue(client.stream.output, m_date.line(), Canned::CLOSE, false);
+
+  client.stream.parser.reset();
+  client.stream.input_size = 0;
+  client.closing = true;
+
+  if (!client.flushing)
+  {
+    client.flushing = true;
+    m_flush.push_back(client.fd);
+  }
+}
+
+/**
+ * Make the connection's input hold at least needed bytes. It comes from
+ * the loop's pool, and one that's outgrown is swapped for a size class at
+ * least twice as big and goes back there.
+ */
+void Worker::reserve(Stream &stream, size_t needed)
+{
+  if (needed <= stream.input.capacity()) return;
+
+  size_t capacity = std::max(needed, 2 * stream.input.capacity());
+  Net::Buffer bigger(capacity > INPUT_MIN ? capacity : INPUT_MIN);
+
+  if (stream.input_size > 0)
+  {
+    memcpy(bigger.data(), stream.input.data(), stream.input_size);
+  }
+
+  stream.input = std::move(bigger);
+}
+
+// hold on to bytes of a request that spans reads
+void Worker::keep(Connection &client, const char *data, size_t size)
+{
+  Stream &stream = client.stream;
+
+  reserve(stream, stream.input_size + size);
+
+  memcpy(stream.input.data() + stream.input_size, data, size);
+  stream.input_size += size;
+}
+
+// whether data points into what the connection has kept
+static bool within(const Net::Buffer &input, size_t size, const char *data)
+{
+  return input && data >= input.data() && data < input.data() + size;
+}
+
+/**
+ * The last size bytes of data are the start of a request that isn't all
+ * here yet. Make them the whole of the connection's input, the parser sees
+ * them again there along with whatever arrives next.
+ */
+void Worker::hold(Connection &client, const char *data, size_t size)
+{
+  Stream &stream = client.stream;
+
+  if (within(stream.input, stream.input_size, data))
+  {
+    memmove(stream.input.data(), data, size);
+    stream.input_size = size;
+    return;
+  }
+
+  stream.input_size = 0;
+  keep(client, data, size);
+}
+
+/**
+ * The request is answered, everything it allocated goes in one rewind.
+ * The size bytes at rest came after it and are the next request's; in the
+ * receive buffer they stay put, out of the kept input they move to its
+ * front, memmove copes with the two overlapping. Input with nothing left
+ * in it goes back to the pool.
+ */
+const char *Worker::finish(Connection &client, const char *rest, size_t size)
+{
+  Stream &stream = client.stream;
+  bool kept = within(stream.input, stream.input_size, rest);
+
+  stream.parser.reset();
+
+  if (!kept)
+  {
+    stream.input.reset();
+    stream.input_size = 0;
+
+    return rest;
+  }
+
+  memmove(stream.input.data(), rest, size);
+  stream.input_size = size;
+
+  return stream.input.data();
+}
+
+/**
+ * Queue the answer to the request the parser just finished, saying
+ * whether the connection stays open for another one. It goes out with
+ * the rest of this loop iteration's responses in flush().
+ */
+bool Worker::respond(Connection &client)
+{
+  Headers *headers = client.stream.parser.get_headers();
+  Headers::Version version = headers->get_http_version();
+  uint64_t body = 0;
+
+  bool valid = client.stream.parser.state() == Parser::State::DONE &&
+    headers->content_length(body);
+
+  client.requests++;
+
+  // a chunked body isn't framed here, and a client waiting on 100-continue
+  // may never send the body it announced; closing gets out of both
+  bool keep_alive = valid && headers->keep_alive() &&
+    (m_max_requests == 0 || client.requests < m_max_requests) &&
+    !headers->has(Known::TRANSFER_ENCODING) &&
+    !(body > 0 && headers->has(Known::EXPECT));
+
+  Canned::Connection connection = Canned::KEEP_ALIVE;
+
+  // 1.1 is persistent unless told otherwise, 1.0 the other way round
+  if (!keep_alive)
+  {
+    connection = Canned::CLOSE;
+  }
+  else if (version.major == 1 && version.minor == 0)
+  {
+    connection = Canned::KEEP_ALIVE_1_0;
+  }
+
+  const Canned *canned = NULL;
+  const Bundle::Asset *asset = NULL;
+
+  if (!valid)           canned = &BAD_REQUEST;
+  else if (m_canned)    canned = m_canned->find(headers->get_path());
+
+  if (!canned && valid && m_bundle)
+  {
+    asset = m_bundle->find(headers->get_path());
+  }
+
+  if (asset)
+  {
+    serveAsset(client, *headers, *asset, connection);
+  }
+  else if (!canned && m_files)
+  {
+    if (!serveFile(client, *headers, connection)) keep_alive = false;
+  }
+  else
+  {
+    if (!canned) canned = &HELLO;
+
+    canned->queue(client.stream.output, m_date.line(), connection,
+        valid && headers->get_method() == Headers::Method::HEAD);
+  }
+
+  if (!client.flushing)
+  {
+    client.flushing = true;
+    m_flush.push_back(client.fd);
+  }
+
+  client.discard = body;
+
+  return keep_alive;
+}
+
+static void connection_field(Response &response,
+    Canned::Connection connection)
+{
+  if (connection == Canned::CLOSE)
+  {
+    response.header("Connection", "close");
+  }
+  else if (connection == Canned::KEEP_ALIVE_1_0)
+  {
+    response.header("Connection", "keep-alive");
+  }
+}
+
+// "bytes first-last/size", or "bytes */size" when first is past last
+static View content_range(char *out, uint64_t first, uint64_t last,
+    uint64_t size)
+{
+  char *p = out;
+
+  memcpy(p, "bytes ", 6);
+  p += 6;
+
+  if (first > last)
+  {
+    *p++ = '*';
+  }
+  else
+  {
+    p += Response::format(first, p);
+    *p++ = '-';
+    p += Response::format(last, p);
+  }
+
+  *p++ = '/';
+  p += Response::format(size, p);
+
+  return View(out, p - out);
+}
+
+/**
+ * Answer from the document root: 304 when the client's copy is current,
+ * the file, the range of it asked for, or why not. The 304, and the whole
+ * of a file held in memory, are queued as they were serialized. Otherwise
+ * the head is built here and the body goes out with sendfile() from the
+ * cached fd. Either way the queue holds on to the file until it's sent.
+ * A client that takes a coding the file is kept in gets that instead.
+ * False when the connection can't carry on, see deflateFile().
+ */
+bool Worker::serveFile(Connection &client, Headers &headers,
+    Canned::Connection connection)
+{
+  Headers::Method method = headers.get_method();
+  bool head = method == Headers::Method::HEAD;
+
+  if (method != Headers::Method::GET && !head)
+  {
+    notAllowed(client, connection);
+    return true;
+  }
+
+  std::shared_ptr<const Files::File> file =
+    m_files->open(headers.get_path(), m_now);
+
+  if (!file)
+  {
+    NOT_FOUND.queue(client.stream.output, m_date.line(), connection, head);
+    return true;
+  }
+
+  // a range is of the file as it is, and only ever served from it
+  bool ranged = headers.has(Known::RANGE);
+
+  const Files::File::Encoding *encoding =
+    ranged ? NULL : file->choose(headers);
+
+  if (encoding)
+  {
+    View tag(encoding->etag.data(), encoding->etag.size());
+
+    const Canned *answer = headers.not_modified(tag, file->modified) ?
+      encoding->not_modified.get() : encoding->hot.get();
+
+    answer->queue(client.stream.output, m_date.line(), connection, head, file);
+    return true;
+  }
+
+  // text too big to keep compressed, see setDeflate()
+  bool deflates = m_deflate_max > 0 && !file->hot &&
+    file->size <= m_deflate_max && Compressor::compressible(file->type);
+
+  Headers::Version version = headers.get_http_version();
+  bool chunks = version.major > 1 || (version.major == 1 && version.minor > 0);
+
+  if (deflates && !ranged && chunks &&
+      headers.quality(Known::ACCEPT_ENCODING, "gzip") > 0)
+  {
+    return deflateFile(client, headers, file, connection);
+  }
+
+  View etag(file->etag.data(), file->etag.size());
+
+  if (headers.not_modified(etag, file->modified))
+  {
+    if (!deflates)
+    {
+      file->not_modified->queue(client.stream.output, m_date.line(), connection,
+          head, file);
+      return true;
+    }
+
+    Response response(304);
+
+    response.header("Date", m_date.value());
+    response.header("ETag", etag);
+    response.header("Last-Modified", file->last_modified_value());
+    response.header("Vary", "Accept-Encoding");
+    connection_field(response, connection);
+    response.queue(client.stream.output);
+    return true;
+  }
+
+  uint64_t offset = 0;
+  uint64_t length = file->size;
+  Files::Range range = Files::Range::FULL;
+
+  if (headers.has(Known::RANGE) && headers.if_range(etag, file->modified))
+  {
+    range = Files::range(headers.get(Known::RANGE), file->size, offset,
+        length);
+  }
+
+  char field[64];
+
+  if (range == Files::Range::UNSATISFIABLE)
+  {
+    Response response(416);
+
+    response.header("Date", m_date.value());
+    response.header("Content-Range", content_range(field, 1, 0, file->size));
+    connection_field(response, connection);
+    response.queue(client.stream.output);
+    return true;
+  }
+
+  if (range == Files::Range::FULL && file->hot)
+  {
+    file->hot->queue(client.stream.output, m_date.line(), connection, head,
+        file);
+    return true;
+  }
+
+  bool partial = range == Files::Range::PARTIAL;
+  Response response(partial ? 206 : 200);
+
+  response.header("Date", m_date.value());
+  response.header("Content-Type", file->type);
+  response.header("ETag", etag);
+  response.header("Last-Modified", file->last_modified_value());
+  response.header("Accept-Ranges", "bytes");
+
+  if (deflates || !file->encodings.empty())
+  {
+    response.header("Vary", "Accept-Encoding");
+  }
+
+  if (partial)
+  {
+    response.header("Content-Range",
+        content_range(field, offset, offset + length - 1, file->size));
+  }
+
+  connection_field(response, connection);
+  response.body_length(length);
+
+  if (head) response.head_only();
+
+  response.queue(client.stream.output);
+
+  if (!head) client.stream.output.file(file->fd, offset, length, file);
+
+  return true;
+}
+
+/**
+ * A file from the root gzipped on its way out, in chunks, since how big
+ * it comes out isn't known until it's done. The connection takes a gzip
+ * stream of its own and deflate() compresses the file into its output a
+ * high watermark at a time, as the peer takes it. False when the file
+ * couldn't be read after the head was queued, the connection has to
+ * close on the truncated body then.
+ */
+bool Worker::deflateFile(Connection &client, Headers &headers,
+    const std::shared_ptr<const Files::File> &file,
+    Canned::Connection connection)
+{
+  // weak, the same bytes needn't compress the same with another zlib
+  char tag[96];
+  int size = snprintf(tag, sizeof(tag), "W/%.*s-gzip\"",
+      (int) file->etag.size() - 1, file->etag.data());
+
+  View etag(tag, size);
+
+  bool not_modified = headers.not_modified(etag, file->modified);
+  bool head = headers.get_method() == Headers::Method::HEAD;
+
+  Response response(not_modified ? 304 : 200);
+
+  response.header("Date", m_date.value());
+  if (!not_modified) response.header("Content-Type", file->type);
+  response.header("ETag", etag);
+  response.header("Last-Modified", file->last_modified_value());
+  if (!not_modified) response.header("Content-Encoding", "gzip");
+  response.header("Vary", "Accept-Encoding");
+  connection_field(response, connection);
+  response.chunked();
+
+  if (head) response.head_only();
+
+  response.queue(client.stream.output);
+
+  if (not_modified || head) return true;
+
+  Stream &stream = client.stream;
+
+  if (m_compressors.empty())
+  {
+    stream.compressor.reset(new Compressor());
+  }
+  else
+  {
+    stream.compressor = std::move(m_compressors.back());
+    m_compressors.pop_back();
+  }
+
+  stream.deflating = file;
+  stream.deflated = 0;
+
+  if (!stream.compressor->begin())
+  {
+    endDeflate(stream);
+    return false;
+  }
+
+  return deflate(client);
+}
+
+/**
+ * Compress more of the file a connection is being sent gzipped, until its
+ * output is at the high watermark or the body is done. The rest waits for
+ * the peer to take some of it, see pace(), so a big file is never more
+ * than that in memory or in one go on the loop. False when the file
+ * couldn't be read, the body is cut short.
+ */
+bool Worker::deflate(Connection &client)
+{
+  Stream &stream = client.stream;
+  const Files::File &file = *stream.deflating;
+  char buffer[Compressor::CHUNK];
+
+  while (stream.output.size() < Net::Output::HIGH_WATERMARK)
+  {
+    if (stream.deflated == file.size)
+    {
+      bool finished = stream.compressor->finish(stream.output);
+
+      endDeflate(stream);
+      return finished;
+    }
+
+    size_t wanted = std::min((uint64_t) sizeof(buffer),
+        file.size - stream.deflated);
+    ssize_t n = pread(file.fd, buffer, wanted, stream.deflated);
+
+    if (n < 0 && errno == EINTR) continue;
+
+    if (n <= 0)
+    {
+      ERR("deflate read: %s", n < 0 ? strerror(errno) : "file shrank");
+      endDeflate(stream);
+      return false;
+    }
+
+    if (!stream.compressor->write(View(buffer, n), stream.output))
+    {
+      endDeflate(stream);
+      return false;
+    }
+
+    stream.deflated += n;
+  }
+
+  return true;
+}
+
+// the body is done or given up on, its gzip stream goes back to the loop
+void Worker::endDeflate(Stream &stream)
+{
+  stream.deflating.reset();
+
+  if (stream.compressor && m_compressors.size() < COMPRESSORS_IDLE)
+  {
+    m_compressors.push_back(std::move(stream.compressor));
+  }
+
+  stream.compressor.reset();
+}
+
+/**
+ * Answer from the compiled in bundle: the representation the client
+ * accepts, or its 304, straight from the generated arrays.
+ */
+void Worker::serveAsset(Connection &client, Headers &headers,
+    const Bundle::Asset &asset, Canned::Connection connection)
+{
+  Headers::Method method = headers.get_method();
+  bool head = method == Headers::Method::HEAD;
+
+  if (method != Headers::Method::GET && !head)
+  {
+    notAllowed(client, connection);
+    return;
+  }
+
+  const Bundle::Representation &representation = asset.choose(headers);
+
+  bool not_modified = headers.not_modified(representation.etag_value(),
+      asset.modified);
+
+  View line;
+
+  if (connection == Canned::CLOSE)
+  {
+    line = "Connection: close\r\n";
+  }
+  else if (connection == Canned::KEEP_ALIVE_1_0)
+  {
+    line = "Connection: keep-alive\r\n";
+  }
+
+  Bundle::queue(client.stream.output, representation, not_modified, head,
+      m_date.line(), line);
+}
+
+void Worker::notAllowed(Connection &client, Canned::Connection connection)
+{
+  Response response(405);
+
+  response.header("Date", m_date.value());
+  response.header("Allow", "GET, HEAD");
+  connection_field(response, connection);
+  response.queue(client.stream.output);
+}
+
+/**
+ * The socket has room for more of the queued output.
+ */
+void Worker::onWrite(Net::Event& event)
+{
+  DEBUG("[0x%016" PRIXPTR "] client write", event.fd);
+
+  Connection *found = m_clients.find(event.fd);
+  if (found == NULL) return;
+
+  if (!flushClient(*found)) event.flags |= Net::Event::HANGUP;
+}
+
+void Worker::onEOF(Net::Event& event)
+{
+  DEBUG("[0x%016" PRIXPTR "] client eof", event.fd);
+
+  // gone both ways or failed, there's no one left to write to; a peer
+  // that only half closed goes through end() instead
+  onClientDisconnect(event);
+}
+
+int Worker::close()
+{
+  int err = ::close(m_sock);
+
+  if (err < 0)
+  {
+    ERR("close: %s", strerror(errno));
+  }
+
+  return err;
+}
+
+Worker::~Worker()
+{
+  if (m_sock_state == LISTENING) close();
+}
+
+} // namepsace
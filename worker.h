@@ -0,0 +1,351 @@
+#ifndef __WORKER_H
+#define __WORKER_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <signal.h>
+#include "log.h"
+#include "parser.h"
+#include "poller.h"
+#include "queue.h"
+#include "notifier.h"
+#include "output.h"
+#include "canned.h"
+#include "date.h"
+#include "files.h"
+#include "bundle.h"
+#include "compress.h"
+#include "slab.h"
+#include "buffer.h"
+#include "budget.h"
+
+namespace Http
+{
+
+/**
+ * One event loop: its own poller, receive buffer and client table, plus a
+ * listening socket unless an Acceptor feeds it. Nothing in here is shared
+ * with other workers, so a Server can run one per core with no locking on
+ * the request path.
+ *
+ * With SHARED_LISTENER every worker binds the same address with
+ * SO_REUSEPORT and the kernel spreads incoming connections across their
+ * listen queues. With NO_LISTENER connections arrive through adopt(),
+ * from the acceptor or from another worker shedding load.
+ */
+class Worker
+{
+  public:
+    enum Listener {
+      OWN_LISTENER,
+      SHARED_LISTENER,
+      NO_LISTENER
+    };
+
+    Worker(
+        const struct sockaddr_in &address,
+        const int backlog = 1000,
+        const Listener listener = OWN_LISTENER);
+    Worker(Worker &w) = delete;
+    Worker(Worker &&w) = delete;
+    ~Worker();
+
+    void onRead(Net::Event& event);
+    void onWrite(Net::Event& event);
+    void onEOF(Net::Event& event);
+
+    int onClientConnect(Net::Event& event);
+    int onClientDisconnect(Net::Event& event);
+
+    void run();
+
+    // safe to call from any thread
+    bool adopt(int fd);
+    void shed(unsigned count, Worker *to);
+
+    unsigned active() { return m_active.load(std::memory_order_relaxed); }
+    unsigned load()   { return active() + m_inbox.size(); }
+
+    /**
+     * Limits on persistent connections, set before run(). A connection is
+     * closed after max_requests responses (0 for no limit, 1 turns
+     * keep-alive off) or once it's been quiet for idle_ms, whether between
+     * requests or halfway through one (0 to never time out).
+     */
+    void setKeepAlive(unsigned max_requests, uint64_t idle_ms);
+
+    /**
+     * Responses answered by path without building anything, set before
+     * run(). The table isn't copied and has to outlive the worker; other
+     * paths get the default page.
+     */
+    void setCanned(const Canned::Table *canned);
+
+    /**
+     * Assets compiled into the binary, served ahead of the document root
+     * and the default page, set before run(). The bundle isn't copied;
+     * a generated one lives as long as the process.
+     */
+    void setBundle(const Bundle *bundle);
+
+    /**
+     * Serve GET and HEAD for everything without a canned response from
+     * this directory, set before run(). Open files are cached per worker.
+     */
+    void setRoot(const char *root);
+
+    /**
+     * gzip text files from the root that are too big to be kept
+     * compressed, up to max bytes, for clients that take it; 0, the
+     * default, sends them as they are. Costs compression per request, a
+     * high watermark of output at a time, and a gzip stream for each body
+     * that's being sent.
+     */
+    void setDeflate(uint64_t max);
+
+    /**
+     * Most bytes of requests a connection holds on to, the largest head
+     * and whatever is pipelined behind it, set before run(); never less
+     * than Parser::HEAD_MAX. A connection's input grows to fit, doubling,
+     * and reads stop at the limit until requests are answered.
+     */
+    void setInputLimit(size_t max);
+
+    /**
+     * Charge what connections hold to a budget shared with other workers,
+     * set before run(); it isn't copied and has to outlive the worker.
+     * Under pressure the biggest connections stop being read from and new
+     * ones are closed as they come in, see account(). Without one nothing
+     * is counted, idle connections are still reclaimed.
+     */
+    void setBudget(Net::Budget *budget);
+
+    // a connection has to be quiet this long before it can be migrated
+    static const uint64_t MIGRATE_IDLE_MS = 1000;
+
+    // a connection's input, the first size taken and the default limit
+    static const size_t INPUT_MIN = 1024;
+    static const size_t INPUT_MAX = 256 * 1024;
+
+    /**
+     * A connection quiet this long between requests gives its buffers
+     * back, see shrink(). Idle, one costs its place in the slab, a 64 byte
+     * line and a Stream of about 700 bytes, besides the kernel's socket;
+     * bench/idle measures 775 bytes resident per idle connection, against
+     * 5.2KB for one that's just had a request answered.
+     */
+    static const uint64_t RECLAIM_IDLE_MS = 1000;
+
+    // under pressure, connections holding this much are no longer read
+    static const size_t STARVE_MIN = 64 * 1024;
+
+    // how often a worker with starved connections checks the budget
+    static const uint64_t RELIEVE_MS = 50;
+
+    static const unsigned KEEP_ALIVE_REQUESTS = 1000;
+    static const uint64_t KEEP_ALIVE_IDLE_MS = 5000;
+  private:
+    int listen();
+    int bind();
+    int shutdown();
+    int close();
+
+    int setupRun();
+
+    int addClient(int fd);
+    int removeClient(int fd);
+    void onNotify();
+    void migrate();
+    void flush();
+    void expire();
+    void govern();
+    int timeout();
+
+    struct sockaddr_in m_address;
+    int m_sock_reuse;
+    Listener m_listener;
+    int m_sock;
+    int m_backlog;
+
+    Net::Poller m_poller;
+    static const int EVENTS_MAX = 32;
+    Net::Event m_event_list[EVENTS_MAX];
+
+    // shared by every connection, for reads that fit it in one go
+    static const size_t RECEIVE_SIZE = 16 * 1024;
+    Net::Buffer m_receive;
+
+    enum SocketState {
+      INITIALIZED,
+      BOUND,
+      LISTENING,
+      CLOSED
+    };
+
+    SocketState m_sock_state;
+
+    // the bulk of a connection, only needed once it has bytes to deal with
+    struct Stream
+    {
+      Stream() : parser(), input(), input_size(0), output(), deflating(),
+        deflated(0), compressor()
+      {}
+
+      // request scoped state, all of it in the parser's arena
+      Parser parser;
+
+      // a request that didn't arrive in one read, empty otherwise
+      Net::Buffer input;
+      size_t input_size;
+
+      // responses not yet written, in request order
+      Net::Output output;
+
+      // a file gzipped into output as it's written, NULL otherwise; how
+      // much of it has been read and the gzip stream it's going through
+      std::shared_ptr<const Files::File> deflating;
+      uint64_t deflated;
+      std::unique_ptr<Compressor> compressor;
+    };
+
+    /**
+     * What every event and the idle sweep look at, a cache line per
+     * connection; the rest is in its Stream, next door in the slab.
+     */
+    struct alignas(64) Connection
+    {
+      Connection(Stream &stream, int fd, uint64_t now) :
+        fd(fd), requests(0), last_active(now), discard(0), older(NULL),
+        newer(NULL), stream(stream), interest(Net::Event::READ), hint(0),
+        footprint(0), closing(false), flushing(false), paused(false),
+        starved(false), ended(false)
+      {}
+
+      int fd;
+      unsigned requests;      // answered so far
+      uint64_t last_active;   // ms, loop clock
+
+      // body bytes of the last request still to come, skipped unread
+      uint64_t discard;
+
+      // neighbours in the worker's list, least recently active first
+      Connection *older;
+      Connection *newer;
+
+      Stream &stream;
+
+      // what the poller has been asked to report, Net::Event flags
+      uint32_t interest;
+
+      // bytes to read at once, 0 to use the loop's buffer; see learn()
+      uint32_t hint;
+
+      // bytes of buffers charged to the budget for it, see account()
+      uint32_t footprint;
+
+      bool closing : 1;   // the last response said close, nothing more is read
+      bool flushing : 1;  // in m_flush
+      bool paused : 1;    // too much output queued, not reading for now
+      bool starved : 1;   // in m_starved, not reading until pressure drops
+      bool ended : 1;     // the peer is done sending, see end()
+    };
+
+    static_assert(sizeof(Connection) == 64, "a connection's hot half is "
+        "one cache line");
+
+    void handle(Connection &client, const char *data, size_t size);
+    ssize_t receive(Connection &client, size_t want, bool &full);
+    void learn(Connection &client, size_t total);
+    void reserve(Stream &stream, size_t needed);
+    void keep(Connection &client, const char *data, size_t size);
+    void hold(Connection &client, const char *data, size_t size);
+    void tooLarge(Connection &client);
+    bool respond(Connection &client);
+    bool serveFile(Connection &client, Headers &headers,
+        Canned::Connection connection);
+    bool deflateFile(Connection &client, Headers &headers,
+        const std::shared_ptr<const Files::File> &file,
+        Canned::Connection connection);
+    bool deflate(Connection &client);
+    void endDeflate(Stream &stream);
+    void serveAsset(Connection &client, Headers &headers,
+        const Bundle::Asset &asset, Canned::Connection connection);
+    void notAllowed(Connection &client, Canned::Connection connection);
+    const char *finish(Connection &client, const char *rest, size_t size);
+
+    bool end(Connection &client);
+    bool done(const Connection &client);
+    bool flushClient(Connection &client);
+    void pace(Connection &client);
+    void watch(Connection &client);
+
+    void account(Connection &client);
+    void shrink(Connection &client);
+    void reclaim(bool all);
+    void relieve();
+
+    void touch(Connection &client);
+    void unlink(Connection &client);
+    void drop(Connection &client);
+
+    Net::Slab<Connection, Stream> m_clients;
+
+    // every connection by last activity, the idle sweep and migration
+    // start at the oldest and stop at the first one still in use
+    Connection *m_oldest;
+    Connection *m_newest;
+
+    // the newest connection the reclaim sweep has been past, see reclaim()
+    Connection *m_reclaimed;
+
+    unsigned m_max_requests;
+    uint64_t m_idle_ms;
+
+    const Canned::Table *m_canned;
+    const Bundle *m_bundle;
+    std::unique_ptr<Files> m_files;
+
+    // gzip streams for files past what's kept compressed, one for each
+    // body being compressed; up to COMPRESSORS_IDLE are kept between them
+    static const size_t COMPRESSORS_IDLE = 4;
+    std::vector<std::unique_ptr<Compressor>> m_compressors;
+    uint64_t m_deflate_max;
+
+    size_t m_input_max;
+
+    Net::Budget *m_budget;
+
+    // connections not read from until the budget is out of pressure
+    std::vector<int> m_starved;
+
+    // connections with responses queued this loop iteration
+    std::vector<int> m_flush;
+
+    // refreshed once per loop iteration, milliseconds
+    uint64_t m_now;
+
+    // wall clock for the Date field, reformatted once a second
+    Date m_date;
+
+    // cross thread hand-off, everything else is loop private
+    Net::Queue<int> m_inbox;
+    Net::Notifier m_notifier;
+    std::atomic<unsigned> m_active;
+    std::atomic<unsigned> m_shed_count;
+    std::atomic<Worker *> m_shed_to;
+};
+
+} // namspace
+
+#endif /** __WORKER_H **/